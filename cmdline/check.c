@@ -25,6 +25,7 @@
 #include "state.h"
 #include "parity.h"
 #include "handle.h"
+#include "io.h"
 #include "raid/raid.h"
 #include "raid/combo.h"
 
@@ -293,6 +294,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 	int something_to_recover;
 	int something_unsynced;
 	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
 
 	error = 0;
 
@@ -338,7 +340,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 			struct snapraid_file* file = failed[j].file;
 			block_off_t file_pos = failed[j].file_pos;
 
-			log_tag("entry:%u:%s:%s:%s:%s:%s:%u:\n", j, desc, hash, data, disk->name, esc(file->sub, esc_buffer), file_pos);
+			log_tag("entry:%u:%s:%s:%s:%s:%s:%u:\n", j, desc, hash, data, disk->name, esc(file_sub(file, sub_buffer), esc_buffer), file_pos);
 		} else {
 			log_tag("entry:%u:%s:%s:%s:\n", j, desc, hash, data);
 		}
@@ -585,6 +587,309 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 		return -1;
 }
 
+/**
+ * Number of recovered blocks that can be queued for writing.
+ */
+#define CHECK_WRITE_MAX 16
+
+/**
+ * Recovered block to write.
+ */
+struct check_write {
+	int f; /**< Handle of the file to write. */
+	data_off_t offset; /**< Offset in the file. */
+	unsigned size; /**< Size to write. */
+	unsigned char* buffer; /**< Copy of the recovered data. */
+	char path[PATH_MAX]; /**< Path of the file, for error reporting. */
+	struct snapraid_disk* disk; /**< Disk of the data file. 0 for parity. */
+	struct snapraid_file* file; /**< Data file. 0 for parity. */
+	unsigned level; /**< Level of the parity. Valid only for parity. */
+};
+
+/**
+ * Writer of the recovered blocks.
+ *
+ * In fix mode the recovered blocks are written by a separate thread,
+ * while the main thread continues with the next blocks.
+ *
+ * The writes use the descriptors of the handles, but not the handles
+ * themselves, that are updated only by the main thread.
+ * Before closing, truncating or renaming a data file, the main thread
+ * waits for all the queued writes with check_writer_flush().
+ */
+struct check_writer {
+	struct check_write map[CHECK_WRITE_MAX]; /**< Ring of the writes. */
+	void* buffer_alloc; /**< Allocation of the buffers of the writes. */
+	unsigned head; /**< Next position to fill. Changed only by the main thread. */
+	unsigned tail; /**< Next position to write. Changed only by the writer thread. */
+	int done; /**< If the writer thread has to exit. */
+
+	/**
+	 * First write failed.
+	 */
+	int error; /**< errno of the failure, or 0 if no failure. */
+	struct snapraid_disk* error_disk; /**< Disk of the failed write. 0 for parity. */
+	struct snapraid_file* error_file; /**< File of the failed write. 0 for parity. */
+	unsigned error_level; /**< Level of the failed parity write. */
+
+#if HAVE_PTHREAD
+	pthread_t thread;
+	pthread_mutex_t mutex; /**< Protects ::head, ::tail, ::done and the error. */
+	pthread_cond_t write_ready; /**< Signaled when a new write is queued. */
+	pthread_cond_t write_done; /**< Signaled when a write is completed. */
+#endif
+};
+
+/**
+ * Write a recovered block.
+ * Return 0 on success, or the errno of the failure.
+ */
+static int check_write_run(struct check_write* w)
+{
+	ssize_t ret;
+	int err;
+
+	ret = pwrite(w->f, w->buffer, w->size, w->offset);
+	if (ret == (ssize_t)w->size) /* conversion is safe because block_size is always small */
+		return 0;
+
+	/* LCOV_EXCL_START */
+	/* a short write without error is reported as lack of space */
+	err = ret < 0 ? errno : ENOSPC;
+
+	log_fatal("Error writing file '%s'. %s.\n", w->path, strerror(err));
+
+	return err;
+	/* LCOV_EXCL_STOP */
+}
+
+/**
+ * Store the first failure of the writer.
+ */
+static void check_writer_fail(struct check_writer* writer, struct check_write* w, int err)
+{
+	/* LCOV_EXCL_START */
+	if (writer->error != 0)
+		return;
+
+	writer->error = err;
+	writer->error_disk = w->disk;
+	writer->error_file = w->file;
+	writer->error_level = w->level;
+	/* LCOV_EXCL_STOP */
+}
+
+#if HAVE_PTHREAD
+static void* check_writer_thread(void* arg)
+{
+	struct check_writer* writer = arg;
+
+	thread_mutex_lock(&writer->mutex);
+
+	while (1) {
+		struct check_write* w;
+		int err;
+
+		while (writer->tail == writer->head && !writer->done)
+			thread_cond_wait(&writer->write_ready, &writer->mutex);
+
+		/* exit only when all the writes are completed */
+		if (writer->tail == writer->head)
+			break;
+
+		w = &writer->map[writer->tail % CHECK_WRITE_MAX];
+
+		/* the write at the tail is not changed by the main thread */
+		thread_mutex_unlock(&writer->mutex);
+
+		err = check_write_run(w);
+
+		thread_mutex_lock(&writer->mutex);
+
+		if (err != 0)
+			check_writer_fail(writer, w, err);
+
+		++writer->tail;
+
+		thread_cond_signal(&writer->write_done);
+	}
+
+	thread_mutex_unlock(&writer->mutex);
+
+	return 0;
+}
+#endif
+
+static void check_writer_init(struct check_writer* writer, struct snapraid_state* state)
+{
+	unsigned block_size = state->block_size;
+	unsigned char* buffer;
+	unsigned i;
+
+	/* the buffers are aligned to allow writes in direct mode */
+	if ((state->file_mode & MODE_DIRECT) != 0)
+		block_size = direct_size(block_size);
+
+	buffer = malloc_nofail_direct(CHECK_WRITE_MAX * (size_t)block_size, &writer->buffer_alloc);
+	for (i = 0; i < CHECK_WRITE_MAX; ++i)
+		writer->map[i].buffer = buffer + i * (size_t)block_size;
+
+	writer->head = 0;
+	writer->tail = 0;
+	writer->done = 0;
+	writer->error = 0;
+	writer->error_disk = 0;
+	writer->error_file = 0;
+	writer->error_level = 0;
+
+#if HAVE_PTHREAD
+	thread_mutex_init(&writer->mutex, 0);
+	thread_cond_init(&writer->write_ready, 0);
+	thread_cond_init(&writer->write_done, 0);
+	thread_create(&writer->thread, 0, check_writer_thread, writer);
+#endif
+}
+
+/**
+ * Stop the writer, after completing all the queued writes.
+ */
+static void check_writer_done(struct check_writer* writer)
+{
+#if HAVE_PTHREAD
+	void* retval;
+
+	thread_mutex_lock(&writer->mutex);
+	writer->done = 1;
+	thread_cond_signal_and_unlock(&writer->write_ready, &writer->mutex);
+
+	thread_join(writer->thread, &retval);
+
+	thread_cond_destroy(&writer->write_done);
+	thread_cond_destroy(&writer->write_ready);
+	thread_mutex_destroy(&writer->mutex);
+#endif
+
+	free(writer->buffer_alloc);
+}
+
+/**
+ * Queue the write of a recovered block.
+ * Return -1 if a previous write failed, and nothing is queued.
+ */
+static int check_writer_push(struct check_writer* writer, int f, const char* path, data_off_t offset, unsigned size, const void* buffer, struct snapraid_disk* disk, struct snapraid_file* file, unsigned level)
+{
+	struct check_write* w;
+
+#if HAVE_PTHREAD
+	thread_mutex_lock(&writer->mutex);
+
+	/* wait for a free position */
+	while (writer->head - writer->tail == CHECK_WRITE_MAX && writer->error == 0)
+		thread_cond_wait(&writer->write_done, &writer->mutex);
+
+	if (writer->error != 0) {
+		/* LCOV_EXCL_START */
+		thread_mutex_unlock(&writer->mutex);
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* the position at the head is not used by the writer thread */
+	thread_mutex_unlock(&writer->mutex);
+#else
+	if (writer->error != 0) {
+		/* LCOV_EXCL_START */
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+#endif
+
+	w = &writer->map[writer->head % CHECK_WRITE_MAX];
+
+	w->f = f;
+	w->offset = offset;
+	w->size = size;
+	memcpy(w->buffer, buffer, size);
+	pathcpy(w->path, sizeof(w->path), path);
+	w->disk = disk;
+	w->file = file;
+	w->level = level;
+
+#if HAVE_PTHREAD
+	thread_mutex_lock(&writer->mutex);
+
+	++writer->head;
+
+	thread_cond_signal_and_unlock(&writer->write_ready, &writer->mutex);
+#else
+	/* without threads, write immediately */
+	{
+		int err = check_write_run(w);
+		if (err != 0) {
+			/* LCOV_EXCL_START */
+			check_writer_fail(writer, w, err);
+			return -1;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+#endif
+
+	return 0;
+}
+
+/**
+ * Wait for the completion of all the queued writes.
+ * Return -1 if a write failed.
+ */
+static int check_writer_flush(struct check_writer* writer)
+{
+	int error;
+
+#if HAVE_PTHREAD
+	thread_mutex_lock(&writer->mutex);
+
+	while (writer->tail != writer->head)
+		thread_cond_wait(&writer->write_done, &writer->mutex);
+
+	error = writer->error;
+
+	thread_mutex_unlock(&writer->mutex);
+#else
+	error = writer->error;
+#endif
+
+	if (error != 0) {
+		/* LCOV_EXCL_START */
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	return 0;
+}
+
+/**
+ * Report the failure of the writer.
+ */
+static void check_writer_report(struct check_writer* writer)
+{
+	/* LCOV_EXCL_START */
+	if (writer->error_file) {
+		/* mark the file as damaged */
+		fs_file_flag_set(writer->error_disk, writer->error_file, FILE_IS_DAMAGED);
+
+		if (writer->error == EACCES) {
+			log_fatal("WARNING! Please give write permission to the file.\n");
+		} else {
+			/* we do not use DANGER because it could be ENOSPC which is not always correctly reported */
+			log_fatal("WARNING! Without a working data disk, it isn't possible to fix errors on it.\n");
+		}
+	} else {
+		/* we do not use DANGER because it could be ENOSPC which is not always correctly reported */
+		log_fatal("WARNING! Without a working %s disk, it isn't possible to fix errors on it.\n", lev_name(writer->error_level));
+	}
+	/* LCOV_EXCL_STOP */
+}
+
 /**
  * Post process all the files at the specified block index ::i.
  * For each file, if we are at the last block, closes it,
@@ -594,12 +899,14 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
  * fix. This assumption is not always correct, and in such case we have to
  * skip the whole postprocessing. And example, is when fixing only bad blocks.
  */
-static int file_post(struct snapraid_state* state, int fix, unsigned i, struct snapraid_handle* handle, unsigned diskmax)
+static int file_post(struct snapraid_state* state, int fix, unsigned i, struct snapraid_handle* handle, unsigned diskmax, struct check_writer* writer)
 {
 	unsigned j;
 	int ret;
 	char esc_buffer[ESC_MAX];
 	char esc_buffer_alt[ESC_MAX];
+	char sub_buffer[PATH_MAX];
+	char sub_buffer_alt[PATH_MAX];
 
 	/* if we are processing only bad blocks, we don't have to do any post-processing */
 	/* as we don't have any guarantee to process the last block of the fixed files */
@@ -630,7 +937,7 @@ static int file_post(struct snapraid_state* state, int fix, unsigned i, struct s
 		}
 
 		file = fs_par2file_get(disk, i, &file_pos);
-		pathprint(path, sizeof(path), "%s%s", disk->dir, file->sub);
+		pathprint(path, sizeof(path), "%s%s", disk->dir, file_sub(file, sub_buffer));
 
 		/* if it isn't the last block in the file */
 		if (!file_block_is_last(file, file_pos)) {
@@ -638,6 +945,14 @@ static int file_post(struct snapraid_state* state, int fix, unsigned i, struct s
 			continue;
 		}
 
+		/* complete the writes of the recovered blocks before closing the file */
+		if (fix && check_writer_flush(writer) != 0) {
+			/* LCOV_EXCL_START */
+			check_writer_report(writer);
+			return -1;
+			/* LCOV_EXCL_STOP */
+		}
+
 		/* if the file is excluded, we have nothing to adjust as the file is never written */
 		if (file_flag_has(file, FILE_IS_EXCLUDED)
 			|| (state->opt.syncedonly && file_flag_has(file, FILE_IS_UNSYNCED))) {
@@ -649,27 +964,30 @@ static int file_post(struct snapraid_state* state, int fix, unsigned i, struct s
 		if (fix) {
 			/* mark that we finished with this file */
 			/* to identify later any NOT finished ones */
-			file_flag_set(file, FILE_IS_FINISHED);
+			fs_file_flag_set(disk, file, FILE_IS_FINISHED);
 
 			/* if the file is damaged, meaning that a fix failed */
 			if (file_flag_has(file, FILE_IS_DAMAGED)) {
 				/* rename it to .unrecoverable */
 				char path_to[PATH_MAX];
 
-				pathprint(path_to, sizeof(path_to), "%s%s.unrecoverable", disk->dir, file->sub);
+				pathprint(path_to, sizeof(path_to), "%s%s.unrecoverable", disk->dir, file_sub(file, sub_buffer));
 
 				/* ensure to close the file before renaming */
 				if (handle[j].file == file) {
 					ret = handle_close(&handle[j]);
 					if (ret != 0) {
 						/* LCOV_EXCL_START */
-						log_tag("error:%u:%s:%s: Close error. %s\n", i, disk->name, esc(file->sub, esc_buffer), strerror(errno));
+						log_tag("error:%u:%s:%s: Close error. %s\n", i, disk->name, esc(file_sub(file, sub_buffer), esc_buffer), strerror(errno));
 						log_fatal("DANGER! Unexpected close error in a data disk.\n");
 						return -1;
 						/* LCOV_EXCL_STOP */
 					}
 				}
 
+				/* the file may be also kept open by the search */
+				state_search_close(state);
+
 				ret = rename(path, path_to);
 				if (ret != 0) {
 					/* LCOV_EXCL_START */
@@ -679,7 +997,7 @@ static int file_post(struct snapraid_state* state, int fix, unsigned i, struct s
 					/* LCOV_EXCL_STOP */
 				}
 
-				log_tag("status:unrecoverable:%s:%s\n", disk->name, esc(file->sub, esc_buffer));
+				log_tag("status:unrecoverable:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 				msg_info("unrecoverable %s\n", path);
 
 				/* and do not set the time if damaged */
@@ -699,7 +1017,7 @@ static int file_post(struct snapraid_state* state, int fix, unsigned i, struct s
 				ret = handle_close(&handle[j]);
 				if (ret != 0) {
 					/* LCOV_EXCL_START */
-					log_tag("error:%u:%s:%s: Close error. %s\n", i, disk->name, esc(handle[j].file->sub, esc_buffer), strerror(errno));
+					log_tag("error:%u:%s:%s: Close error. %s\n", i, disk->name, esc(file_sub(handle[j].file, sub_buffer), esc_buffer), strerror(errno));
 					log_fatal("DANGER! Unexpected close error in a data disk.\n");
 					return -1;
 					/* LCOV_EXCL_STOP */
@@ -710,14 +1028,14 @@ static int file_post(struct snapraid_state* state, int fix, unsigned i, struct s
 				ret = handle_open(&handle[j], file, state->file_mode, log_error, 0);
 				if (ret != 0) {
 					/* LCOV_EXCL_START */
-					log_tag("error:%u:%s:%s: Open error. %s\n", i, disk->name, esc(file->sub, esc_buffer), strerror(errno));
+					log_tag("error:%u:%s:%s: Open error. %s\n", i, disk->name, esc(file_sub(file, sub_buffer), esc_buffer), strerror(errno));
 					log_fatal("WARNING! Without a working data disk, it isn't possible to fix errors on it.\n");
 					return -1;
 					/* LCOV_EXCL_STOP */
 				}
 			}
 
-			log_tag("status:recovered:%s:%s\n", disk->name, esc(file->sub, esc_buffer));
+			log_tag("status:recovered:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 			msg_info("recovered %s\n", path);
 
 			inode = handle[j].st.st_ino;
@@ -734,7 +1052,7 @@ static int file_post(struct snapraid_state* state, int fix, unsigned i, struct s
 			/* and at the next sync some files may have matching inode/size/time even if different name */
 			/* not allowing sync to detect that the file is changed and not renamed */
 			if (!collide_file /* if not in the database, there is no collision */
-				|| strcmp(collide_file->sub, file->sub) == 0 /* if the name is the same, it's the right collision */
+				|| file_path_compare(collide_file, file) == 0 /* if the name is the same, it's the right collision */
 				|| collide_file->size != file->size /* if the size is different, the collision is identified */
 				|| collide_file->mtime_sec != file->mtime_sec /* if the mtime is different, the collision is identified */
 				|| collide_file->mtime_nsec != file->mtime_nsec /* same for mtime_nsec */
@@ -744,32 +1062,32 @@ static int file_post(struct snapraid_state* state, int fix, unsigned i, struct s
 				if (ret == -1) {
 					/* LCOV_EXCL_START */
 					/* mark the file as damaged */
-					file_flag_set(file, FILE_IS_DAMAGED);
+					fs_file_flag_set(disk, file, FILE_IS_DAMAGED);
 					log_fatal("WARNING! Without a working data disk, it isn't possible to fix errors on it.\n");
 					return -1;
 					/* LCOV_EXCL_STOP */
 				}
 			} else {
-				log_tag("collision:%s:%s:%s: Not setting modification time to avoid inode collision\n", disk->name, esc(file->sub, esc_buffer), esc(collide_file->sub, esc_buffer_alt));
+				log_tag("collision:%s:%s:%s: Not setting modification time to avoid inode collision\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer), esc(file_sub(collide_file, sub_buffer_alt), esc_buffer_alt));
 			}
 		} else {
 			/* we are not fixing, but only checking */
 			/* print just the final status */
 			if (file_flag_has(file, FILE_IS_DAMAGED)) {
 				if (state->opt.auditonly) {
-					log_tag("status:damaged:%s:%s\n", disk->name, esc(file->sub, esc_buffer));
+					log_tag("status:damaged:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 					msg_info("damaged %s\n", path);
 				} else {
-					log_tag("status:unrecoverable:%s:%s\n", disk->name, esc(file->sub, esc_buffer));
+					log_tag("status:unrecoverable:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 					msg_info("unrecoverable %s\n", path);
 				}
 			} else if (file_flag_has(file, FILE_IS_FIXED)) {
-				log_tag("status:recoverable:%s:%s\n", disk->name, esc(file->sub, esc_buffer));
+				log_tag("status:recoverable:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 				msg_info("recoverable %s\n", path);
 			} else {
 				/* we don't use msg_verbose() because it also goes into the log */
 				if (msg_level >= MSG_VERBOSE) {
-					log_tag("status:correct:%s:%s\n", disk->name, esc(file->sub, esc_buffer));
+					log_tag("status:correct:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 					msg_info("correct %s\n", path);
 				}
 			}
@@ -779,13 +1097,15 @@ close_and_continue:
 		/* if the opened file is the correct one, close it */
 		/* in case of excluded and fragmented files it's possible */
 		/* that the opened file is not the current one */
-		if (handle[j].file == file) {
+		/* when only checking, the handles are owned by the reader threads */
+		/* that close the files when switching to the next one */
+		if (fix && handle[j].file == file) {
 			/* ensure to close the file just after finishing with it */
 			/* to avoid to keep it open without any possible use */
 			ret = handle_close(&handle[j]);
 			if (ret != 0) {
 				/* LCOV_EXCL_START */
-				log_tag("error:%u:%s:%s: Close error. %s\n", i, disk->name, esc(file->sub, esc_buffer), strerror(errno));
+				log_tag("error:%u:%s:%s: Close error. %s\n", i, disk->name, esc(file_sub(file, sub_buffer), esc_buffer), strerror(errno));
 				log_fatal("DANGER! Unexpected close error in a data disk.\n");
 				return -1;
 				/* LCOV_EXCL_STOP */
@@ -796,11 +1116,49 @@ close_and_continue:
 	return 0;
 }
 
+/**
+ * Sort the failed blocks by disk index.
+ *
+ * It's an insertion sort, as the number of failed blocks is small,
+ * and they are usually already sorted.
+ */
+static void failed_sort(struct failed_struct* failed, unsigned failed_count)
+{
+	unsigned i;
+
+	for (i = 1; i < failed_count; ++i) {
+		struct failed_struct key = failed[i];
+		unsigned j = i;
+
+		while (j > 0 && failed[j - 1].index > key.index) {
+			failed[j] = failed[j - 1];
+			--j;
+		}
+
+		failed[j] = key;
+	}
+}
+
+/**
+ * Check plan to use.
+ */
+struct snapraid_plan {
+	struct snapraid_state* state;
+	int fix; /**< If we are fixing. */
+	struct snapraid_handle* handle; /**< Handles of the data disks. */
+	unsigned handle_max; /**< Number of data disks. */
+	struct snapraid_parity_handle** parity; /**< Handles of the parity. 0 if not accessible. */
+	struct check_writer* writer; /**< Writer of the recovered blocks. Valid only if fixing. */
+};
+
 /**
  * Check if we have to process the specified block index ::i.
  */
-static int block_is_enabled(struct snapraid_state* state, block_off_t i, struct snapraid_handle* handle, unsigned diskmax)
+static int block_is_enabled(void* void_plan, block_off_t i)
 {
+	struct snapraid_plan* plan = void_plan;
+	struct snapraid_state* state = plan->state;
+	struct snapraid_handle* handle = plan->handle;
 	snapraid_info info;
 	unsigned j;
 	unsigned l;
@@ -823,7 +1181,7 @@ static int block_is_enabled(struct snapraid_state* state, block_off_t i, struct
 	}
 
 	/* for each disk */
-	for (j = 0; j < diskmax; ++j) {
+	for (j = 0; j < plan->handle_max; ++j) {
 		struct snapraid_block* block;
 
 		/* if no disk, nothing to check */
@@ -845,14 +1203,213 @@ static int block_is_enabled(struct snapraid_state* state, block_off_t i, struct
 	return 0;
 }
 
-static int state_check_process(struct snapraid_state* state, int fix, struct snapraid_parity_handle** parity, block_off_t blockstart, block_off_t blockmax)
+/**
+ * Continuation of check_data_reader() after the read of the block.
+ */
+static void check_data_reader_done(struct snapraid_worker* worker, struct snapraid_task* task, int ret)
+{
+	struct snapraid_io* io = worker->io;
+	struct snapraid_state* state = io->state;
+	struct snapraid_handle* handle = worker->handle;
+	struct snapraid_disk* disk = handle->disk;
+	block_off_t blockcur = task->position;
+	unsigned char* buffer = task->buffer;
+	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
+
+	task->read_size = ret;
+	if (task->read_size == -1) {
+		log_tag("error:%u:%s:%s: Read error at position %u\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), task->file_pos);
+		task->state = TASK_STATE_ERROR_CONTINUE;
+		return;
+	}
+
+	/* compute the hash in the worker thread, to scale with the number of disks */
+	/* CHG blocks have no hash to compare with */
+	if (block_has_updated_hash(task->block)) {
+		if (info_get_rehash(info_get(&state->infoarr, blockcur))) {
+			memhash(state->prevhash, state->prevhashseed, task->hash, buffer, task->read_size);
+		} else {
+			memhash(state->hash, state->hashseed, task->hash, buffer, task->read_size);
+		}
+	}
+
+	task->state = TASK_STATE_DONE;
+}
+
+static void check_data_reader(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	struct snapraid_io* io = worker->io;
+	struct snapraid_state* state = io->state;
+	struct snapraid_plan* plan = io->block_arg;
+	struct snapraid_handle* handle = worker->handle;
+	struct snapraid_disk* disk = handle->disk;
+	block_off_t blockcur = task->position;
+	unsigned char* buffer = task->buffer;
+	int ret;
+	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
+
+	/* if the disk position is not used */
+	if (!disk) {
+		/* use an empty block */
+		memset(buffer, 0, state->block_size);
+		task->state = TASK_STATE_DONE;
+		return;
+	}
+
+	/* get the block */
+	task->block = fs_par2block_find(disk, blockcur);
+
+	/* if the block is not used, or DELETED */
+	if (!block_has_file(task->block)) {
+		/* use an empty block */
+		memset(buffer, 0, state->block_size);
+		task->state = TASK_STATE_DONE;
+		return;
+	}
+
+	/* get the file of this block */
+	task->file = fs_par2file_get(disk, blockcur, &task->file_pos);
+
+	/* if we are only hashing, we can skip excluded files and don't even read them */
+	if (state->opt.auditonly && fs_file_flag_has(disk, task->file, FILE_IS_EXCLUDED)) {
+		/* use an empty block */
+		/* in true, this is unnecessary, because we are not checking any parity */
+		/* but we keep it for completeness */
+		memset(buffer, 0, state->block_size);
+		task->state = TASK_STATE_DONE;
+		return;
+	}
+
+	/* if the file is closed or different than the current one */
+	if (handle->file == 0 || handle->file != task->file) {
+		/* keep a pointer at the file we are going to close for error reporting */
+		struct snapraid_file* report = handle->file;
+
+		/* complete the writes of the recovered blocks before closing the file */
+		/* a failure is reported by the main thread at the next flush */
+		if (plan->fix)
+			check_writer_flush(plan->writer);
+
+		/* close the old one, if any */
+		ret = handle_close(handle);
+		if (ret == -1) {
+			/* LCOV_EXCL_START */
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(file_sub(report, sub_buffer), esc_buffer), strerror(errno));
+			log_fatal("DANGER! Unexpected close error in a data disk.\n");
+			log_fatal("Stopping at block %u\n", blockcur);
+			task->state = TASK_STATE_ERROR;
+			return;
+			/* LCOV_EXCL_STOP */
+		}
+
+		/* if fixing, and the file is not excluded, we must open for writing */
+		if (plan->fix && !fs_file_flag_has(disk, task->file, FILE_IS_EXCLUDED)) {
+			/* if fixing, create the file, open for writing and resize if required */
+			ret = handle_create(handle, task->file, state->file_mode);
+			if (ret == -1) {
+				/* LCOV_EXCL_START */
+				if (errno == EACCES) {
+					log_fatal("WARNING! Please give write permission to the file.\n");
+				} else {
+					log_fatal("DANGER! Without a working data disk, it isn't possible to fix errors on it.\n");
+				}
+				log_fatal("Stopping at block %u\n", blockcur);
+				task->state = TASK_STATE_ERROR;
+				return;
+				/* LCOV_EXCL_STOP */
+			}
+
+			/* report if the file was just created */
+			task->is_created = handle->created != 0;
+		} else {
+			/* open the file only for reading */
+			if (!fs_file_flag_has(disk, task->file, FILE_IS_MISSING))
+				ret = handle_open(handle, task->file, state->file_mode,
+					log_error, state->opt.expected_missing ? log_expected : 0);
+			else
+				ret = -1; /* if the file is missing, we cannot open it */
+			if (ret == -1) {
+				/* note that the file is marked as missing only later by the main thread */
+				/* so reading ahead, the open could be retried some more times */
+				log_tag("error:%u:%s:%s: Open error at position %u\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), task->file_pos);
+				task->is_missing = 1;
+				task->state = TASK_STATE_ERROR_CONTINUE;
+				return;
+			}
+		}
+	}
+
+	/* check if the file is changed */
+	if (handle->st.st_size != task->file->size
+		|| handle->st.st_mtime != task->file->mtime_sec
+		|| STAT_NSEC(&handle->st) != task->file->mtime_nsec
+	        /* don't check the inode to support file-system without persistent inodes */
+	) {
+		/* report that the file is not synced */
+		task->is_timestamp_different = 1;
+	}
+
+	/* check if the file is larger */
+	if (handle->st.st_size > task->file->size)
+		task->is_larger = 1;
+
+	/* store the path of the opened file */
+	pathcpy(task->path, sizeof(task->path), handle->path);
+
+	/* read from the file */
+	io_task_handle_read(worker, task, log_error, state->opt.expected_missing ? log_expected : 0, check_data_reader_done);
+}
+
+/**
+ * Continuation of check_parity_reader() after the read of the block.
+ */
+static void check_parity_reader_done(struct snapraid_worker* worker, struct snapraid_task* task, int ret)
+{
+	struct snapraid_parity_handle* parity_handle = worker->parity_handle;
+	unsigned level = parity_handle->level;
+	block_off_t blockcur = task->position;
+
+	if (ret == -1) {
+		log_tag("parity_error:%u:%s: Read error\n", blockcur, lev_config_name(level));
+		task->state = TASK_STATE_ERROR_CONTINUE;
+		return;
+	}
+
+	task->state = TASK_STATE_DONE;
+}
+
+static void check_parity_reader(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	struct snapraid_io* io = worker->io;
+	struct snapraid_plan* plan = io->block_arg;
+	struct snapraid_parity_handle* parity_handle = worker->parity_handle;
+	unsigned level = parity_handle->level;
+
+	/* if the parity is not accessible, there is nothing to read */
+	if (!plan->parity[level]) {
+		task->state = TASK_STATE_EMPTY;
+		return;
+	}
+
+	/* read the parity */
+	io_task_parity_read(worker, task, log_error, check_parity_reader_done);
+}
+
+static int state_check_process(struct snapraid_state* state, int fix, struct snapraid_parity_handle* parity_handle, struct snapraid_parity_handle** parity, block_off_t blockstart, block_off_t blockmax)
 {
+	struct snapraid_io io;
+	struct snapraid_plan plan;
+	struct check_writer writer;
 	struct snapraid_handle* handle;
 	unsigned diskmax;
+	block_off_t blockcur;
+	block_off_t blockpost;
 	block_off_t i;
 	unsigned j;
 	void* buffer_alloc;
-	void** buffer;
+	void* buffer_zero;
 	unsigned buffermax;
 	int ret;
 	data_off_t countsize;
@@ -864,21 +1421,31 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 	struct failed_struct* failed;
 	unsigned* failed_map;
 	unsigned l;
+	unsigned* waiting_map;
+	unsigned waiting_mac;
 	char esc_buffer[ESC_MAX];
 	char esc_buffer_alt[ESC_MAX];
+	char sub_buffer[PATH_MAX];
 
 	handle = handle_mapping(state, &diskmax);
 
-	/* we need 1 * data + 2 * parity + 1 * zero */
-	buffermax = diskmax + 2 * state->level + 1;
+	/* we need 1 * data + 2 * parity */
+	buffermax = diskmax + 2 * state->level;
 
-	buffer = malloc_nofail_vector_align(diskmax, buffermax, state->block_size, &buffer_alloc);
-	if (!state->opt.skip_self)
-		mtest_vector(buffermax, state->block_size, buffer);
+	/* initialize the io threads */
+	/* when fixing, files are created, truncated, written and renamed */
+	/* by the main thread, so the io is done synchronously with it, */
+	/* using the mono thread mode */
+	io_init(&io, state, fix ? 1 : state->opt.io_cache, buffermax, check_data_reader, handle, diskmax, check_parity_reader, 0, parity_handle, state->opt.auditonly ? 0 : state->level);
+
+	/* possibly waiting disks */
+	waiting_mac = diskmax > RAID_PARITY_MAX ? diskmax : RAID_PARITY_MAX;
+	waiting_map = malloc_nofail(waiting_mac * sizeof(unsigned));
 
 	/* fill up the zero buffer */
-	memset(buffer[buffermax - 1], 0, state->block_size);
-	raid_zero(buffer[buffermax - 1]);
+	buffer_zero = malloc_nofail_align(state->block_size, &buffer_alloc);
+	memset(buffer_zero, 0, state->block_size);
+	raid_zero(buffer_zero);
 
 	failed = malloc_nofail(diskmax * sizeof(struct failed_struct));
 	failed_map = malloc_nofail(diskmax * sizeof(unsigned));
@@ -887,35 +1454,62 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 	unrecoverable_error = 0;
 	recovered_error = 0;
 
+	/* setup the plan */
+	plan.state = state;
+	plan.fix = fix;
+	plan.handle = handle;
+	plan.handle_max = diskmax;
+	plan.parity = parity;
+	plan.writer = &writer;
+
+	/* the recovered blocks are written by a separate thread */
+	if (fix)
+		check_writer_init(&writer, state);
+
 	/* first count the number of blocks to process */
 	countmax = 0;
-	for (i = blockstart; i < blockmax; ++i) {
-		if (!block_is_enabled(state, i, handle, diskmax))
+	for (blockcur = blockstart; blockcur < blockmax; ++blockcur) {
+		if (!block_is_enabled(&plan, blockcur))
 			continue;
 		++countmax;
 	}
 
+	/* drop until now */
+	state_usage_waste(state);
+
+	/* start all the worker threads */
+	io_start(&io, blockstart, blockmax, &block_is_enabled, &plan);
+
 	/* check all the blocks in files */
 	countsize = 0;
 	countpos = 0;
+	blockpost = blockstart;
 	state_progress_begin(state, blockstart, blockmax, countmax);
-	for (i = blockstart; i < blockmax; ++i) {
+	while (1) {
 		unsigned failed_count;
 		int valid_parity;
 		snapraid_info info;
 		int rehash;
+		void** buffer;
+
+		/* go to the next block */
+		blockcur = io_read_next(&io, &buffer);
+		if (blockcur >= blockmax)
+			break;
 
-		if (!block_is_enabled(state, i, handle, diskmax)) {
-			/* post process the files */
-			ret = file_post(state, fix, i, handle, diskmax);
+		/* until now is scheduling */
+		state_usage_sched(state);
+
+		/* post process the files of the skipped blocks */
+		for (; blockpost < blockcur; ++blockpost) {
+			ret = file_post(state, fix, blockpost, handle, diskmax, &writer);
 			if (ret == -1) {
-				log_fatal("Stopping at block %u\n", i);
+				/* LCOV_EXCL_START */
+				log_fatal("Stopping at block %u\n", blockpost);
 				++unrecoverable_error;
 				goto bail;
+				/* LCOV_EXCL_STOP */
 			}
-
-			/* and now continue with the next block */
-			continue;
 		}
 
 		/* If we have valid parity, and it makes sense to check its content. */
@@ -929,34 +1523,45 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 		failed_count = 0;
 
 		/* get block specific info */
-		info = info_get(&state->infoarr, i);
+		info = info_get(&state->infoarr, blockcur);
 
 		/* if we have to use the old hash */
 		rehash = info_get_rehash(info);
 
 		/* for each disk, process the block */
 		for (j = 0; j < diskmax; ++j) {
-			int read_size;
-			unsigned char hash[HASH_MAX];
+			struct snapraid_task* task;
 			struct snapraid_disk* disk;
 			struct snapraid_block* block;
 			struct snapraid_file* file;
 			block_off_t file_pos;
 			unsigned block_state;
+			unsigned diskcur;
+
+			/* until now is misc */
+			state_usage_misc(state);
+
+			/* get the next task */
+			task = io_data_read(&io, &diskcur, waiting_map, &waiting_mac);
+
+			/* until now is disk */
+			state_usage_disk(state, handle, waiting_map, waiting_mac);
+
+			/* get the task results */
+			disk = task->disk;
+			block = task->block;
+			file = task->file;
+			file_pos = task->file_pos;
 
 			/* if the disk position is not used */
-			disk = handle[j].disk;
 			if (!disk) {
-				/* use an empty block */
-				memset(buffer[j], 0, state->block_size);
+				/* the reader already used an empty block */
 				continue;
 			}
 
 			/* if the disk block is not used */
-			block = fs_par2block_find(disk, i);
 			if (block == BLOCK_NULL) {
-				/* use an empty block */
-				memset(buffer[j], 0, state->block_size);
+				/* the reader already used an empty block */
 				continue;
 			}
 
@@ -973,14 +1578,13 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 
 			/* if the block is DELETED */
 			if (block_state == BLOCK_STATE_DELETED) {
-				/* use an empty block */
-				memset(buffer[j], 0, state->block_size);
+				/* the reader already used an empty block */
 
 				/* store it in the failed set, because potentially */
 				/* the parity may be still computed with the previous content */
 				failed[failed_count].is_bad = 0; /* note that is_bad==0 <=> file==0 */
 				failed[failed_count].is_outofdate = 0;
-				failed[failed_count].index = j;
+				failed[failed_count].index = diskcur;
 				failed[failed_count].block = block;
 				failed[failed_count].disk = disk;
 				failed[failed_count].file = 0;
@@ -990,153 +1594,129 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 				continue;
 			}
 
-			/* get the file of this block */
-			file = fs_par2file_get(disk, i, &file_pos);
-
-			/* if we are only hashing, we can skip excluded files and don't even read them */
+			/* if we are only hashing, excluded files are not even read */
 			if (state->opt.auditonly && file_flag_has(file, FILE_IS_EXCLUDED)) {
-				/* use an empty block */
-				/* in true, this is unnecessary, because we are not checking any parity */
-				/* but we keep it for completeness */
-				memset(buffer[j], 0, state->block_size);
+				/* the reader already used an empty block */
 				continue;
 			}
 
-			/* if the file is closed or different than the current one */
-			if (handle[j].file == 0 || handle[j].file != file) {
-				/* close the old one, if any */
-				ret = handle_close(&handle[j]);
-				if (ret == -1) {
-					/* LCOV_EXCL_START */
-					log_tag("error:%u:%s:%s: Close error. %s\n", i, disk->name, esc(handle[j].file->sub, esc_buffer), strerror(errno));
-					log_fatal("DANGER! Unexpected close error in a data disk.\n");
-					log_fatal("Stopping at block %u\n", i);
-					++unrecoverable_error;
-					goto bail;
-					/* LCOV_EXCL_STOP */
-				}
+			/* if the file cannot be closed, opened or created */
+			if (task->state == TASK_STATE_ERROR) {
+				/* LCOV_EXCL_START */
+				++unrecoverable_error;
+				goto bail;
+				/* LCOV_EXCL_STOP */
+			}
 
-				/* if fixing, and the file is not excluded, we must open for writing */
-				if (fix && !file_flag_has(file, FILE_IS_EXCLUDED)) {
-					/* if fixing, create the file, open for writing and resize if required */
-					ret = handle_create(&handle[j], file, state->file_mode);
-					if (ret == -1) {
-						/* LCOV_EXCL_START */
-						if (errno == EACCES) {
-							log_fatal("WARNING! Please give write permission to the file.\n");
-						} else {
-							log_fatal("DANGER! Without a working data disk, it isn't possible to fix errors on it.\n");
-						}
-						log_fatal("Stopping at block %u\n", i);
-						++unrecoverable_error;
-						goto bail;
-						/* LCOV_EXCL_STOP */
-					}
+			/* check if the file was just created */
+			if (task->is_created) {
+				/* if fragmented, it may be reopened, so remember that the file */
+				/* was originally missing */
+				fs_file_flag_set(disk, file, FILE_IS_CREATED);
+			}
 
-					/* check if the file was just created */
-					if (handle[j].created != 0) {
-						/* if fragmented, it may be reopened, so remember that the file */
-						/* was originally missing */
-						file_flag_set(file, FILE_IS_CREATED);
-					}
-				} else {
-					/* open the file only for reading */
-					if (!file_flag_has(file, FILE_IS_MISSING))
-						ret = handle_open(&handle[j], file, state->file_mode,
-							log_error, state->opt.expected_missing ? log_expected : 0);
-					else
-						ret = -1; /* if the file is missing, we cannot open it */
-					if (ret == -1) {
-						/* save the failed block for the check/fix */
-						failed[failed_count].is_bad = 1;
-						failed[failed_count].is_outofdate = 0;
-						failed[failed_count].index = j;
-						failed[failed_count].block = block;
-						failed[failed_count].disk = disk;
-						failed[failed_count].file = file;
-						failed[failed_count].file_pos = file_pos;
-						failed[failed_count].handle = &handle[j];
-						++failed_count;
-
-						log_tag("error:%u:%s:%s: Open error at position %u\n", i, disk->name, esc(file->sub, esc_buffer), file_pos);
-						++error;
+			/* if the file cannot be opened */
+			if (task->state == TASK_STATE_ERROR_CONTINUE && task->is_missing) {
+				/* save the failed block for the check/fix */
+				failed[failed_count].is_bad = 1;
+				failed[failed_count].is_outofdate = 0;
+				failed[failed_count].index = diskcur;
+				failed[failed_count].block = block;
+				failed[failed_count].disk = disk;
+				failed[failed_count].file = file;
+				failed[failed_count].file_pos = file_pos;
+				failed[failed_count].handle = &handle[diskcur];
+				++failed_count;
 
-						/* mark the file as missing, to avoid to retry to open it again */
-						/* note that this can be done only if we are not fixing it */
-						/* otherwise, it could be recreated */
-						file_flag_set(file, FILE_IS_MISSING);
-						continue;
-					}
-				}
+				/* the reader already logged the error */
+				++error;
+
+				/* mark the file as missing, to avoid to retry to open it again */
+				/* note that this can be done only if we are not fixing it */
+				/* otherwise, it could be recreated */
+				fs_file_flag_set(disk, file, FILE_IS_MISSING);
+				continue;
+			}
 
-				/* if it's the first open, and not excluded */
-				if (!file_flag_has(file, FILE_IS_OPENED)
-					&& !file_flag_has(file, FILE_IS_EXCLUDED)) {
+			/* if it's the first open, and not excluded */
+			if (!file_flag_has(file, FILE_IS_OPENED)
+				&& !file_flag_has(file, FILE_IS_EXCLUDED)) {
 
-					/* check if the file is changed */
-					if (handle[j].st.st_size != file->size
-						|| handle[j].st.st_mtime != file->mtime_sec
-						|| STAT_NSEC(&handle[j].st) != file->mtime_nsec
-					        /* don't check the inode to support file-system without persistent inodes */
-					) {
-						/* report that the file is not synced */
-						file_flag_set(file, FILE_IS_UNSYNCED);
-					}
+				/* check if the file is changed */
+				if (task->is_timestamp_different) {
+					/* report that the file is not synced */
+					fs_file_flag_set(disk, file, FILE_IS_UNSYNCED);
 				}
 
-				/* if it's the first open, and not excluded and larger */
-				if (!file_flag_has(file, FILE_IS_OPENED)
-					&& !file_flag_has(file, FILE_IS_EXCLUDED)
-					&& !(state->opt.syncedonly && file_flag_has(file, FILE_IS_UNSYNCED))
-					&& handle[j].st.st_size > file->size
+				/* check if the file is larger */
+				if (!(state->opt.syncedonly && file_flag_has(file, FILE_IS_UNSYNCED))
+					&& task->is_larger
 				) {
-					log_error("File '%s' is larger than expected.\n", handle[j].path);
-					log_tag("error:%u:%s:%s: Size error\n", i, disk->name, esc(file->sub, esc_buffer));
+					log_error("File '%s' is larger than expected.\n", task->path);
+					log_tag("error:%u:%s:%s: Size error\n", blockcur, disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 					++error;
 
 					if (fix) {
-						ret = handle_truncate(&handle[j], file);
+						/* complete the writes of the recovered blocks before truncating */
+						if (check_writer_flush(&writer) != 0) {
+							/* LCOV_EXCL_START */
+							check_writer_report(&writer);
+							log_fatal("Stopping at block %u\n", blockcur);
+							++unrecoverable_error;
+							goto bail;
+							/* LCOV_EXCL_STOP */
+						}
+
+						/* in fix mode the io is in mono thread mode */
+						/* and we can use the handle of the reader */
+						ret = handle_truncate(&handle[diskcur], file);
 						if (ret == -1) {
 							/* LCOV_EXCL_START */
 							log_fatal("DANGER! Unexpected truncate error in a data disk, it isn't possible to fix.\n");
-							log_fatal("Stopping at block %u\n", i);
+							log_fatal("Stopping at block %u\n", blockcur);
 							++unrecoverable_error;
 							goto bail;
 							/* LCOV_EXCL_STOP */
 						}
 
-						log_tag("fixed:%u:%s:%s: Fixed size\n", i, disk->name, esc(file->sub, esc_buffer));
+						log_tag("fixed:%u:%s:%s: Fixed size\n", blockcur, disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 						++recovered_error;
 					}
 				}
-
-				/* mark the file as opened at least one time */
-				/* this is used to avoid to check the unsynced and size */
-				/* more than one time, in case the file is reopened later */
-				file_flag_set(file, FILE_IS_OPENED);
 			}
 
-			/* read from the file */
-			read_size = handle_read(&handle[j], file_pos, buffer[j], state->block_size,
-				log_error, state->opt.expected_missing ? log_expected : 0);
-			if (read_size == -1) {
+			/* mark the file as opened at least one time */
+			/* this is used to avoid to check the unsynced and size */
+			/* more than one time, in case the file is reopened later */
+			if (!file_flag_has(file, FILE_IS_OPENED))
+				fs_file_flag_set(disk, file, FILE_IS_OPENED);
+
+			/* if the read failed */
+			if (task->state == TASK_STATE_ERROR_CONTINUE) {
 				/* save the failed block for the check/fix */
 				failed[failed_count].is_bad = 1; /* it's bad because we cannot read it */
 				failed[failed_count].is_outofdate = 0;
-				failed[failed_count].index = j;
+				failed[failed_count].index = diskcur;
 				failed[failed_count].block = block;
 				failed[failed_count].disk = disk;
 				failed[failed_count].file = file;
 				failed[failed_count].file_pos = file_pos;
-				failed[failed_count].handle = &handle[j];
+				failed[failed_count].handle = &handle[diskcur];
 				++failed_count;
 
-				log_tag("error:%u:%s:%s: Read error at position %u\n", i, disk->name, esc(file->sub, esc_buffer), file_pos);
+				/* the reader already logged the error */
 				++error;
 				continue;
 			}
 
-			countsize += read_size;
+			if (task->state != TASK_STATE_DONE) {
+				/* LCOV_EXCL_START */
+				log_fatal("Internal inconsistency in task state\n");
+				os_abort();
+				/* LCOV_EXCL_STOP */
+			}
+
+			countsize += task->read_size;
 
 			/* always insert CHG blocks, the repair functions needs all of them */
 			/* because the parity may be still referring at the old state */
@@ -1146,41 +1726,34 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 				/* if we don't have a hash, we always assume the first read of the block correct. */
 				failed[failed_count].is_bad = 0; /* we assume the CHG block correct */
 				failed[failed_count].is_outofdate = 0;
-				failed[failed_count].index = j;
+				failed[failed_count].index = diskcur;
 				failed[failed_count].block = block;
 				failed[failed_count].disk = disk;
 				failed[failed_count].file = file;
 				failed[failed_count].file_pos = file_pos;
-				failed[failed_count].handle = &handle[j];
+				failed[failed_count].handle = &handle[diskcur];
 				++failed_count;
 				continue;
 			}
 
 			assert(block_state == BLOCK_STATE_BLK || block_state == BLOCK_STATE_REP);
 
-			/* compute the hash of the block just read */
-			if (rehash) {
-				memhash(state->prevhash, state->prevhashseed, hash, buffer[j], read_size);
-			} else {
-				memhash(state->hash, state->hashseed, hash, buffer[j], read_size);
-			}
-
-			/* compare the hash */
-			if (memcmp(hash, block->hash, BLOCK_HASH_SIZE) != 0) {
-				unsigned diff = memdiff(hash, block->hash, BLOCK_HASH_SIZE);
+			/* compare the hash, already computed by the reader */
+			if (memcmp(task->hash, block->hash, BLOCK_HASH_SIZE) != 0) {
+				unsigned diff = memdiff(task->hash, block->hash, BLOCK_HASH_SIZE);
 
 				/* save the failed block for the check/fix */
 				failed[failed_count].is_bad = 1; /* it's bad because the hash doesn't match */
 				failed[failed_count].is_outofdate = 0;
-				failed[failed_count].index = j;
+				failed[failed_count].index = diskcur;
 				failed[failed_count].block = block;
 				failed[failed_count].disk = disk;
 				failed[failed_count].file = file;
 				failed[failed_count].file_pos = file_pos;
-				failed[failed_count].handle = &handle[j];
+				failed[failed_count].handle = &handle[diskcur];
 				++failed_count;
 
-				log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u\n", i, disk->name, esc(file->sub, esc_buffer), file_pos, diff);
+				log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u\n", blockcur, disk->name, esc(file_sub(file, sub_buffer), esc_buffer), file_pos, diff);
 				++error;
 				continue;
 			}
@@ -1191,48 +1764,56 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 			if (block_state == BLOCK_STATE_REP) {
 				failed[failed_count].is_bad = 0; /* it's not bad */
 				failed[failed_count].is_outofdate = 0;
-				failed[failed_count].index = j;
+				failed[failed_count].index = diskcur;
 				failed[failed_count].block = block;
 				failed[failed_count].disk = disk;
 				failed[failed_count].file = file;
 				failed[failed_count].file_pos = file_pos;
-				failed[failed_count].handle = &handle[j];
+				failed[failed_count].handle = &handle[diskcur];
 				++failed_count;
 				continue;
 			}
 		}
 
+		/* the disks are read in completion order, but the repair */
+		/* functions need the failed blocks sorted by disk index */
+		failed_sort(failed, failed_count);
+
 		/* now read and check the parity if requested */
 		if (!state->opt.auditonly) {
 			void* buffer_recov[LEV_MAX];
-			void* buffer_zero;
 
 			/* buffers for parity read and not computed */
-			for (l = 0; l < state->level; ++l)
-				buffer_recov[l] = buffer[diskmax + state->level + l];
-			for (; l < LEV_MAX; ++l)
+			/* they are set after each read, as the readers take them when starting the task */
+			for (l = 0; l < LEV_MAX; ++l)
 				buffer_recov[l] = 0;
 
-			/* the zero buffer is the last one */
-			buffer_zero = buffer[buffermax - 1];
-
 			/* read the parity */
 			for (l = 0; l < state->level; ++l) {
-				if (parity[l]) {
-					ret = parity_read(parity[l], i, buffer_recov[l], state->block_size, log_error);
-					if (ret == -1) {
-						buffer_recov[l] = 0; /* no parity to use */
+				struct snapraid_task* task;
+				unsigned levcur;
 
-						log_tag("parity_error:%u:%s: Read error\n", i, lev_config_name(l));
-						++error;
-					}
-				} else {
-					buffer_recov[l] = 0;
+				task = io_parity_read(&io, &levcur, waiting_map, &waiting_mac);
+
+				/* until now is parity */
+				state_usage_parity(state, waiting_map, waiting_mac);
+
+				/* if the parity is not accessible */
+				if (!parity[levcur])
+					continue;
+
+				/* if the read failed */
+				if (task->state != TASK_STATE_DONE) {
+					/* the reader already logged the error */
+					++error;
+					continue;
 				}
+
+				buffer_recov[levcur] = buffer[diskmax + state->level + levcur];
 			}
 
 			/* try all the recovering strategies */
-			ret = repair(state, rehash, i, diskmax, failed, failed_map, failed_count, buffer, buffer_recov, buffer_zero);
+			ret = repair(state, rehash, blockcur, diskmax, failed, failed_map, failed_count, buffer, buffer_recov, buffer_zero);
 			if (ret != 0) {
 				/* increment the number of errors */
 				if (ret > 0)
@@ -1242,13 +1823,13 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 				/* print a list of all the errors in files */
 				for (j = 0; j < failed_count; ++j) {
 					if (failed[j].is_bad)
-						log_tag("unrecoverable:%u:%s:%s: Unrecoverable error at position %u\n", i, failed[j].disk->name, esc(failed[j].file->sub, esc_buffer), failed[j].file_pos);
+						log_tag("unrecoverable:%u:%s:%s: Unrecoverable error at position %u\n", blockcur, failed[j].disk->name, esc(file_sub(failed[j].file, sub_buffer), esc_buffer), failed[j].file_pos);
 				}
 
 				/* keep track of damaged files */
 				for (j = 0; j < failed_count; ++j) {
 					if (failed[j].is_bad)
-						file_flag_set(failed[j].file, FILE_IS_DAMAGED);
+						fs_file_flag_set(failed[j].disk, failed[j].file, FILE_IS_DAMAGED);
 				}
 			} else {
 				/* now counts partial recovers */
@@ -1260,7 +1841,7 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 				for (j = 0; j < failed_count; ++j) {
 					if (failed[j].is_bad && failed[j].is_outofdate) {
 						++partial_recover_error;
-						log_tag("unrecoverable:%u:%s:%s: Unrecoverable unsynced error at position %u\n", i, failed[j].disk->name, esc(failed[j].file->sub, esc_buffer), failed[j].file_pos);
+						log_tag("unrecoverable:%u:%s:%s: Unrecoverable unsynced error at position %u\n", blockcur, failed[j].disk->name, esc(file_sub(failed[j].file, sub_buffer), esc_buffer), failed[j].file_pos);
 					}
 				}
 				if (partial_recover_error != 0) {
@@ -1280,7 +1861,7 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 							/* mark that the read parity is wrong, setting ptr to 0 */
 							buffer_recov[l] = 0;
 
-							log_tag("parity_error:%u:%s: Data error, diff bits %u\n", i, lev_config_name(l), diff);
+							log_tag("parity_error:%u:%s: Data error, diff bits %u\n", blockcur, lev_config_name(l), diff);
 							++error;
 						}
 					}
@@ -1289,7 +1870,15 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 				/* now write recovered files */
 				if (fix) {
 					/* update the fixed files */
+					/* in fix mode the io is in mono thread mode */
+					/* and we can write using the handles of the readers */
+					/* the writes are queued to the writer thread, and the main */
+					/* thread continues with the next block */
 					for (j = 0; j < failed_count; ++j) {
+						struct snapraid_handle* failed_handle = failed[j].handle;
+						data_off_t offset;
+						unsigned size;
+
 						/* nothing to do if it doesn't need recovering */
 						if (!failed[j].is_bad)
 							continue;
@@ -1299,36 +1888,35 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 							|| (state->opt.syncedonly && file_flag_has(failed[j].file, FILE_IS_UNSYNCED)))
 							continue;
 
-						ret = handle_write(failed[j].handle, failed[j].file_pos, buffer[failed[j].index], state->block_size);
+						offset = failed[j].file_pos * (data_off_t)state->block_size;
+						size = file_block_size(failed[j].file, failed[j].file_pos, state->block_size);
+
+						ret = check_writer_push(&writer, failed_handle->f, failed_handle->path, offset, size, buffer[failed[j].index], failed[j].disk, failed[j].file, 0);
 						if (ret == -1) {
 							/* LCOV_EXCL_START */
-							/* mark the file as damaged */
-							file_flag_set(failed[j].file, FILE_IS_DAMAGED);
-
-							if (errno == EACCES) {
-								log_fatal("WARNING! Please give write permission to the file.\n");
-							} else {
-								/* we do not use DANGER because it could be ENOSPC which is not always correctly reported */
-								log_fatal("WARNING! Without a working data disk, it isn't possible to fix errors on it.\n");
-							}
-							log_fatal("Stopping at block %u\n", i);
+							check_writer_report(&writer);
+							log_fatal("Stopping at block %u\n", blockcur);
 							++unrecoverable_error;
 							goto bail;
 							/* LCOV_EXCL_STOP */
 						}
 
+						/* adjust the size of the valid data, like handle_write() */
+						if (failed_handle->valid_size < offset + size)
+							failed_handle->valid_size = offset + size;
+
 						/* if we are not sure that the recovered content is uptodate */
 						if (failed[j].is_outofdate) {
 							/* mark the file as damaged */
-							file_flag_set(failed[j].file, FILE_IS_DAMAGED);
+							fs_file_flag_set(failed[j].disk, failed[j].file, FILE_IS_DAMAGED);
 							continue;
 						}
 
 						/* mark the file as containing some fixes */
 						/* note that it could be also marked as damaged in other iterations */
-						file_flag_set(failed[j].file, FILE_IS_FIXED);
+						fs_file_flag_set(failed[j].disk, failed[j].file, FILE_IS_FIXED);
 
-						log_tag("fixed:%u:%s:%s: Fixed data error at position %u\n", i, failed[j].disk->name, esc(failed[j].file->sub, esc_buffer), failed[j].file_pos);
+						log_tag("fixed:%u:%s:%s: Fixed data error at position %u\n", blockcur, failed[j].disk->name, esc(file_sub(failed[j].file, sub_buffer), esc_buffer), failed[j].file_pos);
 						++recovered_error;
 					}
 
@@ -1345,18 +1933,23 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 							        /* and the parity is not excluded */
 								&& !state->parity[l].is_excluded
 							) {
-								ret = parity_write(parity[l], i, buffer[diskmax + l], state->block_size);
+								data_off_t offset = blockcur * (data_off_t)state->block_size;
+
+								ret = check_writer_push(&writer, parity[l]->f, parity[l]->path, offset, state->block_size, buffer[diskmax + l], 0, 0, l);
 								if (ret == -1) {
 									/* LCOV_EXCL_START */
-									/* we do not use DANGER because it could be ENOSPC which is not always correctly reported */
-									log_fatal("WARNING! Without a working %s disk, it isn't possible to fix errors on it.\n", lev_name(l));
-									log_fatal("Stopping at block %u\n", i);
+									check_writer_report(&writer);
+									log_fatal("Stopping at block %u\n", blockcur);
 									++unrecoverable_error;
 									goto bail;
 									/* LCOV_EXCL_STOP */
 								}
 
-								log_tag("parity_fixed:%u:%s: Fixed data error\n", i, lev_config_name(l));
+								/* adjust the size of the valid data, like parity_write() */
+								if (parity[l]->valid_size < offset + state->block_size)
+									parity[l]->valid_size = offset + state->block_size;
+
+								log_tag("parity_fixed:%u:%s: Fixed data error\n", blockcur, lev_config_name(l));
 								++recovered_error;
 							}
 						}
@@ -1366,40 +1959,61 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 					/* meaning that we could fix this file if we try */
 					for (j = 0; j < failed_count; ++j) {
 						if (failed[j].is_bad) {
-							file_flag_set(failed[j].file, FILE_IS_FIXED);
+							fs_file_flag_set(failed[j].disk, failed[j].file, FILE_IS_FIXED);
 						}
 					}
 				}
 			}
+
+			/* until now is raid */
+			state_usage_raid(state);
 		} else {
 			/* if we are not checking, we just set the DAMAGED flag */
 			/* to report that the file is damaged, and we don't know if we can fix it */
 			for (j = 0; j < failed_count; ++j) {
 				if (failed[j].is_bad) {
-					file_flag_set(failed[j].file, FILE_IS_DAMAGED);
+					fs_file_flag_set(failed[j].disk, failed[j].file, FILE_IS_DAMAGED);
 				}
 			}
 		}
 
 		/* post process the files */
-		ret = file_post(state, fix, i, handle, diskmax);
+		ret = file_post(state, fix, blockcur, handle, diskmax, &writer);
 		if (ret == -1) {
-			log_fatal("Stopping at block %u\n", i);
+			/* LCOV_EXCL_START */
+			log_fatal("Stopping at block %u\n", blockcur);
 			++unrecoverable_error;
 			goto bail;
+			/* LCOV_EXCL_STOP */
 		}
+		blockpost = blockcur + 1;
 
 		/* count the number of processed block */
 		++countpos;
 
 		/* progress */
-		if (state_progress(state, 0, i, countpos, countmax, countsize)) {
+		if (state_progress(state, &io, blockcur, countpos, countmax, countsize)) {
 			/* LCOV_EXCL_START */
 			break;
 			/* LCOV_EXCL_STOP */
 		}
 	}
 
+	/* post process the files of the skipped blocks at the end */
+	/* but only if not interrupted */
+	if (blockcur >= blockmax) {
+		for (; blockpost < blockmax; ++blockpost) {
+			ret = file_post(state, fix, blockpost, handle, diskmax, &writer);
+			if (ret == -1) {
+				/* LCOV_EXCL_START */
+				log_fatal("Stopping at block %u\n", blockpost);
+				++unrecoverable_error;
+				goto bail;
+				/* LCOV_EXCL_STOP */
+			}
+		}
+	}
+
 	/* for each disk, recover empty files, symlinks and empty dirs */
 	for (i = 0; i < diskmax; ++i) {
 		tommy_node* node;
@@ -1431,23 +2045,23 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 			}
 
 			/* stat the file */
-			pathprint(path, sizeof(path), "%s%s", disk->dir, file->sub);
+			pathprint(path, sizeof(path), "%s%s", disk->dir, file_sub(file, sub_buffer));
 			ret = stat(path, &st);
 			if (ret == -1) {
 				unsuccesful = 1;
 
 				log_error("Error stating empty file '%s'. %s.\n", path, strerror(errno));
-				log_tag("error:%s:%s: Empty file stat error\n", disk->name, esc(file->sub, esc_buffer));
+				log_tag("error:%s:%s: Empty file stat error\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 				++error;
 			} else if (!S_ISREG(st.st_mode)) {
 				unsuccesful = 1;
 
-				log_tag("error:%s:%s: Empty file error for not regular file\n", disk->name, esc(file->sub, esc_buffer));
+				log_tag("error:%s:%s: Empty file error for not regular file\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 				++error;
 			} else if (st.st_size != 0) {
 				unsuccesful = 1;
 
-				log_tag("error:%s:%s: Empty file error for size '%" PRIu64 "'\n", disk->name, esc(file->sub, esc_buffer), st.st_size);
+				log_tag("error:%s:%s: Empty file error for size '%" PRIu64 "'\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer), st.st_size);
 				++error;
 			}
 
@@ -1489,7 +2103,7 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 					/* LCOV_EXCL_START */
 					close(f);
 
-					log_fatal("Error timing file '%s'. %s.\n", file->sub, strerror(errno));
+					log_fatal("Error timing file '%s'. %s.\n", file_sub(file, sub_buffer), strerror(errno));
 					log_fatal("WARNING! Without a working data disk, it isn't possible to fix errors on it.\n");
 					log_fatal("Stopping\n");
 					++unrecoverable_error;
@@ -1508,11 +2122,11 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 					/* LCOV_EXCL_STOP */
 				}
 
-				log_tag("fixed:%s:%s: Fixed empty file\n", disk->name, esc(file->sub, esc_buffer));
+				log_tag("fixed:%s:%s: Fixed empty file\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 				++recovered_error;
 
-				log_tag("status:recovered:%s:%s\n", disk->name, esc(file->sub, esc_buffer));
-				msg_info("recovered %s%s\n", disk->dir, file->sub);
+				log_tag("status:recovered:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
+				msg_info("recovered %s%s\n", disk->dir, file_sub(file, sub_buffer));
 			}
 		}
 
@@ -1760,7 +2374,25 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 
 	state_progress_end(state, countpos, countmax, countsize);
 
+	state_usage_print(state);
+
 bail:
+	/* stop all the worker threads */
+	io_stop(&io);
+
+	/* complete the writes of the recovered blocks */
+	if (fix) {
+		if (check_writer_flush(&writer) != 0) {
+			/* LCOV_EXCL_START */
+			check_writer_report(&writer);
+			++unrecoverable_error;
+			/* continue, as we are already exiting */
+			/* LCOV_EXCL_STOP */
+		}
+
+		check_writer_done(&writer);
+	}
+
 	/* close all the files left open */
 	for (j = 0; j < diskmax; ++j) {
 		struct snapraid_file* file = handle[j].file;
@@ -1768,7 +2400,7 @@ bail:
 		ret = handle_close(&handle[j]);
 		if (ret == -1) {
 			/* LCOV_EXCL_START */
-			log_tag("error:%u:%s:%s: Close error. %s\n", blockmax, disk->name, esc(file->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockmax, disk->name, esc(file_sub(file, sub_buffer), esc_buffer), strerror(errno));
 			log_fatal("DANGER! Unexpected close error in a data disk.\n");
 			++unrecoverable_error;
 			/* continue, as we are already exiting */
@@ -1812,7 +2444,7 @@ bail:
 				/* if the file was originally missing, and processing not yet finished */
 				/* we have to throw it away  to ensure that at the next run we will retry */
 				/* to fix it, in case we select to undelete missing files */
-				pathprint(path, sizeof(path), "%s%s", disk->dir, file->sub);
+				pathprint(path, sizeof(path), "%s%s", disk->dir, file_sub(file, sub_buffer));
 
 				ret = remove(path);
 				if (ret != 0) {
@@ -1882,7 +2514,8 @@ bail:
 	free(failed_map);
 	free(handle);
 	free(buffer_alloc);
-	free(buffer);
+	free(waiting_map);
+	io_done(&io);
 
 	/* fail if some error are present after the run */
 	if (fix) {
@@ -1943,6 +2576,8 @@ int state_check(struct snapraid_state* state, int fix, block_off_t blockstart, b
 		for (l = 0; l < state->level; ++l) {
 			/* skip parity disks that are not accessible */
 			if (state->parity[l].skip_access) {
+				/* the level is anyway used by the io threads */
+				parity[l].level = l;
 				parity_ptr[l] = 0;
 				continue;
 			}
@@ -1993,7 +2628,7 @@ int state_check(struct snapraid_state* state, int fix, block_off_t blockstart, b
 
 	/* skip degenerated cases of empty parity, or skipping all */
 	if (blockstart < blockmax) {
-		ret = state_check_process(state, fix, parity_ptr, blockstart, blockmax);
+		ret = state_check_process(state, fix, parity, parity_ptr, blockstart, blockmax);
 		if (ret == -1) {
 			/* LCOV_EXCL_START */
 			++error;
@@ -2002,6 +2637,9 @@ int state_check(struct snapraid_state* state, int fix, block_off_t blockstart, b
 		}
 	}
 
+	/* close the files opened to search the missing blocks */
+	state_search_close(state);
+
 	/* try to close only if opened */
 	for (l = 0; l < state->level; ++l) {
 		if (parity_ptr[l]) {
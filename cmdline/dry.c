@@ -39,6 +39,37 @@ static int block_is_enabled(void* void_plan, block_off_t i)
 	return 1;
 }
 
+/**
+ * Continuation of dry_data_reader() after the read of the block.
+ */
+static void dry_data_reader_done(struct snapraid_worker* worker, struct snapraid_task* task, int ret)
+{
+	struct snapraid_handle* handle = worker->handle;
+	struct snapraid_disk* disk = handle->disk;
+	block_off_t blockcur = task->position;
+	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
+
+	task->read_size = ret;
+	if (task->read_size == -1) {
+		if (errno == EIO) {
+			log_tag("error:%u:%s:%s: Read EIO error at position %u. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), task->file_pos, strerror(errno));
+			log_error("Input/Output error in file '%s' at position '%u'\n", handle->path, task->file_pos);
+			task->state = TASK_STATE_IOERROR_CONTINUE;
+			return;
+		}
+
+		log_tag("error:%u:%s:%s: Read error at position %u. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), task->file_pos, strerror(errno));
+		task->state = TASK_STATE_ERROR_CONTINUE;
+		return;
+	}
+
+	/* store the path of the opened file */
+	pathcpy(task->path, sizeof(task->path), handle->path);
+
+	task->state = TASK_STATE_DONE;
+}
+
 static void dry_data_reader(struct snapraid_worker* worker, struct snapraid_task* task)
 {
 	struct snapraid_io* io = worker->io;
@@ -49,6 +80,7 @@ static void dry_data_reader(struct snapraid_worker* worker, struct snapraid_task
 	unsigned char* buffer = task->buffer;
 	int ret;
 	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
 
 	/* if the disk position is not used */
 	if (!disk) {
@@ -82,7 +114,7 @@ static void dry_data_reader(struct snapraid_worker* worker, struct snapraid_task
 			/* This one is really an unexpected error, because we are only reading */
 			/* and closing a descriptor should never fail */
 			if (errno == EIO) {
-				log_tag("error:%u:%s:%s: Close EIO error. %s\n", blockcur, disk->name, esc(report->sub, esc_buffer), strerror(errno));
+				log_tag("error:%u:%s:%s: Close EIO error. %s\n", blockcur, disk->name, esc(file_sub(report, sub_buffer), esc_buffer), strerror(errno));
 				log_fatal("DANGER! Unexpected input/output close error in a data disk, it isn't possible to dry.\n");
 				log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
 				log_fatal("Stopping at block %u\n", blockcur);
@@ -90,7 +122,7 @@ static void dry_data_reader(struct snapraid_worker* worker, struct snapraid_task
 				return;
 			}
 
-			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(report->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(file_sub(report, sub_buffer), esc_buffer), strerror(errno));
 			log_fatal("WARNING! Unexpected close error in a data disk, it isn't possible to dry.\n");
 			log_fatal("Ensure that file '%s' can be accessed.\n", handle->path);
 			log_fatal("Stopping at block %u\n", blockcur);
@@ -104,7 +136,7 @@ static void dry_data_reader(struct snapraid_worker* worker, struct snapraid_task
 	if (ret == -1) {
 		if (errno == EIO) {
 			/* LCOV_EXCL_START */
-			log_tag("error:%u:%s:%s: Open EIO error. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Open EIO error. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), strerror(errno));
 			log_fatal("DANGER! Unexpected input/output open error in a data disk, it isn't possible to dry.\n");
 			log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
 			log_fatal("Stopping at block %u\n", blockcur);
@@ -113,43 +145,24 @@ static void dry_data_reader(struct snapraid_worker* worker, struct snapraid_task
 			/* LCOV_EXCL_STOP */
 		}
 
-		log_tag("error:%u:%s:%s: Open error. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), strerror(errno));
+		log_tag("error:%u:%s:%s: Open error. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), strerror(errno));
 		task->state = TASK_STATE_ERROR_CONTINUE;
 		return;
 	}
 
-	task->read_size = handle_read(handle, task->file_pos, buffer, state->block_size, log_error, 0);
-	if (task->read_size == -1) {
-		if (errno == EIO) {
-			log_tag("error:%u:%s:%s: Read EIO error at position %u. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), task->file_pos, strerror(errno));
-			log_error("Input/Output error in file '%s' at position '%u'\n", handle->path, task->file_pos);
-			task->state = TASK_STATE_IOERROR_CONTINUE;
-			return;
-		}
-
-		log_tag("error:%u:%s:%s: Read error at position %u. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), task->file_pos, strerror(errno));
-		task->state = TASK_STATE_ERROR_CONTINUE;
-		return;
-	}
-
-	/* store the path of the opened file */
-	pathcpy(task->path, sizeof(task->path), handle->path);
-
-	task->state = TASK_STATE_DONE;
+	/* read the block */
+	io_task_handle_read(worker, task, log_error, 0, dry_data_reader_done);
 }
 
-static void dry_parity_reader(struct snapraid_worker* worker, struct snapraid_task* task)
+/**
+ * Continuation of dry_parity_reader() after the read of the block.
+ */
+static void dry_parity_reader_done(struct snapraid_worker* worker, struct snapraid_task* task, int ret)
 {
-	struct snapraid_io* io = worker->io;
-	struct snapraid_state* state = io->state;
 	struct snapraid_parity_handle* parity_handle = worker->parity_handle;
 	unsigned level = parity_handle->level;
 	block_off_t blockcur = task->position;
-	unsigned char* buffer = task->buffer;
-	int ret;
 
-	/* read the parity */
-	ret = parity_read(parity_handle, blockcur, buffer, state->block_size, log_error);
 	if (ret == -1) {
 		if (errno == EIO) {
 			log_tag("parity_error:%u:%s: Read EIO error. %s\n", blockcur, lev_config_name(level), strerror(errno));
@@ -166,6 +179,12 @@ static void dry_parity_reader(struct snapraid_worker* worker, struct snapraid_ta
 	task->state = TASK_STATE_DONE;
 }
 
+static void dry_parity_reader(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	/* read the parity */
+	io_task_parity_read(worker, task, log_error, dry_parity_reader_done);
+}
+
 static int state_dry_process(struct snapraid_state* state, struct snapraid_parity_handle* parity_handle, block_off_t blockstart, block_off_t blockmax)
 {
 	struct snapraid_io io;
@@ -184,6 +203,7 @@ static int state_dry_process(struct snapraid_state* state, struct snapraid_parit
 	unsigned* waiting_map;
 	unsigned waiting_mac;
 	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
 
 	handle = handle_mapping(state, &diskmax);
 
@@ -360,7 +380,7 @@ bail:
 		ret = handle_close(&handle[j]);
 		if (ret == -1) {
 			/* LCOV_EXCL_START */
-			log_tag("error:%u:%s:%s: Close error. %s\n", blockmax, disk->name, esc(file->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockmax, disk->name, esc(file_sub(file, sub_buffer), esc_buffer), strerror(errno));
 			log_fatal("DANGER! Unexpected close error in a data disk.\n");
 			++error;
 			/* continue, as we are already exiting */
@@ -94,6 +94,8 @@ void state_dup(struct snapraid_state* state)
 	data_off_t size;
 	char esc_buffer[ESC_MAX];
 	char esc_buffer_alt[ESC_MAX];
+	char sub_buffer[PATH_MAX];
+	char sub_buffer_alt[PATH_MAX];
 
 	tommy_hashdyn_init(&hashset);
 
@@ -129,8 +131,8 @@ void state_dup(struct snapraid_state* state)
 			if (found) {
 				++count;
 				size += found->file->size;
-				log_tag("dup:%s:%s:%s:%s:%" PRIu64 ": dup\n", disk->name, esc(file->sub, esc_buffer), found->disk->name, esc(found->file->sub, esc_buffer_alt), found->file->size);
-				printf("%12" PRIu64 " %s%s = %s%s\n", file->size, disk->dir, file->sub, found->disk->dir, found->file->sub);
+				log_tag("dup:%s:%s:%s:%s:%" PRIu64 ": dup\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer), found->disk->name, esc(file_sub(found->file, sub_buffer_alt), esc_buffer_alt), found->file->size);
+				printf("%12" PRIu64 " %s%s = %s%s\n", file->size, disk->dir, file_sub(file, sub_buffer), found->disk->dir, file_sub(found->file, sub_buffer_alt));
 				hash_free(hash);
 			} else {
 				tommy_hashdyn_insert(&hashset, &hash->node, hash, hash32);
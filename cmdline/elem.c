@@ -358,21 +358,121 @@ int filter_content(tommy_list* contentlist, const char* path)
 	return 0;
 }
 
-struct snapraid_file* file_alloc(unsigned block_size, const char* sub, data_off_t size, uint64_t mtime_sec, int mtime_nsec, uint64_t inode, uint64_t physical)
+/**
+ * Compare a directory with a sub path.
+ */
+static int subdir_compare(const void* void_arg, const void* void_data)
+{
+	const struct snapraid_subdir* arg = void_arg;
+	const struct snapraid_subdir* subdir = void_data;
+
+	if (arg->len != subdir->len)
+		return 1;
+
+	return memcmp(arg->sub, subdir->sub, arg->len);
+}
+
+/**
+ * Get the interned directory of a sub path, and take a reference to it.
+ * \param len Length of the directory part of the sub path.
+ */
+static struct snapraid_subdir* subdir_get(struct snapraid_disk* disk, const char* sub, size_t len)
+{
+	struct snapraid_subdir arg;
+	struct snapraid_subdir* subdir;
+	tommy_uint32_t hash;
+
+	arg.sub = (char*)sub;
+	arg.len = len;
+	hash = tommy_hash_u32(0, sub, len);
+
+	subdir = tommy_hashdyn_search(&disk->subdirset, subdir_compare, &arg, hash);
+	if (subdir) {
+		++subdir->ref;
+		return subdir;
+	}
+
+	subdir = arena_alloc(&disk->arena, sizeof(struct snapraid_subdir));
+	subdir->sub = arena_strndup(&disk->arena, sub, len);
+	subdir->len = len;
+	subdir->ref = 1;
+
+	tommy_hashdyn_insert(&disk->subdirset, &subdir->nodeset, subdir, hash);
+
+	return subdir;
+}
+
+/**
+ * Release a reference to an interned directory.
+ */
+static void subdir_put(struct snapraid_disk* disk, struct snapraid_subdir* subdir)
+{
+	if (--subdir->ref != 0)
+		return;
+
+	tommy_hashdyn_remove_existing(&disk->subdirset, &subdir->nodeset);
+	arena_strfree(&disk->arena, subdir->sub);
+	arena_free(&disk->arena, subdir, sizeof(struct snapraid_subdir));
+}
+
+/**
+ * Set the sub path of a file, splitting it in directory and name.
+ */
+static void file_sub_set(struct snapraid_disk* disk, struct snapraid_file* file, const char* sub)
+{
+	const char* name = strrchr(sub, '/');
+
+	if (!name)
+		name = sub;
+	else
+		++name;
+
+	file->subdir = subdir_get(disk, sub, name - sub);
+	file->name = arena_strdup(&disk->arena, name);
+}
+
+const char* file_sub(const struct snapraid_file* file, char* buffer)
+{
+	const struct snapraid_subdir* subdir = file->subdir;
+	size_t len;
+
+	/* files in the root dir don't need a copy */
+	if (subdir->len == 0)
+		return file->name;
+
+	len = strlen(file->name);
+	if (subdir->len + len + 1 > PATH_MAX) {
+		/* LCOV_EXCL_START */
+		log_fatal("Internal inconsistency for too long path '%s%s'\n", subdir->sub, file->name);
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
+
+	memcpy(buffer, subdir->sub, subdir->len);
+	memcpy(buffer + subdir->len, file->name, len + 1);
+
+	return buffer;
+}
+
+struct snapraid_file* file_alloc(struct snapraid_disk* disk, unsigned block_size, const char* sub, data_off_t size, uint64_t mtime_sec, int mtime_nsec, uint64_t inode, uint64_t physical)
 {
 	struct snapraid_file* file;
 	block_off_t i;
 
-	file = malloc_nofail(sizeof(struct snapraid_file));
-	file->sub = strdup_nofail(sub);
+	block_off_t blockmax;
+
+	blockmax = (size + block_size - 1) / block_size;
+
+	/* the blocks are allocated together with the file */
+	file = arena_alloc(&disk->arena, sizeof(struct snapraid_file) + blockmax * block_sizeof());
+	file_sub_set(disk, file, sub);
 	file->size = size;
-	file->blockmax = (size + block_size - 1) / block_size;
+	file->blockmax = blockmax;
 	file->mtime_sec = mtime_sec;
 	file->mtime_nsec = mtime_nsec;
 	file->inode = inode;
 	file->physical = physical;
 	file->flag = 0;
-	file->blockvec = malloc_nofail(file->blockmax * block_sizeof());
 
 	for (i = 0; i < file->blockmax; ++i) {
 		struct snapraid_block* block = file_block(file, i);
@@ -383,13 +483,15 @@ struct snapraid_file* file_alloc(unsigned block_size, const char* sub, data_off_
 	return file;
 }
 
-struct snapraid_file* file_dup(struct snapraid_file* copy)
+struct snapraid_file* file_dup(struct snapraid_disk* disk, struct snapraid_file* copy)
 {
 	struct snapraid_file* file;
 	block_off_t i;
 
-	file = malloc_nofail(sizeof(struct snapraid_file));
-	file->sub = strdup_nofail(copy->sub);
+	/* the blocks are allocated together with the file */
+	file = arena_alloc(&disk->arena, sizeof(struct snapraid_file) + copy->blockmax * block_sizeof());
+	file->subdir = subdir_get(disk, copy->subdir->sub, copy->subdir->len);
+	file->name = arena_strdup(&disk->arena, copy->name);
 	file->size = copy->size;
 	file->blockmax = copy->blockmax;
 	file->mtime_sec = copy->mtime_sec;
@@ -397,7 +499,6 @@ struct snapraid_file* file_dup(struct snapraid_file* copy)
 	file->inode = copy->inode;
 	file->physical = copy->physical;
 	file->flag = copy->flag;
-	file->blockvec = malloc_nofail(file->blockmax * block_sizeof());
 
 	for (i = 0; i < file->blockmax; ++i) {
 		struct snapraid_block* block = file_block(file, i);
@@ -409,19 +510,11 @@ struct snapraid_file* file_dup(struct snapraid_file* copy)
 	return file;
 }
 
-void file_free(struct snapraid_file* file)
+void file_rename(struct snapraid_disk* disk, struct snapraid_file* file, const char* sub)
 {
-	free(file->sub);
-	file->sub = 0;
-	free(file->blockvec);
-	file->blockvec = 0;
-	free(file);
-}
-
-void file_rename(struct snapraid_file* file, const char* sub)
-{
-	free(file->sub);
-	file->sub = strdup_nofail(sub);
+	subdir_put(disk, file->subdir);
+	arena_strfree(&disk->arena, file->name);
+	file_sub_set(disk, file, sub);
 }
 
 void file_copy(struct snapraid_file* src_file, struct snapraid_file* dst_file)
@@ -460,17 +553,6 @@ void file_copy(struct snapraid_file* src_file, struct snapraid_file* dst_file)
 	file_flag_set(dst_file, FILE_IS_COPY);
 }
 
-const char* file_name(const struct snapraid_file* file)
-{
-	const char* r = strrchr(file->sub, '/');
-
-	if (!r)
-		r = file->sub;
-	else
-		++r;
-	return r;
-}
-
 unsigned file_block_size(struct snapraid_file* file, block_off_t file_pos, unsigned block_size)
 {
 	/* if it's the last block */
@@ -530,8 +612,38 @@ int file_path_compare(const void* void_a, const void* void_b)
 {
 	const struct snapraid_file* file_a = void_a;
 	const struct snapraid_file* file_b = void_b;
+	const unsigned char* a;
+	const unsigned char* b;
+	const unsigned char* a_next;
+	const unsigned char* b_next;
+
+	if (file_a->subdir == file_b->subdir)
+		return strcmp(file_a->name, file_b->name);
+
+	/* compare the paths like strcmp(), without building them */
+	a = (const unsigned char*)file_a->subdir->sub;
+	b = (const unsigned char*)file_b->subdir->sub;
+	a_next = (const unsigned char*)file_a->name;
+	b_next = (const unsigned char*)file_b->name;
+	while (1) {
+		/* continue from the dir to the name */
+		if (*a == 0 && a_next) {
+			a = a_next;
+			a_next = 0;
+		}
+		if (*b == 0 && b_next) {
+			b = b_next;
+			b_next = 0;
+		}
+
+		if (*a != *b)
+			return *a < *b ? -1 : 1;
+		if (*a == 0)
+			return 0;
 
-	return strcmp(file_a->sub, file_b->sub);
+		++a;
+		++b;
+	}
 }
 
 int file_physical_compare(const void* void_a, const void* void_b)
@@ -550,8 +662,14 @@ int file_path_compare_to_arg(const void* void_arg, const void* void_data)
 {
 	const char* arg = void_arg;
 	const struct snapraid_file* file = void_data;
+	const struct snapraid_subdir* subdir = file->subdir;
+	int ret;
 
-	return strcmp(arg, file->sub);
+	ret = strncmp(arg, subdir->sub, subdir->len);
+	if (ret != 0)
+		return ret;
+
+	return strcmp(arg + subdir->len, file->name);
 }
 
 int file_name_compare(const void* void_a, const void* void_b)
@@ -609,24 +727,24 @@ int file_pathstamp_compare(const void* void_a, const void* void_b)
 	return file_stamp_compare(void_a, void_b);
 }
 
-struct snapraid_chunk* chunk_alloc(block_off_t parity_pos, struct snapraid_file* file, block_off_t file_pos, block_off_t count)
+struct snapraid_chunk* chunk_alloc(struct snapraid_disk* disk, block_off_t parity_pos, struct snapraid_file* file, block_off_t file_pos, block_off_t count)
 {
 	struct snapraid_chunk* chunk;
 
 	if (count == 0) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency when allocating empty chunk for file '%s' at position '%u/%u'\n", file->sub, file_pos, file->blockmax);
+		log_fatal("Internal inconsistency when allocating empty chunk for file '%s%s' at position '%u/%u'\n", file->subdir->sub, file->name, file_pos, file->blockmax);
 		os_abort();
 		/* LCOV_EXCL_STOP */
 	}
 	if (file_pos + count > file->blockmax) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency when allocating overflowing chunk for file '%s' at position '%u:%u/%u'\n", file->sub, file_pos, count, file->blockmax);
+		log_fatal("Internal inconsistency when allocating overflowing chunk for file '%s%s' at position '%u:%u/%u'\n", file->subdir->sub, file->name, file_pos, count, file->blockmax);
 		os_abort();
 		/* LCOV_EXCL_STOP */
 	}
 
-	chunk = malloc_nofail(sizeof(struct snapraid_chunk));
+	chunk = arena_alloc(&disk->arena, sizeof(struct snapraid_chunk));
 	chunk->parity_pos = parity_pos;
 	chunk->file = file;
 	chunk->file_pos = file_pos;
@@ -635,9 +753,9 @@ struct snapraid_chunk* chunk_alloc(block_off_t parity_pos, struct snapraid_file*
 	return chunk;
 }
 
-void chunk_free(struct snapraid_chunk* chunk)
+void chunk_free(struct snapraid_disk* disk, struct snapraid_chunk* chunk)
 {
-	free(chunk);
+	arena_free(&disk->arena, chunk, sizeof(struct snapraid_chunk));
 }
 
 int chunk_parity_compare(const void* void_a, const void* void_b)
@@ -671,23 +789,29 @@ int chunk_file_compare(const void* void_a, const void* void_b)
 	return 0;
 }
 
-struct snapraid_link* link_alloc(const char* sub, const char* linkto, unsigned link_flag)
+struct snapraid_link* link_alloc(struct snapraid_disk* disk, const char* sub, const char* linkto, unsigned link_flag)
 {
 	struct snapraid_link* slink;
 
-	slink = malloc_nofail(sizeof(struct snapraid_link));
-	slink->sub = strdup_nofail(sub);
-	slink->linkto = strdup_nofail(linkto);
+	slink = arena_alloc(&disk->arena, sizeof(struct snapraid_link));
+	slink->sub = arena_strdup(&disk->arena, sub);
+	slink->linkto = arena_strdup(&disk->arena, linkto);
 	slink->flag = link_flag;
 
 	return slink;
 }
 
-void link_free(struct snapraid_link* slink)
+void link_free(struct snapraid_disk* disk, struct snapraid_link* slink)
+{
+	arena_strfree(&disk->arena, slink->sub);
+	arena_strfree(&disk->arena, slink->linkto);
+	arena_free(&disk->arena, slink, sizeof(struct snapraid_link));
+}
+
+void link_retarget(struct snapraid_disk* disk, struct snapraid_link* slink, const char* linkto)
 {
-	free(slink->sub);
-	free(slink->linkto);
-	free(slink);
+	arena_strfree(&disk->arena, slink->linkto);
+	slink->linkto = arena_strdup(&disk->arena, linkto);
 }
 
 int link_name_compare_to_arg(const void* void_arg, const void* void_data)
@@ -706,21 +830,21 @@ int link_alpha_compare(const void* void_a, const void* void_b)
 	return strcmp(slink_a->sub, slink_b->sub);
 }
 
-struct snapraid_dir* dir_alloc(const char* sub)
+struct snapraid_dir* dir_alloc(struct snapraid_disk* disk, const char* sub)
 {
 	struct snapraid_dir* dir;
 
-	dir = malloc_nofail(sizeof(struct snapraid_dir));
-	dir->sub = strdup_nofail(sub);
+	dir = arena_alloc(&disk->arena, sizeof(struct snapraid_dir));
+	dir->sub = arena_strdup(&disk->arena, sub);
 	dir->flag = 0;
 
 	return dir;
 }
 
-void dir_free(struct snapraid_dir* dir)
+void dir_free(struct snapraid_disk* disk, struct snapraid_dir* dir)
 {
-	free(dir->sub);
-	free(dir);
+	arena_strfree(&disk->arena, dir->sub);
+	arena_free(&disk->arena, dir, sizeof(struct snapraid_dir));
 }
 
 int dir_name_compare(const void* void_arg, const void* void_data)
@@ -770,25 +894,30 @@ struct snapraid_disk* disk_alloc(const char* name, const char* dir, uint64_t dev
 	tommy_hashdyn_init(&disk->linkset);
 	tommy_list_init(&disk->dirlist);
 	tommy_hashdyn_init(&disk->dirset);
+	tommy_hashdyn_init(&disk->subdirset);
 	tommy_tree_init(&disk->fs_parity, chunk_parity_compare);
 	tommy_tree_init(&disk->fs_file, chunk_file_compare);
 	disk->fs_last = 0;
+	disk->fs_index = 0;
+	disk->fs_index_max = 0;
+	disk->fs_index_retired = 0;
+	arena_init(&disk->arena);
 
 	return disk;
 }
 
 void disk_free(struct snapraid_disk* disk)
 {
-	tommy_list_foreach(&disk->filelist, (tommy_foreach_func*)file_free);
-	tommy_list_foreach(&disk->deletedlist, (tommy_foreach_func*)file_free);
-	tommy_tree_foreach(&disk->fs_file, (tommy_foreach_func*)chunk_free);
+	fs_index_drop(disk);
 	tommy_hashdyn_done(&disk->inodeset);
 	tommy_hashdyn_done(&disk->pathset);
 	tommy_hashdyn_done(&disk->stampset);
-	tommy_list_foreach(&disk->linklist, (tommy_foreach_func*)link_free);
 	tommy_hashdyn_done(&disk->linkset);
-	tommy_list_foreach(&disk->dirlist, (tommy_foreach_func*)dir_free);
 	tommy_hashdyn_done(&disk->dirset);
+	tommy_hashdyn_done(&disk->subdirset);
+
+	/* release all the files, links, dirs and chunks at once */
+	arena_done(&disk->arena);
 
 #if HAVE_PTHREAD
 	thread_mutex_destroy(&disk->fs_mutex);
@@ -919,8 +1048,8 @@ static void chunk_parity_check_foreach_unlock(void* void_arg, void* void_obj)
 
 	if (obj->count == 0) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency in parity count zero for file '%s' at '%u'\n",
-			obj->file->sub, obj->parity_pos);
+		log_fatal("Internal inconsistency in parity count zero for file '%s%s' at '%u'\n",
+			obj->file->subdir->sub, obj->file->name, obj->parity_pos);
 		++arg->result;
 		return;
 		/* LCOV_EXCL_STOP */
@@ -933,8 +1062,8 @@ static void chunk_parity_check_foreach_unlock(void* void_arg, void* void_obj)
 	/* check the order */
 	if (prev->parity_pos >= obj->parity_pos) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency in parity order for files '%s' at '%u:%u' and '%s' at '%u:%u'\n",
-			prev->file->sub, prev->parity_pos, prev->count, obj->file->sub, obj->parity_pos, obj->count);
+		log_fatal("Internal inconsistency in parity order for files '%s%s' at '%u:%u' and '%s%s' at '%u:%u'\n",
+			prev->file->subdir->sub, prev->file->name, prev->parity_pos, prev->count, obj->file->subdir->sub, obj->file->name, obj->parity_pos, obj->count);
 		++arg->result;
 		return;
 		/* LCOV_EXCL_STOP */
@@ -943,8 +1072,8 @@ static void chunk_parity_check_foreach_unlock(void* void_arg, void* void_obj)
 	/* check that the chunks don't overlap */
 	if (prev->parity_pos + prev->count > obj->parity_pos) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency for parity overlap for files '%s' at '%u:%u' and '%s' at '%u:%u'\n",
-			prev->file->sub, prev->parity_pos, prev->count, obj->file->sub, obj->parity_pos, obj->count);
+		log_fatal("Internal inconsistency for parity overlap for files '%s%s' at '%u:%u' and '%s%s' at '%u:%u'\n",
+			prev->file->subdir->sub, prev->file->name, prev->parity_pos, prev->count, obj->file->subdir->sub, obj->file->name, obj->parity_pos, obj->count);
 		++arg->result;
 		return;
 		/* LCOV_EXCL_STOP */
@@ -969,8 +1098,8 @@ static void chunk_file_check_foreach_unlock(void* void_arg, void* void_obj)
 
 	if (obj->count == 0) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency in file count zero for file '%s' at '%u'\n",
-			obj->file->sub, obj->file_pos);
+		log_fatal("Internal inconsistency in file count zero for file '%s%s' at '%u'\n",
+			obj->file->subdir->sub, obj->file->name, obj->file_pos);
 		++arg->result;
 		return;
 		/* LCOV_EXCL_STOP */
@@ -985,8 +1114,8 @@ static void chunk_file_check_foreach_unlock(void* void_arg, void* void_obj)
 				/* check that the chunk doesn't overflow the file */
 				if (prev->file_pos + prev->count > prev->file->blockmax) {
 					/* LCOV_EXCL_START */
-					log_fatal("Internal inconsistency in delete end for file '%s' at '%u:%u' overflowing size '%u'\n",
-						prev->file->sub, prev->file_pos, prev->count, prev->file->blockmax);
+					log_fatal("Internal inconsistency in delete end for file '%s%s' at '%u:%u' overflowing size '%u'\n",
+						prev->file->subdir->sub, prev->file->name, prev->file_pos, prev->count, prev->file->blockmax);
 					++arg->result;
 					return;
 					/* LCOV_EXCL_STOP */
@@ -995,8 +1124,8 @@ static void chunk_file_check_foreach_unlock(void* void_arg, void* void_obj)
 				/* check that the chunk ends the file */
 				if (prev->file_pos + prev->count != prev->file->blockmax) {
 					/* LCOV_EXCL_START */
-					log_fatal("Internal inconsistency in file end for file '%s' at '%u:%u' instead of size '%u'\n",
-						prev->file->sub, prev->file_pos, prev->count, prev->file->blockmax);
+					log_fatal("Internal inconsistency in file end for file '%s%s' at '%u:%u' instead of size '%u'\n",
+						prev->file->subdir->sub, prev->file->name, prev->file_pos, prev->count, prev->file->blockmax);
 					++arg->result;
 					return;
 					/* LCOV_EXCL_STOP */
@@ -1008,8 +1137,8 @@ static void chunk_file_check_foreach_unlock(void* void_arg, void* void_obj)
 			/* check that the chunk doesn't overflow the file */
 			if (obj->file_pos + obj->count > obj->file->blockmax) {
 				/* LCOV_EXCL_START */
-				log_fatal("Internal inconsistency in delete start for file '%s' at '%u:%u' overflowing size '%u'\n",
-					obj->file->sub, obj->file_pos, obj->count, obj->file->blockmax);
+				log_fatal("Internal inconsistency in delete start for file '%s%s' at '%u:%u' overflowing size '%u'\n",
+					obj->file->subdir->sub, obj->file->name, obj->file_pos, obj->count, obj->file->blockmax);
 				++arg->result;
 				return;
 				/* LCOV_EXCL_STOP */
@@ -1018,8 +1147,8 @@ static void chunk_file_check_foreach_unlock(void* void_arg, void* void_obj)
 			/* check that the chunk starts the file */
 			if (obj->file_pos != 0) {
 				/* LCOV_EXCL_START */
-				log_fatal("Internal inconsistency in file start for file '%s' at '%u:%u'\n",
-					obj->file->sub, obj->file_pos, obj->count);
+				log_fatal("Internal inconsistency in file start for file '%s%s' at '%u:%u'\n",
+					obj->file->subdir->sub, obj->file->name, obj->file_pos, obj->count);
 				++arg->result;
 				return;
 				/* LCOV_EXCL_STOP */
@@ -1029,8 +1158,8 @@ static void chunk_file_check_foreach_unlock(void* void_arg, void* void_obj)
 		/* check the order */
 		if (prev->file_pos >= obj->file_pos) {
 			/* LCOV_EXCL_START */
-			log_fatal("Internal inconsistency in file order for file '%s' at '%u:%u' and at '%u:%u'\n",
-				prev->file->sub, prev->file_pos, prev->count, obj->file_pos, obj->count);
+			log_fatal("Internal inconsistency in file order for file '%s%s' at '%u:%u' and at '%u:%u'\n",
+				prev->file->subdir->sub, prev->file->name, prev->file_pos, prev->count, obj->file_pos, obj->count);
 			++arg->result;
 			return;
 			/* LCOV_EXCL_STOP */
@@ -1040,8 +1169,8 @@ static void chunk_file_check_foreach_unlock(void* void_arg, void* void_obj)
 			/* check that the chunks don't overlap */
 			if (prev->file_pos + prev->count > obj->file_pos) {
 				/* LCOV_EXCL_START */
-				log_fatal("Internal inconsistency in delete sequence for file '%s' at '%u:%u' and at '%u:%u'\n",
-					prev->file->sub, prev->file_pos, prev->count, obj->file_pos, obj->count);
+				log_fatal("Internal inconsistency in delete sequence for file '%s%s' at '%u:%u' and at '%u:%u'\n",
+					prev->file->subdir->sub, prev->file->name, prev->file_pos, prev->count, obj->file_pos, obj->count);
 				++arg->result;
 				return;
 				/* LCOV_EXCL_STOP */
@@ -1050,8 +1179,8 @@ static void chunk_file_check_foreach_unlock(void* void_arg, void* void_obj)
 			/* check that the chunks are sequential */
 			if (prev->file_pos + prev->count != obj->file_pos) {
 				/* LCOV_EXCL_START */
-				log_fatal("Internal inconsistency in file sequence for file '%s' at '%u:%u' and at '%u:%u'\n",
-					prev->file->sub, prev->file_pos, prev->count, obj->file_pos, obj->count);
+				log_fatal("Internal inconsistency in file sequence for file '%s%s' at '%u:%u' and at '%u:%u'\n",
+					prev->file->subdir->sub, prev->file->name, prev->file_pos, prev->count, obj->file_pos, obj->count);
 				++arg->result;
 				return;
 				/* LCOV_EXCL_STOP */
@@ -1190,11 +1319,103 @@ static struct snapraid_chunk* fs_file2chunk_get_unlock(struct snapraid_disk* dis
 	return chunk;
 }
 
+static void chunk_index_foreach_unlock(void* void_arg, void* void_chunk)
+{
+	struct snapraid_disk* disk = void_arg;
+	struct snapraid_chunk* chunk = void_chunk;
+	struct snapraid_extent* extent = &disk->fs_index[disk->fs_index_max++];
+
+	extent->parity_pos = chunk->parity_pos;
+	extent->count = chunk->count;
+	extent->file_pos = chunk->file_pos;
+	extent->file = chunk->file;
+}
+
+void fs_index_build(struct snapraid_disk* disk)
+{
+	fs_index_drop(disk);
+
+	/* allocate one more extent to never allocate 0 bytes */
+	disk->fs_index = malloc_nofail((tommy_tree_count(&disk->fs_parity) + 1) * sizeof(struct snapraid_extent));
+	disk->fs_index_max = 0;
+
+	/* the tree is visited in order, so the index is sorted by parity_pos */
+	tommy_tree_foreach_arg(&disk->fs_parity, chunk_index_foreach_unlock, disk);
+}
+
+void fs_index_drop(struct snapraid_disk* disk)
+{
+	free(disk->fs_index);
+	free(disk->fs_index_retired);
+	disk->fs_index = 0;
+	disk->fs_index_max = 0;
+	disk->fs_index_retired = 0;
+}
+
+/**
+ * Detach the chunk index after a change of the chunks.
+ *
+ * The vector is not freed, because another thread may have just read
+ * the pointer and it may still be searching in it.
+ * Also ::fs_index_max is not changed, to keep it matching the vector.
+ */
+static void fs_index_retire_unlock(struct snapraid_disk* disk)
+{
+	if (!disk->fs_index)
+		return;
+
+	/* a new index is built only after freeing the retired one */
+	assert(disk->fs_index_retired == 0);
+
+	disk->fs_index_retired = disk->fs_index;
+	disk->fs_index = 0;
+}
+
+/**
+ * Search the extent containing the parity position in the chunk index.
+ *
+ * The binary search is branch-free, as the only condition in the loop
+ * is computed with a conditional move, and the loop runs always for
+ * log2(fs_index_max) iterations.
+ */
+static const struct snapraid_extent* fs_index_search(const struct snapraid_extent* base, block_off_t count, block_off_t parity_pos)
+{
+
+	if (count == 0)
+		return 0;
+
+	while (count > 1) {
+		block_off_t half = count / 2;
+		base = base[half].parity_pos <= parity_pos ? base + half : base;
+		count -= half;
+	}
+
+	if (parity_pos < base->parity_pos || parity_pos >= base->parity_pos + base->count)
+		return 0;
+
+	return base;
+}
+
 struct snapraid_file* fs_par2file_find(struct snapraid_disk* disk, block_off_t parity_pos, block_off_t* file_pos)
 {
+	const struct snapraid_extent* index;
 	struct snapraid_chunk* chunk;
 	struct snapraid_file* file;
 
+	/* read the pointer only once, as it may be detached by another thread */
+	index = disk->fs_index;
+	if (index) {
+		const struct snapraid_extent* extent = fs_index_search(index, disk->fs_index_max, parity_pos);
+
+		if (!extent)
+			return 0;
+
+		if (file_pos)
+			*file_pos = extent->file_pos + (parity_pos - extent->parity_pos);
+
+		return extent->file;
+	}
+
 	fs_lock(disk);
 
 	chunk = fs_par2chunk_get_unlock(disk, &disk->fs_last, parity_pos);
@@ -1213,6 +1434,38 @@ struct snapraid_file* fs_par2file_find(struct snapraid_disk* disk, block_off_t p
 	return file;
 }
 
+block_off_t fs_par2file_run(struct snapraid_disk* disk, block_off_t parity_pos)
+{
+	const struct snapraid_extent* index;
+	struct snapraid_chunk* chunk;
+	block_off_t run;
+
+	/* read the pointer only once, as it may be detached by another thread */
+	index = disk->fs_index;
+	if (index) {
+		const struct snapraid_extent* extent = fs_index_search(index, disk->fs_index_max, parity_pos);
+
+		if (!extent)
+			return 0;
+
+		return extent->parity_pos + extent->count - parity_pos;
+	}
+
+	fs_lock(disk);
+
+	chunk = fs_par2chunk_get_unlock(disk, &disk->fs_last, parity_pos);
+
+	if (!chunk) {
+		fs_unlock(disk);
+		return 0;
+	}
+
+	run = chunk->parity_pos + chunk->count - parity_pos;
+
+	fs_unlock(disk);
+	return run;
+}
+
 block_off_t fs_file2par_find(struct snapraid_disk* disk, struct snapraid_file* file, block_off_t file_pos)
 {
 	struct snapraid_chunk* chunk;
@@ -1232,6 +1485,27 @@ block_off_t fs_file2par_find(struct snapraid_disk* disk, struct snapraid_file* f
 	return ret;
 }
 
+void fs_file_flag_set(struct snapraid_disk* disk, struct snapraid_file* file, unsigned mask)
+{
+	fs_lock(disk);
+
+	file_flag_set(file, mask);
+
+	fs_unlock(disk);
+}
+
+int fs_file_flag_has(struct snapraid_disk* disk, struct snapraid_file* file, unsigned mask)
+{
+	int ret;
+
+	fs_lock(disk);
+
+	ret = file_flag_has(file, mask);
+
+	fs_unlock(disk);
+	return ret;
+}
+
 void fs_allocate(struct snapraid_disk* disk, block_off_t parity_pos, struct snapraid_file* file, block_off_t file_pos)
 {
 	struct snapraid_chunk* chunk;
@@ -1240,6 +1514,8 @@ void fs_allocate(struct snapraid_disk* disk, block_off_t parity_pos, struct snap
 
 	fs_lock(disk);
 
+	fs_index_retire_unlock(disk);
+
 	if (file_pos > 0) {
 		/* search an existing chunk for the previous file_pos */
 		chunk = fs_file2chunk_get_unlock(disk, &disk->fs_last, file, file_pos - 1);
@@ -1248,7 +1524,7 @@ void fs_allocate(struct snapraid_disk* disk, block_off_t parity_pos, struct snap
 			/* ensure that we are extending the chunk at the end */
 			if (file_pos != chunk->file_pos + chunk->count) {
 				/* LCOV_EXCL_START */
-				log_fatal("Internal inconsistency when allocating file '%s' at position '%u/%u' in the middle of chunk '%u:%u' in disk '%s'\n", file->sub, file_pos, file->blockmax, chunk->file_pos, chunk->count, disk->name);
+				log_fatal("Internal inconsistency when allocating file '%s%s' at position '%u/%u' in the middle of chunk '%u:%u' in disk '%s'\n", file->subdir->sub, file->name, file_pos, file->blockmax, chunk->file_pos, chunk->count, disk->name);
 				os_abort();
 				/* LCOV_EXCL_STOP */
 			}
@@ -1262,7 +1538,7 @@ void fs_allocate(struct snapraid_disk* disk, block_off_t parity_pos, struct snap
 	}
 
 	/* a chunk doesn't exist, and we have to create a new one */
-	chunk = chunk_alloc(parity_pos, file, file_pos, 1);
+	chunk = chunk_alloc(disk, parity_pos, file, file_pos, 1);
 
 	/* insert the chunk in the trees */
 	parity_chunk = tommy_tree_insert(&disk->fs_parity, &chunk->parity_node, chunk);
@@ -1270,7 +1546,7 @@ void fs_allocate(struct snapraid_disk* disk, block_off_t parity_pos, struct snap
 
 	if (parity_chunk != chunk || file_chunk != chunk) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency when allocating file '%s' at position '%u/%u' for existing chunk '%u:%u' in disk '%s'\n", file->sub, file_pos, file->blockmax, chunk->file_pos, chunk->count, disk->name);
+		log_fatal("Internal inconsistency when allocating file '%s%s' at position '%u/%u' for existing chunk '%u:%u' in disk '%s'\n", file->subdir->sub, file->name, file_pos, file->blockmax, chunk->file_pos, chunk->count, disk->name);
 		os_abort();
 		/* LCOV_EXCL_STOP */
 	}
@@ -1291,6 +1567,8 @@ void fs_deallocate(struct snapraid_disk* disk, block_off_t parity_pos)
 
 	fs_lock(disk);
 
+	fs_index_retire_unlock(disk);
+
 	chunk = fs_par2chunk_get_unlock(disk, &disk->fs_last, parity_pos);
 	if (!chunk) {
 		/* LCOV_EXCL_START */
@@ -1305,8 +1583,7 @@ void fs_deallocate(struct snapraid_disk* disk, block_off_t parity_pos)
 		tommy_tree_remove(&disk->fs_parity, chunk);
 		tommy_tree_remove(&disk->fs_file, chunk);
 
-		/* deallocate */
-		chunk_free(chunk);
+		chunk_free(disk, chunk);
 
 		/* clear the last accessed chunk */
 		disk->fs_last = 0;
@@ -1341,7 +1618,7 @@ void fs_deallocate(struct snapraid_disk* disk, block_off_t parity_pos)
 	chunk->count = first_count;
 
 	/* allocate the second chunk */
-	second_chunk = chunk_alloc(chunk->parity_pos + first_count + 1, chunk->file, chunk->file_pos + first_count + 1, second_count);
+	second_chunk = chunk_alloc(disk, chunk->parity_pos + first_count + 1, chunk->file, chunk->file_pos + first_count + 1, second_count);
 
 	/* insert the chunk in the trees */
 	parity_chunk = tommy_tree_insert(&disk->fs_parity, &second_chunk->parity_node, second_chunk);
@@ -1364,7 +1641,7 @@ struct snapraid_block* fs_file2block_get(struct snapraid_file* file, block_off_t
 {
 	if (file_pos >= file->blockmax) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency when dereferencing file '%s' at position '%u/%u'\n", file->sub, file_pos, file->blockmax);
+		log_fatal("Internal inconsistency when dereferencing file '%s%s' at position '%u/%u'\n", file->subdir->sub, file->name, file_pos, file->blockmax);
 		os_abort();
 		/* LCOV_EXCL_STOP */
 	}
@@ -276,19 +276,41 @@ struct snapraid_block {
 #define FILE_IS_JUNCTION 0x8000 /**< If it's a junction for Windows. Not yet supported. */
 #define FILE_IS_LINK_MASK 0xF000 /**< Mask for link type. */
 
+/**
+ * Directory of files.
+ *
+ * The directory part of the file paths is interned in a set of the disk,
+ * and it's shared by all the files in the same directory.
+ * It's released when the last file referencing it is renamed.
+ */
+struct snapraid_subdir {
+	char* sub; /**< Sub path of the dir, with the final slash, or empty for the root. Without the disk dir. */
+	size_t len; /**< Length of the sub path. */
+	unsigned ref; /**< Number of files referencing it. */
+
+	/* nodes for data structures */
+	tommy_hashdyn_node nodeset;
+};
+
 /**
  * File.
+ *
+ * The blocks of the file follow the structure in the same allocation,
+ * each one of block_sizeof() bytes. Use file_block() to access them.
+ *
+ * The sub path of the file is stored as its interned directory and its name.
+ * Use file_sub() to get it.
  */
 struct snapraid_file {
 	int64_t mtime_sec; /**< Modification time. */
 	uint64_t inode; /**< Inode. */
 	uint64_t physical; /**< Physical offset of the file. */
 	data_off_t size; /**< Size of the file. */
-	struct snapraid_block* blockvec; /**< All the blocks of the file. */
 	int mtime_nsec; /**< Modification time nanoseconds. In the range 0 <= x < 1,000,000,000, or STAT_NSEC_INVALID if not present. */
 	block_off_t blockmax; /**< Number of blocks. */
 	unsigned flag; /**< FILE_IS_* flags. */
-	char* sub; /**< Sub path of the file. Without the disk dir. The disk is implicit. */
+	struct snapraid_subdir* subdir; /**< Directory of the file. */
+	char* name; /**< Name of the file, without the directory. */
 
 	/* nodes for data structures */
 	tommy_node nodelist;
@@ -336,6 +358,18 @@ struct snapraid_chunk {
 	tommy_tree_node file_node; /**< Tree sorter by <file,file_pos>. */
 };
 
+/**
+ * Extent.
+ *
+ * A flat copy of a chunk, used in the immutable chunk index of the disk.
+ */
+struct snapraid_extent {
+	block_off_t parity_pos; /**< Parity position. */
+	block_off_t count; /**< Number of sequential blocks in the file and parity. */
+	block_off_t file_pos; /**< Position in the file. */
+	struct snapraid_file* file; /**< File containing this extent. */
+};
+
 /**
  * Disk.
  */
@@ -376,7 +410,11 @@ struct snapraid_disk {
 	 * meaning that it protectes only chunks.
 	 *
 	 * Files, links and dirs are not protected as they are not expected to
-	 * change during multithread processing.
+	 * change during multithread processing. The only exception are the
+	 * file flags, when accessed with fs_file_flag_set() and fs_file_flag_has().
+	 *
+	 * When the chunk index ::fs_index is present, fs_par2file_find() and
+	 * fs_par2block_find() don't use this mutex at all.
 	 */
 	pthread_mutex_t fs_mutex;
 #endif
@@ -394,6 +432,26 @@ struct snapraid_disk {
 	 */
 	struct snapraid_chunk* fs_last;
 
+	/**
+	 * Immutable index of the chunks, sorted by <parity_pos>.
+	 *
+	 * It's built by fs_index_build() before starting the multithread
+	 * processing, and it's discarded at the first change of the chunks.
+	 * As it's never changed after being built, it's read without locking.
+	 * If 0, the index is not present, and the trees are used.
+	 */
+	struct snapraid_extent* fs_index;
+	block_off_t fs_index_max; /**< Number of extents in the index. */
+
+	/**
+	 * Index discarded by a change of the chunks, but not yet freed.
+	 *
+	 * A thread may still be searching in it, so it's freed only at the next
+	 * safe point, in fs_index_build() or fs_index_drop().
+	 * ::fs_index_max is kept, to always match the vector seen by a thread.
+	 */
+	struct snapraid_extent* fs_index_retired;
+
 	/**
 	 * List of all the snapraid_file for the disk.
 	 */
@@ -414,6 +472,19 @@ struct snapraid_disk {
 	tommy_hashdyn linkset; /**< Hashtable by name of all the links. */
 	tommy_list dirlist; /**< List of all the dirs. */
 	tommy_hashdyn dirset; /**< Hashtable by name of all the dirs. */
+	tommy_hashdyn subdirset; /**< Hashtable by sub path of the directories of the files. */
+
+	/**
+	 * Arena for all the files, links, dirs and chunks of the disk, with their names.
+	 *
+	 * Links, dirs and chunks removed from the disk are freed with link_free(),
+	 * dir_free() and chunk_free(), and their memory is reused by the next
+	 * allocations. All the rest is released when the disk is deallocated.
+	 *
+	 * Each disk has its own arena, so the threads scanning or loading
+	 * different disks don't need any lock to allocate.
+	 */
+	struct arena arena;
 
 	/* nodes for data structures */
 	tommy_node node;
@@ -715,24 +786,19 @@ static inline void file_flag_clear(struct snapraid_file* file, unsigned mask)
 }
 
 /**
- * Allocate a file.
+ * Allocate a file in the arena of the disk.
  */
-struct snapraid_file* file_alloc(unsigned block_size, const char* sub, data_off_t size, uint64_t mtime_sec, int mtime_nsec, uint64_t inode, uint64_t physical);
+struct snapraid_file* file_alloc(struct snapraid_disk* disk, unsigned block_size, const char* sub, data_off_t size, uint64_t mtime_sec, int mtime_nsec, uint64_t inode, uint64_t physical);
 
 /**
- * Duplicate a file.
+ * Duplicate a file in the arena of the disk.
  */
-struct snapraid_file* file_dup(struct snapraid_file* copy);
-
-/**
- * Deallocate a file.
- */
-void file_free(struct snapraid_file* file);
+struct snapraid_file* file_dup(struct snapraid_disk* disk, struct snapraid_file* copy);
 
 /**
  * Rename a file.
  */
-void file_rename(struct snapraid_file* file, const char* sub);
+void file_rename(struct snapraid_disk* disk, struct snapraid_file* file, const char* sub);
 
 /**
  * Copy a file.
@@ -742,11 +808,14 @@ void file_copy(struct snapraid_file* src_file, struct snapraid_file* dest_file);
 /**
  * Return the block at the specified position.
  *
+ * The blocks are stored just after the file structure,
+ * packed with only BLOCK_HASH_SIZE bytes of hash for each one.
+ *
  * Note that the block size if a runtime value.
  */
 static inline struct snapraid_block* file_block(struct snapraid_file* file, size_t pos)
 {
-	unsigned char* ptr = (unsigned char*)file->blockvec;
+	unsigned char* ptr = (unsigned char*)(file + 1);
 
 	return (struct snapraid_block*)(ptr + pos * block_sizeof());
 }
@@ -754,7 +823,19 @@ static inline struct snapraid_block* file_block(struct snapraid_file* file, size
 /**
  * Return the name of the file, without the dir.
  */
-const char* file_name(const struct snapraid_file* file);
+static inline const char* file_name(const struct snapraid_file* file)
+{
+	return file->name;
+}
+
+/**
+ * Return the sub path of the file. Without the disk dir.
+ *
+ * The path is built in the buffer joining the directory and the name,
+ * but for the files in the root dir the name is returned directly.
+ * \param buffer Buffer of PATH_MAX chars.
+ */
+const char* file_sub(const struct snapraid_file* file, char* buffer);
 
 /**
  * Check if the block is the last in the file.
@@ -825,14 +906,14 @@ static inline tommy_uint32_t file_stamp_hash(data_off_t size, int64_t mtime_sec,
 }
 
 /**
- * Allocate a chunk.
+ * Allocate a chunk in the arena of the disk.
  */
-struct snapraid_chunk* chunk_alloc(block_off_t parity_pos, struct snapraid_file* file, block_off_t file_pos, block_off_t count);
+struct snapraid_chunk* chunk_alloc(struct snapraid_disk* disk, block_off_t parity_pos, struct snapraid_file* file, block_off_t file_pos, block_off_t count);
 
 /**
- * Deallocate a chunk.
+ * Free a chunk in the arena of the disk.
  */
-void chunk_free(struct snapraid_chunk* chunk);
+void chunk_free(struct snapraid_disk* disk, struct snapraid_chunk* chunk);
 
 /**
  * Compare chunk by parity position.
@@ -871,14 +952,19 @@ static inline unsigned link_flag_get(struct snapraid_link* slink, unsigned mask)
 }
 
 /**
- * Allocate a link.
+ * Allocate a link in the arena of the disk.
  */
-struct snapraid_link* link_alloc(const char* name, const char* slink, unsigned link_flag);
+struct snapraid_link* link_alloc(struct snapraid_disk* disk, const char* name, const char* slink, unsigned link_flag);
 
 /**
- * Deallocate a link.
+ * Free a link in the arena of the disk.
  */
-void link_free(struct snapraid_link* slink);
+void link_free(struct snapraid_disk* disk, struct snapraid_link* slink);
+
+/**
+ * Change the target of a link.
+ */
+void link_retarget(struct snapraid_disk* disk, struct snapraid_link* slink, const char* linkto);
 
 /**
  * Compare a link with a name.
@@ -914,14 +1000,14 @@ static inline void dir_flag_clear(struct snapraid_dir* dir, unsigned mask)
 }
 
 /**
- * Allocate a dir.
+ * Allocate a dir in the arena of the disk.
  */
-struct snapraid_dir* dir_alloc(const char* name);
+struct snapraid_dir* dir_alloc(struct snapraid_disk* disk, const char* name);
 
 /**
- * Deallocate a dir.
+ * Free a dir in the arena of the disk.
  */
-void dir_free(struct snapraid_dir* dir);
+void dir_free(struct snapraid_disk* disk, struct snapraid_dir* dir);
 
 /**
  * Compare a dir with a name.
@@ -965,6 +1051,28 @@ int fs_is_empty(struct snapraid_disk* disk, block_off_t blockmax);
  */
 int fs_check(struct snapraid_disk* disk);
 
+/**
+ * Build the immutable chunk index of the disk.
+ *
+ * After this call, and until the next fs_allocate() or fs_deallocate(),
+ * the par2file/par2block operations run lock-free with a binary search
+ * on a flat vector, instead than walking the tree with the mutex held.
+ *
+ * \note This function is NOT thread-safe, call it before starting the threads.
+ */
+void fs_index_build(struct snapraid_disk* disk);
+
+/**
+ * Discard the immutable chunk index of the disk.
+ *
+ * The fs_allocate() and fs_deallocate() calls only detach the index,
+ * and they leave it allocated until the next call of this function,
+ * as another thread may still be searching in it.
+ *
+ * \note This function is NOT thread-safe, call it when no thread is running.
+ */
+void fs_index_drop(struct snapraid_disk* disk);
+
 /**
  * Allocate a parity position for the specified file position.
  *
@@ -996,6 +1104,13 @@ struct snapraid_block* fs_file2block_get(struct snapraid_file* file, block_off_t
  */
 struct snapraid_file* fs_par2file_find(struct snapraid_disk* disk, block_off_t parity_pos, block_off_t* file_pos);
 
+/**
+ * Get the number of blocks stored sequentially in both the file and the parity,
+ * starting from the parity position, and inside the same chunk.
+ * Return 0 if no file is using it.
+ */
+block_off_t fs_par2file_run(struct snapraid_disk* disk, block_off_t parity_pos);
+
 /**
  * Get the file position from the parity position.
  */
@@ -1030,7 +1145,7 @@ static inline block_off_t fs_file2par_get(struct snapraid_disk* disk, struct sna
 	ret = fs_file2par_find(disk, file, file_pos);
 	if (ret == POS_NULL) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency when resolving file '%s' at position '%u/%u' in disk '%s'\n", file->sub, file_pos, file->blockmax, disk->name);
+		log_fatal("Internal inconsistency when resolving file '%s%s' at position '%u/%u' in disk '%s'\n", file->subdir->sub, file->name, file_pos, file->blockmax, disk->name);
 		os_abort();
 		/* LCOV_EXCL_STOP */
 	}
@@ -1062,6 +1177,18 @@ static inline struct snapraid_block* fs_par2block_get(struct snapraid_disk* disk
 	return ret;
 }
 
+/**
+ * Set the flags of a file, protecting them with the disk mutex.
+ *
+ * To use when the flags could be read at the same time by worker threads.
+ */
+void fs_file_flag_set(struct snapraid_disk* disk, struct snapraid_file* file, unsigned mask);
+
+/**
+ * Check the flags of a file, protecting them with the disk mutex.
+ */
+int fs_file_flag_has(struct snapraid_disk* disk, struct snapraid_file* file, unsigned mask);
+
 /**
  * Allocate a disk mapping.
  * Uses uuid="" if not available.
@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2026 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "portable.h"
+
+#include "gen.h"
+#include "util.h"
+#include "raid/raid.h"
+
+/**
+ * Compute the parity of the slice assigned to the worker.
+ */
+static void gen_slice(struct snapraid_gen* gen, struct snapraid_gen_worker* worker, size_t size, void** v)
+{
+	size_t offset;
+	size_t len;
+	unsigned first;
+	unsigned last;
+	unsigned j;
+	int i;
+
+	/* hash the range of blocks assigned to the worker */
+	/* each hash must be computed in order, so the blocks are split, and not the columns */
+	first = worker->index * gen->hash_max / gen->thread_max;
+	last = (worker->index + 1) * gen->hash_max / gen->thread_max;
+	for (j = first; j < last; ++j) {
+		struct snapraid_gen_hash* hash = &gen->hash[j];
+		memhash_update(&hash->ctx, gen->hash_v[hash->index], hash->size);
+	}
+
+	offset = worker->index * gen->slice;
+	if (offset >= size)
+		return;
+
+	len = size - offset;
+	if (len > gen->slice)
+		len = gen->slice;
+
+	for (i = 0; i < gen->nd_used + gen->np; ++i)
+		worker->v[i] = (unsigned char*)v[i] + offset;
+
+	raid_gen(gen->nd_used, gen->np, len, worker->v);
+}
+
+#if HAVE_PTHREAD
+static void* gen_thread(void* arg)
+{
+	struct snapraid_gen_worker* worker = arg;
+	struct snapraid_gen* gen = worker->gen;
+
+	while (1) {
+		size_t size;
+		void** v;
+
+		thread_mutex_lock(&gen->mutex);
+
+		/* wait for a new request */
+		while (!gen->done && worker->generation == gen->generation)
+			thread_cond_wait(&gen->work_cond, &gen->mutex);
+
+		if (gen->done) {
+			thread_mutex_unlock(&gen->mutex);
+			break;
+		}
+
+		worker->generation = gen->generation;
+		size = gen->size;
+		v = gen->v;
+
+		thread_mutex_unlock(&gen->mutex);
+
+		gen_slice(gen, worker, size, v);
+
+		thread_mutex_lock(&gen->mutex);
+
+		/* the last slice completed wakes up the calling thread */
+		if (--gen->pending == 0)
+			thread_cond_signal_and_unlock(&gen->done_cond, &gen->mutex);
+		else
+			thread_mutex_unlock(&gen->mutex);
+	}
+
+	return 0;
+}
+#endif
+
+/**
+ * Number of processors online.
+ */
+static unsigned gen_cpu(void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+
+	return info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (count < 1)
+		return 1;
+
+	return count;
+#else
+	return 1;
+#endif
+}
+
+unsigned gen_select(int nd, int np, size_t size)
+{
+	uint64_t work;
+	unsigned cpu;
+	unsigned thread_max;
+
+	/* each parity processes all the data blocks */
+	work = (uint64_t)nd * np * size;
+
+	cpu = gen_cpu();
+
+	thread_max = 1;
+	while (thread_max * 2 <= GEN_THREAD_MAX && thread_max * 2 <= cpu && size >= thread_max * 2 * GEN_SLICE_MIN && work >= thread_max * 2 * (uint64_t)GEN_WORK_MIN)
+		thread_max *= 2;
+
+	return thread_max;
+}
+
+void gen_init(struct snapraid_gen* gen, int nd, int np, size_t size, unsigned thread_max)
+{
+	unsigned i;
+
+	if (thread_max == 0)
+		thread_max = gen_select(nd, np, size);
+	if (thread_max > GEN_THREAD_MAX)
+		thread_max = GEN_THREAD_MAX;
+#if !HAVE_PTHREAD
+	thread_max = 1;
+#endif
+
+	msg_verbose("Using %u threads for the parity\n", thread_max);
+
+	gen->nd = nd;
+	gen->np = np;
+	gen->thread_max = thread_max;
+	gen->size = 0;
+
+	/* slice of all the blocks that fits in the cache */
+	gen->fuse_slice = GEN_FUSE_CACHE / (nd + np);
+	gen->fuse_slice &= ~(size_t)63;
+	if (gen->fuse_slice < GEN_FUSE_SLICE_MIN)
+		gen->fuse_slice = GEN_FUSE_SLICE_MIN;
+
+	gen->slice = 0;
+	gen->v = 0;
+	gen->nd_used = nd;
+	gen->hash = 0;
+	gen->hash_max = 0;
+	gen->hash_v = 0;
+
+	/* block of zeros used in place of the data blocks not present */
+	gen->zero = malloc_nofail_align(size, &gen->zero_alloc);
+	memset(gen->zero, 0, size);
+	gen->sparse_v = malloc_nofail((nd + np) * sizeof(void*));
+
+	for (i = 0; i < thread_max; ++i) {
+		struct snapraid_gen_worker* worker = &gen->worker_map[i];
+
+		worker->gen = gen;
+		worker->index = i;
+		worker->generation = 0;
+		worker->v = malloc_nofail((nd + np) * sizeof(void*));
+	}
+
+#if HAVE_PTHREAD
+	gen->generation = 0;
+	gen->pending = 0;
+	gen->done = 0;
+
+	if (thread_max > 1) {
+		thread_mutex_init(&gen->mutex, 0);
+		thread_cond_init(&gen->work_cond, 0);
+		thread_cond_init(&gen->done_cond, 0);
+
+		/* the first slice is computed by the calling thread */
+		for (i = 1; i < thread_max; ++i) {
+			struct snapraid_gen_worker* worker = &gen->worker_map[i];
+
+			thread_create(&worker->thread, 0, gen_thread, worker);
+		}
+	}
+#endif
+}
+
+void gen_done(struct snapraid_gen* gen)
+{
+	unsigned i;
+
+#if HAVE_PTHREAD
+	if (gen->thread_max > 1) {
+		thread_mutex_lock(&gen->mutex);
+
+		/* mark that we are stopping */
+		gen->done = 1;
+
+		thread_cond_broadcast_and_unlock(&gen->work_cond, &gen->mutex);
+
+		for (i = 1; i < gen->thread_max; ++i) {
+			struct snapraid_gen_worker* worker = &gen->worker_map[i];
+			void* retval;
+
+			thread_join(worker->thread, &retval);
+		}
+
+		thread_cond_destroy(&gen->done_cond);
+		thread_cond_destroy(&gen->work_cond);
+		thread_mutex_destroy(&gen->mutex);
+	}
+#endif
+
+	for (i = 0; i < gen->thread_max; ++i)
+		free(gen->worker_map[i].v);
+
+	free(gen->sparse_v);
+	free(gen->zero_alloc);
+}
+
+/**
+ * Compute the parity using only the first data blocks, and update the hashes.
+ *
+ * \param hash_v Vector of blocks to hash, indexed by snapraid_gen_hash::index.
+ */
+static void gen_parity_used(struct snapraid_gen* gen, int nd, size_t size, void** v, struct snapraid_gen_hash* hash, unsigned hash_max, void** hash_v)
+{
+	size_t slice;
+
+	/* without threads, don't split */
+	if (gen->thread_max <= 1) {
+		gen_hash(hash, hash_max, hash_v);
+		raid_gen(nd, gen->np, size, v);
+		return;
+	}
+
+	/* split in slices of cache lines */
+	slice = (size + gen->thread_max - 1) / gen->thread_max;
+	slice = (slice + 63) & ~(size_t)63;
+
+#if HAVE_PTHREAD
+	thread_mutex_lock(&gen->mutex);
+
+	gen->size = size;
+	gen->slice = slice;
+	gen->v = v;
+	gen->nd_used = nd;
+	gen->hash = hash;
+	gen->hash_max = hash_max;
+	gen->hash_v = hash_v;
+	gen->pending = gen->thread_max - 1;
+	++gen->generation;
+
+	thread_cond_broadcast_and_unlock(&gen->work_cond, &gen->mutex);
+
+	gen_slice(gen, &gen->worker_map[0], size, v);
+
+	/* wait for the other slices */
+	thread_mutex_lock(&gen->mutex);
+	while (gen->pending != 0)
+		thread_cond_wait(&gen->done_cond, &gen->mutex);
+	thread_mutex_unlock(&gen->mutex);
+#endif
+}
+
+void gen_parity(struct snapraid_gen* gen, size_t size, void** v)
+{
+	gen_parity_used(gen, gen->nd, size, v, 0, 0, 0);
+}
+
+/**
+ * Setup the vector of the stripe with only the data blocks present.
+ *
+ * For a single parity, that is a XOR, the data blocks not present are
+ * removed. For more parities the position of the data blocks is part
+ * of the computation, and only the latest ones not present can be
+ * removed. The others are replaced with the block of zeros.
+ *
+ * Return the number of data blocks in the vector.
+ */
+static int gen_sparse(struct snapraid_gen* gen, void** v, const unsigned char* present, void** sv)
+{
+	int nd;
+	int i;
+
+	nd = 0;
+	for (i = 0; i < gen->nd; ++i) {
+		if (gen->np == 1) {
+			if (present[i])
+				sv[nd++] = v[i];
+		} else {
+			if (present[i]) {
+				sv[i] = v[i];
+				nd = i + 1;
+			} else {
+				sv[i] = gen->zero;
+			}
+		}
+	}
+
+	for (i = 0; i < gen->np; ++i)
+		sv[nd + i] = v[gen->nd + i];
+
+	return nd;
+}
+
+void gen_parity_sparse(struct snapraid_gen* gen, size_t size, void** v, const unsigned char* present)
+{
+	void** sv = gen->sparse_v;
+	int nd;
+	int i;
+
+	nd = gen_sparse(gen, v, present, sv);
+
+	/* if no data is present, the parity is all zero */
+	if (nd == 0) {
+		for (i = 0; i < gen->np; ++i)
+			memset(v[gen->nd + i], 0, size);
+		return;
+	}
+
+	gen_parity_used(gen, nd, size, sv, 0, 0, 0);
+}
+
+void gen_hash(struct snapraid_gen_hash* hash, unsigned hash_max, void** v)
+{
+	unsigned i;
+
+	for (i = 0; i < hash_max; ++i)
+		memhash_update(&hash[i].ctx, v[hash[i].index], hash[i].size);
+}
+
+void gen_parity_hash(struct snapraid_gen* gen, size_t size, void** v, const unsigned char* present, struct snapraid_gen_hash* hash, unsigned hash_max)
+{
+	void** s = gen->worker_map[0].v;
+	void** sv;
+	size_t offset;
+	unsigned i;
+	int nd;
+	int j;
+
+	if (present) {
+		sv = gen->sparse_v;
+		nd = gen_sparse(gen, v, present, sv);
+
+		/* if no data is present, there is nothing to hash, and the parity is all zero */
+		if (nd == 0) {
+			gen_parity_sparse(gen, size, v, present);
+			return;
+		}
+	} else {
+		sv = v;
+		nd = gen->nd;
+	}
+
+	/* with threads, each worker hashes a range of blocks and then computes a slice of the parity */
+	if (gen->thread_max > 1) {
+		gen_parity_used(gen, nd, size, sv, hash, hash_max, v);
+		return;
+	}
+
+	for (offset = 0; offset < size; offset += gen->fuse_slice) {
+		size_t len = size - offset;
+		if (len > gen->fuse_slice)
+			len = gen->fuse_slice;
+
+		/* hash the slice, bringing the data in the cache */
+		for (i = 0; i < hash_max; ++i) {
+			size_t hash_len;
+
+			if (offset >= hash[i].size)
+				continue;
+
+			hash_len = hash[i].size - offset;
+			if (hash_len > len)
+				hash_len = len;
+
+			memhash_update(&hash[i].ctx, (unsigned char*)v[hash[i].index] + offset, hash_len);
+		}
+
+		/* compute the parity of the slice, with the data still in the cache */
+		for (j = 0; j < nd + gen->np; ++j)
+			s[j] = (unsigned char*)sv[j] + offset;
+
+		raid_gen(nd, gen->np, len, s);
+	}
+}
+
+uint64_t gen_measure(int nd, int np, size_t size, void** v, unsigned thread_max)
+{
+	struct snapraid_gen gen;
+	uint64_t start;
+	uint64_t stop;
+	unsigned i;
+
+	gen_init(&gen, nd, np, size, thread_max);
+
+	/* warm up the threads and the cache */
+	gen_parity(&gen, size, v);
+
+	start = tick();
+	for (i = 0; i < GEN_CALIBRATE_LOOP; ++i)
+		gen_parity(&gen, size, v);
+	stop = tick();
+
+	gen_done(&gen);
+
+	return stop - start;
+}
+
+unsigned gen_calibrate(int nd, int np, size_t size)
+{
+	void* v_alloc;
+	void** v;
+	unsigned best_thread;
+	uint64_t best_time;
+	unsigned thread_max;
+	int i;
+
+	/* if the block is too small, threads cannot help */
+	if (size < 2 * GEN_SLICE_MIN)
+		return 1;
+
+	v = malloc_nofail_vector_align(nd, nd + np, size, &v_alloc);
+
+	/* the content of the data doesn't matter */
+	for (i = 0; i < nd; ++i)
+		memset(v[i], i, size);
+
+	best_thread = 1;
+	best_time = gen_measure(nd, np, size, v, 1);
+
+	for (thread_max = 2; thread_max <= GEN_THREAD_MAX && size >= thread_max * GEN_SLICE_MIN; thread_max *= 2) {
+		uint64_t elapsed = gen_measure(nd, np, size, v, thread_max);
+
+		/* use more threads only if they give at least a 10% gain */
+		if (elapsed * 10 > best_time * 9)
+			break;
+
+		best_thread = thread_max;
+		best_time = elapsed;
+	}
+
+	free(v_alloc);
+	free(v);
+
+	return best_thread;
+}
+
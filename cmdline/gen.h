@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2026 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEN_H
+#define __GEN_H
+
+#include "support.h"
+#include "util.h"
+
+/****************************************************************************/
+/* parallel parity generation */
+
+/**
+ * Max number of threads used to compute the parity.
+ */
+#define GEN_THREAD_MAX 8
+
+/**
+ * Min size of the slice of the stripe assigned to each thread by the calibration.
+ *
+ * Smaller slices don't pay the cost of waking up the threads.
+ */
+#define GEN_SLICE_MIN (16 * 1024)
+
+/**
+ * Min work assigned to each thread by the automatic selection.
+ *
+ * The work of a stripe is the size of its data blocks multiplied by
+ * the number of parities, as each parity processes all the data.
+ * Less work doesn't pay the cost of waking up the threads.
+ */
+#define GEN_WORK_MIN (4 * 1024 * 1024)
+
+/**
+ * Number of parity computations done for each thread count during calibration.
+ */
+#define GEN_CALIBRATE_LOOP 16
+
+/**
+ * Cache size targeted by the fused hash and parity pass.
+ *
+ * The slice of all the data and parity blocks processed at each step
+ * should stay in the L2 cache, to read the data from memory only once.
+ */
+#define GEN_FUSE_CACHE (256 * 1024)
+
+/**
+ * Min size of the slice used by the fused hash and parity pass.
+ */
+#define GEN_FUSE_SLICE_MIN 1024
+
+/**
+ * Hash computed in the same pass of the parity.
+ */
+struct snapraid_gen_hash {
+	unsigned index; /**< Index of the data block to hash. */
+	size_t size; /**< Number of bytes to hash, starting from the beginning of the block. */
+	struct memhash_ctx ctx; /**< Hash context, already started with memhash_init(). */
+};
+
+struct snapraid_gen;
+
+/**
+ * Worker thread computing the parity of a slice of the stripe.
+ */
+struct snapraid_gen_worker {
+#if HAVE_PTHREAD
+	pthread_t thread; /**< Thread context for the worker. */
+#endif
+	struct snapraid_gen* gen; /**< Parent pointer. */
+	unsigned index; /**< Index of the slice processed by the worker. */
+	unsigned generation; /**< Last request processed. */
+	void** v; /**< Vector of pointers inside the slice. */
+};
+
+/**
+ * Parallel parity generator.
+ *
+ * Each stripe is split in column slices aligned at the cache line,
+ * and each slice is computed by a different thread with raid_gen().
+ * The calling thread computes the first slice, and then waits for the others.
+ */
+struct snapraid_gen {
+	int nd; /**< Number of data blocks. */
+	int np; /**< Number of parity blocks. */
+	unsigned thread_max; /**< Number of slices. 1 to compute the parity in the calling thread. */
+	size_t fuse_slice; /**< Size of the slice used by the fused hash and parity pass. Multiple of 64. */
+
+	/**
+	 * Current request.
+	 */
+	size_t size; /**< Size of the blocks. */
+	size_t slice; /**< Size of each slice. Multiple of 64. */
+	void** v; /**< Vector of blocks. */
+	int nd_used; /**< Number of data blocks in the vector. It's less than ::nd if some are not present. */
+	struct snapraid_gen_hash* hash; /**< Hashes to update, split in ranges between the workers. */
+	unsigned hash_max; /**< Number of hashes. */
+	void** hash_v; /**< Vector of blocks to hash. */
+
+	/**
+	 * Support for data blocks not present.
+	 */
+	void* zero; /**< Block of zeros. */
+	void* zero_alloc; /**< Allocation of the block of zeros. */
+	void** sparse_v; /**< Vector of blocks with only the data blocks present. */
+
+#if HAVE_PTHREAD
+	pthread_mutex_t mutex; /**< Mutex protecting the request. */
+	pthread_cond_t work_cond; /**< Signaled when a new request is available. */
+	pthread_cond_t done_cond; /**< Signaled when all the slices are completed. */
+	unsigned generation; /**< Counter of the requests. */
+	unsigned pending; /**< Number of slices still in progress. */
+	int done; /**< Set to terminate the threads. */
+#endif
+
+	struct snapraid_gen_worker worker_map[GEN_THREAD_MAX];
+};
+
+/**
+ * Initialize the parity generator.
+ *
+ * \param nd Number of data blocks.
+ * \param np Number of parity blocks.
+ * \param size Size of the blocks.
+ * \param thread_max Number of threads to use. 0 to select it automatically with gen_select().
+ */
+void gen_init(struct snapraid_gen* gen, int nd, int np, size_t size, unsigned thread_max);
+
+/**
+ * Deinitialize the parity generator, stopping all the threads.
+ */
+void gen_done(struct snapraid_gen* gen);
+
+/**
+ * Compute the parity like raid_gen(), but using all the threads.
+ *
+ * The blocks must have the same number of data and parity blocks specified
+ * in gen_init(). The size must be a multiple of 64.
+ */
+void gen_parity(struct snapraid_gen* gen, size_t size, void** v);
+
+/**
+ * Compute the parity like gen_parity(), but only with the data blocks present.
+ *
+ * The data blocks not present are considered filled with zeros, and their
+ * buffers are not accessed, saving the time to clear and process them.
+ *
+ * \param present Vector of ::nd elements, with 1 for the data blocks present.
+ */
+void gen_parity_sparse(struct snapraid_gen* gen, size_t size, void** v, const unsigned char* present);
+
+/**
+ * Compute the parity like gen_parity_sparse(), and also update the specified hashes.
+ *
+ * The stripe is processed in slices that fit in the cache, updating the
+ * hashes and the parity of each slice in the same pass, and reading the
+ * data from memory only once.
+ *
+ * If the parity is computed with more threads, each thread updates
+ * a range of the hashes, and then computes its slice of the parity.
+ * If present is 0, all the data blocks are present.
+ *
+ * The hashes are not completed, and memhash_final() has to be called after.
+ */
+void gen_parity_hash(struct snapraid_gen* gen, size_t size, void** v, const unsigned char* present, struct snapraid_gen_hash* hash, unsigned hash_max);
+
+/**
+ * Update the specified hashes, without computing the parity.
+ */
+void gen_hash(struct snapraid_gen_hash* hash, unsigned hash_max, void** v);
+
+/**
+ * Measure the time to compute the parity with the specified number of threads.
+ *
+ * Return the time in ticks used by GEN_CALIBRATE_LOOP computations.
+ */
+uint64_t gen_measure(int nd, int np, size_t size, void** v, unsigned thread_max);
+
+/**
+ * Select the number of threads that computes the parity faster.
+ */
+unsigned gen_calibrate(int nd, int np, size_t size);
+
+/**
+ * Select the number of threads to compute the parity without any measure.
+ *
+ * The threads are doubled while each one gets at least GEN_WORK_MIN of work,
+ * computed from the number of data blocks, the number of parities and the
+ * block size, and a slice of at least GEN_SLICE_MIN of each block.
+ * The threads are also limited by the number of processors.
+ */
+unsigned gen_select(int nd, int np, size_t size);
+
+#endif
+
@@ -28,13 +28,14 @@ int handle_create(struct snapraid_handle* handle, struct snapraid_file* file, in
 {
 	int ret;
 	int flags;
+	char sub_buffer[PATH_MAX];
 
 	/* if it's the same file, and already opened, nothing to do */
 	if (handle->file == file && handle->f != -1) {
 		return 0;
 	}
 
-	pathprint(handle->path, sizeof(handle->path), "%s%s", handle->disk->dir, file->sub);
+	pathprint(handle->path, sizeof(handle->path), "%s%s", handle->disk->dir, file_sub(file, sub_buffer));
 
 	ret = mkancestor(handle->path);
 	if (ret != 0) {
@@ -46,6 +47,9 @@ int handle_create(struct snapraid_handle* handle, struct snapraid_file* file, in
 	/* initial values, changed later if required */
 	handle->created = 0;
 
+	/* never in direct mode, as the writes of the file tail are not aligned */
+	handle->direct = 0;
+
 	/* flags for opening */
 	/* O_BINARY: open as binary file (Windows only) */
 	/* O_NOFOLLOW: do not follow links to ensure to open the real file */
@@ -152,6 +156,7 @@ int handle_open(struct snapraid_handle* handle, struct snapraid_file* file, int
 {
 	int ret;
 	int flags;
+	char sub_buffer[PATH_MAX];
 
 	if (!out_missing)
 		out_missing = out;
@@ -161,7 +166,7 @@ int handle_open(struct snapraid_handle* handle, struct snapraid_file* file, int
 		return 0;
 	}
 
-	pathprint(handle->path, sizeof(handle->path), "%s%s", handle->disk->dir, file->sub);
+	pathprint(handle->path, sizeof(handle->path), "%s%s", handle->disk->dir, file_sub(file, sub_buffer));
 
 	/* for sure not created */
 	handle->created = 0;
@@ -170,12 +175,27 @@ int handle_open(struct snapraid_handle* handle, struct snapraid_file* file, int
 	/* O_BINARY: open as binary file (Windows only) */
 	/* O_NOFOLLOW: do not follow links to ensure to open the real file */
 	/* O_SEQUENTIAL: improve performance for sequential access (Windows only) */
+	/* O_DIRECT: bypass the OS cache */
 	flags = O_BINARY | O_NOFOLLOW;
 	if ((mode & MODE_SEQUENTIAL) != 0)
 		flags |= O_SEQUENTIAL;
+#ifdef O_DIRECT
+	if ((mode & MODE_DIRECT) != 0)
+		flags |= O_DIRECT;
+#endif
 
 	/* open for read */
 	handle->f = open_noatime(handle->path, flags | O_RDONLY);
+#ifdef O_DIRECT
+	/* if the file-system doesn't support direct I/O, use the OS cache */
+	if (handle->f == -1 && errno == EINVAL && (flags & O_DIRECT) != 0) {
+		flags &= ~O_DIRECT;
+		handle->f = open_noatime(handle->path, flags | O_RDONLY);
+	}
+	handle->direct = (flags & O_DIRECT) != 0;
+#else
+	handle->direct = 0;
+#endif
 	if (handle->f == -1) {
 		/* invalidate for error */
 		handle->file = 0;
@@ -223,13 +243,14 @@ int handle_open(struct snapraid_handle* handle, struct snapraid_file* file, int
 int handle_close(struct snapraid_handle* handle)
 {
 	int ret;
+	char sub_buffer[PATH_MAX];
 
 	/* close if open */
 	if (handle->f != -1) {
 		ret = close(handle->f);
 		if (ret != 0) {
 			/* LCOV_EXCL_START */
-			log_fatal("Error closing file '%s'. %s.\n", handle->file->sub, strerror(errno));
+			log_fatal("Error closing file '%s'. %s.\n", file_sub(handle->file, sub_buffer), strerror(errno));
 
 			/* invalidate for error */
 			handle->file = 0;
@@ -248,12 +269,9 @@ int handle_close(struct snapraid_handle* handle)
 	return 0;
 }
 
-int handle_read(struct snapraid_handle* handle, block_off_t file_pos, unsigned char* block_buffer, unsigned block_size, fptr* out, fptr* out_missing)
+int handle_read_size(struct snapraid_handle* handle, block_off_t file_pos, unsigned block_size, fptr* out, fptr* out_missing)
 {
-	ssize_t read_ret;
 	data_off_t offset;
-	unsigned read_size;
-	unsigned count;
 
 	offset = file_pos * (data_off_t)block_size;
 
@@ -270,14 +288,67 @@ int handle_read(struct snapraid_handle* handle, block_off_t file_pos, unsigned c
 		return -1;
 	}
 
-	read_size = file_block_size(handle->file, file_pos, block_size);
+	return file_block_size(handle->file, file_pos, block_size);
+}
+
+int handle_direct_disable(struct snapraid_handle* handle)
+{
+#if defined(O_DIRECT) && defined(F_SETFL)
+	int flags;
+
+	flags = fcntl(handle->f, F_GETFL);
+	if (flags == -1 || fcntl(handle->f, F_SETFL, flags & ~O_DIRECT) == -1) {
+		/* LCOV_EXCL_START */
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	handle->direct = 0;
+
+	log_tag("io:direct:fallback:%s\n", handle->path);
+
+	return 0;
+#else
+	(void)handle;
+	return -1;
+#endif
+}
+
+int handle_read(struct snapraid_handle* handle, block_off_t file_pos, unsigned char* block_buffer, unsigned block_size, fptr* out, fptr* out_missing)
+{
+	ssize_t read_ret;
+	data_off_t offset;
+	unsigned read_size;
+	unsigned request_size;
+	unsigned count;
+	int ret;
+
+	offset = file_pos * (data_off_t)block_size;
+
+	ret = handle_read_size(handle, file_pos, block_size, out, out_missing);
+	if (ret == -1)
+		return -1;
+	read_size = ret;
+
+	/* in direct mode the size has to be aligned, and the tail of the file */
+	/* is read with a larger request that the kernel truncates at the end of file */
+	if (handle->direct)
+		request_size = direct_size(read_size);
+	else
+		request_size = read_size;
 
 	count = 0;
 	do {
-		read_ret = pread(handle->f, block_buffer + count, read_size - count, offset + count);
+		read_ret = pread(handle->f, block_buffer + count, request_size - count, offset + count);
 		if (read_ret < 0) {
+			/* if the direct read is refused, like after a short read, continue with the OS cache */
+			if (errno == EINVAL && handle->direct && handle_direct_disable(handle) == 0) {
+				request_size = read_size;
+				continue;
+			}
+
 			/* LCOV_EXCL_START */
-			out("Error reading file '%s' at offset %" PRIu64 " for size %u. %s.\n", handle->path, offset + count, read_size - count, strerror(errno));
+			out("Error reading file '%s' at offset %" PRIu64 " for size %u. %s.\n", handle->path, offset + count, request_size - count, strerror(errno));
 			return -1;
 			/* LCOV_EXCL_STOP */
 		}
@@ -343,6 +414,7 @@ int handle_write(struct snapraid_handle* handle, block_off_t file_pos, unsigned
 int handle_utime(struct snapraid_handle* handle)
 {
 	int ret;
+	char sub_buffer[PATH_MAX];
 
 	/* do nothing if not opened */
 	if (handle->f == -1)
@@ -352,7 +424,7 @@ int handle_utime(struct snapraid_handle* handle)
 
 	if (ret != 0) {
 		/* LCOV_EXCL_START */
-		log_fatal("Error timing file '%s'. %s.\n", handle->file->sub, strerror(errno));
+		log_fatal("Error timing file '%s'. %s.\n", file_sub(handle->file, sub_buffer), strerror(errno));
 		return -1;
 		/* LCOV_EXCL_STOP */
 	}
@@ -384,6 +456,7 @@ struct snapraid_handle* handle_mapping(struct snapraid_state* state, unsigned* h
 		handle[j].file = 0;
 		handle[j].f = -1;
 		handle[j].valid_size = 0;
+		handle[j].direct = 0;
 	}
 
 	/* set the vector */
@@ -32,6 +32,7 @@ struct snapraid_handle {
 	struct stat st; /**< Stat info of the opened file. */
 	data_off_t valid_size; /**< Size of the valid data. */
 	int created; /**< If the file was created, otherwise it was already existing. */
+	int direct; /**< If the file is opened in direct mode, bypassing the OS cache. */
 };
 
 /**
@@ -52,6 +53,7 @@ int handle_truncate(struct snapraid_handle* handle, struct snapraid_file* file);
 /**
  * Open a file.
  * The file is opened for reading.
+ * With MODE_DIRECT the file is opened in direct mode, if supported by the file-system.
  */
 int handle_open(struct snapraid_handle* handle, struct snapraid_file* file, int mode, fptr* out, fptr* out_missing);
 
@@ -60,9 +62,25 @@ int handle_open(struct snapraid_handle* handle, struct snapraid_file* file, int
  */
 int handle_close(struct snapraid_handle* handle);
 
+/**
+ * Check if a block of a file can be read, and return the size to read.
+ * It's the first step of handle_read(), used also by the asynchronous reads.
+ * Return -1 on error.
+ */
+int handle_read_size(struct snapraid_handle* handle, block_off_t file_pos, unsigned block_size, fptr* out, fptr* out_missing);
+
+/**
+ * Continue to read the file with the OS cache, if the direct I/O is refused.
+ * Return -1 if the mode of the file cannot be changed.
+ */
+int handle_direct_disable(struct snapraid_handle* handle);
+
 /**
  * Read a block from a file.
  * If the read block is shorter, it's padded with 0.
+ * If the direct read fails with EINVAL, it's retried with handle_direct_disable().
+ * In direct mode the buffer must be allocated with malloc_nofail_direct()
+ * or malloc_nofail_vector_huge(), as the tail of the file is read up to the alignment.
  */
 int handle_read(struct snapraid_handle* handle, block_off_t file_pos, unsigned char* block_buffer, unsigned block_size, fptr* out, fptr* out_missing);
 
@@ -18,6 +18,7 @@
 #include "portable.h"
 
 #include "support.h"
+#include "stream.h"
 #include "import.h"
 
 /****************************************************************************/
@@ -52,24 +53,62 @@ static inline tommy_uint32_t import_block_hash(const unsigned char* hash)
 	return hash[0] | ((uint32_t)hash[1] << 8) | ((uint32_t)hash[2] << 16) | ((uint32_t)hash[3] << 24);
 }
 
-static void import_file(struct snapraid_state* state, const char* path, uint64_t size)
+/**
+ * Set the position of all the blocks of the file.
+ */
+static void import_file_layout(struct snapraid_state* state, struct snapraid_import_file* file)
 {
-	struct snapraid_import_file* file;
-	block_off_t i;
+	data_off_t size = file->size;
 	data_off_t offset;
-	void* buffer;
-	int ret;
-	int f;
-	int flags;
+	block_off_t i;
+	unsigned block_size = state->block_size;
+
+	offset = 0;
+	for (i = 0; i < file->blockmax; ++i) {
+		struct snapraid_import_block* block = &file->blockimp[i];
+		unsigned read_size = block_size;
+		if (read_size > size)
+			read_size = size;
+
+		block->file = file;
+		block->offset = offset;
+		block->size = read_size;
+
+		offset += read_size;
+		size -= read_size;
+	}
+}
+
+static void import_file(struct snapraid_state* state, const char* path, data_off_t size, int64_t mtime_sec, int mtime_nsec, uint64_t device)
+{
+	struct snapraid_import_file* file;
 	unsigned block_size = state->block_size;
 
 	file = malloc_nofail(sizeof(struct snapraid_import_file));
 	file->path = strdup_nofail(path);
 	file->size = size;
+	file->mtime_sec = mtime_sec;
+	file->mtime_nsec = mtime_nsec;
+	file->device = device;
 	file->blockmax = (size + block_size - 1) / block_size;
 	file->blockimp = malloc_nofail(file->blockmax * sizeof(struct snapraid_import_block));
+	file->is_hashed = 0;
 
-	buffer = malloc_nofail(block_size);
+	import_file_layout(state, file);
+
+	tommy_list_insert_tail(&state->importlist, &file->nodelist, file);
+}
+
+/**
+ * Read the file and compute the hash of all its blocks.
+ */
+static void import_file_hash(struct snapraid_state* state, struct snapraid_import_file* file, void* buffer)
+{
+	const char* path = file->path;
+	block_off_t i;
+	int ret;
+	int f;
+	int flags;
 
 	/* open for read */
 	/* O_SEQUENTIAL: opening in sequential mode in Windows */
@@ -97,37 +136,24 @@ static void import_file(struct snapraid_state* state, const char* path, uint64_t
 	}
 #endif
 
-	offset = 0;
 	for (i = 0; i < file->blockmax; ++i) {
 		struct snapraid_import_block* block = &file->blockimp[i];
-		unsigned read_size = block_size;
-		if (read_size > size)
-			read_size = size;
 
-		ret = read(f, buffer, read_size);
-		if (ret < 0 || (unsigned)ret != read_size) {
+		ret = read(f, buffer, block->size);
+		if (ret < 0 || (unsigned)ret != block->size) {
 			/* LCOV_EXCL_START */
 			log_fatal("Error reading file '%s'. %s.\n", path, strerror(errno));
 			exit(EXIT_FAILURE);
 			/* LCOV_EXCL_STOP */
 		}
 
-		block->file = file;
-		block->offset = offset;
-		block->size = read_size;
-
-		memhash(state->hash, state->hashseed, block->hash, buffer, read_size);
-		tommy_hashdyn_insert(&state->importset, &block->nodeset, block, import_block_hash(block->hash));
+		memhash(state->hash, state->hashseed, block->hash, buffer, block->size);
 
 		/* if we are in a rehash state */
 		if (state->prevhash != HASH_UNDEFINED) {
 			/* compute also the previous hash */
-			memhash(state->prevhash, state->prevhashseed, block->prevhash, buffer, read_size);
-			tommy_hashdyn_insert(&state->previmportset, &block->prevnodeset, block, import_block_hash(block->prevhash));
+			memhash(state->prevhash, state->prevhashseed, block->prevhash, buffer, block->size);
 		}
-
-		offset += read_size;
-		size -= read_size;
 	}
 
 	ret = close(f);
@@ -138,9 +164,7 @@ static void import_file(struct snapraid_state* state, const char* path, uint64_t
 		/* LCOV_EXCL_STOP */
 	}
 
-	tommy_list_insert_tail(&state->importlist, &file->nodelist, file);
-
-	free(buffer);
+	file->is_hashed = 1;
 }
 
 void import_file_free(struct snapraid_import_file* file)
@@ -289,7 +313,7 @@ static void import_dir(struct snapraid_state* state, const char* dir)
 #endif
 
 		if (S_ISREG(st.st_mode)) {
-			import_file(state, path_next, st.st_size);
+			import_file(state, path_next, st.st_size, st.st_mtime, STAT_NSEC(&st), st.st_dev);
 		} else if (S_ISDIR(st.st_mode)) {
 			pathslash(path_next, sizeof(path_next));
 			import_dir(state, path_next);
@@ -304,9 +328,449 @@ static void import_dir(struct snapraid_state* state, const char* dir)
 	}
 }
 
-void state_import(struct snapraid_state* state, const char* dir)
+/**
+ * Import worker.
+ * It hashes all the files of a single device.
+ */
+struct snapraid_import_worker {
+	struct snapraid_state* state;
+	uint64_t device; /**< Device of the files. */
+	struct snapraid_import_file** file_map; /**< Files to hash. */
+	unsigned file_mac; /**< Number of files to hash. */
+#if HAVE_PTHREAD
+	pthread_t thread;
+#endif
+};
+
+static void* import_worker(void* void_arg)
+{
+	struct snapraid_import_worker* worker = void_arg;
+	void* buffer;
+	unsigned i;
+
+	buffer = malloc_nofail(worker->state->block_size);
+
+	for (i = 0; i < worker->file_mac; ++i)
+		import_file_hash(worker->state, worker->file_map[i], buffer);
+
+	free(buffer);
+
+	return 0;
+}
+
+/**
+ * Find the worker of the specified device.
+ */
+static struct snapraid_import_worker* import_worker_find(struct snapraid_import_worker* worker_map, unsigned worker_max, uint64_t device)
+{
+	unsigned i;
+
+	for (i = 0; i < worker_max; ++i) {
+		if (worker_map[i].device == device)
+			return &worker_map[i];
+	}
+
+	return 0;
+}
+
+/**
+ * Hash all the files not yet hashed, using one thread for each device.
+ * Files in the same device are read sequentially to avoid seeks.
+ */
+static void import_hash(struct snapraid_state* state)
+{
+	struct snapraid_import_worker* worker_map;
+	struct snapraid_import_file** file_map;
+	unsigned worker_max;
+	unsigned file_max;
+	unsigned file_mac;
+	tommy_node* i;
+	unsigned j;
+
+	/* count the files to hash */
+	file_max = 0;
+	for (i = tommy_list_head(&state->importlist); i != 0; i = i->next) {
+		struct snapraid_import_file* file = i->data;
+		if (!file->is_hashed)
+			++file_max;
+	}
+
+	log_tag("import:hash:%u\n", file_max);
+
+	if (file_max == 0)
+		return;
+
+	file_map = malloc_nofail(file_max * sizeof(struct snapraid_import_file*));
+
+	/* at most one worker for each file */
+	worker_map = malloc_nofail(file_max * sizeof(struct snapraid_import_worker));
+
+	/* count the files of each device */
+	worker_max = 0;
+	for (i = tommy_list_head(&state->importlist); i != 0; i = i->next) {
+		struct snapraid_import_file* file = i->data;
+		struct snapraid_import_worker* worker;
+
+		if (file->is_hashed)
+			continue;
+
+		worker = import_worker_find(worker_map, worker_max, file->device);
+		if (!worker) {
+			worker = &worker_map[worker_max++];
+			worker->state = state;
+			worker->device = file->device;
+			worker->file_mac = 0;
+		}
+
+		++worker->file_mac;
+	}
+
+	/* assign to each worker its part of the file vector */
+	file_mac = 0;
+	for (j = 0; j < worker_max; ++j) {
+		worker_map[j].file_map = file_map + file_mac;
+		file_mac += worker_map[j].file_mac;
+		worker_map[j].file_mac = 0;
+	}
+
+	/* fill the files, keeping the directory order */
+	for (i = tommy_list_head(&state->importlist); i != 0; i = i->next) {
+		struct snapraid_import_file* file = i->data;
+		struct snapraid_import_worker* worker;
+
+		if (file->is_hashed)
+			continue;
+
+		worker = import_worker_find(worker_map, worker_max, file->device);
+
+		worker->file_map[worker->file_mac++] = file;
+	}
+
+	log_tag("import:thread:%u\n", worker_max);
+
+#if HAVE_PTHREAD
+	for (j = 0; j < worker_max; ++j)
+		thread_create(&worker_map[j].thread, 0, import_worker, &worker_map[j]);
+
+	for (j = 0; j < worker_max; ++j) {
+		void* retval;
+
+		thread_join(worker_map[j].thread, &retval);
+	}
+#else
+	for (j = 0; j < worker_max; ++j)
+		import_worker(&worker_map[j]);
+#endif
+
+	free(worker_map);
+	free(file_map);
+}
+
+/**
+ * Insert all the blocks in the hashtables used to search them.
+ */
+static void import_insert(struct snapraid_state* state)
+{
+	tommy_node* i;
+
+	for (i = tommy_list_head(&state->importlist); i != 0; i = i->next) {
+		struct snapraid_import_file* file = i->data;
+		block_off_t j;
+
+		for (j = 0; j < file->blockmax; ++j) {
+			struct snapraid_import_block* block = &file->blockimp[j];
+
+			tommy_hashdyn_insert(&state->importset, &block->nodeset, block, import_block_hash(block->hash));
+
+			/* if we are in a rehash state */
+			if (state->prevhash != HASH_UNDEFINED)
+				tommy_hashdyn_insert(&state->previmportset, &block->prevnodeset, block, import_block_hash(block->prevhash));
+		}
+	}
+}
+
+/****************************************************************************/
+/* import cache */
+
+/**
+ * Signature of the import cache file.
+ */
+#define IMPORT_CACHE_MAGIC "SNAPIMP1"
+#define IMPORT_CACHE_MAGIC_SIZE 8
+
+/**
+ * Compare an import file with a path.
+ */
+static int import_file_path_compare(const void* void_arg, const void* void_data)
+{
+	const char* arg = void_arg;
+	const struct snapraid_import_file* file = void_data;
+
+	return strcmp(arg, file->path);
+}
+
+/**
+ * Read the hashes of a file from the cache.
+ * Return -1 on error.
+ */
+static int import_cache_read_hash(struct snapraid_state* state, STREAM* f, struct snapraid_import_file* file, block_off_t blockmax)
+{
+	unsigned char hash[HASH_MAX];
+	block_off_t i;
+
+	for (i = 0; i < blockmax; ++i) {
+		unsigned char* ptr = file ? file->blockimp[i].hash : hash;
+
+		if (sread(f, ptr, HASH_MAX) != 0)
+			return -1;
+
+		if (state->prevhash != HASH_UNDEFINED) {
+			ptr = file ? file->blockimp[i].prevhash : hash;
+
+			if (sread(f, ptr, HASH_MAX) != 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Load the hashes of the files not changed from the cache.
+ * Return the number of files loaded.
+ */
+static unsigned import_cache_load(struct snapraid_state* state, const char* cache)
+{
+	tommy_hashdyn pathset;
+	STREAM* f;
+	tommy_node* i;
+	char magic[IMPORT_CACHE_MAGIC_SIZE];
+	unsigned char seed[HASH_MAX];
+	char path[PATH_MAX];
+	uint32_t value;
+	uint32_t hash;
+	uint32_t prevhash;
+	uint32_t count;
+	uint32_t crc_computed;
+	uint32_t crc_stored;
+	unsigned loaded;
+	int seed_is_matching;
+
+	f = sopen_read(cache);
+	if (!f) {
+		if (errno == ENOENT) {
+			log_tag("import:cache:missing\n");
+			return 0;
+		}
+
+		/* LCOV_EXCL_START */
+		log_error("Error opening the import cache '%s'. %s.\n", cache, strerror(errno));
+		return 0;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* index the files by path */
+	tommy_hashdyn_init(&pathset);
+	for (i = tommy_list_head(&state->importlist); i != 0; i = i->next) {
+		struct snapraid_import_file* file = i->data;
+		tommy_hashdyn_insert(&pathset, &file->nodeset, file, file_path_hash(file->path));
+	}
+
+	loaded = 0;
+
+	/* the hashes are valid only with the same block size, hash kinds and seeds */
+	if (sread(f, magic, IMPORT_CACHE_MAGIC_SIZE) != 0
+		|| memcmp(magic, IMPORT_CACHE_MAGIC, IMPORT_CACHE_MAGIC_SIZE) != 0
+		|| sgetb32(f, &value) != 0
+		|| value != state->block_size
+		|| sgetb32(f, &hash) != 0
+		|| sread(f, seed, HASH_MAX) != 0
+	) {
+		goto invalid;
+	}
+
+	seed_is_matching = hash == state->hash && memcmp(seed, state->hashseed, HASH_MAX) == 0;
+
+	if (sgetb32(f, &prevhash) != 0
+		|| sread(f, seed, HASH_MAX) != 0
+	) {
+		goto invalid;
+	}
+
+	if (prevhash != state->prevhash
+		|| (prevhash != HASH_UNDEFINED && memcmp(seed, state->prevhashseed, HASH_MAX) != 0)
+	) {
+		seed_is_matching = 0;
+	}
+
+	if (!seed_is_matching)
+		goto invalid;
+
+	if (sgetb32(f, &count) != 0)
+		goto invalid;
+
+	while (count > 0) {
+		struct snapraid_import_file* file;
+		uint64_t size;
+		uint64_t mtime_sec;
+		uint32_t mtime_nsec;
+		block_off_t blockmax;
+
+		if (sgetbs(f, path, sizeof(path)) != 0
+			|| sgetb64(f, &size) != 0
+			|| sgetb64(f, &mtime_sec) != 0
+			|| sgetb32(f, &mtime_nsec) != 0
+		) {
+			goto invalid;
+		}
+
+		blockmax = (size + state->block_size - 1) / state->block_size;
+
+		/* use the cached hashes only if the file is not changed */
+		file = tommy_hashdyn_search(&pathset, import_file_path_compare, path, file_path_hash(path));
+		if (file != 0
+			&& (file->is_hashed
+			|| (uint64_t)file->size != size
+			|| (uint64_t)file->mtime_sec != mtime_sec
+			|| file->mtime_nsec != (int)mtime_nsec)
+		) {
+			file = 0;
+		}
+
+		if (import_cache_read_hash(state, f, file, blockmax) != 0)
+			goto invalid;
+
+		if (file) {
+			file->is_hashed = 1;
+			++loaded;
+		}
+
+		--count;
+	}
+
+	/* get the computed crc before reading the stored one */
+	crc_computed = scrc(f);
+
+	if (sgetble32(f, &crc_stored) != 0 || crc_stored != crc_computed)
+		goto invalid;
+
+	tommy_hashdyn_done(&pathset);
+	sclose(f);
+
+	log_tag("import:cache_hit:%u\n", loaded);
+
+	return loaded;
+
+invalid:
+	/* discard anything loaded */
+	for (i = tommy_list_head(&state->importlist); i != 0; i = i->next) {
+		struct snapraid_import_file* file = i->data;
+		file->is_hashed = 0;
+	}
+
+	tommy_hashdyn_done(&pathset);
+	sclose(f);
+
+	log_tag("import:cache:invalid\n");
+	msg_verbose("Ignoring the invalid import cache '%s'.\n", cache);
+
+	return 0;
+}
+
+/**
+ * Save the hashes of all the files in the cache.
+ */
+static void import_cache_save(struct snapraid_state* state, const char* cache)
+{
+	char tmp[PATH_MAX];
+	STREAM* f;
+	tommy_node* i;
+	uint32_t crc;
+
+	pathprint(tmp, sizeof(tmp), "%s.tmp", cache);
+
+	f = sopen_write(tmp);
+	if (!f) {
+		/* LCOV_EXCL_START */
+		log_error("Error creating the import cache '%s'. %s.\n", tmp, strerror(errno));
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	swrite(IMPORT_CACHE_MAGIC, IMPORT_CACHE_MAGIC_SIZE, f);
+	sputb32(state->block_size, f);
+	sputb32(state->hash, f);
+	swrite(state->hashseed, HASH_MAX, f);
+	sputb32(state->prevhash, f);
+	swrite(state->prevhashseed, HASH_MAX, f);
+	sputb32(tommy_list_count(&state->importlist), f);
+
+	for (i = tommy_list_head(&state->importlist); i != 0; i = i->next) {
+		struct snapraid_import_file* file = i->data;
+		block_off_t j;
+
+		sputbs(file->path, f);
+		sputb64(file->size, f);
+		sputb64(file->mtime_sec, f);
+		sputb32(file->mtime_nsec, f);
+
+		for (j = 0; j < file->blockmax; ++j) {
+			swrite(file->blockimp[j].hash, HASH_MAX, f);
+			if (state->prevhash != HASH_UNDEFINED)
+				swrite(file->blockimp[j].prevhash, HASH_MAX, f);
+		}
+	}
+
+	/* flush data written to the disk */
+	if (sflush(f) != 0) {
+		/* LCOV_EXCL_START */
+		goto bail;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* get the file crc */
+	crc = scrc(f);
+
+	sputble32(crc, f);
+	if (serror(f)) {
+		/* LCOV_EXCL_START */
+		goto bail;
+		/* LCOV_EXCL_STOP */
+	}
+
+	if (sclose(f) != 0) {
+		/* LCOV_EXCL_START */
+		log_error("Error closing the import cache '%s'. %s.\n", tmp, strerror(errno));
+		remove(tmp);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	if (rename(tmp, cache) != 0) {
+		/* LCOV_EXCL_START */
+		log_error("Error renaming the import cache '%s' to '%s'. %s.\n", tmp, cache, strerror(errno));
+		remove(tmp);
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	return;
+
+bail:
+	/* LCOV_EXCL_START */
+	log_error("Error writing the import cache '%s'. %s.\n", tmp, strerror(errno));
+	sclose(f);
+	remove(tmp);
+	/* LCOV_EXCL_STOP */
+}
+
+/****************************************************************************/
+/* import */
+
+void state_import(struct snapraid_state* state, const char* dir, const char* cache)
 {
 	char path[PATH_MAX];
+	unsigned loaded;
 
 	msg_progress("Importing...\n");
 
@@ -322,6 +786,20 @@ void state_import(struct snapraid_state* state, const char* dir)
 	pathimport(path, sizeof(path), dir);
 	pathslash(path, sizeof(path));
 
+	/* list all the files */
 	import_dir(state, path);
-}
 
+	/* get the hashes of the files not changed from the cache */
+	loaded = 0;
+	if (cache)
+		loaded = import_cache_load(state, cache);
+
+	/* hash all the other files concurrently */
+	import_hash(state);
+
+	import_insert(state);
+
+	/* update the cache if something changed */
+	if (cache && loaded != tommy_list_count(&state->importlist))
+		import_cache_save(state, cache);
+}
@@ -46,12 +46,17 @@ struct snapraid_import_block {
  */
 struct snapraid_import_file {
 	data_off_t size; /**< Size of the file. */
+	int64_t mtime_sec; /**< Modification time. */
+	int mtime_nsec; /**< Modification time nanoseconds. */
+	uint64_t device; /**< Device of the file. Files in the same device are hashed by the same thread. */
 	struct snapraid_import_block* blockimp; /**< All the blocks of the file. */
 	block_off_t blockmax; /**< Number of blocks. */
 	char* path; /**< Full path of the file. */
+	int is_hashed; /**< If the hashes of the blocks are computed, or loaded from the cache. */
 
 	/* nodes for data structures */
 	tommy_node nodelist;
+	tommy_hashdyn_node nodeset;
 };
 
 /**
@@ -67,8 +72,12 @@ int state_import_fetch(struct snapraid_state* state, int prevhash, struct snapra
 
 /**
  * Import files from the specified directory.
+ * The files are hashed concurrently, using one thread for each device.
+ * \param cache File where to keep the hashes of the imported files, or 0 for none.
+ * The hashes of the files with the same path, size and time are loaded from it,
+ * instead of being computed again.
  */
-void state_import(struct snapraid_state* state, const char* dir);
+void state_import(struct snapraid_state* state, const char* dir, const char* cache);
 
 #endif
 
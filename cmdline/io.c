@@ -60,13 +60,21 @@ static void io_reader_sched(struct snapraid_io* io, int task_index, block_off_t
 			task->disk = worker->handle->disk;
 		else
 			task->disk = 0;
-		task->buffer = io->buffer_map[task_index][worker->buffer_skew + i];
+		/* with the pool, the buffer is taken by the reader when starting the task */
+		if (io->pool_max != 0)
+			task->buffer = 0;
+		else
+			task->buffer = io->buffer_map[task_index][worker->buffer_skew + i];
 		task->position = blockcur;
 		task->block = 0;
 		task->file = 0;
 		task->file_pos = 0;
 		task->read_size = 0;
 		task->is_timestamp_different = 0;
+		task->is_larger = 0;
+		task->is_created = 0;
+		task->is_missing = 0;
+		task->ahead_file = 0;
 	}
 }
 
@@ -92,6 +100,10 @@ static void io_writer_sched(struct snapraid_io* io, int task_index, block_off_t
 		task->file_pos = 0;
 		task->read_size = 0;
 		task->is_timestamp_different = 0;
+		task->is_larger = 0;
+		task->is_created = 0;
+		task->is_missing = 0;
+		task->ahead_written = 0;
 	}
 }
 
@@ -117,6 +129,10 @@ static void io_writer_sched_empty(struct snapraid_io* io, int task_index, block_
 		task->file_pos = 0;
 		task->read_size = 0;
 		task->is_timestamp_different = 0;
+		task->is_larger = 0;
+		task->is_created = 0;
+		task->is_missing = 0;
+		task->ahead_written = 0;
 	}
 }
 
@@ -264,6 +280,194 @@ static void io_stop_mono(struct snapraid_io* io)
 /* disable multithread if pthread is not present */
 #if HAVE_PTHREAD
 
+/**
+ * Atomic access to the state shared between the io and the workers.
+ *
+ * The sequential consistency ensures that a thread that sets its waiting
+ * flag, and then checks the ring, cannot miss the update of another
+ * thread that changes the ring, and then checks the waiting flag.
+ */
+#define io_atomic_load(ptr) __atomic_load_n(ptr, __ATOMIC_SEQ_CST)
+#define io_atomic_store(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST)
+#define io_atomic_inc(ptr) __atomic_add_fetch(ptr, 1, __ATOMIC_SEQ_CST)
+#define io_atomic_exchange(ptr, value) __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST)
+
+/**
+ * If the reader has a buffer for the task, or a free one to use.
+ */
+static int io_reader_has_buffer(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	if (task->buffer != 0)
+		return 1;
+
+	return worker->free_tail != io_atomic_load(&worker->free_head);
+}
+
+/**
+ * Take a free buffer for the task of the reader, if it has none.
+ *
+ * The buffer is also stored in the IO slot of the task, where the caller
+ * gets it after the task is completed.
+ *
+ * Return 0 if no buffer is free.
+ */
+static int io_reader_take_buffer(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	struct snapraid_io* io = worker->io;
+	unsigned i = worker - io->reader_map;
+	unsigned tail = worker->free_tail;
+
+	if (task->buffer != 0)
+		return 1;
+
+	if (tail == io_atomic_load(&worker->free_head))
+		return 0;
+
+	task->buffer = worker->free_map[tail % IO_MAX];
+
+	/* the buffer is published to the IO with the completion of the task */
+	io->buffer_map[task - worker->task_map][worker->buffer_skew + i] = task->buffer;
+
+	worker->free_tail = tail + 1;
+
+	return 1;
+}
+
+/**
+ * Give a buffer to the reader.
+ */
+static void io_reader_give_buffer(struct snapraid_worker* worker, void* buffer)
+{
+	unsigned head = worker->free_head;
+
+	worker->free_map[head % IO_MAX] = buffer;
+
+	/* this also publishes the buffer to the worker */
+	io_atomic_store(&worker->free_head, head + 1);
+}
+
+/**
+ * Account the time spent by the reader to complete the task.
+ */
+static void io_reader_account(struct snapraid_worker* worker)
+{
+	uint64_t elapsed = tick() - worker->tick_start;
+	uint64_t latency = worker->latency;
+
+	/* moving average of the latest tasks */
+	if (latency == 0)
+		latency = elapsed;
+	else
+		latency = (latency * 7 + elapsed) / 8;
+
+	io_atomic_store(&worker->latency, latency);
+}
+
+/**
+ * If the reader has a new task, or it has to exit.
+ */
+static int io_reader_ready(struct snapraid_worker* worker)
+{
+	struct snapraid_io* io = worker->io;
+	unsigned next_index;
+
+	if (io_atomic_load(&io->done))
+		return 1;
+
+	next_index = (worker->index + 1) % io->io_max;
+
+	if (next_index == io_atomic_load(&io->reader_index))
+		return 0;
+
+	/* the new task cannot start without a buffer */
+	return io_reader_has_buffer(worker, &worker->task_map[next_index]);
+}
+
+/**
+ * If the writer has a new task, or it has to exit.
+ */
+static int io_writer_ready(struct snapraid_worker* worker)
+{
+	struct snapraid_io* io = worker->io;
+
+	if (io_atomic_load(&io->done))
+		return 1;
+
+	return (worker->index + 1) % io->io_max != io_atomic_load(&io->writer_index);
+}
+
+/**
+ * Wait for a new task for the worker.
+ */
+static void io_worker_wait(struct snapraid_worker* worker, int (*ready)(struct snapraid_worker*))
+{
+	thread_mutex_lock(&worker->mutex);
+
+	/* set the flag before checking again */
+	io_atomic_store(&worker->waiting, 1);
+
+	while (!ready(worker))
+		thread_cond_wait(&worker->cond, &worker->mutex);
+
+	io_atomic_store(&worker->waiting, 0);
+
+	thread_mutex_unlock(&worker->mutex);
+}
+
+/**
+ * Wake up the worker, if it's waiting for a new task.
+ */
+static void io_worker_wakeup(struct snapraid_worker* worker)
+{
+	if (!io_atomic_load(&worker->waiting))
+		return;
+
+	thread_mutex_lock(&worker->mutex);
+
+	thread_cond_signal_and_unlock(&worker->cond, &worker->mutex);
+}
+
+/**
+ * Notify the IO that a task is completed, if it's waiting for it.
+ */
+static void io_done_notify(struct snapraid_io* io, int* waiting, pthread_cond_t* cond, unsigned done_index, unsigned* waiting_index, unsigned waiting_skew)
+{
+	/* the IO changes the index only when not waiting */
+	if (!io_atomic_load(waiting))
+		return;
+
+	/* if the just completed task is not at the waiting index */
+	if (done_index != (io_atomic_load(waiting_index) + waiting_skew) % io->io_max)
+		return;
+
+	thread_mutex_lock(&io->io_mutex);
+
+	thread_cond_signal_and_unlock(cond, &io->io_mutex);
+}
+
+/**
+ * Start to wait for the workers.
+ *
+ * After setting the flag, the IO has to check again the workers
+ * before really waiting.
+ */
+static void io_wait_begin(struct snapraid_io* io, int* waiting)
+{
+	thread_mutex_lock(&io->io_mutex);
+
+	io_atomic_store(waiting, 1);
+}
+
+/**
+ * End to wait for the workers.
+ */
+static void io_wait_end(struct snapraid_io* io, int* waiting)
+{
+	io_atomic_store(waiting, 0);
+
+	thread_mutex_unlock(&io->io_mutex);
+}
+
 /**
  * Get the next task to work on for a reader.
  *
@@ -273,50 +477,41 @@ static struct snapraid_task* io_reader_step(struct snapraid_worker* worker)
 {
 	struct snapraid_io* io = worker->io;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
-
 	while (1) {
 		unsigned next_index;
 
 		/* check if the worker has to exit */
 		/* even if there is work to do */
-		if (io->done) {
-			thread_mutex_unlock(&io->io_mutex);
+		if (io_atomic_load(&io->done))
 			return 0;
-		}
 
 		/* get the next pending task */
 		next_index = (worker->index + 1) % io->io_max;
 
-		/* if the queue of pending tasks is not empty */
-		if (next_index != io->reader_index) {
-			struct snapraid_task* task;
-
-			/* the index that the IO may be waiting for */
-			unsigned waiting_index = io->reader_index;
-
+		/* if the ring of pending tasks is not empty, and there is a buffer for the task */
+		/* note that the worker keeps the completed task until the next one can start */
+		/* and this doesn't deadlock because the IO returns the buffers before waiting */
+		if (next_index != io_atomic_load(&io->reader_index) && io_reader_has_buffer(worker, &worker->task_map[next_index])) {
 			/* the index that worker just completed */
 			unsigned done_index = worker->index;
+			struct snapraid_task* task = &worker->task_map[next_index];
+
+			/* the buffer is published to the IO with the completion of the new task */
+			io_reader_take_buffer(worker, task);
 
 			/* get the new working task */
-			worker->index = next_index;
-			task = &worker->task_map[worker->index];
-
-			/* if the just completed task is at this index */
-			if (done_index == waiting_index) {
-				/* notify the IO that a new read is complete */
-				thread_cond_signal_and_unlock(&io->read_done, &io->io_mutex);
-			} else {
-				thread_mutex_unlock(&io->io_mutex);
-			}
+			/* this also publishes the completion of the previous one */
+			io_atomic_store(&worker->index, next_index);
+
+			/* notify the IO if it's waiting for this read */
+			io_done_notify(io, &io->read_waiting, &io->read_done, done_index, &io->reader_index, 0);
 
 			/* return the new task */
 			return task;
 		}
 
-		/* otherwise wait for a read_sched event */
-		thread_cond_wait(&io->read_sched, &io->io_mutex);
+		/* otherwise wait for a new task */
+		io_worker_wait(worker, io_reader_ready);
 	}
 }
 
@@ -330,13 +525,11 @@ static struct snapraid_task* io_writer_step(struct snapraid_worker* worker, int
 	struct snapraid_io* io = worker->io;
 	int error_index;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
-
 	/* counts the number of errors in the global state */
+	/* before publishing the completion of the task */
 	error_index = state - IO_WRITER_ERROR_BASE;
 	if (error_index >= 0 && error_index < IO_WRITER_ERROR_MAX)
-		++io->writer_error[error_index];
+		io_atomic_inc(&io->writer_error[error_index]);
 
 	while (1) {
 		unsigned next_index;
@@ -344,44 +537,190 @@ static struct snapraid_task* io_writer_step(struct snapraid_worker* worker, int
 		/* get the next pending task */
 		next_index = (worker->index + 1) % io->io_max;
 
-		/* if the queue of pending tasks is not empty */
-		if (next_index != io->writer_index) {
-			struct snapraid_task* task;
-
-			/* the index that the IO may be waiting for */
-			unsigned waiting_index = (io->writer_index + 1) % io->io_max;
-
+		/* if the ring of pending tasks is not empty */
+		if (next_index != io_atomic_load(&io->writer_index)) {
 			/* the index that worker just completed */
 			unsigned done_index = worker->index;
 
 			/* get the new working task */
-			worker->index = next_index;
-			task = &worker->task_map[worker->index];
-
-			/* if the just completed task is at this index */
-			if (done_index == waiting_index) {
-				/* notify the IO that a new write is complete */
-				thread_cond_signal_and_unlock(&io->write_done, &io->io_mutex);
-			} else {
-				thread_mutex_unlock(&io->io_mutex);
-			}
+			/* this also publishes the completion of the previous one */
+			io_atomic_store(&worker->index, next_index);
+
+			/* notify the IO if it's waiting for this write */
+			io_done_notify(io, &io->write_waiting, &io->write_done, done_index, &io->writer_index, io->io_max - io->buffer_static_count + 1);
 
 			/* return the new task */
-			return task;
+			return &worker->task_map[next_index];
 		}
 
 		/* check if the worker has to exit */
 		/* but only if there is no work to do */
-		if (io->done) {
-			thread_mutex_unlock(&io->io_mutex);
+		if (io_atomic_load(&io->done))
 			return 0;
+
+		/* otherwise wait for a new task */
+		io_worker_wait(worker, io_writer_ready);
+	}
+}
+
+/**
+ * Adapt the read-ahead depth of the readers.
+ *
+ * The buffers of the pool are distributed proportionally at the time
+ * each reader takes to complete a task, to give a deeper read-ahead
+ * to the slower disks.
+ *
+ * It's done only if some reader was found without a block ready for
+ * the caller, as otherwise the current distribution is already enough.
+ */
+static void io_reader_adapt(struct snapraid_io* io)
+{
+	uint64_t latency_sum;
+	unsigned latency_count;
+	unsigned starving;
+	unsigned left;
+	unsigned i;
+
+	latency_sum = 0;
+	latency_count = 0;
+	starving = 0;
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
+		uint64_t latency = io_atomic_load(&worker->latency);
+
+		if (latency != 0) {
+			latency_sum += latency;
+			++latency_count;
+		}
+
+		starving += worker->starving;
+		worker->starving = 0;
+	}
+
+	if (starving == 0 || latency_count == 0)
+		return;
+
+	/* the readers without a measure yet are considered average */
+	latency_sum += (latency_sum / latency_count) * (io->reader_max - latency_count);
+
+	/* every reader has at least the minimum */
+	left = io->pool_max - io->reader_max * IO_DEPTH_MIN;
+	for (i = 0; i < io->reader_max; ++i)
+		io->reader_map[i].buffer_depth = IO_DEPTH_MIN;
+
+	/* distribute the rest proportionally at the latency */
+	if (latency_sum != 0) {
+		unsigned given = 0;
+
+		for (i = 0; i < io->reader_max; ++i) {
+			struct snapraid_worker* worker = &io->reader_map[i];
+			uint64_t latency = io_atomic_load(&worker->latency);
+			uint64_t extra;
+
+			if (latency == 0)
+				latency = latency_sum / io->reader_max;
+
+			extra = left * latency / latency_sum;
+			if (extra > io->io_max - IO_DEPTH_MIN)
+				extra = io->io_max - IO_DEPTH_MIN;
+
+			worker->buffer_depth += extra;
+			given += extra;
+		}
+
+		left -= given;
+	}
+
+	/* distribute the rounding remainder, up to the max depth */
+	while (left != 0) {
+		unsigned prev_left = left;
+
+		for (i = 0; i < io->reader_max && left != 0; ++i) {
+			struct snapraid_worker* worker = &io->reader_map[i];
+
+			if (worker->buffer_depth < io->io_max) {
+				++worker->buffer_depth;
+				--left;
+			}
+		}
+
+		/* LCOV_EXCL_START */
+		if (left == prev_left)
+			break;
+		/* LCOV_EXCL_STOP */
+	}
+}
+
+/**
+ * Return the buffers of the readers in the IO slot.
+ *
+ * The buffers go back to their reader, or to a reader that needs
+ * more buffers to reach its read-ahead depth.
+ */
+static void io_reader_release(struct snapraid_io* io, unsigned slot)
+{
+	unsigned i, j;
+
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
+		unsigned k = worker->buffer_skew + i;
+		void* buffer = io->buffer_map[slot][k];
+
+		/* the slot may be not yet used */
+		if (buffer == 0)
+			continue;
+
+		io->buffer_map[slot][k] = 0;
+
+		/* if the reader has more buffers than its depth, move it to another one */
+		if (worker->buffer_owned > worker->buffer_depth) {
+			for (j = 0; j < io->reader_max; ++j) {
+				struct snapraid_worker* other = &io->reader_map[j];
+
+				if (other->buffer_owned < other->buffer_depth) {
+					--worker->buffer_owned;
+					++other->buffer_owned;
+					worker = other;
+					break;
+				}
+			}
 		}
 
-		/* otherwise wait for a write_sched event */
-		thread_cond_wait(&io->write_sched, &io->io_mutex);
+		io_reader_give_buffer(worker, buffer);
+	}
+}
+
+/**
+ * Assign the next set of buffers not used by readers at the IO slot.
+ *
+ * The writers already completed the previous use of the set,
+ * as io_parity_write() waits for them.
+ */
+static void io_static_assign(struct snapraid_io* io, unsigned slot)
+{
+	void** set = io->buffer_static_map[io->buffer_static_next];
+	unsigned j, k;
+
+	io->buffer_static_next = (io->buffer_static_next + 1) % io->buffer_static_count;
+
+	for (j = 0, k = 0; j < io->buffer_max; ++j) {
+		if (!io->buffer_reader[j])
+			io->buffer_map[slot][j] = set[k++];
 	}
 }
 
+/**
+ * Index of the write that the IO waits for, before reusing the next set of static buffers.
+ *
+ * The IO is at the write ::writer_index, and its next set was used ::buffer_static_count writes before.
+ * A worker at the index returned is still using it, as the index is of the task in progress, or
+ * of the latest one completed.
+ */
+static unsigned io_static_busy(struct snapraid_io* io, unsigned writer_index)
+{
+	return (writer_index + io->io_max - io->buffer_static_count + 1) % io->io_max;
+}
+
 /**
  * Get the next block position to operate on.
  *
@@ -403,23 +742,42 @@ static block_off_t io_read_next_thread(struct snapraid_io* io, void*** buffer)
 	for (i = 0; i <= io->reader_max; ++i)
 		io->reader_list[i] = i;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
+	/* periodically adapt the read-ahead of the readers */
+	if (--io->adapt_countdown == 0) {
+		io->adapt_countdown = io->io_max;
+		io_reader_adapt(io);
+	}
+
+	/* the caller is done with the buffers of the readers */
+	/* this is done before waiting for any reader, as they may need the buffers */
+	io_reader_release(io, io->reader_index);
 
 	/* schedule the next read */
+	/* no worker is using this index, as all of them completed it */
 	io_reader_sched(io, io->reader_index, blockcur_schedule);
 
 	/* set the index for the tasks to return to the caller */
-	io->reader_index = (io->reader_index + 1) % io->io_max;
+	/* this also publishes the new pending task in all the rings */
+	io_atomic_store(&io->reader_index, (io->reader_index + 1) % io->io_max);
+
+	/* count the readers that don't have the block ready for the caller */
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
+
+		if (io_atomic_load(&worker->index) == io->reader_index)
+			++worker->starving;
+	}
 
 	/* get the position to operate at high level from one task */
 	blockcur_caller = io->reader_map[0].task_map[io->reader_index].position;
 
 	/* set the buffer to use */
+	io_static_assign(io, io->reader_index);
 	*buffer = io->buffer_map[io->reader_index];
 
-	/* signal all the workers that there is a new pending task */
-	thread_cond_broadcast_and_unlock(&io->read_sched, &io->io_mutex);
+	/* wake up only the workers waiting for a new task */
+	for (i = 0; i < io->reader_max; ++i)
+		io_worker_wakeup(&io->reader_map[i]);
 
 	return blockcur_caller;
 }
@@ -442,14 +800,9 @@ static void io_write_next_thread(struct snapraid_io* io, block_off_t blockcur, i
 	for (i = 0; i <= io->writer_max; ++i)
 		io->writer_list[i] = i;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
-
 	/* report errors */
-	for (i = 0; i < IO_WRITER_ERROR_MAX; ++i) {
-		writer_error[i] = io->writer_error[i];
-		io->writer_error[i] = 0;
-	}
+	for (i = 0; i < IO_WRITER_ERROR_MAX; ++i)
+		writer_error[i] = io_atomic_exchange(&io->writer_error[i], 0);
 
 	if (skip) {
 		/* skip the next write */
@@ -463,19 +816,18 @@ static void io_write_next_thread(struct snapraid_io* io, block_off_t blockcur, i
 	assert(io->writer_index == io->reader_index);
 
 	/* set the index to be used for the next write */
-	io->writer_index = (io->writer_index + 1) % io->io_max;
+	/* this also publishes the new pending task in all the rings */
+	io_atomic_store(&io->writer_index, (io->writer_index + 1) % io->io_max);
 
-	/* signal all the workers that there is a new pending task */
-	thread_cond_broadcast_and_unlock(&io->write_sched, &io->io_mutex);
+	/* wake up only the workers waiting for a new task */
+	for (i = 0; i < io->writer_max; ++i)
+		io_worker_wakeup(&io->writer_map[i]);
 }
 
 static void io_refresh_thread(struct snapraid_io* io)
 {
 	unsigned i;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
-
 	/* for all readers, count the number of read blocks */
 	for (i = 0; i < io->reader_max; ++i) {
 		unsigned begin, end, cached;
@@ -484,7 +836,7 @@ static void io_refresh_thread(struct snapraid_io* io)
 		/* the first block read */
 		begin = io->reader_index + 1;
 		/* the block in reading */
-		end = worker->index;
+		end = io_atomic_load(&worker->index);
 		if (begin > end)
 			end += io->io_max;
 		cached = end - begin;
@@ -504,30 +856,29 @@ static void io_refresh_thread(struct snapraid_io* io)
 		/* the first block written */
 		begin = io->writer_index + 1;
 		/* the block in writing */
-		end = worker->index;
+		end = io_atomic_load(&worker->index);
 		if (begin > end)
 			end += io->io_max;
 		cached = end - begin;
 
 		io->state->parity[worker->parity_handle->level].cached = cached;
 	}
-
-	thread_mutex_unlock(&io->io_mutex);
 }
 
 static struct snapraid_task* io_task_read_thread(struct snapraid_io* io, unsigned base, unsigned count, unsigned* pos, unsigned* waiting_map, unsigned* waiting_mac)
 {
 	unsigned waiting_cycle;
+	int waiting;
 
 	/* count the waiting cycle */
 	waiting_cycle = 0;
 
+	/* not yet waiting */
+	waiting = 0;
+
 	/* clear the waiting indexes */
 	*waiting_mac = 0;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
-
 	while (1) {
 		unsigned char* let;
 		unsigned busy_index;
@@ -559,12 +910,13 @@ static struct snapraid_task* io_task_read_thread(struct snapraid_io* io, unsigne
 				worker = &io->reader_map[i];
 
 				/* if the worker has finished this index */
-				if (busy_index != worker->index) {
+				if (busy_index != io_atomic_load(&worker->index)) {
 					struct snapraid_task* task;
 
 					task = &worker->task_map[io->reader_index];
 
-					thread_mutex_unlock(&io->io_mutex);
+					if (waiting)
+						io_wait_end(io, &io->read_waiting);
 
 					/* mark the worker as processed */
 					/* setting the previous one to point at the next one */
@@ -586,7 +938,13 @@ static struct snapraid_task* io_task_read_thread(struct snapraid_io* io, unsigne
 		}
 
 		/* if no worker is ready, wait for an event */
-		thread_cond_wait(&io->read_done, &io->io_mutex);
+		if (!waiting) {
+			/* set the flag, and check again before really waiting */
+			io_wait_begin(io, &io->read_waiting);
+			waiting = 1;
+		} else {
+			thread_cond_wait(&io->read_done, &io->io_mutex);
+		}
 
 		/* count the cycles */
 		++waiting_cycle;
@@ -606,32 +964,34 @@ static struct snapraid_task* io_parity_read_thread(struct snapraid_io* io, unsig
 static void io_parity_write_thread(struct snapraid_io* io, unsigned* pos, unsigned* waiting_map, unsigned* waiting_mac)
 {
 	unsigned waiting_cycle;
+	int waiting;
 
 	/* count the waiting cycle */
 	waiting_cycle = 0;
 
+	/* not yet waiting */
+	waiting = 0;
+
 	/* clear the waiting indexes */
 	*waiting_mac = 0;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
-
 	while (1) {
 		unsigned char* let;
 		unsigned busy_index;
 
-		/* get the next index the IO is going to use */
+		/* get the index of the write using the set of buffers the IO is going to use next */
 		/* we must ensure that this index has not a write in progress */
 		/* to avoid a concurrent access */
 		/* note that we are already sure that a write is not in progress */
-		/* at the index the IO is using at now */
-		busy_index = (io->writer_index + 1) % io->io_max;
+		/* with the set the IO is using at now */
+		busy_index = io_static_busy(io, io->writer_index);
 
 		/* search for a worker that has already finished */
 		let = &io->writer_list[0];
 		while (1) {
 			unsigned i = *let;
 			struct snapraid_worker* worker;
+			unsigned worker_index;
 
 			/* if we are at the end */
 			if (i == io->writer_max)
@@ -644,13 +1004,15 @@ static void io_parity_write_thread(struct snapraid_io* io, unsigned* pos, unsign
 			}
 
 			worker = &io->writer_map[i];
+			worker_index = io_atomic_load(&worker->index);
 
 			/* the two indexes cannot be equal */
-			assert(io->writer_index != worker->index);
+			assert(io->writer_index != worker_index);
 
 			/* if the worker has finished this index */
-			if (busy_index != worker->index) {
-				thread_mutex_unlock(&io->io_mutex);
+			if (busy_index != worker_index) {
+				if (waiting)
+					io_wait_end(io, &io->write_waiting);
 
 				/* mark the worker as processed */
 				/* setting the previous one to point at the next one */
@@ -671,7 +1033,13 @@ static void io_parity_write_thread(struct snapraid_io* io, unsigned* pos, unsign
 		}
 
 		/* if no worker is ready, wait for an event */
-		thread_cond_wait(&io->write_done, &io->io_mutex);
+		if (!waiting) {
+			/* set the flag, and check again before really waiting */
+			io_wait_begin(io, &io->write_waiting);
+			waiting = 1;
+		} else {
+			thread_cond_wait(&io->write_done, &io->io_mutex);
+		}
 
 		/* count the cycles */
 		++waiting_cycle;
@@ -684,9 +1052,20 @@ static void io_reader_worker(struct snapraid_worker* worker, struct snapraid_tas
 	if (task->position >= worker->io->block_max) {
 		/* complete a dummy task */
 		task->state = TASK_STATE_EMPTY;
-	} else {
-		worker->func(worker, task);
+		return;
 	}
+
+	worker->tick_start = tick();
+
+	worker->func(worker, task);
+
+#if HAVE_IO_URING
+	/* with io_uring the time is accounted when the request completes */
+	if (worker->ring && worker->ring_submitted)
+		return;
+#endif
+
+	io_reader_account(worker);
 }
 
 static void* io_reader_thread(void* arg)
@@ -694,6 +1073,8 @@ static void* io_reader_thread(void* arg)
 	struct snapraid_worker* worker = arg;
 
 	/* force completion of the first task */
+	/* the reader has always a free buffer at the start */
+	io_reader_take_buffer(worker, &worker->task_map[0]);
 	io_reader_worker(worker, &worker->task_map[0]);
 
 	while (1) {
@@ -752,7 +1133,10 @@ static void* io_writer_thread(void* arg)
 	return 0;
 }
 
-static void io_start_thread(struct snapraid_io* io,
+/**
+ * Setup the initial state, common at the thread and io_uring engines.
+ */
+static void io_start_setup(struct snapraid_io* io,
 	block_off_t blockstart, block_off_t blockmax,
 	int (*block_is_enabled)(void* arg, block_off_t), void* blockarg)
 {
@@ -767,11 +1151,36 @@ static void io_start_thread(struct snapraid_io* io,
 	io->done = 0;
 	io->reader_index = io->io_max - 1;
 	io->writer_index = 0;
+	io->read_waiting = 0;
+	io->write_waiting = 0;
 
 	/* clear writer errors */
 	for (i = 0; i < IO_WRITER_ERROR_MAX; ++i)
 		io->writer_error[i] = 0;
 
+	/* distribute the pool in equal parts at the readers */
+	io->adapt_countdown = io->io_max;
+	for (i = 0; i < io->io_max; ++i) {
+		unsigned j;
+
+		for (j = 0; j < io->reader_max; ++j)
+			io->buffer_map[i][io->reader_map[j].buffer_skew + j] = 0;
+	}
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
+		unsigned j;
+
+		worker->free_head = 0;
+		worker->free_tail = 0;
+		worker->buffer_owned = io->pool_max / io->reader_max;
+		worker->buffer_depth = worker->buffer_owned;
+		worker->starving = 0;
+		worker->latency = 0;
+
+		for (j = 0; j < worker->buffer_owned; ++j)
+			io_reader_give_buffer(worker, io->pool_map[i * worker->buffer_owned + j]);
+	}
+
 	/* setup the initial read pending tasks, except the latest one, */
 	/* the latest will be initialized at the fist io_read_next() call */
 	for (i = 0; i < io->io_max - 1; ++i) {
@@ -784,12 +1193,22 @@ static void io_start_thread(struct snapraid_io* io,
 	io->reader_list[0] = io->reader_max;
 	for (i = 0; i <= io->writer_max; ++i)
 		io->writer_list[i] = i;
+}
+
+static void io_start_thread(struct snapraid_io* io,
+	block_off_t blockstart, block_off_t blockmax,
+	int (*block_is_enabled)(void* arg, block_off_t), void* blockarg)
+{
+	unsigned i;
+
+	io_start_setup(io, blockstart, blockmax, block_is_enabled, blockarg);
 
 	/* start the reader threads */
 	for (i = 0; i < io->reader_max; ++i) {
 		struct snapraid_worker* worker = &io->reader_map[i];
 
 		worker->index = 0;
+		worker->waiting = 0;
 
 		thread_create(&worker->thread, 0, io_reader_thread, worker);
 	}
@@ -799,25 +1218,46 @@ static void io_start_thread(struct snapraid_io* io,
 		struct snapraid_worker* worker = &io->writer_map[i];
 
 		worker->index = io->io_max - 1;
+		worker->waiting = 0;
 
 		thread_create(&worker->thread, 0, io_writer_thread, worker);
 	}
 }
 
-static void io_stop_thread(struct snapraid_io* io)
+/**
+ * Log the read-ahead depth reached by the readers.
+ */
+static void io_reader_log(struct snapraid_io* io)
 {
 	unsigned i;
 
-	thread_mutex_lock(&io->io_mutex);
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
+		const char* name;
 
-	/* mark that we are stopping */
-	io->done = 1;
+		if (worker->parity_handle)
+			name = lev_config_name(worker->parity_handle->level);
+		else if (worker->handle->disk)
+			name = worker->handle->disk->name;
+		else
+			continue;
 
-	/* signal all the threads to recognize the new state */
-	thread_cond_broadcast(&io->read_sched);
-	thread_cond_broadcast(&io->write_sched);
+		log_tag("io:depth:%s:%u:%u\n", name, worker->buffer_depth, worker->buffer_owned);
+	}
+}
 
-	thread_mutex_unlock(&io->io_mutex);
+static void io_stop_thread(struct snapraid_io* io)
+{
+	unsigned i;
+
+	/* mark that we are stopping */
+	io_atomic_store(&io->done, 1);
+
+	/* wake up all the threads to recognize the new state */
+	for (i = 0; i < io->reader_max; ++i)
+		io_worker_wakeup(&io->reader_map[i]);
+	for (i = 0; i < io->writer_max; ++i)
+		io_worker_wakeup(&io->writer_map[i]);
 
 	/* wait for all readers to terminate */
 	for (i = 0; i < io->reader_max; ++i) {
@@ -836,9 +1276,884 @@ static void io_stop_thread(struct snapraid_io* io)
 		/* wait for thread termination */
 		thread_join(worker->thread, &retval);
 	}
+
+	io_reader_log(io);
 }
 
-#endif
+/*****************************************************************************/
+/* io_uring */
+
+#if HAVE_IO_URING
+
+static int io_uring_setup_sys(unsigned entries, struct io_uring_params* p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter_sys(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, 0, 0);
+}
+
+static int io_uring_register_sys(int fd, unsigned opcode, const void* arg, unsigned nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * If the worker is a writer.
+ *
+ * Parity workers are writers only if there are writers at all.
+ */
+static int io_ring_is_writer(struct snapraid_io* io, struct snapraid_worker* worker)
+{
+	return io->writer_max != 0 && worker->parity_handle != 0;
+}
+
+/**
+ * Release the ring.
+ *
+ * It works also with a ring partially initialized by io_ring_init().
+ */
+static void io_ring_done(struct snapraid_ring* ring)
+{
+	if (ring->sqe_map != MAP_FAILED)
+		munmap(ring->sqe_map, ring->sqe_map_size);
+	if (ring->cq_map != MAP_FAILED && ring->cq_map != ring->sq_map)
+		munmap(ring->cq_map, ring->cq_map_size);
+	if (ring->sq_map != MAP_FAILED)
+		munmap(ring->sq_map, ring->sq_map_size);
+	if (ring->event != -1)
+		close(ring->event);
+	if (ring->fd != -1)
+		close(ring->fd);
+	free(ring->worker_map);
+	free(ring->start_map);
+}
+
+/**
+ * Create a ring able to run the specified number of workers.
+ *
+ * Return -1 if io_uring is not available, with errno set.
+ * On error the ring has anyway to be released with io_ring_done().
+ */
+static int io_ring_init(struct snapraid_io* io, struct snapraid_ring* ring, unsigned worker_max)
+{
+	struct io_uring_params p;
+	unsigned char* sq_ptr;
+	unsigned char* cq_ptr;
+
+	ring->io = io;
+	ring->fd = -1;
+	ring->event = -1;
+	ring->event_armed = 0;
+	ring->waiting = 0;
+	ring->has_buffer = 0;
+	ring->sq_map = MAP_FAILED;
+	ring->cq_map = MAP_FAILED;
+	ring->sqe_map = MAP_FAILED;
+	ring->sq_pending = 0;
+	ring->worker_max = 0;
+	ring->worker_map = malloc_nofail(worker_max * sizeof(struct snapraid_worker*));
+	ring->start_map = malloc_nofail(worker_max * sizeof(struct snapraid_worker*));
+
+	/* one request for each worker, plus the poll of the event */
+	memset(&p, 0, sizeof(p));
+	ring->fd = io_uring_setup_sys(worker_max + 1, &p);
+	if (ring->fd < 0) {
+		ring->fd = -1;
+		return -1;
+	}
+
+	/* IORING_OP_READ and IORING_OP_WRITE are in the same kernel of this feature */
+	if ((p.features & IORING_FEAT_RW_CUR_POS) == 0) {
+		errno = ENOSYS;
+		return -1;
+	}
+
+	ring->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->sq_map_size < ring->cq_map_size)
+			ring->sq_map_size = ring->cq_map_size;
+		ring->cq_map_size = ring->sq_map_size;
+	}
+
+	ring->sq_map = mmap(0, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_map == MAP_FAILED)
+		return -1;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_map = ring->sq_map;
+	} else {
+		ring->cq_map = mmap(0, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_map == MAP_FAILED)
+			return -1;
+	}
+
+	ring->sqe_map_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqe_map = mmap(0, ring->sqe_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqe_map == MAP_FAILED)
+		return -1;
+
+	sq_ptr = ring->sq_map;
+	ring->sq_head = (unsigned*)(sq_ptr + p.sq_off.head);
+	ring->sq_tail = (unsigned*)(sq_ptr + p.sq_off.tail);
+	ring->sq_mask = (unsigned*)(sq_ptr + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned*)(sq_ptr + p.sq_off.array);
+
+	cq_ptr = ring->cq_map;
+	ring->cq_head = (unsigned*)(cq_ptr + p.cq_off.head);
+	ring->cq_tail = (unsigned*)(cq_ptr + p.cq_off.tail);
+	ring->cq_mask = (unsigned*)(cq_ptr + p.cq_off.ring_mask);
+	ring->cqe_map = (struct io_uring_cqe*)(cq_ptr + p.cq_off.cqes);
+
+	ring->event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ring->event < 0) {
+		ring->event = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Get the memory range covering all the blocks of a vector.
+ */
+static void io_ring_range(void** map, unsigned max, unsigned block_size, unsigned char** begin_ptr, unsigned char** end_ptr)
+{
+	unsigned char* begin;
+	unsigned char* end;
+	unsigned i;
+
+	if (max == 0) {
+		*begin_ptr = 0;
+		*end_ptr = 0;
+		return;
+	}
+
+	begin = map[0];
+	end = begin + block_size;
+
+	for (i = 1; i < max; ++i) {
+		unsigned char* ptr = map[i];
+		if (begin > ptr)
+			begin = ptr;
+		if (end < ptr + block_size)
+			end = ptr + block_size;
+	}
+
+	*begin_ptr = begin;
+	*end_ptr = end;
+}
+
+/**
+ * Register the IO buffers and the parity files in the ring.
+ *
+ * It's only an optimization, and on failure the ring works without them.
+ * The buffers registration may fail for the limit of locked memory.
+ */
+static void io_ring_register(struct snapraid_ring* ring)
+{
+	struct snapraid_io* io = ring->io;
+	unsigned block_size = io->state->block_size;
+	struct iovec iov[2];
+	int* fd_map;
+	unsigned fd_max;
+	unsigned i;
+
+	/* in direct mode the blocks are larger to allow aligned reads */
+	if ((io->state->file_mode & MODE_DIRECT) != 0)
+		block_size = direct_size(block_size);
+
+	/* all the sets not used by readers are registered as a single buffer */
+	io_ring_range(io->buffer_static, io->buffer_static_count * (io->buffer_max - io->reader_max), block_size, &ring->static_begin, &ring->static_end);
+	iov[0].iov_base = ring->static_begin;
+	iov[0].iov_len = ring->static_end - ring->static_begin;
+
+	/* the pool of the readers is registered after them */
+	io_ring_range(io->pool_map, io->pool_max, block_size, &ring->pool_begin, &ring->pool_end);
+	iov[1].iov_base = ring->pool_begin;
+	iov[1].iov_len = ring->pool_end - ring->pool_begin;
+
+	ring->has_buffer = io_uring_register_sys(ring->fd, IORING_REGISTER_BUFFERS, iov, 2) == 0;
+
+	/* register only the parity files, as they stay open */
+	/* the data files are opened and closed while running */
+	fd_map = malloc_nofail(ring->worker_max * sizeof(int));
+	fd_max = 0;
+	for (i = 0; i < ring->worker_max; ++i) {
+		struct snapraid_worker* worker = ring->worker_map[i];
+
+		worker->ring_file = -1;
+		if (worker->parity_handle && worker->parity_handle->f != -1) {
+			fd_map[fd_max] = worker->parity_handle->f;
+			worker->ring_file = fd_max++;
+		}
+	}
+
+	if (fd_max != 0 && io_uring_register_sys(ring->fd, IORING_REGISTER_FILES, fd_map, fd_max) != 0) {
+		/* LCOV_EXCL_START */
+		for (i = 0; i < ring->worker_max; ++i)
+			ring->worker_map[i]->ring_file = -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	free(fd_map);
+
+	log_tag("io:uring:buffer:%u:file:%u\n", ring->has_buffer, fd_max);
+}
+
+/**
+ * Setup the io_uring engine, distributing the workers in the rings.
+ *
+ * If io_uring is not available, ::ring_max is left to 0.
+ */
+static void io_ring_setup(struct snapraid_io* io, unsigned ring_max)
+{
+	unsigned worker_max = io->reader_max + io->writer_max;
+	unsigned i;
+
+	if (ring_max > worker_max)
+		ring_max = worker_max;
+
+	for (i = 0; i < ring_max; ++i) {
+		/* each ring gets at most this number of workers */
+		if (io_ring_init(io, &io->ring_map[i], (worker_max + ring_max - 1) / ring_max) != 0) {
+			/* LCOV_EXCL_START */
+			int err = errno;
+			unsigned j;
+
+			for (j = 0; j <= i; ++j)
+				io_ring_done(&io->ring_map[j]);
+
+			log_tag("io:uring:unavailable: %s\n", strerror(err));
+			msg_progress("io_uring not available, using threads. %s.\n", strerror(err));
+			return;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	io->ring_max = ring_max;
+
+	/* distribute the workers round robin, to mix data and parity disks */
+	for (i = 0; i < worker_max; ++i) {
+		struct snapraid_worker* worker;
+		struct snapraid_ring* ring = &io->ring_map[i % ring_max];
+
+		if (i < io->reader_max)
+			worker = &io->reader_map[i];
+		else
+			worker = &io->writer_map[i - io->reader_max];
+
+		worker->ring = ring;
+		ring->worker_map[ring->worker_max++] = worker;
+	}
+
+	for (i = 0; i < ring_max; ++i)
+		io_ring_register(&io->ring_map[i]);
+
+	log_tag("io:uring:%u\n", ring_max);
+}
+
+/**
+ * Add the request of the task in the submission queue.
+ *
+ * The request is sent to the kernel at the next io_ring_enter().
+ */
+static void io_ring_push(struct snapraid_ring* ring, struct snapraid_task* task)
+{
+	unsigned tail = *ring->sq_tail;
+	unsigned index = tail & *ring->sq_mask;
+	struct io_uring_sqe* sqe = &ring->sqe_map[index];
+	unsigned char* ptr = task->buffer + task->req_count;
+	unsigned len;
+	int fixed;
+
+	/* in direct mode the tail of the file is read up to the alignment */
+	if (task->req_direct)
+		len = direct_size(task->req_size) - task->req_count;
+	else
+		len = task->req_size - task->req_count;
+
+	/* use the registered buffer only if the data is inside it */
+	/* the buffers of the readers are in the pool, registered after the sets */
+	fixed = -1;
+	if (ring->has_buffer) {
+		if (ptr >= ring->static_begin && ptr + len <= ring->static_end)
+			fixed = 0;
+		else if (ptr >= ring->pool_begin && ptr + len <= ring->pool_end)
+			fixed = 1;
+	}
+
+	memset(sqe, 0, sizeof(*sqe));
+	if (task->req_write)
+		sqe->opcode = fixed >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	else
+		sqe->opcode = fixed >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe->fd = task->req_fd;
+	if (task->req_fixed_file)
+		sqe->flags = IOSQE_FIXED_FILE;
+	sqe->off = task->req_offset + task->req_count;
+	sqe->addr = (uintptr_t)ptr;
+	sqe->len = len;
+	if (fixed >= 0)
+		sqe->buf_index = fixed;
+	sqe->user_data = (uintptr_t)task;
+
+	ring->sq_array[index] = index;
+
+	/* the kernel reads the entry only after the tail is updated */
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	++ring->sq_pending;
+}
+
+/**
+ * Add the poll of the wake up event in the submission queue.
+ *
+ * It's identified by a 0 user_data.
+ */
+static void io_ring_arm(struct snapraid_ring* ring)
+{
+	unsigned tail = *ring->sq_tail;
+	unsigned index = tail & *ring->sq_mask;
+	struct io_uring_sqe* sqe = &ring->sqe_map[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = ring->event;
+	sqe->poll_events = POLLIN;
+	sqe->user_data = 0;
+
+	ring->sq_array[index] = index;
+
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	++ring->sq_pending;
+
+	ring->event_armed = 1;
+}
+
+/**
+ * Submit the pending requests, and optionally wait for a completion.
+ */
+static void io_ring_enter(struct snapraid_ring* ring, int wait)
+{
+	int ret;
+
+	/* nothing to do */
+	if (!wait && ring->sq_pending == 0)
+		return;
+
+	ret = io_uring_enter_sys(ring->fd, ring->sq_pending, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+	if (ret < 0) {
+		/* LCOV_EXCL_START */
+		if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+			return;
+		log_fatal("Error submitting requests to io_uring. %s.\n", strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* the not submitted requests are retried at the next call */
+	ring->sq_pending -= ret;
+}
+
+/**
+ * Complete the task after a callback or a continuation.
+ */
+static void io_ring_end(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	/* if a new request was submitted, the task completes with it */
+	if (worker->ring_submitted)
+		return;
+
+	/* save the resulting state, used by writers */
+	worker->ring_state = task->state;
+	worker->ring_busy = 0;
+}
+
+/**
+ * Wake up the ring if it's waiting, to recognize the new state.
+ */
+static void io_ring_signal(struct snapraid_ring* ring)
+{
+	uint64_t value = 1;
+	ssize_t write_ret;
+
+	if (!io_atomic_load(&ring->waiting))
+		return;
+
+	/* the event counter cannot overflow, as the ring reads it */
+	write_ret = write(ring->event, &value, sizeof(value));
+	(void)write_ret;
+}
+
+/**
+ * Pass the read completed to the thread of the reader.
+ */
+static void io_ring_post(struct snapraid_worker* worker, struct snapraid_task* task, int ret)
+{
+	thread_mutex_lock(&worker->mutex);
+
+	worker->post_task = task;
+	worker->post_ret = ret;
+
+	thread_cond_signal_and_unlock(&worker->cond, &worker->mutex);
+}
+
+/**
+ * Thread of the reader running the continuation of the reads.
+ */
+static void* io_ring_post_thread(void* arg)
+{
+	struct snapraid_worker* worker = arg;
+	struct snapraid_ring* ring = worker->ring;
+
+	while (1) {
+		struct snapraid_task* task;
+		int ret;
+
+		thread_mutex_lock(&worker->mutex);
+
+		while (!worker->post_exit && worker->post_task == 0)
+			thread_cond_wait(&worker->cond, &worker->mutex);
+
+		task = worker->post_task;
+		ret = worker->post_ret;
+		worker->post_task = 0;
+
+		thread_mutex_unlock(&worker->mutex);
+
+		/* if no task, it means to exit */
+		if (!task)
+			break;
+
+		task->req_done(worker, task, ret);
+
+		io_reader_account(worker);
+
+		/* complete the task, and let the ring start the next one */
+		io_atomic_store(&worker->ring_busy, 0);
+		io_ring_signal(ring);
+	}
+
+	return 0;
+}
+
+/**
+ * Process the completion of a request.
+ *
+ * It reports errors like handle_read(), parity_read() and parity_write(),
+ * and then calls the continuation of the task.
+ */
+static void io_ring_complete(struct snapraid_ring* ring, struct snapraid_task* task, int res)
+{
+	struct snapraid_worker* worker = task->req_worker;
+	unsigned block_size = ring->io->state->block_size;
+	const char* path;
+	int ret;
+
+	if (worker->handle)
+		path = worker->handle->path;
+	else
+		path = worker->parity_handle->path;
+
+	if (res > 0) {
+		task->req_count += res;
+
+		/* continue a partial read or write */
+		if (task->req_count < task->req_size) {
+			io_ring_push(ring, task);
+			return;
+		}
+
+		if (task->req_write) {
+			data_off_t end = task->req_offset + task->req_size;
+
+			/* adjust the size of the valid data */
+			if (worker->parity_handle->valid_size < end)
+				worker->parity_handle->valid_size = end;
+
+			ret = 0;
+		} else {
+			/* pad with 0 */
+			if (task->req_size < block_size)
+				memset(task->buffer + task->req_size, 0, block_size - task->req_size);
+
+			ret = task->req_size;
+		}
+	} else if (task->req_write) {
+		/* LCOV_EXCL_START */
+		errno = res < 0 ? -res : EIO;
+		if (errno == ENOSPC) {
+			log_fatal("Failed to grow parity file '%s' using write due lack of space.\n", path);
+		} else {
+			log_fatal("Error writing file '%s'. %s.\n", path, strerror(errno));
+		}
+		ret = -1;
+		/* LCOV_EXCL_STOP */
+	} else if (res == 0) {
+		/* LCOV_EXCL_START */
+		errno = 0;
+		task->req_out("Unexpected end of file '%s' at offset %" PRIu64 ". %s.\n", path, task->req_offset, strerror(errno));
+		ret = -1;
+		/* LCOV_EXCL_STOP */
+	} else if (res == -EINVAL && task->req_direct && handle_direct_disable(worker->handle) == 0) {
+		/* if the direct read is refused, like after a short read, continue with the OS cache */
+		task->req_direct = 0;
+		io_ring_push(ring, task);
+		return;
+	} else {
+		/* LCOV_EXCL_START */
+		errno = -res;
+		task->req_out("Error reading file '%s' at offset %" PRIu64 " for size %u. %s.\n", path, task->req_offset + task->req_count, task->req_size - task->req_count, strerror(errno));
+		ret = -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	worker->ring_submitted = 0;
+
+	/* readers run the continuation in their thread, as it may hash the block */
+	if (!io_ring_is_writer(ring->io, worker)) {
+		io_ring_post(worker, task, ret);
+		return;
+	}
+
+	task->req_done(worker, task, ret);
+
+	io_ring_end(worker, task);
+}
+
+/**
+ * Process all the available completions.
+ */
+static void io_ring_reap(struct snapraid_ring* ring)
+{
+	while (1) {
+		unsigned head = *ring->cq_head;
+		unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+		struct io_uring_cqe* cqe;
+		uint64_t user_data;
+		int res;
+
+		if (head == tail)
+			break;
+
+		cqe = &ring->cqe_map[head & *ring->cq_mask];
+		user_data = cqe->user_data;
+		res = cqe->res;
+
+		/* release the entry before processing it */
+		__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+		if (user_data == 0) {
+			/* clear the wake up event, the poll has to be armed again */
+			ssize_t read_ret = read(ring->event, &ring->event_value, sizeof(ring->event_value));
+			(void)read_ret;
+			ring->event_armed = 0;
+		} else {
+			io_ring_complete(ring, (struct snapraid_task*)(uintptr_t)user_data, res);
+		}
+	}
+}
+
+/**
+ * Wake up the rings waiting, to recognize the new state.
+ */
+static void io_ring_wakeup(struct snapraid_io* io)
+{
+	unsigned i;
+
+	for (i = 0; i < io->ring_max; ++i)
+		io_ring_signal(&io->ring_map[i]);
+}
+
+/**
+ * Get the next tasks to work on for all the workers of the ring.
+ *
+ * This is the synchronization point for workers with the io,
+ * like io_reader_step() and io_writer_step(), but without waiting.
+ *
+ * Return the number of tasks to start, or -1 if the ring has to exit.
+ */
+static int io_ring_step(struct snapraid_ring* ring)
+{
+	struct snapraid_io* io = ring->io;
+	unsigned start_mac;
+	int busy;
+	unsigned i;
+
+	start_mac = 0;
+	busy = 0;
+
+	for (i = 0; i < ring->worker_max; ++i) {
+		struct snapraid_worker* worker = ring->worker_map[i];
+		unsigned next_index;
+		unsigned done_index;
+
+		/* the worker is still waiting for its request */
+		if (io_atomic_load(&worker->ring_busy)) {
+			busy = 1;
+			continue;
+		}
+
+		/* get the next pending task */
+		next_index = (worker->index + 1) % io->io_max;
+
+		if (io_ring_is_writer(io, worker)) {
+			int error_index;
+
+			/* counts the number of errors in the global state */
+			error_index = worker->ring_state - IO_WRITER_ERROR_BASE;
+			if (error_index >= 0 && error_index < IO_WRITER_ERROR_MAX)
+				io_atomic_inc(&io->writer_error[error_index]);
+			worker->ring_state = TASK_STATE_DONE;
+
+			/* if the ring of pending tasks is empty */
+			if (next_index == io_atomic_load(&io->writer_index))
+				continue;
+
+			/* the index that worker just completed */
+			done_index = worker->index;
+
+			/* get the new working task */
+			io_atomic_store(&worker->index, next_index);
+
+			/* notify the IO if it's waiting for this write */
+			io_done_notify(io, &io->write_waiting, &io->write_done, done_index, &io->writer_index, io->io_max - io->buffer_static_count + 1);
+		} else {
+			/* readers exit even if there is work to do */
+			if (io_atomic_load(&io->done))
+				continue;
+
+			/* if the ring of pending tasks is empty */
+			if (next_index == io_atomic_load(&io->reader_index))
+				continue;
+
+			/* if there is no buffer for the task */
+			if (!io_reader_has_buffer(worker, &worker->task_map[next_index]))
+				continue;
+
+			/* the index that worker just completed */
+			done_index = worker->index;
+
+			/* the buffer is published to the IO with the completion of the new task */
+			io_reader_take_buffer(worker, &worker->task_map[next_index]);
+
+			/* get the new working task */
+			io_atomic_store(&worker->index, next_index);
+
+			/* notify the IO if it's waiting for this read */
+			io_done_notify(io, &io->read_waiting, &io->read_done, done_index, &io->reader_index, 0);
+		}
+
+		worker->ring_busy = 1;
+		ring->start_map[start_mac++] = worker;
+	}
+
+	/* exit only when stopping, and all the requests are completed */
+	if (io_atomic_load(&io->done) && !busy && start_mac == 0)
+		return -1;
+
+	return start_mac;
+}
+
+/**
+ * Start the current task of the worker.
+ */
+static void io_ring_run(struct snapraid_ring* ring, struct snapraid_worker* worker)
+{
+	struct snapraid_task* task = &worker->task_map[worker->index];
+
+	worker->ring_submitted = 0;
+
+	/* nothing more to do */
+	if (task->state != TASK_STATE_EMPTY) {
+		assert(task->state == TASK_STATE_READY);
+
+		/* work on the assigned task */
+		if (io_ring_is_writer(ring->io, worker))
+			worker->func(worker, task);
+		else
+			io_reader_worker(worker, task);
+	}
+
+	io_ring_end(worker, task);
+}
+
+static void* io_ring_thread(void* arg)
+{
+	struct snapraid_ring* ring = arg;
+	unsigned i;
+
+	/* force completion of the first task of readers */
+	for (i = 0; i < ring->worker_max; ++i) {
+		struct snapraid_worker* worker = ring->worker_map[i];
+
+		if (!io_ring_is_writer(ring->io, worker)) {
+			worker->ring_busy = 1;
+			worker->ring_submitted = 0;
+			io_reader_take_buffer(worker, &worker->task_map[0]);
+			io_reader_worker(worker, &worker->task_map[0]);
+			io_ring_end(worker, &worker->task_map[0]);
+		}
+	}
+
+	while (1) {
+		int ret;
+
+		/* get the new tasks */
+		ret = io_ring_step(ring);
+
+		/* it means to exit */
+		if (ret < 0)
+			break;
+
+		/* if nothing to do, set the flag, and check again before waiting */
+		if (ret == 0 && !ring->waiting) {
+			io_atomic_store(&ring->waiting, 1);
+			continue;
+		}
+
+		/* start the new tasks, submitting their requests */
+		for (i = 0; i < (unsigned)ret; ++i)
+			io_ring_run(ring, ring->start_map[i]);
+
+		/* ensure to be waked up for new tasks */
+		if (!ring->event_armed)
+			io_ring_arm(ring);
+
+		/* wait only if there are no new tasks, as they may be already completed */
+		io_ring_enter(ring, ret == 0);
+
+		io_atomic_store(&ring->waiting, 0);
+
+		io_ring_reap(ring);
+	}
+
+	return 0;
+}
+
+static block_off_t io_read_next_ring(struct snapraid_io* io, void*** buffer)
+{
+	block_off_t blockcur;
+
+	blockcur = io_read_next_thread(io, buffer);
+
+	/* the rings don't wait on the worker condition */
+	io_ring_wakeup(io);
+
+	return blockcur;
+}
+
+static void io_write_next_ring(struct snapraid_io* io, block_off_t blockcur, int skip, int* writer_error)
+{
+	io_write_next_thread(io, blockcur, skip, writer_error);
+
+	/* the rings don't wait on the worker condition */
+	io_ring_wakeup(io);
+}
+
+static void io_start_ring(struct snapraid_io* io,
+	block_off_t blockstart, block_off_t blockmax,
+	int (*block_is_enabled)(void* arg, block_off_t), void* blockarg)
+{
+	unsigned i;
+
+	io_start_setup(io, blockstart, blockmax, block_is_enabled, blockarg);
+
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
+
+		worker->index = 0;
+		worker->ring_busy = 0;
+		worker->ring_submitted = 0;
+		worker->ring_state = TASK_STATE_DONE;
+		worker->post_task = 0;
+		worker->post_exit = 0;
+
+		thread_create(&worker->post_thread, 0, io_ring_post_thread, worker);
+	}
+
+	for (i = 0; i < io->writer_max; ++i) {
+		struct snapraid_worker* worker = &io->writer_map[i];
+
+		worker->index = io->io_max - 1;
+		worker->ring_busy = 0;
+		worker->ring_submitted = 0;
+		worker->ring_state = TASK_STATE_DONE;
+	}
+
+	/* start the ring threads */
+	for (i = 0; i < io->ring_max; ++i) {
+		struct snapraid_ring* ring = &io->ring_map[i];
+
+		ring->waiting = 0;
+
+		thread_create(&ring->thread, 0, io_ring_thread, ring);
+	}
+}
+
+static void io_stop_ring(struct snapraid_io* io)
+{
+	unsigned i;
+
+	/* mark that we are stopping */
+	io_atomic_store(&io->done, 1);
+
+	/* wake up all the rings to recognize the new state */
+	io_ring_wakeup(io);
+
+	/* wait for all rings to terminate */
+	for (i = 0; i < io->ring_max; ++i) {
+		void* retval;
+
+		thread_join(io->ring_map[i].thread, &retval);
+	}
+
+	/* the rings exit only when all the reads are completed */
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
+		void* retval;
+
+		thread_mutex_lock(&worker->mutex);
+		worker->post_exit = 1;
+		thread_cond_signal_and_unlock(&worker->cond, &worker->mutex);
+
+		thread_join(worker->post_thread, &retval);
+	}
+
+	io_reader_log(io);
+}
+
+/**
+ * Submit the request of the task to the ring of the worker.
+ */
+static void io_ring_submit(struct snapraid_worker* worker, struct snapraid_task* task, fptr* out,
+	void (*done)(struct snapraid_worker* worker, struct snapraid_task* task, int ret),
+	int write, int fd, int fixed_file, int direct, data_off_t offset, unsigned size)
+{
+	task->req_worker = worker;
+	task->req_done = done;
+	task->req_out = out;
+	task->req_write = write;
+	task->req_fd = fd;
+	task->req_fixed_file = fixed_file;
+	task->req_direct = direct;
+	task->req_offset = offset;
+	task->req_size = size;
+	task->req_count = 0;
+
+	io_ring_push(worker->ring, task);
+
+	worker->ring_submitted = 1;
+}
+
+#endif
+
+#endif
 
 /*****************************************************************************/
 /* global */
@@ -852,42 +2167,53 @@ void io_init(struct snapraid_io* io, struct snapraid_state* state,
 	struct snapraid_parity_handle* parity_handle_map, unsigned parity_handle_max)
 {
 	unsigned i;
+	unsigned depth;
 	size_t allocated;
+	int direct;
 
 	io->state = state;
 
+#if HAVE_IO_URING
+	io->ring_max = 0;
+#endif
+
 #if HAVE_PTHREAD
 	if (io_cache == 0) {
 		/* default is 8 MiB of cache */
 		/* this seems to be a good tradeoff between speed and memory usage */
-		io->io_max = 8 * 1024 * 1024 / state->block_size;
-		if (io->io_max < IO_MIN)
-			io->io_max = IO_MIN;
+		depth = 8 * 1024 * 1024 / state->block_size;
+		if (depth < IO_MIN)
+			depth = IO_MIN;
+		if (depth > IO_MAX)
+			depth = IO_MAX;
+	} else {
+		depth = io_cache;
+	}
+
+	/* the slower disks may use up to the double of the average read-ahead */
+	io->io_max = depth;
+	if (depth > 1) {
+		io->io_max = depth * 2;
 		if (io->io_max > IO_MAX)
 			io->io_max = IO_MAX;
-	} else {
-		io->io_max = io_cache;
 	}
 #else
 	(void)io_cache;
 
 	/* without pthread force the mono thread mode */
+	depth = 1;
 	io->io_max = 1;
 #endif
 
 	assert(io->io_max == 1 || (io->io_max >= IO_MIN && io->io_max <= IO_MAX));
 
-	io->buffer_max = buffer_max;
-	allocated = 0;
-	for (i = 0; i < io->io_max; ++i) {
-		io->buffer_map[i] = malloc_nofail_vector_align(handle_max, buffer_max, state->block_size, &io->buffer_alloc_map[i]);
-		if (!state->opt.skip_self)
-			mtest_vector(io->buffer_max, state->block_size, io->buffer_map[i]);
-		allocated += state->block_size * buffer_max;
+	/* build the chunk index of the disks, to allow the workers */
+	/* to map parity positions to blocks without locking */
+	for (i = 0; i < handle_max; ++i) {
+		if (handle_map[i].disk)
+			fs_index_build(handle_map[i].disk);
 	}
 
-	msg_progress("Using %u MiB of memory for %u blocks of IO cache.\n", (unsigned)(allocated / MEBI), io->io_max);
-
 	if (parity_writer) {
 		io->reader_max = handle_max;
 		io->writer_max = parity_handle_max;
@@ -944,6 +2270,78 @@ void io_init(struct snapraid_io* io, struct snapraid_state* state,
 		worker->buffer_skew = handle_max;
 	}
 
+	/* the buffers are allocated with huge pages, to reduce the TLB misses */
+	/* direct mode requires page aligned buffers */
+	direct = (state->file_mode & MODE_DIRECT) != 0;
+
+	io->buffer_max = buffer_max;
+	io->buffer_static = 0;
+	io->buffer_static_count = 0;
+	io->buffer_static_next = 0;
+	io->buffer_reader = 0;
+	io->pool_max = 0;
+	io->pool_alloc = 0;
+	io->pool_map = 0;
+	allocated = 0;
+	if (io->io_max == 1) {
+		io->buffer_map[0] = malloc_nofail_vector_huge(handle_max, buffer_max, state->block_size, direct, &io->buffer_alloc);
+		if (!state->opt.skip_self)
+			mtest_vector(io->buffer_max, state->block_size, io->buffer_map[0]);
+		io->buffer_static_map[0] = 0;
+		allocated += buffer_max;
+	} else {
+		unsigned static_max = buffer_max - io->reader_max;
+		unsigned char* reader_mask;
+
+		/* the buffers used by readers */
+		reader_mask = malloc_nofail(buffer_max);
+		memset(reader_mask, 0, buffer_max);
+		for (i = 0; i < io->reader_max; ++i)
+			reader_mask[io->reader_map[i].buffer_skew + i] = 1;
+
+		/* the readers share a pool with the same memory of the default read-ahead */
+		/* and each one of them may use up to the double of it */
+		io->pool_max = io->reader_max * depth;
+		io->pool_map = malloc_nofail_vector_huge(0, io->pool_max, state->block_size, direct, &io->pool_alloc);
+		if (!state->opt.skip_self)
+			mtest_vector(io->pool_max, state->block_size, io->pool_map);
+		allocated += io->pool_max;
+
+		/* the buffers not used by readers are needed only for the read-ahead depth */
+		/* and all the sets are allocated together, to not round up each one to the huge page size */
+		io->buffer_static_count = depth;
+		io->buffer_static = malloc_nofail_vector_huge(0, depth * static_max, state->block_size, direct, &io->buffer_alloc);
+		if (!state->opt.skip_self)
+			mtest_vector(depth * static_max, state->block_size, io->buffer_static);
+		allocated += depth * static_max;
+
+		for (i = 0; i < depth; ++i)
+			io->buffer_static_map[i] = io->buffer_static + i * static_max;
+
+		/* the buffers are set when the slot is returned by io_read_next(), */
+		/* and for the readers when they take them from the pool */
+		for (i = 0; i < io->io_max; ++i) {
+			io->buffer_map[i] = malloc_nofail(buffer_max * sizeof(void*));
+			memset(io->buffer_map[i], 0, buffer_max * sizeof(void*));
+		}
+
+		io->buffer_reader = reader_mask;
+	}
+
+	msg_progress("Using %u MiB of memory for %u blocks of IO cache.\n", (unsigned)(allocated * state->block_size / MEBI), (unsigned)allocated);
+	log_tag("memory:io_pages:%s\n", huge_kind());
+
+#if HAVE_IO_URING
+	for (i = 0; i < io->reader_max; ++i)
+		io->reader_map[i].ring = 0;
+	for (i = 0; i < io->writer_max; ++i)
+		io->writer_map[i].ring = 0;
+
+	/* the io_uring engine replaces the thread of each disk */
+	if (io->io_max > 1 && state->opt.io_uring != 0)
+		io_ring_setup(io, state->opt.io_uring);
+#endif
+
 #if HAVE_PTHREAD
 	if (io->io_max > 1) {
 		io_read_next = io_read_next_thread;
@@ -956,11 +2354,27 @@ void io_init(struct snapraid_io* io, struct snapraid_state* state,
 		io_start = io_start_thread;
 		io_stop = io_stop_thread;
 
+#if HAVE_IO_URING
+		if (io->ring_max != 0) {
+			io_read_next = io_read_next_ring;
+			io_write_next = io_write_next_ring;
+			io_start = io_start_ring;
+			io_stop = io_stop_ring;
+		}
+#endif
+
 		thread_mutex_init(&io->io_mutex, 0);
 		thread_cond_init(&io->read_done, 0);
-		thread_cond_init(&io->read_sched, 0);
 		thread_cond_init(&io->write_done, 0);
-		thread_cond_init(&io->write_sched, 0);
+
+		for (i = 0; i < io->reader_max; ++i) {
+			thread_mutex_init(&io->reader_map[i].mutex, 0);
+			thread_cond_init(&io->reader_map[i].cond, 0);
+		}
+		for (i = 0; i < io->writer_max; ++i) {
+			thread_mutex_init(&io->writer_map[i].mutex, 0);
+			thread_cond_init(&io->writer_map[i].cond, 0);
+		}
 	} else
 #endif
 	{
@@ -980,24 +2394,318 @@ void io_done(struct snapraid_io* io)
 {
 	unsigned i;
 
-	for (i = 0; i < io->io_max; ++i) {
+	for (i = 0; i < io->io_max; ++i)
 		free(io->buffer_map[i]);
-		free(io->buffer_alloc_map[i]);
+	free(io->buffer_static);
+	free(io->buffer_reader);
+	free_huge(io->buffer_alloc);
+	free(io->pool_map);
+	free_huge(io->pool_alloc);
+
+#if HAVE_PTHREAD
+	if (io->io_max > 1) {
+		thread_mutex_destroy(&io->io_mutex);
+		thread_cond_destroy(&io->read_done);
+		thread_cond_destroy(&io->write_done);
+
+		for (i = 0; i < io->reader_max; ++i) {
+			thread_mutex_destroy(&io->reader_map[i].mutex);
+			thread_cond_destroy(&io->reader_map[i].cond);
+		}
+		for (i = 0; i < io->writer_max; ++i) {
+			thread_mutex_destroy(&io->writer_map[i].mutex);
+			thread_cond_destroy(&io->writer_map[i].cond);
+		}
 	}
+#endif
 
 	free(io->reader_map);
 	free(io->reader_list);
 	free(io->writer_map);
 	free(io->writer_list);
 
-#if HAVE_PTHREAD
-	if (io->io_max > 1) {
-		thread_mutex_destroy(&io->io_mutex);
-		thread_cond_destroy(&io->read_done);
-		thread_cond_destroy(&io->read_sched);
-		thread_cond_destroy(&io->write_done);
-		thread_cond_destroy(&io->write_sched);
+#if HAVE_IO_URING
+	for (i = 0; i < io->ring_max; ++i)
+		io_ring_done(&io->ring_map[i]);
+#endif
+}
+
+#if HAVE_PTHREAD && HAVE_PREADV
+/**
+ * Read the block of the task, and the following blocks of the same file
+ * for the next tasks already scheduled in the ring of the worker.
+ *
+ * The blocks of the next tasks are stored in their buffers, and used when
+ * the worker reaches them, with a single syscall for all the blocks.
+ * It reports errors like handle_read().
+ */
+static int io_task_handle_read_coalesce(struct snapraid_worker* worker, struct snapraid_task* task, fptr* out, fptr* out_missing)
+{
+	struct snapraid_io* io = worker->io;
+	struct snapraid_handle* handle = worker->handle;
+	unsigned block_size = io->state->block_size;
+	struct snapraid_task* run_map[IO_MAX];
+	unsigned size_map[IO_MAX];
+	struct iovec iov[IO_MAX];
+	block_off_t run;
+	unsigned reader_index;
+	unsigned index;
+	unsigned i, n;
+	data_off_t offset;
+	ssize_t read_ret;
+	int ret;
+
+	/* in the mono thread mode there are no other tasks scheduled */
+	if (io->io_max == 1)
+		return handle_read(handle, task->file_pos, task->buffer, block_size, out, out_missing);
+
+	/* number of blocks of the file following in the parity */
+	run = fs_par2file_run(handle->disk, task->position);
+	if (run > IO_COALESCE_SIZE / block_size)
+		run = IO_COALESCE_SIZE / block_size;
+	if (run <= 1)
+		return handle_read(handle, task->file_pos, task->buffer, block_size, out, out_missing);
+
+	ret = handle_read_size(handle, task->file_pos, block_size, out, out_missing);
+	if (ret == -1)
+		return -1;
+
+	offset = task->file_pos * (data_off_t)block_size;
+
+	run_map[0] = task;
+	size_map[0] = ret;
+	n = 1;
+
+	/* the tasks scheduled are the ones before the reader index */
+	reader_index = io_atomic_load(&io->reader_index);
+	index = task - worker->task_map;
+	while (n < run) {
+		struct snapraid_task* next;
+
+		index = (index + 1) % io->io_max;
+		if (index == reader_index)
+			break;
+
+		next = &worker->task_map[index];
+
+		/* stop at the first task not at the next parity position */
+		if (next->state != TASK_STATE_READY || next->position != task->position + n)
+			break;
+
+		/* stop at the end of the valid data, and let the task report the error */
+		if (offset + n * (data_off_t)block_size >= handle->valid_size)
+			break;
+
+		/* stop if there is no free buffer for the task */
+		if (!io_reader_take_buffer(worker, next))
+			break;
+
+		run_map[n] = next;
+		size_map[n] = file_block_size(handle->file, task->file_pos + n, block_size);
+		++n;
+	}
+
+	if (n == 1)
+		return handle_read(handle, task->file_pos, task->buffer, block_size, out, out_missing);
+
+	/* only the last block of the file may be shorter */
+	for (i = 0; i < n; ++i) {
+		iov[i].iov_base = run_map[i]->buffer;
+		iov[i].iov_len = size_map[i];
 	}
+
+	/* in direct mode the size has to be aligned */
+	if (handle->direct)
+		iov[n - 1].iov_len = direct_size(size_map[n - 1]);
+
+	read_ret = preadv(handle->f, iov, n, offset);
+
+	/* if the first block is not complete, read it alone to report the error */
+	if (read_ret < (ssize_t)size_map[0])
+		return handle_read(handle, task->file_pos, task->buffer, block_size, out, out_missing);
+
+	/* mark the next tasks with the blocks completely read */
+	for (i = 1; i < n; ++i) {
+		struct snapraid_task* next = run_map[i];
+
+		if ((size_t)read_ret < i * (size_t)block_size + size_map[i])
+			break;
+
+		/* pad with 0 */
+		if (size_map[i] < block_size)
+			memset(next->buffer + size_map[i], 0, block_size - size_map[i]);
+
+		next->ahead_file = handle->file;
+		next->ahead_file_pos = task->file_pos + i;
+		next->ahead_size = size_map[i];
+	}
+
+	return size_map[0];
+}
+#endif
+
+void io_task_handle_read(struct snapraid_worker* worker, struct snapraid_task* task, fptr* out, fptr* out_missing,
+	void (*done)(struct snapraid_worker* worker, struct snapraid_task* task, int ret))
+{
+	struct snapraid_handle* handle = worker->handle;
+	unsigned block_size = worker->io->state->block_size;
+
+#if HAVE_IO_URING
+	if (worker->ring) {
+		int ret;
+
+		ret = handle_read_size(handle, task->file_pos, block_size, out, out_missing);
+		if (ret == -1) {
+			done(worker, task, -1);
+			return;
+		}
+
+		io_ring_submit(worker, task, out, done, 0, handle->f, 0, handle->direct, task->file_pos * (data_off_t)block_size, ret);
+		return;
+	}
+#endif
+
+	/* if the data was already read with a previous task */
+	if (task->ahead_file != 0 && task->ahead_file == handle->file && task->ahead_file_pos == task->file_pos) {
+		done(worker, task, task->ahead_size);
+		return;
+	}
+
+#if HAVE_PTHREAD && HAVE_PREADV
+	done(worker, task, io_task_handle_read_coalesce(worker, task, out, out_missing));
+#else
+	done(worker, task, handle_read(handle, task->file_pos, task->buffer, block_size, out, out_missing));
 #endif
 }
 
+void io_task_parity_read(struct snapraid_worker* worker, struct snapraid_task* task, fptr* out,
+	void (*done)(struct snapraid_worker* worker, struct snapraid_task* task, int ret))
+{
+	struct snapraid_parity_handle* parity = worker->parity_handle;
+	unsigned block_size = worker->io->state->block_size;
+
+#if HAVE_IO_URING
+	if (worker->ring) {
+		data_off_t offset = task->position * (data_off_t)block_size;
+
+		/* check if we are going to read only not initialized data */
+		if (offset >= parity->valid_size) {
+			out("Reading missing data from file '%s' at offset %" PRIu64 ".\n", parity->path, offset);
+			done(worker, task, -1);
+			return;
+		}
+
+		if (worker->ring_file != -1)
+			io_ring_submit(worker, task, out, done, 0, worker->ring_file, 1, 0, offset, block_size);
+		else
+			io_ring_submit(worker, task, out, done, 0, parity->f, 0, 0, offset, block_size);
+		return;
+	}
+#endif
+
+	done(worker, task, parity_read(parity, task->position, task->buffer, block_size, out));
+}
+
+#if HAVE_PTHREAD && HAVE_PWRITEV
+/**
+ * Write the block of the task, and the blocks of the next tasks already
+ * scheduled in the ring of the worker, if at the following parity positions.
+ *
+ * The next tasks are marked as written, and completed when the worker
+ * reaches them, with a single syscall for all the blocks.
+ * It reports errors like parity_write().
+ */
+static int io_task_parity_write_coalesce(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	struct snapraid_io* io = worker->io;
+	struct snapraid_parity_handle* parity = worker->parity_handle;
+	unsigned block_size = io->state->block_size;
+	struct snapraid_task* run_map[IO_MAX];
+	struct iovec iov[IO_MAX];
+	unsigned run;
+	unsigned writer_index;
+	unsigned index;
+	unsigned i, n;
+
+	/* in the mono thread mode there are no other tasks scheduled */
+	if (io->io_max == 1)
+		return parity_write(parity, task->position, task->buffer, block_size);
+
+	run = IO_COALESCE_SIZE / block_size;
+	if (run > IO_MAX)
+		run = IO_MAX;
+
+	run_map[0] = task;
+	n = 1;
+
+	/* the tasks scheduled are the ones before the writer index */
+	writer_index = io_atomic_load(&io->writer_index);
+	index = task - worker->task_map;
+	while (n < run) {
+		struct snapraid_task* next;
+
+		index = (index + 1) % io->io_max;
+		if (index == writer_index)
+			break;
+
+		next = &worker->task_map[index];
+
+		/* stop at the first task not at the next parity position */
+		if (next->state != TASK_STATE_READY || next->position != task->position + n)
+			break;
+
+		run_map[n] = next;
+		++n;
+	}
+
+	if (n == 1)
+		return parity_write(parity, task->position, task->buffer, block_size);
+
+	for (i = 0; i < n; ++i) {
+		iov[i].iov_base = run_map[i]->buffer;
+		iov[i].iov_len = block_size;
+	}
+
+	/* if the write fails, write the first block alone to report the error */
+	/* the next blocks are written by their tasks */
+	if (parity_write_vector(parity, task->position, iov, n, block_size) != 0)
+		return parity_write(parity, task->position, task->buffer, block_size);
+
+	/* mark the next tasks as already written */
+	for (i = 1; i < n; ++i)
+		run_map[i]->ahead_written = 1;
+
+	return 0;
+}
+#endif
+
+void io_task_parity_write(struct snapraid_worker* worker, struct snapraid_task* task,
+	void (*done)(struct snapraid_worker* worker, struct snapraid_task* task, int ret))
+{
+	struct snapraid_parity_handle* parity = worker->parity_handle;
+	unsigned block_size = worker->io->state->block_size;
+
+#if HAVE_IO_URING
+	if (worker->ring) {
+		data_off_t offset = task->position * (data_off_t)block_size;
+
+		if (worker->ring_file != -1)
+			io_ring_submit(worker, task, 0, done, 1, worker->ring_file, 1, 0, offset, block_size);
+		else
+			io_ring_submit(worker, task, 0, done, 1, parity->f, 0, 0, offset, block_size);
+		return;
+	}
+#endif
+
+	/* if the data was already written with a previous task */
+	if (task->ahead_written) {
+		done(worker, task, 0);
+		return;
+	}
+
+#if HAVE_PTHREAD && HAVE_PWRITEV
+	done(worker, task, io_task_parity_write_coalesce(worker, task));
+#else
+	done(worker, task, parity_write(parity, task->position, task->buffer, block_size));
+#endif
+}
@@ -42,6 +42,28 @@
 #define IO_MIN 3 /* required by writers, readers can work also with 2 */
 #define IO_MAX 128
 
+/**
+ * Min number of read-ahead buffers owned by a reader.
+ *
+ * The reader needs one buffer for the block the caller is waiting,
+ * and another to start the next block.
+ */
+#define IO_DEPTH_MIN 2
+
+/**
+ * Max size read with a single request by a reader.
+ *
+ * The consecutive blocks of the same file, already scheduled in the ring
+ * of the reader, are read with a single preadv() instead of a read
+ * for each block.
+ */
+#define IO_COALESCE_SIZE (1024 * 1024)
+
+/**
+ * Max number of threads used by the io_uring engine.
+ */
+#define IO_RING_MAX 4
+
 /**
  * State of the task.
  */
@@ -49,7 +71,7 @@
 #define TASK_STATE_ERROR_CONTINUE -3 /**< Generic error. Continuation requested. */
 #define TASK_STATE_IOERROR -2 /**< IO error. Failure requested. */
 #define TASK_STATE_ERROR -1 /**< Generic error. Failure requested. */
-#define TASK_STATE_EMPTY 0 /**< Nothing to do. */
+#define TASK_STATE_EMPTY 0 /**< Nothing to do, or no data at the position. The buffer is not cleared. */
 #define TASK_STATE_READY 1 /**< Ready to start. */
 #define TASK_STATE_DONE 2 /**< Task completed. */
 
@@ -59,7 +81,8 @@
  * This represents the minimal element of work that worker threads are
  * going to be asked to do.
  *
- * It consists in reading a block of data from a disk.
+ * It consists in reading a block of data from a disk, and optionally
+ * in computing its hash.
  *
  * Note that the disk to use is defined implicitly in the worker thread.
  */
@@ -78,8 +101,57 @@ struct snapraid_task {
 	block_off_t file_pos;
 	int read_size; /**< Size of the data read. */
 	int is_timestamp_different; /**< Report if file has a changed timestamp. */
+	int is_larger; /**< Report if file is larger than expected. */
+	int is_created; /**< Report if file was created when opening it. */
+	int is_missing; /**< Report if file cannot be opened. */
+
+	/**
+	 * Hashes of the data read.
+	 *
+	 * Computed by the worker thread, if the reader callback supports it,
+	 * to move the hashing work out of the main thread.
+	 */
+	unsigned char hash[HASH_MAX]; /**< Hash of the data, computed with the hash of the block. */
+	unsigned char rehash[HASH_MAX]; /**< Hash of the data, computed with the new hash. Only in case of rehash. */
+	uint64_t tick_hash; /**< Time spent to compute the hashes, in tick() units. */
+
+	/**
+	 * Data already read in the buffer.
+	 *
+	 * Set by the worker when it reads the blocks of the next tasks
+	 * together with the current one.
+	 */
+	struct snapraid_file* ahead_file; /**< File of the data read. 0 if nothing was read. */
+	block_off_t ahead_file_pos; /**< Position in the file of the data read. */
+	int ahead_size; /**< Size of the data read. */
+
+	/**
+	 * Data already written from the buffer.
+	 *
+	 * Set by the writer when it writes the blocks of the next tasks
+	 * together with the current one.
+	 */
+	int ahead_written; /**< If the block was already written. */
+
+	/**
+	 * Request submitted with io_task_handle_read(), io_task_parity_read() or io_task_parity_write().
+	 *
+	 * Used only by the io_uring engine to complete the request.
+	 */
+	struct snapraid_worker* req_worker; /**< Worker of the request. */
+	void (*req_done)(struct snapraid_worker*, struct snapraid_task*, int); /**< Continuation to call at completion. */
+	fptr* req_out; /**< Function used to report errors. */
+	int req_write; /**< If it's a write. */
+	int req_fd; /**< File descriptor, or index of the registered file. */
+	int req_fixed_file; /**< If ::req_fd is the index of a registered file. */
+	int req_direct; /**< If the file is in direct mode, and the read has to be aligned. */
+	data_off_t req_offset; /**< Offset in the file. */
+	unsigned req_size; /**< Size to read or write. */
+	unsigned req_count; /**< Size already completed. */
 };
 
+struct snapraid_ring;
+
 /**
  * Worker for tasks.
  *
@@ -107,6 +179,12 @@ struct snapraid_worker {
 	 * Vector of tasks.
 	 *
 	 * It's a ring of tasks reused cycle after cycle.
+	 *
+	 * The ring has a single producer, the IO, and a single consumer,
+	 * the worker. The head of the ring is the ::reader_index or
+	 * ::writer_index of the IO, shared by all the workers because
+	 * the IO fills all the rings at the same time, and the tail
+	 * is the ::index of the worker.
 	 */
 	struct snapraid_task task_map[IO_MAX];
 
@@ -114,15 +192,138 @@ struct snapraid_worker {
 	 * The task in progress by the worker thread.
 	 *
 	 * It's an index inside in the ::task_map vector.
+	 *
+	 * It's written only by the worker, and moving it to the next
+	 * task publishes to the IO the completion of the previous one.
+	 * It's accessed with atomic operations.
 	 */
 	unsigned index;
 
+#if HAVE_PTHREAD
+	/**
+	 * Wait of the worker for a new task.
+	 *
+	 * The worker sleeps on ::cond only when its ring is empty,
+	 * after setting ::waiting, and the IO signals it only in such case.
+	 */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int waiting;
+#endif
+
 	/**
 	 * Which buffer base index should be used for destination.
 	 */
 	unsigned buffer_skew;
+
+#if HAVE_PTHREAD
+	/**
+	 * Free buffers of the reader.
+	 *
+	 * The buffers of the readers are not bound at the IO slots, but taken
+	 * from the pool of the IO. The reader gets a buffer from this ring
+	 * when it starts a new task, and the IO returns it when the caller
+	 * is done with the block.
+	 *
+	 * The ring has a single producer, the IO, and a single consumer,
+	 * the worker. The ::free_head is accessed with atomic operations.
+	 */
+	unsigned char* free_map[IO_MAX];
+	unsigned free_head; /**< Next position to fill. Written only by the IO. */
+	unsigned free_tail; /**< Next position to use. Used only by the worker. */
+
+	/**
+	 * Read-ahead depth of the reader.
+	 *
+	 * It's the number of buffers owned by the reader, adapted while running
+	 * to give more buffers to the readers of the slower disks.
+	 * Used only by the IO.
+	 */
+	unsigned buffer_owned; /**< Buffers currently owned. */
+	unsigned buffer_depth; /**< Buffers that should be owned. */
+	unsigned starving; /**< Number of times the IO found the reader without a block ready. */
+
+	/**
+	 * Time spent to complete a task, in tick() units.
+	 */
+	uint64_t tick_start; /**< Start of the task in progress. Used only by the worker. */
+	uint64_t latency; /**< Moving average of the time of the tasks. Accessed with atomic operations. */
+#endif
+
+#if HAVE_IO_URING
+	/**
+	 * State in the io_uring engine.
+	 *
+	 * The tasks of the worker are run by the ring thread.
+	 * Readers have also a thread running the continuation of the reads,
+	 * like the hash of the block, to not delay the other requests of the ring.
+	 * It waits on ::cond for the ::post_task, protected by ::mutex.
+	 */
+	struct snapraid_ring* ring; /**< Ring running the worker. 0 if not using io_uring. */
+	int ring_file; /**< Index of the registered file of the parity handle. -1 if not registered. */
+	int ring_busy; /**< If the current task is not yet completed. Accessed with atomic operations. */
+	int ring_submitted; /**< If the current task has a request in the ring. */
+	int ring_state; /**< State of the latest task completed by a writer. */
+	pthread_t post_thread; /**< Thread running the continuation of the reads. */
+	struct snapraid_task* post_task; /**< Task with the read completed, waiting for the continuation. 0 if none. */
+	int post_ret; /**< Result of the read of ::post_task. */
+	int post_exit; /**< Set to terminate ::post_thread. */
+#endif
 };
 
+#if HAVE_IO_URING
+/**
+ * Thread of the io_uring engine.
+ *
+ * Each thread has its ring, and runs the tasks of a subset of the workers,
+ * keeping a read or write in progress for each one of them.
+ */
+struct snapraid_ring {
+	pthread_t thread; /**< Thread context for the ring. */
+	struct snapraid_io* io; /**< Parent pointer. */
+	int fd; /**< Descriptor of the io_uring. */
+	int event; /**< Event used to wake up the thread when new tasks are scheduled. */
+	int event_armed; /**< If the poll of the event is in the ring. */
+	int waiting; /**< If the thread may wait for the event. Accessed with atomic operations. */
+	uint64_t event_value; /**< Buffer for reading the event. */
+	int has_buffer; /**< If the IO buffers are registered. */
+	unsigned char* static_begin; /**< Begin of the registered buffer of the sets not used by readers. */
+	unsigned char* static_end; /**< End of the registered buffer of the sets not used by readers. */
+	unsigned char* pool_begin; /**< Begin of the registered buffer of the pool of the readers. */
+	unsigned char* pool_end; /**< End of the registered buffer of the pool of the readers. */
+
+	/**
+	 * Submission queue mapped from the kernel.
+	 */
+	void* sq_map;
+	size_t sq_map_size;
+	unsigned* sq_head;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	struct io_uring_sqe* sqe_map;
+	size_t sqe_map_size;
+	unsigned sq_pending; /**< Entries added, but not yet submitted. */
+
+	/**
+	 * Completion queue mapped from the kernel.
+	 */
+	void* cq_map;
+	size_t cq_map_size;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	struct io_uring_cqe* cqe_map;
+
+	/**
+	 * Workers run by the ring.
+	 */
+	unsigned worker_max;
+	struct snapraid_worker** worker_map;
+	struct snapraid_worker** start_map; /**< Workers with a new task to start. */
+};
+#endif
+
 /**
  * Number of error kind for writers.
  */
@@ -144,51 +345,39 @@ struct snapraid_io {
 	 * Between IO_MIN and IO_MAX for thread use.
 	 *
 	 * If equal to 1, it means to work without any thread.
+	 *
+	 * With threads, it's the max read-ahead of a single reader,
+	 * and the buffers of the readers are limited by ::pool_max.
 	 */
 	unsigned io_max;
 
 #if HAVE_PTHREAD
 	/**
-	 * Mutex used to protect the synchronization
-	 * between the io and the workers.
+	 * Mutex used to protect the wait of the IO for the workers.
+	 *
+	 * The synchronization between the io and the workers is lock free,
+	 * and the mutex is used only when the IO has to sleep.
 	 */
 	pthread_mutex_t io_mutex;
 
 	/**
 	 * Condition for a new read is completed.
 	 *
-	 * The workers signal this condition when a new read is completed.
 	 * The IO waits on this condition when it's waiting for
-	 * a new read to be completed.
+	 * a new read to be completed, after setting ::read_waiting.
+	 * The workers signal this condition when the read the IO
+	 * is waiting for is completed, but only if ::read_waiting is set.
 	 */
 	pthread_cond_t read_done;
-
-	/**
-	 * Condition for a new read scheduled.
-	 *
-	 * The workers wait on this condition when they are waiting for a new
-	 * read to process.
-	 * The IO signals this condition when new reads are scheduled.
-	 */
-	pthread_cond_t read_sched;
+	int read_waiting;
 
 	/**
 	 * Condition for a new write is completed.
 	 *
-	 * The workers signal this condition when a new write is completed.
-	 * The IO waits on this condition when it's waiting for
-	 * a new write to be completed.
+	 * Like ::read_done, but for writes.
 	 */
 	pthread_cond_t write_done;
-
-	/**
-	 * Condition for a new write scheduled.
-	 *
-	 * The workers wait on this condition when they are waiting for a new
-	 * write to process.
-	 * The IO signals this condition when new writes are scheduled.
-	 */
-	pthread_cond_t write_sched;
+	int write_waiting;
 #endif
 
 	/**
@@ -226,9 +415,36 @@ struct snapraid_io {
 	 * A pool of buffers used to store the data read.
 	 */
 	unsigned buffer_max; /**< Number of buffers. */
-	void* buffer_alloc_map[IO_MAX]; /**< Allocation map for buffers. */
+	void* buffer_alloc; /**< Allocation of the buffers, in huge pages. */
 	void** buffer_map[IO_MAX]; /**< Buffers for data. */
 
+	/**
+	 * Buffers not used by readers, like the ones of the parity computed.
+	 *
+	 * They are allocated in sets for the read-ahead depth, and not for
+	 * each IO slot, as only the readers may go ahead more than the depth.
+	 * A set is assigned at the slot when it's returned by io_read_next(),
+	 * and the writers must complete it before the set is assigned again.
+	 */
+	void** buffer_static; /**< Buffers of all the sets. 0 if not used. */
+	void** buffer_static_map[IO_MAX]; /**< Buffers of each set, inside ::buffer_static. 0 if not used. */
+	unsigned buffer_static_count; /**< Number of sets. */
+	unsigned buffer_static_next; /**< Next set to assign. */
+	unsigned char* buffer_reader; /**< Mask of the buffers of the slot used by readers. */
+
+	/**
+	 * Pool of buffers for the readers.
+	 *
+	 * With threads, the buffers of the readers in ::buffer_map are
+	 * set by the readers themselves, taking them from this pool.
+	 * This allows a different read-ahead for each disk, keeping
+	 * the total memory used bounded.
+	 */
+	unsigned pool_max; /**< Number of buffers in the pool. 0 if not used. */
+	void* pool_alloc; /**< Allocation of the pool, in huge pages. */
+	void** pool_map; /**< Buffers of the pool. */
+	unsigned adapt_countdown; /**< Blocks before the next adaptation of the read-ahead depths. */
+
 	/**
 	 * Workers.
 	 *
@@ -254,6 +470,8 @@ struct snapraid_io {
 
 	/**
 	 * Exit condition for all threads.
+	 *
+	 * It's accessed with atomic operations.
 	 */
 	int done;
 
@@ -264,7 +482,8 @@ struct snapraid_io {
 	 * it goes again to 0.
 	 *
 	 * When the caller finish with the current index,
-	 * it's incremented, and a read_sched() signal is sent.
+	 * it's incremented, and the readers waiting are woken up.
+	 * It's accessed with atomic operations.
 	 *
 	 * In monothread mode it isn't the task index,
 	 * but the worker index.
@@ -278,7 +497,8 @@ struct snapraid_io {
 	 * it goes again to 0.
 	 *
 	 * When the caller finish with the current index,
-	 * it's incremented, and a write_sched() signal is sent.
+	 * it's incremented, and the writers waiting are woken up.
+	 * It's accessed with atomic operations.
 	 *
 	 * In monothread mode it isn't the task index,
 	 * but the worker index.
@@ -287,8 +507,20 @@ struct snapraid_io {
 
 	/**
 	 * Counts the error happening in the writers.
+	 *
+	 * It's accessed with atomic operations.
 	 */
 	int writer_error[IO_WRITER_ERROR_MAX];
+
+#if HAVE_IO_URING
+	/**
+	 * Threads of the io_uring engine.
+	 *
+	 * If ::ring_max is 0, the engine is not used.
+	 */
+	unsigned ring_max;
+	struct snapraid_ring ring_map[IO_RING_MAX];
+#endif
 };
 
 /**
@@ -330,6 +562,7 @@ void (*io_stop)(struct snapraid_io* io);
  *
  * \param io InputOutput context.
  * \param buffer The data buffers to use for this position.
+ * The buffers of the readers are valid only after their task is returned.
  * \return The parity position.
  */
 block_off_t (*io_read_next)(struct snapraid_io* io, void*** buffer);
@@ -396,5 +629,36 @@ void (*io_write_next)(struct snapraid_io* io, block_off_t blockcur, int skip, in
  */
 void (*io_refresh)(struct snapraid_io* io);
 
+/**
+ * Read the data block of a task from the file opened in the worker handle.
+ *
+ * It's like handle_read() at the position ::file_pos, but with the io_uring
+ * engine the read is only submitted, and the worker callback has to return
+ * immediately. The ::done continuation is called when the read completes.
+ * With the other engines, the read is completed, and ::done is called
+ * before returning.
+ *
+ * The continuation receives the same value returned by handle_read(),
+ * and on error errno is set.
+ */
+void io_task_handle_read(struct snapraid_worker* worker, struct snapraid_task* task, fptr* out, fptr* out_missing,
+	void (*done)(struct snapraid_worker* worker, struct snapraid_task* task, int ret));
+
+/**
+ * Read the parity block of a task from the worker parity handle.
+ *
+ * Like io_task_handle_read(), but for parity_read().
+ */
+void io_task_parity_read(struct snapraid_worker* worker, struct snapraid_task* task, fptr* out,
+	void (*done)(struct snapraid_worker* worker, struct snapraid_task* task, int ret));
+
+/**
+ * Write the parity block of a task to the worker parity handle.
+ *
+ * Like io_task_handle_read(), but for parity_write().
+ */
+void io_task_parity_write(struct snapraid_worker* worker, struct snapraid_task* task,
+	void (*done)(struct snapraid_worker* worker, struct snapraid_task* task, int ret));
+
 #endif
 
@@ -34,6 +34,7 @@ void state_list(struct snapraid_state* state)
 	unsigned link_count;
 	char esc_buffer[ESC_MAX];
 	char esc_buffer_alt[ESC_MAX];
+	char sub_buffer[PATH_MAX];
 
 	file_count = 0;
 	file_size = 0;
@@ -61,7 +62,7 @@ void state_list(struct snapraid_state* state)
 			++file_count;
 			file_size += file->size;
 
-			log_tag("file:%s:%s:%" PRIu64 ":%" PRIi64 ":%u:%" PRIi64 "\n", disk->name, esc(file->sub, esc_buffer), file->size, file->mtime_sec, file->mtime_nsec, file->inode);
+			log_tag("file:%s:%s:%" PRIu64 ":%" PRIi64 ":%u:%" PRIi64 "\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer), file->size, file->mtime_sec, file->mtime_nsec, file->inode);
 
 			t = file->mtime_sec;
 #if HAVE_LOCALTIME_R
@@ -77,7 +78,7 @@ void state_list(struct snapraid_state* state)
 					printf(":%02u.%03u", tm->tm_sec, file->mtime_nsec / 1000000);
 				printf(" ");
 			}
-			printf("%s%s\n", disk->dir, file->sub);
+			printf("%s%s\n", disk->dir, file_sub(file, sub_buffer));
 		}
 
 		/* sort by name */
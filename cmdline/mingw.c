@@ -1792,6 +1792,25 @@ uint64_t tick_ms(void)
 	return GetTickCount();
 }
 
+uint64_t tick_cpu_ms(void)
+{
+	FILETIME creation_time;
+	FILETIME exit_time;
+	FILETIME kernel_time;
+	FILETIME user_time;
+	uint64_t kernel;
+	uint64_t user;
+
+	if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time))
+		return 0;
+
+	/* the times are in 100 nanoseconds units */
+	kernel = kernel_time.dwLowDateTime | ((uint64_t)kernel_time.dwHighDateTime << 32);
+	user = user_time.dwLowDateTime | ((uint64_t)user_time.dwHighDateTime << 32);
+
+	return (kernel + user) / 10000;
+}
+
 int randomize(void* void_ptr, size_t size)
 {
 	size_t i;
@@ -75,30 +75,17 @@ uint32_t c2 = 0xab0e9789;
 uint32_t c3 = 0x38b34ae5;
 uint32_t c4 = 0xa1e38b93;
 
-void MurmurHash3_x86_128(const void* data, size_t size, const uint8_t* seed, void* digest)
+/**
+ * Process whole blocks of 16 bytes.
+ */
+static void MurmurHash3_x86_128_blocks(uint32_t* h, const uint32_t* blocks, size_t nblocks)
 {
-	size_t nblocks;
-	const uint32_t* blocks;
-	const uint32_t* end;
-	size_t size_remainder;
-
-	uint32_t h1 = ((const uint32_t*)seed)[0];
-	uint32_t h2 = ((const uint32_t*)seed)[1];
-	uint32_t h3 = ((const uint32_t*)seed)[2];
-	uint32_t h4 = ((const uint32_t*)seed)[3];
-
-#if WORDS_BIGENDIAN
-	h1 = util_swap32(h1);
-	h2 = util_swap32(h2);
-	h3 = util_swap32(h3);
-	h4 = util_swap32(h4);
-#endif
+	const uint32_t* end = blocks + nblocks * 4;
+	uint32_t h1 = h[0];
+	uint32_t h2 = h[1];
+	uint32_t h3 = h[2];
+	uint32_t h4 = h[3];
 
-	nblocks = size / 16;
-	blocks = data;
-	end = blocks + nblocks * 4;
-
-	/* body */
 	while (blocks < end) {
 		uint32_t k1 = blocks[0];
 		uint32_t k2 = blocks[1];
@@ -131,10 +118,70 @@ void MurmurHash3_x86_128(const void* data, size_t size, const uint8_t* seed, voi
 		blocks += 4;
 	}
 
+	h[0] = h1;
+	h[1] = h2;
+	h[2] = h3;
+	h[3] = h4;
+}
+
+void MurmurHash3_x86_128_init(struct murmur3_ctx* ctx, const uint8_t* seed)
+{
+	unsigned i;
+
+	for (i = 0; i < 4; ++i) {
+		ctx->h[i] = ((const uint32_t*)seed)[i];
+#if WORDS_BIGENDIAN
+		ctx->h[i] = util_swap32(ctx->h[i]);
+#endif
+	}
+
+	ctx->size = 0;
+}
+
+void MurmurHash3_x86_128_update(struct murmur3_ctx* ctx, const void* data, size_t size)
+{
+	const uint8_t* ptr = data;
+	size_t used = ctx->size & 15;
+
+	ctx->size += size;
+
+	/* complete the block left pending by the previous call */
+	if (used != 0) {
+		size_t fill = 16 - used;
+		if (fill > size)
+			fill = size;
+
+		memcpy((uint8_t*)ctx->buf + used, ptr, fill);
+		ptr += fill;
+		size -= fill;
+
+		/* if still not complete, wait for more data */
+		if (used + fill < 16)
+			return;
+
+		MurmurHash3_x86_128_blocks(ctx->h, ctx->buf, 1);
+	}
+
+	/* body */
+	MurmurHash3_x86_128_blocks(ctx->h, (const uint32_t*)ptr, size / 16);
+
+	/* keep the tail for the next call */
+	memcpy(ctx->buf, ptr + (size & ~(size_t)15), size & 15);
+}
+
+void MurmurHash3_x86_128_final(struct murmur3_ctx* ctx, void* digest)
+{
+	size_t size = ctx->size;
+	size_t size_remainder;
+	uint32_t h1 = ctx->h[0];
+	uint32_t h2 = ctx->h[1];
+	uint32_t h3 = ctx->h[2];
+	uint32_t h4 = ctx->h[3];
+
 	/* tail */
 	size_remainder = size & 15;
 	if (size_remainder != 0) {
-		const uint8_t* tail = (const uint8_t*)blocks;
+		const uint8_t* tail = (const uint8_t*)ctx->buf;
 
 		uint32_t k1 = 0;
 		uint32_t k2 = 0;
@@ -191,3 +238,11 @@ void MurmurHash3_x86_128(const void* data, size_t size, const uint8_t* seed, voi
 	((uint32_t*)digest)[3] = h4;
 }
 
+void MurmurHash3_x86_128(const void* data, size_t size, const uint8_t* seed, void* digest)
+{
+	struct murmur3_ctx ctx;
+
+	MurmurHash3_x86_128_init(&ctx, seed);
+	MurmurHash3_x86_128_update(&ctx, data, size);
+	MurmurHash3_x86_128_final(&ctx, digest);
+}
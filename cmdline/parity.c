@@ -117,6 +117,7 @@ void parity_overflow(struct snapraid_state* state, data_off_t size)
 	block_off_t blockalloc;
 	int first = 1;
 	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
 
 	/* don't report if everything is outside or if the file is not accessible */
 	if (size == 0) {
@@ -137,13 +138,13 @@ void parity_overflow(struct snapraid_state* state, data_off_t size)
 			if (file->blockmax > 0) {
 				block_off_t parity_pos = fs_file2par_get(disk, file, file->blockmax - 1);
 				if (parity_pos >= blockalloc) {
-					log_tag("outofparity:%s:%s\n", disk->name, esc(file->sub, esc_buffer));
+					log_tag("outofparity:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 					if (first) {
 						first = 0;
 						log_fatal("\nYour data requires more parity than the available space.\n");
 						log_fatal("Please move the files 'outofparity' to another data disk:\n");
 					}
-					log_fatal("outofparity %s%s\n", disk->dir, file->sub);
+					log_fatal("outofparity %s%s\n", disk->dir, file_sub(file, sub_buffer));
 				}
 			}
 		}
@@ -160,10 +161,20 @@ int parity_create(struct snapraid_parity_handle* parity, unsigned level, const c
 
 	/* opening in sequential mode in Windows */
 	/* O_SEQUENTIAL: opening in sequential mode in Windows */
+	/* O_DIRECT: bypass the OS cache */
 	flags = O_RDWR | O_CREAT | O_BINARY;
 	if ((mode & MODE_SEQUENTIAL) != 0)
 		flags |= O_SEQUENTIAL;
+#ifdef O_DIRECT
+	if ((mode & MODE_DIRECT) != 0)
+		flags |= O_DIRECT;
+#endif
 	parity->f = open(parity->path, flags, 0600);
+#ifdef O_DIRECT
+	/* if the file-system doesn't support direct I/O, use the OS cache */
+	if (parity->f == -1 && errno == EINVAL && (flags & O_DIRECT) != 0)
+		parity->f = open(parity->path, flags & ~O_DIRECT, 0600);
+#endif
 	if (parity->f == -1) {
 		/* LCOV_EXCL_START */
 		log_fatal("Error opening parity file '%s'. %s.\n", parity->path, strerror(errno));
@@ -197,6 +208,10 @@ int parity_create(struct snapraid_parity_handle* parity, unsigned level, const c
 	parity->valid_size = parity->st.st_size;
 	*out_size = parity->st.st_size;
 
+	/* start the writeback only if requested */
+	parity->writeback = (mode & MODE_WRITEBACK) != 0;
+	parity->writeback_pos = 0;
+
 	return 0;
 
 bail:
@@ -336,10 +351,20 @@ int parity_open(struct snapraid_parity_handle* parity, unsigned level, const cha
 	/* open for read */
 	/* O_SEQUENTIAL: opening in sequential mode in Windows */
 	/* O_NOATIME: do not change access time */
+	/* O_DIRECT: bypass the OS cache */
 	flags = O_RDONLY | O_BINARY;
 	if ((mode & MODE_SEQUENTIAL) != 0)
 		flags |= O_SEQUENTIAL;
+#ifdef O_DIRECT
+	if ((mode & MODE_DIRECT) != 0)
+		flags |= O_DIRECT;
+#endif
 	parity->f = open_noatime(parity->path, flags);
+#ifdef O_DIRECT
+	/* if the file-system doesn't support direct I/O, use the OS cache */
+	if (parity->f == -1 && errno == EINVAL && (flags & O_DIRECT) != 0)
+		parity->f = open_noatime(parity->path, flags & ~O_DIRECT);
+#endif
 	if (parity->f == -1) {
 		log_fatal("Error opening parity file '%s'. %s.\n", parity->path, strerror(errno));
 		return -1;
@@ -357,6 +382,10 @@ int parity_open(struct snapraid_parity_handle* parity, unsigned level, const cha
 	/* get the size of the existing data */
 	parity->valid_size = parity->st.st_size;
 
+	/* nothing is written */
+	parity->writeback = 0;
+	parity->writeback_pos = 0;
+
 #if HAVE_POSIX_FADVISE
 	if ((mode & MODE_SEQUENTIAL) != 0) {
 		/* advise sequential access */
@@ -427,6 +456,46 @@ int parity_close(struct snapraid_parity_handle* parity)
 	return 0;
 }
 
+/**
+ * Start the writeback of the data just written.
+ *
+ * The writeback of the data written before the latest PARITY_WRITEBACK_SIZE
+ * bytes is waited, to keep the dirty data in the OS cache limited, and to
+ * have it written progressively, instead of all at the flush.
+ *
+ * Errors are ignored, as this is only a hint, and any write error is
+ * anyway reported by parity_sync().
+ */
+static void parity_writeback(struct snapraid_parity_handle* parity, data_off_t offset, data_off_t size)
+{
+#if HAVE_SYNC_FILE_RANGE
+	data_off_t end = offset + size;
+
+	if (!parity->writeback)
+		return;
+
+	/* if the write jumps ahead, restart from it */
+	if (offset > parity->writeback_pos + 2 * PARITY_WRITEBACK_SIZE)
+		parity->writeback_pos = offset;
+
+	/* start the writeback of the new data */
+	sync_file_range(parity->f, offset, size, SYNC_FILE_RANGE_WRITE);
+
+	/* wait for the writeback of the older data */
+	if (end > parity->writeback_pos + 2 * PARITY_WRITEBACK_SIZE) {
+		data_off_t wait_end = end - PARITY_WRITEBACK_SIZE;
+
+		sync_file_range(parity->f, parity->writeback_pos, wait_end - parity->writeback_pos, SYNC_FILE_RANGE_WAIT_BEFORE);
+
+		parity->writeback_pos = wait_end;
+	}
+#else
+	(void)parity;
+	(void)offset;
+	(void)size;
+#endif
+}
+
 int parity_write(struct snapraid_parity_handle* parity, block_off_t pos, unsigned char* block_buffer, unsigned block_size)
 {
 	ssize_t write_ret;
@@ -454,9 +523,36 @@ int parity_write(struct snapraid_parity_handle* parity, block_off_t pos, unsigne
 	/* Here doesn't make sense to call posix_fadvise(..., POSIX_FADV_DONTNEED) because */
 	/* at this time the data is still in not yet written and it cannot be discharged. */
 
+	parity_writeback(parity, offset, block_size);
+
 	return 0;
 }
 
+#if HAVE_PWRITEV
+int parity_write_vector(struct snapraid_parity_handle* parity, block_off_t pos, const struct iovec* iov, unsigned iov_count, unsigned block_size)
+{
+	ssize_t write_ret;
+	data_off_t offset;
+	data_off_t size;
+
+	offset = pos * (data_off_t)block_size;
+	size = iov_count * (data_off_t)block_size;
+
+	write_ret = pwritev(parity->f, iov, iov_count, offset);
+	if (write_ret != (ssize_t)size) /* conversion is safe because the vector is limited */
+		return -1;
+
+	/* adjust the size of the valid data */
+	if (parity->valid_size < offset + size) {
+		parity->valid_size = offset + size;
+	}
+
+	parity_writeback(parity, offset, size);
+
+	return 0;
+}
+#endif
+
 int parity_read(struct snapraid_parity_handle* parity, block_off_t pos, unsigned char* block_buffer, unsigned block_size, fptr* out)
 {
 	ssize_t read_ret;
@@ -29,8 +29,15 @@ struct snapraid_parity_handle {
 	int f; /**< Handle of the file. */
 	struct stat st; /**< Stat info of the opened file. */
 	data_off_t valid_size; /**< Size of the valid data. */
+	int writeback; /**< If the writeback of the data is started as soon as it's written. */
+	data_off_t writeback_pos; /**< Position before which the writeback is completed. */
 };
 
+/**
+ * Size of the data kept in writeback before waiting for it.
+ */
+#define PARITY_WRITEBACK_SIZE (16 * 1024 * 1024)
+
 /**
  * Compute the size of the allocated parity data in number of blocks.
  *
@@ -73,6 +80,9 @@ void parity_overflow(struct snapraid_state* state, data_off_t size);
 
 /**
  * Create the parity file.
+ * With MODE_DIRECT the file is opened in direct mode, if supported by the file-system.
+ * With MODE_WRITEBACK the writeback of the data is started as soon as it's written,
+ * and only the latest PARITY_WRITEBACK_SIZE bytes are left to write at the flush.
  * \param out_size Return the size of the parity file.
  */
 int parity_create(struct snapraid_parity_handle* parity, unsigned level, const char* path, data_off_t* out_size, int mode);
@@ -85,6 +95,7 @@ int parity_chsize(struct snapraid_parity_handle* parity, data_off_t size, data_o
 
 /**
  * Open an already existing parity file.
+ * With MODE_DIRECT the file is opened in direct mode, if supported by the file-system.
  */
 int parity_open(struct snapraid_parity_handle* parity, unsigned level, const char* path, int mode);
 
@@ -100,13 +111,26 @@ int parity_close(struct snapraid_parity_handle* parity);
 
 /**
  * Read a block from the parity file.
+ * In direct mode the buffer must be allocated with malloc_nofail_direct() or malloc_nofail_vector_huge().
  */
 int parity_read(struct snapraid_parity_handle* parity, block_off_t pos, unsigned char* block_buffer, unsigned block_size, fptr* out);
 
 /**
  * Write a block in the parity file.
+ * In direct mode the buffer must be allocated with malloc_nofail_direct() or malloc_nofail_vector_huge().
  */
 int parity_write(struct snapraid_parity_handle* parity, block_off_t pos, unsigned char* block_buffer, unsigned block_size);
 
+#if HAVE_PWRITEV
+/**
+ * Write consecutive blocks in the parity file with a single call.
+ * Each element of the vector is a full block.
+ * It doesn't report errors, as the caller is expected to write the blocks
+ * one by one with parity_write() to report them.
+ * In direct mode the buffers must be allocated with malloc_nofail_direct() or malloc_nofail_vector_huge().
+ */
+int parity_write_vector(struct snapraid_parity_handle* parity, block_off_t pos, const struct iovec* iov, unsigned iov_count, unsigned block_size);
+#endif
+
 #endif
 
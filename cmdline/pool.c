@@ -145,17 +145,66 @@ static int clean_dir(struct snapraid_state* state, const char* dir)
 }
 
 /**
- * Create a link to the specified disk entry.
+ * Link expected in the pool.
  */
-static void make_link(const char* pool_dir, const char* share_dir, struct snapraid_disk* disk, const char* sub)
+struct snapraid_pool_link {
+	struct snapraid_disk* disk; /**< Disk containing the file. */
+	char* sub; /**< Sub path of the file. */
+	int present; /**< If the link is already present and correct in the pool. */
+
+	/* nodes for data structures */
+	tommy_node node;
+	tommy_hashdyn_node nodeset;
+};
+
+static int pool_link_compare(const void* void_arg, const void* void_data)
 {
-	char path[PATH_MAX];
-	char linkto[PATH_MAX];
-	char linkto_exported[PATH_MAX];
-	int ret;
+	const char* arg = void_arg;
+	const struct snapraid_pool_link* link = void_data;
 
-	/* make the source path */
-	pathprint(path, sizeof(path), "%s%s", pool_dir, sub);
+	return strcmp(arg, link->sub);
+}
+
+/**
+ * Insert a link in the set of the expected ones.
+ */
+static unsigned pool_link_insert(tommy_list* linklist, tommy_hashdyn* linkset, const char* pool_dir, struct snapraid_disk* disk, const char* sub)
+{
+	struct snapraid_pool_link* link;
+	tommy_uint32_t hash = file_path_hash(sub);
+
+	/* the first disk wins, like when creating the links in order */
+	if (tommy_hashdyn_search(linkset, pool_link_compare, sub, hash) != 0) {
+		log_fatal("WARNING! Duplicate pooling for '%s%s'\n", pool_dir, sub);
+		return 0;
+	}
+
+	link = malloc_nofail(sizeof(struct snapraid_pool_link));
+	link->disk = disk;
+	link->sub = strdup_nofail(sub);
+	link->present = 0;
+
+	tommy_list_insert_tail(linklist, &link->node, link);
+	tommy_hashdyn_insert(linkset, &link->nodeset, link, hash);
+
+	return 1;
+}
+
+/**
+ * Free a link.
+ */
+static void pool_link_free(struct snapraid_pool_link* link)
+{
+	free(link->sub);
+	free(link);
+}
+
+/**
+ * Make the target of the link to the specified disk entry.
+ */
+static void make_linkto(char* linkto_exported, size_t size, const char* share_dir, struct snapraid_disk* disk, const char* sub)
+{
+	char linkto[PATH_MAX];
 
 	/* make the linkto path */
 	if (share_dir[0] != 0) {
@@ -166,6 +215,177 @@ static void make_link(const char* pool_dir, const char* share_dir, struct snapra
 		pathprint(linkto, sizeof(linkto), "%s%s", disk->dir, sub);
 	}
 
+	/* convert back slashes */
+	pathexport(linkto_exported, size, linkto);
+}
+
+/**
+ * Update a directory tree removing all the symlinks and empty directories
+ * not matching the expected links, and marking the ones already present.
+ * Return == 0 if the directory is empty, and it can be removed
+ */
+static int update_dir(struct snapraid_state* state, tommy_hashdyn* linkset, const char* share_dir, const char* dir, const char* sub, unsigned* removed)
+{
+	DIR* d;
+	int ignored = 0;
+	int kept = 0;
+
+	d = opendir(dir);
+	if (!d) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error opening pool directory '%s'. %s.\n", dir, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	while (1) {
+		char path_next[PATH_MAX];
+		char sub_next[PATH_MAX];
+		struct stat st;
+		const char* name;
+		struct dirent* dd;
+
+		/* clear errno to detect erroneous conditions */
+		errno = 0;
+		dd = readdir(d);
+		if (dd == 0 && errno != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error reading pool directory '%s'. %s.\n", dir, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+		if (dd == 0 && errno == 0) {
+			break; /* finished */
+		}
+
+		/* skip "." and ".." files */
+		name = dd->d_name;
+		if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+			continue;
+
+		pathprint(path_next, sizeof(path_next), "%s%s", dir, name);
+		pathprint(sub_next, sizeof(sub_next), "%s%s", sub, name);
+
+#if HAVE_STRUCT_DIRENT_D_STAT
+		/* convert dirent to lstat result */
+		dirent_lstat(dd, &st);
+
+		/* if the st_mode field is missing, takes care to fill it using normal lstat() */
+		/* at now this can happen only in Windows */
+		if (st.st_mode == 0) {
+			if (lstat(path_next, &st) != 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Error in stat file/directory '%s'. %s.\n", path_next, strerror(errno));
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+		}
+#else
+		/* get lstat info about the file */
+		if (lstat(path_next, &st) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error in stat file/directory '%s'. %s.\n", path_next, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+#endif
+
+		if (S_ISLNK(st.st_mode)) {
+			struct snapraid_pool_link* link;
+			int ret;
+
+			link = tommy_hashdyn_search(linkset, pool_link_compare, sub_next, file_path_hash(sub_next));
+			if (link) {
+				char linkto[PATH_MAX];
+				char linkto_expected[PATH_MAX];
+
+				make_linkto(linkto_expected, sizeof(linkto_expected), share_dir, link->disk, link->sub);
+
+				ret = readlink(path_next, linkto, sizeof(linkto));
+				if (ret >= 0 && ret < PATH_MAX) {
+					/* readlink doesn't put the final 0 */
+					linkto[ret] = 0;
+
+					/* keep the link if it's already correct */
+					if (strcmp(linkto, linkto_expected) == 0) {
+						link->present = 1;
+						kept = 1;
+						continue;
+					}
+				}
+			}
+
+			/* delete the link */
+			ret = remove(path_next);
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Error removing symlink '%s'. %s.\n", path_next, strerror(errno));
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			++*removed;
+		} else if (S_ISDIR(st.st_mode)) {
+			/* recurse */
+			pathslash(path_next, sizeof(path_next));
+			pathcatc(sub_next, sizeof(sub_next), '/');
+			if (update_dir(state, linkset, share_dir, path_next, sub_next, removed) == 0) {
+				int ret;
+
+				/* directory is empty, try to remove it */
+				ret = rmdir(path_next);
+				if (ret < 0) {
+#ifdef _WIN32
+					if (errno == EACCES) {
+						/* in Windows just ignore EACCES errors removing directories */
+						/* because it could happen that the directory is in use */
+						/* and it cannot be removed */
+						log_fatal("Directory '%s' not removed because it's in use.\n", path_next);
+						ignored = 1;
+					} else
+#endif
+					{
+						/* LCOV_EXCL_START */
+						log_fatal("Error removing pool directory '%s'. %s.\n", path_next, strerror(errno));
+						exit(EXIT_FAILURE);
+						/* LCOV_EXCL_STOP */
+					}
+				}
+			} else {
+				/* something was kept inside the subdir */
+				kept = 1;
+			}
+		} else {
+			ignored = 1;
+			msg_verbose("Ignoring pool file '%s'\n", path_next);
+		}
+	}
+
+	if (closedir(d) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error closing pool directory '%s'. %s.\n", dir, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	return ignored || kept;
+}
+
+/**
+ * Create a link to the specified disk entry.
+ */
+static void make_link(const char* pool_dir, const char* share_dir, struct snapraid_disk* disk, const char* sub)
+{
+	char path[PATH_MAX];
+	char linkto_exported[PATH_MAX];
+	int ret;
+
+	/* make the source path */
+	pathprint(path, sizeof(path), "%s%s", pool_dir, sub);
+
+	/* make the linkto path */
+	make_linkto(linkto_exported, sizeof(linkto_exported), share_dir, disk, sub);
+
 	/* create the ancestor directories */
 	ret = mkancestor(path);
 	if (ret != 0) {
@@ -174,9 +394,6 @@ static void make_link(const char* pool_dir, const char* share_dir, struct snapra
 		/* LCOV_EXCL_STOP */
 	}
 
-	/* convert back slashes */
-	pathexport(linkto_exported, sizeof(linkto_exported), linkto);
-
 	/* create the symlink */
 	ret = symlink(linkto_exported, path);
 	if (ret != 0) {
@@ -203,7 +420,12 @@ void state_pool(struct snapraid_state* state)
 	tommy_node* i;
 	char pool_dir[PATH_MAX];
 	char share_dir[PATH_MAX];
+	tommy_list linklist;
+	tommy_hashdyn linkset;
 	unsigned count;
+	unsigned created;
+	unsigned removed;
+	char sub_buffer[PATH_MAX];
 
 	if (state->pool[0] == 0) {
 		/* LCOV_EXCL_START */
@@ -212,8 +434,6 @@ void state_pool(struct snapraid_state* state)
 		/* LCOV_EXCL_STOP */
 	}
 
-	msg_progress("Cleaning...\n");
-
 	/* pool directory with final slash */
 	pathprint(pool_dir, sizeof(pool_dir), "%s", state->pool);
 	pathslash(pool_dir, sizeof(pool_dir));
@@ -222,10 +442,8 @@ void state_pool(struct snapraid_state* state)
 	pathprint(share_dir, sizeof(share_dir), "%s", state->share);
 	pathslash(share_dir, sizeof(share_dir));
 
-	/* first clear the previous pool tree */
-	clean_dir(state, pool_dir);
-
-	msg_progress("Pooling...\n");
+	tommy_list_init(&linklist);
+	tommy_hashdyn_init(&linkset);
 
 	/* for each disk */
 	count = 0;
@@ -236,26 +454,57 @@ void state_pool(struct snapraid_state* state)
 		/* for each file */
 		for (j = disk->filelist; j != 0; j = j->next) {
 			struct snapraid_file* file = j->data;
-			make_link(pool_dir, share_dir, disk, file->sub);
-			++count;
+			count += pool_link_insert(&linklist, &linkset, pool_dir, disk, file_sub(file, sub_buffer));
 		}
 
 		/* for each link */
 		for (j = disk->linklist; j != 0; j = j->next) {
 			struct snapraid_link* slink = j->data;
-			make_link(pool_dir, share_dir, disk, slink->sub);
-			++count;
+			count += pool_link_insert(&linklist, &linkset, pool_dir, disk, slink->sub);
 		}
 
 		/* we ignore empty dirs in disk->dir */
 	}
 
-	if (count)
-		msg_status("%u links created\n", count);
+	removed = 0;
+	if (state->opt.pool_full) {
+		msg_progress("Cleaning...\n");
+
+		/* clear the previous pool tree */
+		clean_dir(state, pool_dir);
+	} else {
+		msg_progress("Updating...\n");
+
+		/* remove only the links and directories not matching anymore */
+		update_dir(state, &linkset, share_dir, pool_dir, "", &removed);
+	}
+
+	msg_progress("Pooling...\n");
+
+	/* create the links not already present */
+	created = 0;
+	for (i = linklist; i != 0; i = i->next) {
+		struct snapraid_pool_link* link = i->data;
+
+		if (!link->present) {
+			make_link(pool_dir, share_dir, link->disk, link->sub);
+			++created;
+		}
+	}
+
+	tommy_hashdyn_done(&linkset);
+	tommy_list_foreach(&linklist, (tommy_foreach_func*)pool_link_free);
+
+	if (created)
+		msg_status("%u links created\n", created);
 	else
 		msg_status("No link created\n");
+	if (removed)
+		msg_status("%u links removed\n", removed);
 
 	log_tag("summary:link_count::%u\n", count);
+	log_tag("summary:link_created::%u\n", created);
+	log_tag("summary:link_removed::%u\n", removed);
 	log_tag("summary:exit:ok\n");
 	log_flush();
 }
@@ -121,6 +121,14 @@
 #include <sys/ioctl.h>
 #endif
 
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#if HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #if HAVE_LINUX_FS_H
 #include <linux/fs.h>
 #endif
@@ -129,6 +137,13 @@
 #include <linux/fiemap.h>
 #endif
 
+#if HAVE_LINUX_IO_URING_H && HAVE_SYS_EVENTFD_H && HAVE_SYS_SYSCALL_H
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#endif
+
 #if HAVE_BLKID_BLKID_H
 #include <blkid/blkid.h>
 #if HAVE_BLKID_DEVNO_TO_DEVNAME && HAVE_BLKID_GET_TAG_VALUE
@@ -198,6 +213,13 @@
 #include <sys/types.h>
 #endif
 
+/* major() and minor() */
+#if MAJOR_IN_MKDEV
+#include <sys/mkdev.h>
+#elif MAJOR_IN_SYSMACROS
+#include <sys/sysmacros.h>
+#endif
+
 #if HAVE_SYS_STAT_H
 #include <sys/stat.h>
 #endif
@@ -241,6 +263,17 @@
 #define HAVE_PTHREAD 1
 #endif
 
+/**
+ * Enable the io_uring engine.
+ *
+ * It uses directly the syscalls, without liburing.
+ * IORING_FEAT_RW_CUR_POS identifies the Linux 5.6 headers that define IORING_OP_READ.
+ */
+#if HAVE_PTHREAD && HAVE_MMAP && HAVE_LINUX_IO_URING_H && HAVE_SYS_EVENTFD_H && HAVE_SYS_SYSCALL_H \
+	&& defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define HAVE_IO_URING 1
+#endif
+
 /**
  * Disable case check in Windows.
  */
@@ -342,6 +375,11 @@ uint64_t tick(void);
  */
 uint64_t tick_ms(void);
 
+/**
+ * Get the CPU time used by all the threads of the process in millisecond.
+ */
+uint64_t tick_cpu_ms(void);
+
 /**
  * Initializes the system.
  */
@@ -93,6 +93,6 @@ void state_rehash(struct snapraid_state* state)
 
 	msg_status("A rehash is now scheduled. It will take place progressively in the next\n");
 	msg_status("'sync' and 'scrub' commands. You can check the rehash progress using the\n");
-	msg_status("'status' command.\n");
+	msg_status("'status' command, or complete it now using 'snapraid -p rehash scrub'.\n");
 }
 
@@ -41,27 +41,150 @@ struct snapraid_scan {
 	tommy_list link_insert_list; /**< Links to insert. */
 	tommy_list dir_insert_list; /**< Dirs to insert. */
 
+	/**
+	 * Files and lines to report, after the copy detection.
+	 *
+	 * Used only when scanning the disks in parallel, because the copy
+	 * detection searches in all the disks, and it's delayed after
+	 * the scan of all the disks completes.
+	 * All the other lines, printed or logged, are also delayed to keep
+	 * the output and the log ordered by disk, and not mixed by the threads.
+	 */
+	tommy_list file_report_list;
+
+	int is_diff; /**< If running a diff. */
+	int is_parallel; /**< If the disks are scanned in parallel. */
+	int need_write; /**< If the state is changed. Merged in the state after the scan. */
+
+#if HAVE_PTHREAD
+	pthread_t thread; /**< Thread used to scan the disk in parallel. */
+#endif
+
 	/* nodes for data structures */
 	tommy_node node;
 };
 
+/**
+ * Destinations of a delayed line.
+ */
+#define SCAN_LINE_PRINT 0 /**< Line printed in the diff output. */
+#define SCAN_LINE_TAG 1 /**< Tag line written in the log. */
+#define SCAN_LINE_VERBOSE 2 /**< Verbose message. */
+
+/**
+ * A new or updated file, or a line, waiting to be reported.
+ */
+struct snapraid_scan_report {
+	char* line; /**< Line to output, or 0 if it's a file to report. */
+	int line_type; /**< Destination of the line. One of SCAN_LINE_*. */
+	struct snapraid_file* file; /**< File to report. */
+	int is_file_already_present; /**< If the file was already present with a different size or time. */
+	data_off_t file_already_present_size; /**< Previous size. */
+	int64_t file_already_present_mtime_sec; /**< Previous modification time. */
+	int file_already_present_mtime_nsec; /**< Previous modification time, nanoseconds part. */
+
+	/* nodes for data structures */
+	tommy_node node;
+};
+
+/**
+ * Output a line to its destination.
+ */
+static void scan_line_output(int line_type, const char* line)
+{
+	switch (line_type) {
+	case SCAN_LINE_PRINT :
+		printf("%s", line);
+		break;
+	case SCAN_LINE_TAG :
+		log_tag("%s", line);
+		break;
+	case SCAN_LINE_VERBOSE :
+		msg_verbose("%s", line);
+		break;
+	}
+}
+
+/**
+ * Output a line, or store it if scanning the disks in parallel.
+ */
+static void scan_line(struct snapraid_scan* scan, int line_type, const char* format, va_list ap)
+{
+	struct snapraid_scan_report* report;
+	char line[ESC_MAX * 2 + 64];
+
+	vsnprintf(line, sizeof(line), format, ap);
+
+	if (!scan->is_parallel) {
+		scan_line_output(line_type, line);
+		return;
+	}
+
+	report = malloc_nofail(sizeof(struct snapraid_scan_report));
+	report->line = strdup_nofail(line);
+	report->line_type = line_type;
+	report->file = 0;
+	tommy_list_insert_tail(&scan->file_report_list, &report->node, report);
+}
+
+/**
+ * Print a line of the diff output.
+ *
+ * When scanning the disks in parallel, the line is stored, and printed
+ * later by the main thread in disk order.
+ */
+static void scan_print(struct snapraid_scan* scan, const char* format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	scan_line(scan, SCAN_LINE_PRINT, format, ap);
+	va_end(ap);
+}
+
+/**
+ * Write a tag line in the log.
+ *
+ * Like scan_print(), the line is delayed when scanning the disks in parallel.
+ */
+static void scan_log_tag(struct snapraid_scan* scan, const char* format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	scan_line(scan, SCAN_LINE_TAG, format, ap);
+	va_end(ap);
+}
+
+/**
+ * Print a verbose message.
+ *
+ * Like scan_print(), the message is delayed when scanning the disks in parallel.
+ */
+static void scan_msg_verbose(struct snapraid_scan* scan, const char* format, ...)
+{
+	va_list ap;
+
+	va_start(ap, format);
+	scan_line(scan, SCAN_LINE_VERBOSE, format, ap);
+	va_end(ap);
+}
+
 /**
  * Remove the specified link from the data set.
  */
 static void scan_link_remove(struct snapraid_scan* scan, struct snapraid_link* slink)
 {
-	struct snapraid_state* state = scan->state;
 	struct snapraid_disk* disk = scan->disk;
 
 	/* state changed */
-	state->need_write = 1;
+	scan->need_write = 1;
 
 	/* remove the file from the link containers */
 	tommy_hashdyn_remove_existing(&disk->linkset, &slink->nodeset);
 	tommy_list_remove_existing(&disk->linklist, &slink->nodelist);
 
-	/* deallocate */
-	link_free(slink);
+	link_free(disk, slink);
 }
 
 /**
@@ -69,11 +192,10 @@ static void scan_link_remove(struct snapraid_scan* scan, struct snapraid_link* s
  */
 static void scan_link_insert(struct snapraid_scan* scan, struct snapraid_link* slink)
 {
-	struct snapraid_state* state = scan->state;
 	struct snapraid_disk* disk = scan->disk;
 
 	/* state changed */
-	state->need_write = 1;
+	scan->need_write = 1;
 
 	/* insert the link in the link containers */
 	tommy_hashdyn_insert(&disk->linkset, &slink->nodeset, slink, link_name_hash(slink->sub));
@@ -110,24 +232,23 @@ static void scan_link(struct snapraid_scan* scan, int is_diff, const char* sub,
 			++scan->count_equal;
 
 			if (state->opt.gui) {
-				log_tag("scan:equal:%s:%s\n", disk->name, esc(slink->sub, esc_buffer));
+				scan_log_tag(scan, "scan:equal:%s:%s\n", disk->name, esc(slink->sub, esc_buffer));
 			}
 		} else {
 			/* it's an update */
 
 			/* we have to save the linkto/type */
-			state->need_write = 1;
+			scan->need_write = 1;
 
 			++scan->count_change;
 
-			log_tag("scan:update:%s:%s\n", disk->name, esc(slink->sub, esc_buffer));
+			scan_log_tag(scan, "scan:update:%s:%s\n", disk->name, esc(slink->sub, esc_buffer));
 			if (is_diff) {
-				printf("update %s%s\n", disk->dir, slink->sub);
+				scan_print(scan, "update %s%s\n", disk->dir, slink->sub);
 			}
 
 			/* update it */
-			free(slink->linkto);
-			slink->linkto = strdup_nofail(linkto);
+			link_retarget(disk, slink, linkto);
 			link_flag_let(slink, link_flag, FILE_IS_LINK_MASK);
 		}
 
@@ -137,16 +258,16 @@ static void scan_link(struct snapraid_scan* scan, int is_diff, const char* sub,
 		/* create the new link */
 		++scan->count_insert;
 
-		log_tag("scan:add:%s:%s\n", disk->name, esc(sub, esc_buffer));
+		scan_log_tag(scan, "scan:add:%s:%s\n", disk->name, esc(sub, esc_buffer));
 		if (is_diff) {
-			printf("add %s%s\n", disk->dir, sub);
+			scan_print(scan, "add %s%s\n", disk->dir, sub);
 		}
 
 		/* and continue to insert it */
 	}
 
 	/* insert it */
-	slink = link_alloc(sub, linkto, link_flag);
+	slink = link_alloc(disk, sub, linkto, link_flag);
 
 	/* mark it as present */
 	link_flag_set(slink, FILE_IS_PRESENT);
@@ -166,7 +287,7 @@ static void scan_file_allocate(struct snapraid_scan* scan, struct snapraid_file*
 	block_off_t parity_pos;
 
 	/* state changed */
-	state->need_write = 1;
+	scan->need_write = 1;
 
 	/* allocate the blocks of the file */
 	parity_pos = disk->first_free_block;
@@ -262,12 +383,13 @@ static void scan_file_deallocate(struct snapraid_scan* scan, struct snapraid_fil
 	struct snapraid_state* state = scan->state;
 	struct snapraid_disk* disk = scan->disk;
 	block_off_t i;
+	char sub_buffer[PATH_MAX];
 
 	/* remove from the list of contained files */
 	tommy_list_remove_existing(&disk->filelist, &file->nodelist);
 
 	/* state changed */
-	state->need_write = 1;
+	scan->need_write = 1;
 
 	/* here we are supposed to adjust the ::first_free_block position */
 	/* with the parity position we are deleting */
@@ -275,7 +397,7 @@ static void scan_file_deallocate(struct snapraid_scan* scan, struct snapraid_fil
 	/* so at this point ::first_free_block is always at 0, and we don't need to update it */
 	if (disk->first_free_block != 0) {
 		/* LCOV_EXCL_START */
-		log_fatal("Internal inconsistency for first free position at '%u' deallocating file '%s'\n", disk->first_free_block, file->sub);
+		log_fatal("Internal inconsistency for first free position at '%u' deallocating file '%s'\n", disk->first_free_block, file_sub(file, sub_buffer));
 		os_abort();
 		/* LCOV_EXCL_STOP */
 	}
@@ -315,7 +437,7 @@ static void scan_file_deallocate(struct snapraid_scan* scan, struct snapraid_fil
 			break;
 		default :
 			/* LCOV_EXCL_START */
-			log_fatal("Internal inconsistency in file '%s' deallocating block '%u:%u' state %u\n", file->sub, i, file->blockmax, block_state);
+			log_fatal("Internal inconsistency in file '%s' deallocating block '%u:%u' state %u\n", file_sub(file, sub_buffer), i, file->blockmax, block_state);
 			os_abort();
 			/* LCOV_EXCL_STOP */
 		}
@@ -335,6 +457,7 @@ static void scan_file_delayed_allocate(struct snapraid_scan* scan, struct snapra
 {
 	struct snapraid_state* state = scan->state;
 	struct snapraid_disk* disk = scan->disk;
+	char sub_buffer[PATH_MAX];
 
 	/* if we sort for physical offsets we have to read them for new files */
 	if (state->opt.force_order == SORT_PHYSICAL
@@ -342,7 +465,7 @@ static void scan_file_delayed_allocate(struct snapraid_scan* scan, struct snapra
 	) {
 		char path_next[PATH_MAX];
 
-		pathprint(path_next, sizeof(path_next), "%s%s", disk->dir, file->sub);
+		pathprint(path_next, sizeof(path_next), "%s%s", disk->dir, file_sub(file, sub_buffer));
 
 		if (filephy(path_next, file->size, &file->physical) != 0) {
 			/* LCOV_EXCL_START */
@@ -543,11 +666,12 @@ static void scan_file_refresh(struct snapraid_scan* scan, const char* sub, struc
 static void scan_file_insert(struct snapraid_scan* scan, struct snapraid_file* file)
 {
 	struct snapraid_disk* disk = scan->disk;
+	char sub_buffer[PATH_MAX];
 
 	/* insert the file in the containers */
 	if (!file_flag_has(file, FILE_IS_WITHOUT_INODE))
 		tommy_hashdyn_insert(&disk->inodeset, &file->nodeset, file, file_inode_hash(file->inode));
-	tommy_hashdyn_insert(&disk->pathset, &file->pathset, file, file_path_hash(file->sub));
+	tommy_hashdyn_insert(&disk->pathset, &file->pathset, file, file_path_hash(file_sub(file, sub_buffer)));
 	tommy_hashdyn_insert(&disk->stampset, &file->stampset, file, file_stamp_hash(file->size, file->mtime_sec, file->mtime_nsec));
 
 	/* delayed allocation of the parity */
@@ -590,7 +714,7 @@ static void scan_file_keep(struct snapraid_scan* scan, struct snapraid_file* fil
 
 	/* if the file is full invalid, schedule a reinsert at later stage */
 	if (file_is_full_invalid_parity_and_stable(scan->state, disk, file)) {
-		struct snapraid_file* copy = file_dup(file);
+		struct snapraid_file* copy = file_dup(disk, file);
 
 		/* remove the file */
 		scan_file_remove(scan, file);
@@ -600,6 +724,90 @@ static void scan_file_keep(struct snapraid_scan* scan, struct snapraid_file* fil
 	}
 }
 
+/**
+ * Search for a copy of a new or updated file, and report it.
+ */
+static void scan_file_report(struct snapraid_scan* scan, int is_diff, struct snapraid_file* file, int is_file_already_present, data_off_t file_already_present_size, int64_t file_already_present_mtime_sec, int file_already_present_mtime_nsec)
+{
+	struct snapraid_state* state = scan->state;
+	struct snapraid_disk* disk = scan->disk;
+	tommy_node* i;
+	int is_file_reported;
+	char esc_buffer[ESC_MAX];
+	char esc_buffer_alt[ESC_MAX];
+	char sub_buffer[PATH_MAX];
+	char sub_buffer_alt[PATH_MAX];
+
+	/* initialize for later overwrite */
+	is_file_reported = 0;
+
+	/* if copy detection is enabled */
+	/* note that the copy detection is tried also for updated files */
+	/* this makes sense because it may happen to have two different copies */
+	/* of the same file, and we move the right one over the wrong one */
+	/* in such case we have a "copy" over an "update" */
+	if (!state->opt.force_nocopy) {
+		tommy_uint32_t hash = file_stamp_hash(file->size, file->mtime_sec, file->mtime_nsec);
+
+		/* search for a file with the same name and stamp in all the disks */
+		for (i = state->disklist; i != 0; i = i->next) {
+			struct snapraid_disk* other_disk = i->data;
+			struct snapraid_file* other_file;
+
+			/* if the nanosecond part of the time stamp is valid, search */
+			/* for name and stamp, otherwise for path and stamp */
+			if (file->mtime_nsec != 0 && file->mtime_nsec != STAT_NSEC_INVALID)
+				other_file = tommy_hashdyn_search(&other_disk->stampset, file_namestamp_compare, file, hash);
+			else
+				other_file = tommy_hashdyn_search(&other_disk->stampset, file_pathstamp_compare, file, hash);
+
+			/* if found, and it's a fully hashed file */
+			if (other_file && file_is_full_hashed_and_stable(scan->state, other_disk, other_file)) {
+				/* assume that the file is a copy, and reuse the hash */
+				file_copy(other_file, file);
+
+				/* revert old counter and use the copy one */
+				++scan->count_copy;
+
+				log_tag("scan:copy:%s:%s:%s:%s\n", other_disk->name, esc(file_sub(other_file, sub_buffer), esc_buffer), disk->name, esc(file_sub(file, sub_buffer_alt), esc_buffer_alt));
+				if (is_diff) {
+					printf("copy %s%s -> %s%s\n", other_disk->dir, file_sub(other_file, sub_buffer), disk->dir, file_sub(file, sub_buffer_alt));
+				}
+
+				/* mark it as reported */
+				is_file_reported = 1;
+
+				/* no need to continue the search */
+				break;
+			}
+		}
+	}
+
+	/* if not yet reported, do it now */
+	/* we postpone this to avoid to print two times the copied files */
+	if (!is_file_reported) {
+		if (is_file_already_present) {
+			++scan->count_change;
+
+			log_tag("scan:update:%s:%s: %" PRIu64 " %" PRIu64 ".%d -> %" PRIu64 " %" PRIu64 ".%d\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer),
+				(uint64_t)file_already_present_size, (uint64_t)file_already_present_mtime_sec, file_already_present_mtime_nsec,
+				(uint64_t)file->size, (uint64_t)file->mtime_sec, file->mtime_nsec
+			);
+
+			if (is_diff) {
+				printf("update %s%s\n", disk->dir, file_sub(file, sub_buffer));
+			}
+		} else {
+			++scan->count_insert;
+
+			log_tag("scan:add:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
+			if (is_diff) {
+				printf("add %s%s\n", disk->dir, file_sub(file, sub_buffer));
+			}
+		}
+	}
+}
+
 /**
  * Process a file.
  */
@@ -608,15 +816,14 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
 	struct snapraid_state* state = scan->state;
 	struct snapraid_disk* disk = scan->disk;
 	struct snapraid_file* file;
-	tommy_node* i;
 	int is_original_file_size_different_than_zero;
 	int is_file_already_present;
 	data_off_t file_already_present_size;
 	int64_t file_already_present_mtime_sec;
 	int file_already_present_mtime_nsec;
-	int is_file_reported;
 	char esc_buffer[ESC_MAX];
 	char esc_buffer_alt[ESC_MAX];
+	char sub_buffer[PATH_MAX];
 
 	/*
 	 * If the disk has persistent inodes and UUID, try a search on the past inodes,
@@ -675,7 +882,7 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
 				}
 #endif
 				/* it's a hardlink */
-				scan_link(scan, is_diff, sub, file->sub, FILE_IS_HARDLINK);
+				scan_link(scan, is_diff, sub, file_sub(file, sub_buffer), FILE_IS_HARDLINK);
 				return;
 			}
 
@@ -690,35 +897,35 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
 				file->mtime_nsec = STAT_NSEC(st);
 
 				/* we have to save the new mtime */
-				state->need_write = 1;
+				scan->need_write = 1;
 			}
 
-			if (strcmp(file->sub, sub) != 0) {
+			if (file_path_compare_to_arg(sub, file) != 0) {
 				/* if the path is different, it means a moved file with the same inode */
 				++scan->count_move;
 
-				log_tag("scan:move:%s:%s:%s\n", disk->name, esc(file->sub, esc_buffer), esc(sub, esc_buffer_alt));
+				scan_log_tag(scan, "scan:move:%s:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer), esc(sub, esc_buffer_alt));
 				if (is_diff) {
-					printf("move %s%s -> %s%s\n", disk->dir, file->sub, disk->dir, sub);
+					scan_print(scan, "move %s%s -> %s%s\n", disk->dir, file_sub(file, sub_buffer), disk->dir, sub);
 				}
 
 				/* remove from the name set */
 				tommy_hashdyn_remove_existing(&disk->pathset, &file->pathset);
 
 				/* save the new name */
-				file_rename(file, sub);
+				file_rename(disk, file, sub);
 
 				/* reinsert in the name set */
-				tommy_hashdyn_insert(&disk->pathset, &file->pathset, file, file_path_hash(file->sub));
+				tommy_hashdyn_insert(&disk->pathset, &file->pathset, file, file_path_hash(sub));
 
 				/* we have to save the new name */
-				state->need_write = 1;
+				scan->need_write = 1;
 			} else {
 				/* otherwise it's equal */
 				++scan->count_equal;
 
 				if (state->opt.gui) {
-					log_tag("scan:equal:%s:%s\n", disk->name, esc(file->sub, esc_buffer));
+					scan_log_tag(scan, "scan:equal:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 				}
 			}
 
@@ -737,7 +944,7 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
 		/* for sure it cannot be already present */
 		if (file_flag_has(file, FILE_IS_PRESENT)) {
 			/* LCOV_EXCL_START */
-			log_fatal("Internal inode '%" PRIu64 "' inconsistency for files '%s%s' and '%s%s' matching and already present but different\n", file->inode, disk->dir, sub, disk->dir, file->sub);
+			log_fatal("Internal inode '%" PRIu64 "' inconsistency for files '%s%s' and '%s%s' matching and already present but different\n", file->inode, disk->dir, sub, disk->dir, file_sub(file, sub_buffer));
 			os_abort();
 			/* LCOV_EXCL_STOP */
 		}
@@ -763,7 +970,6 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
 	}
 
 	/* initialize for later overwrite */
-	is_file_reported = 0;
 	is_original_file_size_different_than_zero = 0;
 
 	/* then try finding it by name */
@@ -822,7 +1028,7 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
 				file->mtime_nsec = STAT_NSEC(st);
 
 				/* we have to save the new mtime */
-				state->need_write = 1;
+				scan->need_write = 1;
 			}
 
 			/* if when processing the disk we used the past inodes values */
@@ -834,9 +1040,9 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
 				/* like when restoring a backup that restores also the timestamp */
 				++scan->count_restore;
 
-				log_tag("scan:restore:%s:%s\n", disk->name, esc(sub, esc_buffer));
+				scan_log_tag(scan, "scan:restore:%s:%s\n", disk->name, esc(sub, esc_buffer));
 				if (is_diff) {
-					printf("restore %s%s\n", disk->dir, sub);
+					scan_print(scan, "restore %s%s\n", disk->dir, sub);
 				}
 
 				/* remove from the inode set */
@@ -849,7 +1055,7 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
 				tommy_hashdyn_insert(&disk->inodeset, &file->nodeset, file, file_inode_hash(file->inode));
 
 				/* we have to save the new inode */
-				state->need_write = 1;
+				scan->need_write = 1;
 			} else {
 				/* otherwise it's the case of not persistent inode, where doesn't */
 				/* matter if the inode is different or equal, because they have no */
@@ -857,7 +1063,7 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
 				++scan->count_equal;
 
 				if (state->opt.gui) {
-					log_tag("scan:equal:%s:%s\n", disk->name, esc(file->sub, esc_buffer));
+					scan_log_tag(scan, "scan:equal:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 				}
 			}
 
@@ -916,75 +1122,24 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
 #endif
 
 	/* insert it */
-	file = file_alloc(state->block_size, sub, st->st_size, st->st_mtime, STAT_NSEC(st), st->st_ino, physical);
+	file = file_alloc(disk, state->block_size, sub, st->st_size, st->st_mtime, STAT_NSEC(st), st->st_ino, physical);
 
 	/* mark it as present */
 	file_flag_set(file, FILE_IS_PRESENT);
 
-	/* if copy detection is enabled */
-	/* note that the copy detection is tried also for updated files */
-	/* this makes sense because it may happen to have two different copies */
-	/* of the same file, and we move the right one over the wrong one */
-	/* in such case we have a "copy" over an "update" */
-	if (!state->opt.force_nocopy) {
-		tommy_uint32_t hash = file_stamp_hash(file->size, file->mtime_sec, file->mtime_nsec);
-
-		/* search for a file with the same name and stamp in all the disks */
-		for (i = state->disklist; i != 0; i = i->next) {
-			struct snapraid_disk* other_disk = i->data;
-			struct snapraid_file* other_file;
-
-			/* if the nanosecond part of the time stamp is valid, search */
-			/* for name and stamp, otherwise for path and stamp */
-			if (file->mtime_nsec != 0 && file->mtime_nsec != STAT_NSEC_INVALID)
-				other_file = tommy_hashdyn_search(&other_disk->stampset, file_namestamp_compare, file, hash);
-			else
-				other_file = tommy_hashdyn_search(&other_disk->stampset, file_pathstamp_compare, file, hash);
-
-			/* if found, and it's a fully hashed file */
-			if (other_file && file_is_full_hashed_and_stable(scan->state, other_disk, other_file)) {
-				/* assume that the file is a copy, and reuse the hash */
-				file_copy(other_file, file);
-
-				/* revert old counter and use the copy one */
-				++scan->count_copy;
-
-				log_tag("scan:copy:%s:%s:%s:%s\n", other_disk->name, esc(other_file->sub, esc_buffer), disk->name, esc(file->sub, esc_buffer_alt));
-				if (is_diff) {
-					printf("copy %s%s -> %s%s\n", other_disk->dir, other_file->sub, disk->dir, file->sub);
-				}
-
-				/* mark it as reported */
-				is_file_reported = 1;
-
-				/* no need to continue the search */
-				break;
-			}
-		}
-	}
-
-	/* if not yet reported, do it now */
-	/* we postpone this to avoid to print two times the copied files */
-	if (!is_file_reported) {
-		if (is_file_already_present) {
-			++scan->count_change;
-
-			log_tag("scan:update:%s:%s: %" PRIu64 " %" PRIu64 ".%d -> %" PRIu64 " %" PRIu64 ".%d\n", disk->name, esc(sub, esc_buffer),
-				(uint64_t)file_already_present_size, (uint64_t)file_already_present_mtime_sec, file_already_present_mtime_nsec,
-				(uint64_t)file->size, (uint64_t)file->mtime_sec, file->mtime_nsec
-			);
-
-			if (is_diff) {
-				printf("update %s%s\n", disk->dir, sub);
-			}
-		} else {
-			++scan->count_insert;
-
-			log_tag("scan:add:%s:%s\n", disk->name, esc(sub, esc_buffer));
-			if (is_diff) {
-				printf("add %s%s\n", disk->dir, sub);
-			}
-		}
+	if (scan->is_parallel) {
+		/* the copy detection searches in all the disks */
+		/* so it's delayed after the scan of all the disks */
+		struct snapraid_scan_report* report = malloc_nofail(sizeof(struct snapraid_scan_report));
+		report->line = 0;
+		report->file = file;
+		report->is_file_already_present = is_file_already_present;
+		report->file_already_present_size = file_already_present_size;
+		report->file_already_present_mtime_sec = file_already_present_mtime_sec;
+		report->file_already_present_mtime_nsec = file_already_present_mtime_nsec;
+		tommy_list_insert_tail(&scan->file_report_list, &report->node, report);
+	} else {
+		scan_file_report(scan, is_diff, file, is_file_already_present, file_already_present_size, file_already_present_mtime_sec, file_already_present_mtime_nsec);
 	}
 
 	/* insert the file in the delayed list */
@@ -996,18 +1151,16 @@ static void scan_file(struct snapraid_scan* scan, int is_diff, const char* sub,
  */
 static void scan_emptydir_remove(struct snapraid_scan* scan, struct snapraid_dir* dir)
 {
-	struct snapraid_state* state = scan->state;
 	struct snapraid_disk* disk = scan->disk;
 
 	/* state changed */
-	state->need_write = 1;
+	scan->need_write = 1;
 
 	/* remove the file from the dir containers */
 	tommy_hashdyn_remove_existing(&disk->dirset, &dir->nodeset);
 	tommy_list_remove_existing(&disk->dirlist, &dir->nodelist);
 
-	/* deallocate */
-	dir_free(dir);
+	dir_free(disk, dir);
 }
 
 /**
@@ -1015,11 +1168,10 @@ static void scan_emptydir_remove(struct snapraid_scan* scan, struct snapraid_dir
  */
 static void scan_emptydir_insert(struct snapraid_scan* scan, struct snapraid_dir* dir)
 {
-	struct snapraid_state* state = scan->state;
 	struct snapraid_disk* disk = scan->disk;
 
 	/* state changed */
-	state->need_write = 1;
+	scan->need_write = 1;
 
 	/* insert the dir in the dir containers */
 	tommy_hashdyn_insert(&disk->dirset, &dir->nodeset, dir, dir_name_hash(dir->sub));
@@ -1055,7 +1207,7 @@ static void scan_emptydir(struct snapraid_scan* scan, const char* sub)
 	}
 
 	/* insert it */
-	dir = dir_alloc(sub);
+	dir = dir_alloc(disk, sub);
 
 	/* mark it as present */
 	dir_flag_set(dir, FILE_IS_PRESENT);
@@ -1194,13 +1346,13 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 
 		/* exclude hidden files even before calling lstat() */
 		if (filter_hidden(state->filter_hidden, dd) != 0) {
-			msg_verbose("Excluding hidden '%s'\n", path_next);
+			scan_msg_verbose(scan, "Excluding hidden '%s'\n", path_next);
 			continue;
 		}
 
 		/* exclude content files even before calling lstat() */
 		if (filter_content(&state->contentlist, path_next) != 0) {
-			msg_verbose("Excluding content '%s'\n", path_next);
+			scan_msg_verbose(scan, "Excluding content '%s'\n", path_next);
 			continue;
 		}
 
@@ -1335,7 +1487,7 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 				scan_file(scan, is_diff, sub_next, st, FILEPHY_UNREAD_OFFSET);
 				processed = 1;
 			} else {
-				msg_verbose("Excluding file '%s' for rule '%s'\n", path_next, filter_type(reason, out, sizeof(out)));
+				scan_msg_verbose(scan, "Excluding file '%s' for rule '%s'\n", path_next, filter_type(reason, out, sizeof(out)));
 			}
 		} else if (type == 1) { /* LNK */
 			if (filter_path(&state->filterlist, &reason, disk->name, sub_next) == 0) {
@@ -1365,7 +1517,7 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 				scan_link(scan, is_diff, sub_next, subnew, FILE_IS_SYMLINK);
 				processed = 1;
 			} else {
-				msg_verbose("Excluding link '%s' for rule '%s'\n", path_next, filter_type(reason, out, sizeof(out)));
+				scan_msg_verbose(scan, "Excluding link '%s' for rule '%s'\n", path_next, filter_type(reason, out, sizeof(out)));
 			}
 		} else if (type == 2) { /* DIR */
 			if (filter_dir(&state->filterlist, &reason, disk->name, sub_next) == 0) {
@@ -1395,7 +1547,7 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 					processed = 1;
 				}
 			} else {
-				msg_verbose("Excluding directory '%s' for rule '%s'\n", path_next, filter_type(reason, out, sizeof(out)));
+				scan_msg_verbose(scan, "Excluding directory '%s' for rule '%s'\n", path_next, filter_type(reason, out, sizeof(out)));
 			}
 		} else {
 			if (filter_path(&state->filterlist, &reason, disk->name, sub_next) == 0) {
@@ -1405,7 +1557,7 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 
 				log_fatal("WARNING! Ignoring special '%s' file '%s'\n", stat_desc(st), path_next);
 			} else {
-				msg_verbose("Excluding special file '%s' for rule '%s'\n", path_next, filter_type(reason, out, sizeof(out)));
+				scan_msg_verbose(scan, "Excluding special file '%s' for rule '%s'\n", path_next, filter_type(reason, out, sizeof(out)));
 			}
 		}
 
@@ -1419,22 +1571,85 @@ static int scan_dir(struct snapraid_scan* scan, int level, int is_diff, const ch
 	return processed;
 }
 
+/**
+ * Report all the new and updated files, and all the delayed lines, of a disk scanned in parallel.
+ */
+static void scan_file_delayed_report(struct snapraid_scan* scan)
+{
+	struct snapraid_disk* disk = scan->disk;
+	tommy_node* node;
+
+	node = scan->file_report_list;
+	while (node) {
+		struct snapraid_scan_report* report = node->data;
+		struct snapraid_file* file = report->file;
+
+		/* next node */
+		node = node->next;
+
+		if (report->line) {
+			scan_line_output(report->line_type, report->line);
+			free(report->line);
+			free(report);
+			continue;
+		}
+
+		/* the file is already inserted in the stamp set */
+		/* so remove it, to avoid to find it as a copy of itself */
+		tommy_hashdyn_remove_existing(&disk->stampset, &file->stampset);
+
+		scan_file_report(scan, scan->is_diff, file, report->is_file_already_present, report->file_already_present_size, report->file_already_present_mtime_sec, report->file_already_present_mtime_nsec);
+
+		/* reinsert it, to allow to find it as a copy of the next ones */
+		tommy_hashdyn_insert(&disk->stampset, &file->stampset, file, file_stamp_hash(file->size, file->mtime_sec, file->mtime_nsec));
+
+		free(report);
+	}
+
+	tommy_list_init(&scan->file_report_list);
+}
+
+#if HAVE_PTHREAD
+/**
+ * Scan a disk in a dedicated thread.
+ */
+static void* scan_disk_thread(void* arg)
+{
+	struct snapraid_scan* scan = arg;
+
+	scan_dir(scan, 0, scan->is_diff, scan->disk->dir, "");
+
+	return 0;
+}
+#endif
+
 static int state_diffscan(struct snapraid_state* state, int is_diff)
 {
 	tommy_node* i;
 	tommy_node* j;
 	tommy_list scanlist;
+	int is_parallel;
 	int done;
 	fptr* msg;
 	struct snapraid_scan total;
 	int no_difference;
 	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
+	char sub_buffer_alt[PATH_MAX];
 
 	tommy_list_init(&scanlist);
 
 	if (is_diff)
 		msg_progress("Comparing...\n");
 
+	/* scan the disks in parallel, one thread for each disk */
+	/* as the data structures of each disk are independent */
+#if HAVE_PTHREAD
+	is_parallel = !state->opt.skip_scan_thread && tommy_list_count(&state->disklist) > 1;
+#else
+	is_parallel = 0;
+#endif
+
 	/* first scan all the directory and find new and deleted files */
 	for (i = state->disklist; i != 0; i = i->next) {
 		struct snapraid_disk* disk = i->data;
@@ -1456,6 +1671,10 @@ static int state_diffscan(struct snapraid_state* state, int is_diff)
 		tommy_list_init(&scan->file_insert_list);
 		tommy_list_init(&scan->link_insert_list);
 		tommy_list_init(&scan->dir_insert_list);
+		tommy_list_init(&scan->file_report_list);
+		scan->is_diff = is_diff;
+		scan->is_parallel = is_parallel;
+		scan->need_write = 0;
 
 		tommy_list_insert_tail(&scanlist, &scan->node, scan);
 
@@ -1497,7 +1716,33 @@ static int state_diffscan(struct snapraid_state* state, int is_diff)
 			}
 		}
 
-		scan_dir(scan, 0, is_diff, disk->dir, "");
+		if (is_parallel) {
+#if HAVE_PTHREAD
+			thread_create(&scan->thread, 0, scan_disk_thread, scan);
+#endif
+		} else {
+			scan_dir(scan, 0, is_diff, disk->dir, "");
+		}
+	}
+
+#if HAVE_PTHREAD
+	/* wait for the end of all the disk scans */
+	if (is_parallel) {
+		for (i = scanlist; i != 0; i = i->next) {
+			struct snapraid_scan* scan = i->data;
+			void* retval;
+
+			thread_join(scan->thread, &retval);
+		}
+	}
+#endif
+
+	/* now that all the disks are scanned, do the delayed copy detection */
+	/* in the same order as a not parallel scan */
+	for (i = scanlist; i != 0; i = i->next) {
+		struct snapraid_scan* scan = i->data;
+
+		scan_file_delayed_report(scan);
 	}
 
 	/* we split the search in two phases because to detect files */
@@ -1526,9 +1771,9 @@ static int state_diffscan(struct snapraid_state* state, int is_diff)
 			if (!file_flag_has(file, FILE_IS_PRESENT)) {
 				++scan->count_remove;
 
-				log_tag("scan:remove:%s:%s\n", disk->name, esc(file->sub, esc_buffer));
+				log_tag("scan:remove:%s:%s\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 				if (is_diff) {
-					printf("remove %s%s\n", disk->dir, file->sub);
+					printf("remove %s%s\n", disk->dir, file_sub(file, sub_buffer));
 				}
 
 				scan_file_remove(scan, file);
@@ -1608,7 +1853,7 @@ static int state_diffscan(struct snapraid_state* state, int is_diff)
 					/* if verbose, print the list of duplicates real offsets */
 					/* other cases are for offsets not supported, so we don't need to report them file by file */
 					if (phy_last >= FILEPHY_REAL_OFFSET) {
-						log_fatal("WARNING! Files '%s%s' and '%s%s' have the same physical offset %" PRId64 ".\n", disk->dir, phy_file_last->sub, disk->dir, file->sub, phy_last);
+						log_fatal("WARNING! Files '%s%s' and '%s%s' have the same physical offset %" PRId64 ".\n", disk->dir, file_sub(phy_file_last, sub_buffer), disk->dir, file_sub(file, sub_buffer_alt), phy_last);
 					}
 					++phy_dup;
 				}
@@ -1653,6 +1898,10 @@ static int state_diffscan(struct snapraid_state* state, int is_diff)
 			/* insert it */
 			scan_emptydir_insert(scan, dir);
 		}
+
+		/* merge the state change */
+		if (scan->need_write)
+			state->need_write = 1;
 	}
 
 	/* check for disks where all the previously existing files where removed */
@@ -23,6 +23,7 @@
 #include "parity.h"
 #include "handle.h"
 #include "io.h"
+#include "gen.h"
 #include "raid/raid.h"
 
 /****************************************************************************/
@@ -36,6 +37,15 @@ struct snapraid_rehash {
 	struct snapraid_block* block;
 };
 
+/**
+ * Data block read, and waiting for the hash verification.
+ */
+struct snapraid_verify {
+	struct snapraid_task* task; /**< Task of the block read, or 0 if there is nothing to verify. */
+	unsigned hash_pos; /**< Position of the hash to verify in the hash vector. */
+	int file_is_unsynced; /**< If the file is not synced, and errors are expected. */
+};
+
 /**
  * Scrub plan to use.
  */
@@ -78,6 +88,9 @@ static int block_is_enabled(void* void_plan, block_off_t i)
 	case SCRUB_BAD :
 		/* in 'bad' plan, only bad blocks (already reported) */
 		return 0;
+	case SCRUB_REHASH :
+		/* in 'rehash' plan, only blocks still using the previous hash */
+		return info_get_rehash(info);
 	}
 
 	/* if it's too new */
@@ -102,6 +115,47 @@ static int block_is_enabled(void* void_plan, block_off_t i)
 	return 1;
 }
 
+/**
+ * Continuation of scrub_data_reader() after the read of the block.
+ */
+static void scrub_data_reader_done(struct snapraid_worker* worker, struct snapraid_task* task, int ret)
+{
+	struct snapraid_io* io = worker->io;
+	struct snapraid_state* state = io->state;
+	struct snapraid_handle* handle = worker->handle;
+	struct snapraid_disk* disk = handle->disk;
+	block_off_t blockcur = task->position;
+	uint64_t tick_hash;
+	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
+
+	task->read_size = ret;
+	if (task->read_size == -1) {
+		if (errno == EIO) {
+			log_tag("error:%u:%s:%s: Read EIO error at position %u. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), task->file_pos, strerror(errno));
+			log_error("Input/Output error in file '%s' at position '%u'\n", handle->path, task->file_pos);
+			task->state = TASK_STATE_IOERROR_CONTINUE;
+			return;
+		}
+
+		log_tag("error:%u:%s:%s: Read error at position %u. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), task->file_pos, strerror(errno));
+		task->state = TASK_STATE_ERROR_CONTINUE;
+		return;
+	}
+
+	/* compute the new hash in the worker thread, to scale with the number of disks */
+	/* the hash to verify is instead computed in the same pass of the parity */
+	tick_hash = tick();
+	if (info_get_rehash(info_get(&state->infoarr, blockcur)))
+		memhash(state->hash, state->hashseed, task->rehash, task->buffer, task->read_size);
+	task->tick_hash = tick() - tick_hash;
+
+	/* store the path of the opened file */
+	pathcpy(task->path, sizeof(task->path), handle->path);
+
+	task->state = TASK_STATE_DONE;
+}
+
 static void scrub_data_reader(struct snapraid_worker* worker, struct snapraid_task* task)
 {
 	struct snapraid_io* io = worker->io;
@@ -109,15 +163,14 @@ static void scrub_data_reader(struct snapraid_worker* worker, struct snapraid_ta
 	struct snapraid_handle* handle = worker->handle;
 	struct snapraid_disk* disk = handle->disk;
 	block_off_t blockcur = task->position;
-	unsigned char* buffer = task->buffer;
 	int ret;
 	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
 
 	/* if the disk position is not used */
 	if (!disk) {
-		/* use an empty block */
-		memset(buffer, 0, state->block_size);
-		task->state = TASK_STATE_DONE;
+		/* report an empty block, without clearing the buffer */
+		task->state = TASK_STATE_EMPTY;
 		return;
 	}
 
@@ -126,9 +179,8 @@ static void scrub_data_reader(struct snapraid_worker* worker, struct snapraid_ta
 
 	/* if the block is not used */
 	if (!block_has_file(task->block)) {
-		/* use an empty block */
-		memset(buffer, 0, state->block_size);
-		task->state = TASK_STATE_DONE;
+		/* report an empty block, without clearing the buffer */
+		task->state = TASK_STATE_EMPTY;
 		return;
 	}
 
@@ -145,7 +197,7 @@ static void scrub_data_reader(struct snapraid_worker* worker, struct snapraid_ta
 			/* This one is really an unexpected error, because we are only reading */
 			/* and closing a descriptor should never fail */
 			if (errno == EIO) {
-				log_tag("error:%u:%s:%s: Close EIO error. %s\n", blockcur, disk->name, esc(report->sub, esc_buffer), strerror(errno));
+				log_tag("error:%u:%s:%s: Close EIO error. %s\n", blockcur, disk->name, esc(file_sub(report, sub_buffer), esc_buffer), strerror(errno));
 				log_fatal("DANGER! Unexpected input/output close error in a data disk, it isn't possible to scrub.\n");
 				log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
 				log_fatal("Stopping at block %u\n", blockcur);
@@ -153,7 +205,7 @@ static void scrub_data_reader(struct snapraid_worker* worker, struct snapraid_ta
 				return;
 			}
 
-			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(report->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(file_sub(report, sub_buffer), esc_buffer), strerror(errno));
 			log_fatal("WARNING! Unexpected close error in a data disk, it isn't possible to scrub.\n");
 			log_fatal("Ensure that file '%s' can be accessed.\n", handle->path);
 			log_fatal("Stopping at block %u\n", blockcur);
@@ -167,7 +219,7 @@ static void scrub_data_reader(struct snapraid_worker* worker, struct snapraid_ta
 	if (ret == -1) {
 		if (errno == EIO) {
 			/* LCOV_EXCL_START */
-			log_tag("error:%u:%s:%s: Open EIO error. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Open EIO error. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), strerror(errno));
 			log_fatal("DANGER! Unexpected input/output open error in a data disk, it isn't possible to scrub.\n");
 			log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
 			log_fatal("Stopping at block %u\n", blockcur);
@@ -176,7 +228,7 @@ static void scrub_data_reader(struct snapraid_worker* worker, struct snapraid_ta
 			/* LCOV_EXCL_STOP */
 		}
 
-		log_tag("error:%u:%s:%s: Open error. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), strerror(errno));
+		log_tag("error:%u:%s:%s: Open error. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), strerror(errno));
 		task->state = TASK_STATE_ERROR_CONTINUE;
 		return;
 	}
@@ -196,38 +248,19 @@ static void scrub_data_reader(struct snapraid_worker* worker, struct snapraid_ta
 	/* from the last sync, as we are expected to return errors if running */
 	/* in an unsynced array. This is just like the check command. */
 
-	task->read_size = handle_read(handle, task->file_pos, buffer, state->block_size, log_error, 0);
-	if (task->read_size == -1) {
-		if (errno == EIO) {
-			log_tag("error:%u:%s:%s: Read EIO error at position %u. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), task->file_pos, strerror(errno));
-			log_error("Input/Output error in file '%s' at position '%u'\n", handle->path, task->file_pos);
-			task->state = TASK_STATE_IOERROR_CONTINUE;
-			return;
-		}
-
-		log_tag("error:%u:%s:%s: Read error at position %u. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), task->file_pos, strerror(errno));
-		task->state = TASK_STATE_ERROR_CONTINUE;
-		return;
-	}
-
-	/* store the path of the opened file */
-	pathcpy(task->path, sizeof(task->path), handle->path);
-
-	task->state = TASK_STATE_DONE;
+	/* read the block */
+	io_task_handle_read(worker, task, log_error, 0, scrub_data_reader_done);
 }
 
-static void scrub_parity_reader(struct snapraid_worker* worker, struct snapraid_task* task)
+/**
+ * Continuation of scrub_parity_reader() after the read of the block.
+ */
+static void scrub_parity_reader_done(struct snapraid_worker* worker, struct snapraid_task* task, int ret)
 {
-	struct snapraid_io* io = worker->io;
-	struct snapraid_state* state = io->state;
 	struct snapraid_parity_handle* parity_handle = worker->parity_handle;
 	unsigned level = parity_handle->level;
 	block_off_t blockcur = task->position;
-	unsigned char* buffer = task->buffer;
-	int ret;
 
-	/* read the parity */
-	ret = parity_read(parity_handle, blockcur, buffer, state->block_size, log_error);
 	if (ret == -1) {
 		if (errno == EIO) {
 			log_tag("parity_error:%u:%s: Read EIO error. %s\n", blockcur, lev_config_name(level), strerror(errno));
@@ -244,12 +277,22 @@ static void scrub_parity_reader(struct snapraid_worker* worker, struct snapraid_
 	task->state = TASK_STATE_DONE;
 }
 
+static void scrub_parity_reader(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	/* read the parity */
+	io_task_parity_read(worker, task, log_error, scrub_parity_reader_done);
+}
+
 static int state_scrub_process(struct snapraid_state* state, struct snapraid_parity_handle* parity_handle, block_off_t blockstart, block_off_t blockmax, struct snapraid_plan* plan, time_t now)
 {
 	struct snapraid_io io;
+	struct snapraid_gen gen;
 	struct snapraid_handle* handle;
 	void* rehandle_alloc;
 	struct snapraid_rehash* rehandle;
+	struct snapraid_verify* verify;
+	struct snapraid_gen_hash* hashmap;
+	unsigned char* present;
 	unsigned diskmax;
 	block_off_t blockcur;
 	unsigned j;
@@ -268,6 +311,7 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 	unsigned* waiting_map;
 	unsigned waiting_mac;
 	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
 
 	/* maps the disks to handles */
 	handle = handle_mapping(state, &diskmax);
@@ -275,12 +319,23 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 	/* rehash buffers */
 	rehandle = malloc_nofail_align(diskmax * sizeof(struct snapraid_rehash), &rehandle_alloc);
 
+	/* blocks to verify, with the hash for each one */
+	verify = malloc_nofail(diskmax * sizeof(struct snapraid_verify));
+	hashmap = malloc_nofail(diskmax * sizeof(struct snapraid_gen_hash));
+
+	/* data blocks present in the stripe */
+	present = malloc_nofail(diskmax);
+
 	/* we need 1 * data + 2 * parity */
 	buffermax = diskmax + 2 * state->level;
 
 	/* initialize the io threads */
 	io_init(&io, state, state->opt.io_cache, buffermax, scrub_data_reader, handle, diskmax, scrub_parity_reader, 0, parity_handle, state->level);
 
+	/* initialize the parity threads */
+	gen_init(&gen, diskmax, state->level, state->block_size, state->opt.raid_thread);
+	log_tag("raid:thread:%u\n", gen.thread_max);
+
 	/* possibly waiting disks */
 	waiting_mac = diskmax > RAID_PARITY_MAX ? diskmax : RAID_PARITY_MAX;
 	waiting_map = malloc_nofail(waiting_mac * sizeof(unsigned));
@@ -323,7 +378,9 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 		int silent_error_on_this_block;
 		int io_error_on_this_block;
 		int block_is_unsynced;
+		int parity_is_computed;
 		int rehash;
+		unsigned hash_mac;
 		void** buffer;
 
 		/* go to the next block */
@@ -353,16 +410,16 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 		/* if we have to use the old hash */
 		rehash = info_get_rehash(info);
 
+		/* no hash to compute yet */
+		hash_mac = 0;
+
 		/* for each disk, process the block */
 		for (j = 0; j < diskmax; ++j) {
 			struct snapraid_task* task;
 			int read_size;
-			unsigned char hash[HASH_MAX];
 			struct snapraid_block* block;
 			int file_is_unsynced;
 			struct snapraid_disk* disk;
-			struct snapraid_file* file;
-			block_off_t file_pos;
 			unsigned diskcur;
 
 			/* if the file on this disk is synced */
@@ -381,12 +438,14 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 			/* get the task results */
 			disk = task->disk;
 			block = task->block;
-			file = task->file;
-			file_pos = task->file_pos;
 			read_size = task->read_size;
 
-			/* by default no rehash in case of "continue" */
+			/* by default no rehash and nothing to verify in case of "continue" */
 			rehandle[diskcur].block = 0;
+			verify[diskcur].task = 0;
+
+			/* the empty blocks are not read, and their buffer is not cleared */
+			present[diskcur] = task->state != TASK_STATE_EMPTY;
 
 			/* if the disk position is not used */
 			if (!disk)
@@ -450,45 +509,32 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 
 			countsize += read_size;
 
-			/* now compute the hash */
+			/* the hash is computed later, in the same pass of the parity */
+			verify[diskcur].task = task;
+			verify[diskcur].hash_pos = hash_mac;
+			verify[diskcur].file_is_unsynced = file_is_unsynced;
+
 			if (rehash) {
-				memhash(state->prevhash, state->prevhashseed, hash, buffer[diskcur], read_size);
+				hashmap[hash_mac].index = diskcur;
+				hashmap[hash_mac].size = read_size;
+				memhash_init(&hashmap[hash_mac].ctx, state->prevhash, state->prevhashseed);
+				++hash_mac;
 
-				/* compute the new hash, and store it */
+				/* the new hash is already computed by the worker, and it's stored later */
 				rehandle[diskcur].block = block;
-				memhash(state->hash, state->hashseed, rehandle[diskcur].hash, buffer[diskcur], read_size);
+				memcpy(rehandle[diskcur].hash, task->rehash, BLOCK_HASH_SIZE);
+				state_usage_hash_worker(state, task->tick_hash);
 			} else {
-				memhash(state->hash, state->hashseed, hash, buffer[diskcur], read_size);
-			}
-
-			/* until now is hash */
-			state_usage_hash(state);
-
-			if (block_has_updated_hash(block)) {
-				/* compare the hash */
-				if (memcmp(hash, block->hash, BLOCK_HASH_SIZE) != 0) {
-					unsigned diff = memdiff(hash, block->hash, BLOCK_HASH_SIZE);
-
-					log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u\n", blockcur, disk->name, esc(file->sub, esc_buffer), file_pos, diff);
-
-					/* it's a silent error only if we are dealing with synced files */
-					if (file_is_unsynced) {
-						++error;
-						error_on_this_block = 1;
-					} else {
-						log_error("Data error in file '%s' at position '%u', diff bits %u\n", task->path, file_pos, diff);
-						++silent_error;
-						silent_error_on_this_block = 1;
-					}
-					continue;
-				}
+				hashmap[hash_mac].index = diskcur;
+				hashmap[hash_mac].size = read_size;
+				memhash_init(&hashmap[hash_mac].ctx, state->hash, state->hashseed);
+				++hash_mac;
 			}
 		}
 
 		/* buffers for parity read and not computed */
-		for (l = 0; l < state->level; ++l)
-			buffer_recov[l] = buffer[diskmax + state->level + l];
-		for (; l < LEV_MAX; ++l)
+		/* they are set after each read, as the readers take them when starting the task */
+		for (l = 0; l < LEV_MAX; ++l)
 			buffer_recov[l] = 0;
 
 		/* until now is misc */
@@ -545,14 +591,62 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 				os_abort();
 				/* LCOV_EXCL_STOP */
 			}
+
+			buffer_recov[levcur] = buffer[diskmax + state->level + levcur];
+		}
+
+		/* if we have read all the data required, compute the hash and the parity in the same pass */
+		if (!error_on_this_block && !io_error_on_this_block) {
+			gen_parity_hash(&gen, state->block_size, buffer, present, hashmap, hash_mac);
+			parity_is_computed = 1;
+
+			/* until now is raid */
+			state_usage_raid(state);
+		} else {
+			gen_hash(hashmap, hash_mac, buffer);
+			parity_is_computed = 0;
+
+			/* until now is hash */
+			state_usage_hash(state);
 		}
 
-		/* if we have read all the data required and it's correct, proceed with the parity check */
-		if (!error_on_this_block && !silent_error_on_this_block && !io_error_on_this_block) {
+		/* verify the hash of each block read */
+		for (j = 0; j < diskmax; ++j) {
+			struct snapraid_task* task = verify[j].task;
+			struct snapraid_gen_hash* h;
+			unsigned char hash[HASH_MAX];
+			struct snapraid_block* block;
+
+			if (!task)
+				continue;
+
+			block = task->block;
+			h = &hashmap[verify[j].hash_pos];
+
+			memhash_final(&h->ctx, hash);
+
+			if (block_has_updated_hash(block)) {
+				/* compare the hash */
+				if (memcmp(hash, block->hash, BLOCK_HASH_SIZE) != 0) {
+					unsigned diff = memdiff(hash, block->hash, BLOCK_HASH_SIZE);
 
-			/* compute the parity */
-			raid_gen(diskmax, state->level, state->block_size, buffer);
+					log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u\n", blockcur, task->disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), task->file_pos, diff);
+
+					/* it's a silent error only if we are dealing with synced files */
+					if (verify[j].file_is_unsynced) {
+						++error;
+						error_on_this_block = 1;
+					} else {
+						log_error("Data error in file '%s' at position '%u', diff bits %u\n", task->path, task->file_pos, diff);
+						++silent_error;
+						silent_error_on_this_block = 1;
+					}
+				}
+			}
+		}
 
+		/* if all the data read is correct, proceed with the parity check */
+		if (parity_is_computed && !error_on_this_block && !silent_error_on_this_block) {
 			/* compare the parity */
 			for (l = 0; l < state->level; ++l) {
 				if (buffer_recov[l] && memcmp(buffer[diskmax + l], buffer_recov[l], state->block_size) != 0) {
@@ -677,7 +771,7 @@ bail:
 		ret = handle_close(&handle[j]);
 		if (ret == -1) {
 			/* LCOV_EXCL_START */
-			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(file->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(file_sub(file, sub_buffer), esc_buffer), strerror(errno));
 			log_fatal("DANGER! Unexpected close error in a data disk.\n");
 			++error;
 			/* continue, as we are already exiting */
@@ -687,7 +781,11 @@ bail:
 
 	free(handle);
 	free(rehandle_alloc);
+	free(verify);
+	free(hashmap);
+	free(present);
 	free(waiting_map);
+	gen_done(&gen);
 	io_done(&io);
 
 	if (state->opt.expect_recoverable) {
@@ -734,7 +832,7 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 
 	msg_progress("Initializing...\n");
 
-	if ((plan == SCRUB_BAD || plan == SCRUB_NEW || plan == SCRUB_FULL)
+	if ((plan == SCRUB_BAD || plan == SCRUB_NEW || plan == SCRUB_FULL || plan == SCRUB_REHASH)
 		&& olderthan >= 0) {
 		/* LCOV_EXCL_START */
 		log_fatal("You can specify -o, --older-than only with a numeric percentage.\n");
@@ -742,6 +840,13 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 		/* LCOV_EXCL_STOP */
 	}
 
+	if (plan == SCRUB_REHASH && state->prevhash == HASH_UNDEFINED) {
+		/* LCOV_EXCL_START */
+		log_fatal("You don't have a rehash in progress. Use 'snapraid rehash' to start it.\n");
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
 	blockmax = parity_allocated_size(state);
 
 	/* preinitialize to avoid warnings */
@@ -757,6 +862,8 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 		ps.plan = SCRUB_NEW;
 	} else if (plan == SCRUB_BAD) {
 		ps.plan = SCRUB_BAD;
+	} else if (plan == SCRUB_REHASH) {
+		ps.plan = SCRUB_REHASH;
 	} else if (state->opt.force_scrub_at) {
 		/* scrub the specified amount of blocks */
 		ps.plan = SCRUB_AUTO;
@@ -884,6 +991,21 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 		}
 	}
 
+	/* report the rehash progress */
+	if (ps.plan == SCRUB_REHASH) {
+		count = 0;
+		for (i = 0; i < blockmax; ++i) {
+			if (info_get_rehash(info_get(&state->infoarr, i)))
+				++count;
+		}
+
+		log_tag("rehash_missing:%u\n", count);
+		if (count == 0)
+			msg_status("The rehash is now completed.\n");
+		else
+			msg_status("The rehash is not yet completed. Blocks still to rehash: %u.\n", count);
+	}
+
 	/* abort if required */
 	if (error != 0)
 		return -1;
@@ -23,6 +23,16 @@
 /****************************************************************************/
 /* search */
 
+/**
+ * Max number of search files kept open.
+ */
+#define SEARCH_OPEN_MAX 16
+
+/**
+ * Size of the data read ahead when a search file is read sequentially.
+ */
+#define SEARCH_AHEAD_SIZE (4 * 1024 * 1024)
+
 static void search_file(struct snapraid_state* state, const char* path, data_off_t size, int64_t mtime_sec, int mtime_nsec)
 {
 	struct snapraid_search_file* file;
@@ -33,6 +43,11 @@ static void search_file(struct snapraid_state* state, const char* path, data_off
 	file->size = size;
 	file->mtime_sec = mtime_sec;
 	file->mtime_nsec = mtime_nsec;
+	file->f = -1;
+	file->ahead = 0;
+	file->ahead_offset = 0;
+	file->ahead_size = 0;
+	file->next_offset = 0;
 
 	file_hash = file_stamp_hash(file->size, file->mtime_sec, file->mtime_nsec);
 
@@ -41,43 +56,81 @@ static void search_file(struct snapraid_state* state, const char* path, data_off
 
 void search_file_free(struct snapraid_search_file* file)
 {
+	/* close the file if still opened, ignoring errors as we are only reading */
+	if (file->f != -1)
+		close(file->f);
+	free(file->ahead);
 	free(file->path);
 	free(file);
 }
 
-struct search_file_compare_arg {
-	const struct snapraid_state* state;
-	const struct snapraid_block* block;
-	const struct snapraid_file* file;
-	unsigned char* buffer;
-	data_off_t offset;
-	unsigned read_size;
-	int prevhash;
-};
+/**
+ * Size of the read-ahead buffer.
+ * It's a multiple of the block size, to read ahead whole blocks.
+ */
+static unsigned search_ahead_size(const struct snapraid_state* state)
+{
+	unsigned size = SEARCH_AHEAD_SIZE - SEARCH_AHEAD_SIZE % state->block_size;
+
+	if (size < state->block_size)
+		size = state->block_size;
 
-int search_file_compare(const void* void_arg, const void* void_data)
+	return size;
+}
+
+/**
+ * Close the file, and return its read-ahead buffer.
+ */
+static unsigned char* search_file_close(struct snapraid_state* state, struct snapraid_search_file* file)
+{
+	unsigned char* ahead = file->ahead;
+
+	if (close(file->f) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error closing file '%s'. %s.\n", file->path, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	tommy_list_remove_existing(&state->searchopen, &file->nodeopen);
+
+	file->f = -1;
+	file->ahead = 0;
+	file->ahead_size = 0;
+
+	return ahead;
+}
+
+/**
+ * Open the file, or keep it open if already opened.
+ * If too many files are opened, the least recently used is closed.
+ */
+static void search_file_open(struct snapraid_state* state, struct snapraid_search_file* file)
 {
-	const struct search_file_compare_arg* arg = void_arg;
-	const struct snapraid_search_file* file = void_data;
-	const struct snapraid_state* state = arg->state;
-	unsigned char buffer_hash[HASH_MAX];
 	const char* path = file->path;
-	int f;
-	ssize_t ret;
+	unsigned char* ahead;
 
-	/* compare file info */
-	if (arg->file->size != file->size)
-		return -1;
+	/* if already opened, move it at the head of the list */
+	if (file->f != -1) {
+		tommy_list_remove_existing(&state->searchopen, &file->nodeopen);
+		tommy_list_insert_head(&state->searchopen, &file->nodeopen, file);
+		return;
+	}
 
-	if (arg->file->mtime_sec != file->mtime_sec)
-		return -1;
+	/* reuse the buffer of the least recently used file, if too many are opened */
+	if (tommy_list_count(&state->searchopen) >= SEARCH_OPEN_MAX) {
+		struct snapraid_search_file* last = tommy_list_tail(&state->searchopen)->data;
+		char esc_buffer[ESC_MAX];
 
-	if (arg->file->mtime_nsec != file->mtime_nsec)
-		return -1;
+		log_tag("search:evict:%s\n", esc(last->path, esc_buffer));
 
-	/* read the block and compare the hash */
-	f = open(path, O_RDONLY | O_BINARY);
-	if (f == -1) {
+		ahead = search_file_close(state, last);
+	} else {
+		ahead = malloc_nofail(search_ahead_size(state));
+	}
+
+	file->f = open(path, O_RDONLY | O_BINARY);
+	if (file->f == -1) {
 		/* LCOV_EXCL_START */
 		if (errno == ENOENT) {
 			log_fatal("DANGER! file '%s' disappeared.\n", path);
@@ -89,63 +142,141 @@ int search_file_compare(const void* void_arg, const void* void_data)
 		/* LCOV_EXCL_STOP */
 	}
 
-	ret = pread(f, arg->buffer, arg->read_size, arg->offset);
-	if (ret < 0 || (unsigned)ret != arg->read_size) {
-		/* LCOV_EXCL_START */
-		log_fatal("Error reading file '%s'. %s.\n", path, strerror(errno));
-		exit(EXIT_FAILURE);
-		/* LCOV_EXCL_STOP */
+	file->ahead = ahead;
+	file->ahead_offset = 0;
+	file->ahead_size = 0;
+	file->next_offset = 0;
+
+	tommy_list_insert_head(&state->searchopen, &file->nodeopen, file);
+}
+
+/**
+ * Read a block from the file.
+ * When reading sequentially, the next blocks are read ahead in a single call.
+ */
+static void search_file_read(struct snapraid_state* state, struct snapraid_search_file* file, unsigned char* buffer, data_off_t offset, unsigned read_size)
+{
+	const char* path = file->path;
+	ssize_t ret;
+
+	search_file_open(state, file);
+
+	if (offset >= file->ahead_offset && offset + read_size <= file->ahead_offset + file->ahead_size) {
+		/* the data was already read ahead */
+		memcpy(buffer, file->ahead + (offset - file->ahead_offset), read_size);
+	} else if (offset == file->next_offset) {
+		/* sequential access, read also the next blocks */
+		unsigned ahead_size = search_ahead_size(state);
+		if (ahead_size > file->size - offset)
+			ahead_size = file->size - offset;
+
+		/* the read-ahead buffer is invalid until filled */
+		file->ahead_size = 0;
+
+		ret = pread(file->f, file->ahead, ahead_size, offset);
+		if (ret < 0 || (unsigned)ret != ahead_size || ahead_size < read_size) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error reading file '%s'. %s.\n", path, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		file->ahead_offset = offset;
+		file->ahead_size = ahead_size;
+
+		memcpy(buffer, file->ahead, read_size);
+	} else {
+		/* random access, read only the block */
+		ret = pread(file->f, buffer, read_size, offset);
+		if (ret < 0 || (unsigned)ret != read_size) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error reading file '%s'. %s.\n", path, strerror(errno));
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
 	}
 
-	ret = close(f);
-	if (ret != 0) {
-		/* LCOV_EXCL_START */
-		log_fatal("Error closing file '%s'. %s.\n", path, strerror(errno));
-		exit(EXIT_FAILURE);
-		/* LCOV_EXCL_STOP */
+	file->next_offset = offset + read_size;
+}
+
+void state_search_close(struct snapraid_state* state)
+{
+	unsigned count = 0;
+
+	while (!tommy_list_empty(&state->searchopen)) {
+		struct snapraid_search_file* file = tommy_list_head(&state->searchopen)->data;
+		free(search_file_close(state, file));
+		++count;
 	}
 
-	/* compute the hash */
-	if (arg->prevhash)
-		memhash(state->prevhash, state->prevhashseed, buffer_hash, arg->buffer, arg->read_size);
-	else
-		memhash(state->hash, state->hashseed, buffer_hash, arg->buffer, arg->read_size);
+	if (count)
+		log_tag("search:close:%u\n", count);
+}
+
+/**
+ * Compare the file info of a missing file with a search file.
+ */
+static int search_file_compare(const struct snapraid_file* missing_file, const struct snapraid_search_file* file)
+{
+	/* compare file info */
+	if (missing_file->size != file->size)
+		return -1;
 
-	/* check if the hash is matching */
-	if (memcmp(buffer_hash, arg->block->hash, BLOCK_HASH_SIZE) != 0)
+	if (missing_file->mtime_sec != file->mtime_sec)
 		return -1;
 
-	if (arg->read_size != state->block_size) {
-		/* fill the remaining with 0 */
-		memset(arg->buffer + arg->read_size, 0, state->block_size - arg->read_size);
-	}
+	if (missing_file->mtime_nsec != file->mtime_nsec)
+		return -1;
 
 	return 0;
 }
 
 int state_search_fetch(struct snapraid_state* state, int prevhash, struct snapraid_file* missing_file, block_off_t missing_file_pos, struct snapraid_block* missing_block, unsigned char* buffer)
 {
-	struct snapraid_search_file* file;
+	tommy_hashdyn_node* i;
 	tommy_uint32_t file_hash;
-	struct search_file_compare_arg arg;
+	unsigned char buffer_hash[HASH_MAX];
+	data_off_t offset;
+	unsigned read_size;
 
-	arg.state = state;
-	arg.block = missing_block;
-	arg.file = missing_file;
-	arg.buffer = buffer;
-	arg.offset = state->block_size * (data_off_t)missing_file_pos;
-	arg.read_size = file_block_size(missing_file, missing_file_pos, state->block_size);
-	arg.prevhash = prevhash;
+	offset = state->block_size * (data_off_t)missing_file_pos;
+	read_size = file_block_size(missing_file, missing_file_pos, state->block_size);
 
-	file_hash = file_stamp_hash(arg.file->size, arg.file->mtime_sec, arg.file->mtime_nsec);
+	file_hash = file_stamp_hash(missing_file->size, missing_file->mtime_sec, missing_file->mtime_nsec);
 
-	/* search in the hashtable, and also check if the data matches the hash */
-	file = tommy_hashdyn_search(&state->searchset, search_file_compare, &arg, file_hash);
-	if (!file)
-		return -1;
+	/* search in the hashtable all the files with the same stamp, and check if the data matches the hash */
+	i = tommy_hashdyn_bucket(&state->searchset, file_hash);
+	while (i) {
+		struct snapraid_search_file* file = i->data;
+		tommy_hash_t key = i->key;
 
-	/* if found, buffer is already set with data */
-	return 0;
+		i = i->next;
+
+		if (key != file_hash || search_file_compare(missing_file, file) != 0)
+			continue;
+
+		/* read the block, keeping the file open for the next blocks */
+		search_file_read(state, file, buffer, offset, read_size);
+
+		/* compute the hash */
+		if (prevhash)
+			memhash(state->prevhash, state->prevhashseed, buffer_hash, buffer, read_size);
+		else
+			memhash(state->hash, state->hashseed, buffer_hash, buffer, read_size);
+
+		/* check if the hash is matching */
+		if (memcmp(buffer_hash, missing_block->hash, BLOCK_HASH_SIZE) != 0)
+			continue;
+
+		if (read_size != state->block_size) {
+			/* fill the remaining with 0 */
+			memset(buffer + read_size, 0, state->block_size - read_size);
+		}
+
+		return 0;
+	}
+
+	return -1;
 }
 
 static void search_dir(struct snapraid_state* state, struct snapraid_disk* disk, const char* dir, const char* sub)
@@ -35,8 +35,21 @@ struct snapraid_search_file {
 	int64_t mtime_sec;
 	int mtime_nsec;
 
+	/**
+	 * Opened file.
+	 *
+	 * The most recently used files are kept open, with the data read ahead
+	 * when the blocks are requested sequentially.
+	 */
+	int f; /**< Handle of the file, or -1 if not opened. */
+	unsigned char* ahead; /**< Read-ahead buffer. Allocated only if the file is opened. */
+	data_off_t ahead_offset; /**< Offset in the file of the data in the read-ahead buffer. */
+	unsigned ahead_size; /**< Size of the data in the read-ahead buffer. */
+	data_off_t next_offset; /**< Offset of the next block, if read sequentially. */
+
 	/* nodes for data structures */
 	tommy_node node;
+	tommy_node nodeopen;
 };
 
 /**
@@ -50,6 +63,12 @@ void search_file_free(struct snapraid_search_file* file);
  */
 int state_search_fetch(struct snapraid_state* state, int prevhash, struct snapraid_file* missing_file, block_off_t missing_file_pos, struct snapraid_block* missing_block, unsigned char* buffer);
 
+/**
+ * Close all the search files kept open.
+ * It has to be called before renaming or removing any file of the array.
+ */
+void state_search_close(struct snapraid_state* state);
+
 /**
  * Import files from the specified directory.
  */
@@ -203,6 +203,47 @@ static void test_hash(void)
 		}
 	}
 
+	/* incremental hash of all the splits of the data */
+	for (i = 0; TEST_SPOOKY2[i].data; ++i) {
+		int j;
+		memcpy(buffer_aligned, TEST_SPOOKY2[i].data, TEST_SPOOKY2[i].len);
+		for (j = 0; j <= TEST_SPOOKY2[i].len; ++j) {
+			unsigned char digest[HASH_MAX];
+			struct memhash_ctx ctx;
+
+			memhash_init(&ctx, HASH_SPOOKY2, seed_aligned);
+			memhash_update(&ctx, buffer_aligned, j);
+			memhash_update(&ctx, buffer_aligned + j, TEST_SPOOKY2[i].len - j);
+			memhash_final(&ctx, digest);
+			if (memcmp(digest, TEST_SPOOKY2[i].digest, HASH_MAX) != 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Failed Spooky2 incremental test\n");
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+		}
+	}
+
+	for (i = 0; TEST_MURMUR3[i].data; ++i) {
+		int j;
+		memcpy(buffer_aligned, TEST_MURMUR3[i].data, TEST_MURMUR3[i].len);
+		for (j = 0; j <= TEST_MURMUR3[i].len; ++j) {
+			unsigned char digest[HASH_MAX];
+			struct memhash_ctx ctx;
+
+			memhash_init(&ctx, HASH_MURMUR3, seed_aligned);
+			memhash_update(&ctx, buffer_aligned, j);
+			memhash_update(&ctx, buffer_aligned + j, TEST_MURMUR3[i].len - j);
+			memhash_final(&ctx, digest);
+			if (memcmp(digest, TEST_MURMUR3[i].digest, HASH_MAX) != 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Failed Murmur3 incremental test\n");
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+		}
+	}
+
 	free(buffer_alloc);
 	free(seed_alloc);
 }
@@ -240,6 +281,7 @@ static struct crc_test_vector TEST_CRC32C[] = {
 static void test_crc32c(void)
 {
 	unsigned i;
+	int j;
 
 	for (i = 0; TEST_CRC32C[i].data; ++i) {
 		uint32_t digest;
@@ -254,6 +296,20 @@ static void test_crc32c(void)
 			exit(EXIT_FAILURE);
 			/* LCOV_EXCL_STOP */
 		}
+
+		/* combine the crc of all the splits of the data */
+		for (j = 0; j <= TEST_CRC32C[i].len; ++j) {
+			const unsigned char* data = (const unsigned char*)TEST_CRC32C[i].data;
+			uint32_t crc1 = crc32c(0, data, j);
+			uint32_t crc2 = crc32c(0, data + j, TEST_CRC32C[i].len - j);
+
+			if (crc32c_combine(crc1, crc2, TEST_CRC32C[i].len - j) != TEST_CRC32C[i].digest) {
+				/* LCOV_EXCL_START */
+				log_fatal("Failed CRC32C combine test\n");
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+		}
 	}
 }
 
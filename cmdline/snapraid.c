@@ -24,6 +24,7 @@
 #include "search.h"
 #include "state.h"
 #include "io.h"
+#include "gen.h"
 #include "raid/raid.h"
 
 /****************************************************************************/
@@ -75,18 +76,38 @@ void usage(void)
 	printf("  " SWITCH_GETOPT_LONG("-v, --verbose         ", "-v") "  Verbose\n");
 }
 
-void memory(void)
+void memory(struct snapraid_state* state)
 {
+	tommy_node* i;
+	uint64_t arena_alloc_count;
+	uint64_t arena_saved_count;
+	uint64_t arena_reuse_count;
+
+	/* count the allocations served by the disk arenas */
+	arena_alloc_count = 0;
+	arena_saved_count = 0;
+	arena_reuse_count = 0;
+	for (i = state->disklist; i != 0; i = i->next) {
+		struct snapraid_disk* disk = i->data;
+		arena_alloc_count += disk->arena.alloc_count;
+		arena_saved_count += arena_saved(&disk->arena);
+		arena_reuse_count += disk->arena.reuse_count;
+	}
+
 	log_tag("memory:used:%" PRIu64 "\n", (uint64_t)malloc_counter_get());
+	log_tag("memory:arena_alloc:%" PRIu64 "\n", arena_alloc_count);
+	log_tag("memory:arena_saved:%" PRIu64 "\n", arena_saved_count);
+	log_tag("memory:arena_reuse:%" PRIu64 "\n", arena_reuse_count);
 
 	/* size of the block */
-	log_tag("memory:block:%" PRIu64 "\n", (uint64_t)(sizeof(struct snapraid_block)));
+	log_tag("memory:block:%" PRIu64 "\n", (uint64_t)block_sizeof());
 	log_tag("memory:chunk:%" PRIu64 "\n", (uint64_t)(sizeof(struct snapraid_chunk)));
 	log_tag("memory:file:%" PRIu64 "\n", (uint64_t)(sizeof(struct snapraid_file)));
 	log_tag("memory:link:%" PRIu64 "\n", (uint64_t)(sizeof(struct snapraid_link)));
 	log_tag("memory:dir:%" PRIu64 "\n", (uint64_t)(sizeof(struct snapraid_dir)));
 
 	msg_progress("Using %u MiB of memory for the FileSystem.\n", (unsigned)(malloc_counter_get() / MEBI));
+	msg_verbose("Saved %" PRIu64 " memory allocations of %" PRIu64 " using the disk arenas.\n", arena_saved_count, arena_alloc_count);
 }
 
 void test(int argc, char* argv[])
@@ -283,6 +304,14 @@ void config(char* conf, size_t conf_size, const char* argv0)
 #define OPT_TEST_IO_CACHE 290
 #define OPT_TEST_IO_STATS 291
 #define OPT_TEST_COND_SIGNAL_OUTSIDE 292
+#define OPT_TEST_SKIP_SCAN_THREAD 293
+#define OPT_TEST_SKIP_MMAP 294
+#define OPT_TEST_RAID_THREAD 295
+#define OPT_IO_URING 296
+#define OPT_IO_DIRECT 297
+#define OPT_IO_WRITEBACK 298
+#define OPT_IMPORT_CACHE 299
+#define OPT_POOL_FULL 300
 
 #if HAVE_GETOPT_LONG
 struct option long_options[] = {
@@ -386,6 +415,9 @@ struct option long_options[] = {
 	/* Alternative import working by data */
 	{ "test-import-content", 1, 0, OPT_TEST_IMPORT_CONTENT },
 
+	/* Cache of the hashes of the files imported by data */
+	{ "import-cache", 1, 0, OPT_IMPORT_CACHE },
+
 	/* Force immediate progress state update */
 	{ "test-force-progress", 0, 0, OPT_TEST_FORCE_PROGRESS },
 
@@ -419,6 +451,27 @@ struct option long_options[] = {
 	/* Signal condition variable outside the mutex */
 	{ "test-cond-signal-outside", 0, 0, OPT_TEST_COND_SIGNAL_OUTSIDE },
 
+	/* Scan the disks one after the other */
+	{ "test-skip-scan-thread", 0, 0, OPT_TEST_SKIP_SCAN_THREAD },
+
+	/* Read the content file without mapping it in memory */
+	{ "test-skip-mmap", 0, 0, OPT_TEST_SKIP_MMAP },
+
+	/* Number of threads used to compute the parity */
+	{ "test-raid-thread", 1, 0, OPT_TEST_RAID_THREAD },
+
+	/* Use io_uring with the specified number of threads */
+	{ "io-uring", 1, 0, OPT_IO_URING },
+
+	/* Read and write data and parity bypassing the OS cache */
+	{ "io-direct", 0, 0, OPT_IO_DIRECT },
+
+	/* Start the writeback of the parity as soon as it's written */
+	{ "io-writeback", 0, 0, OPT_IO_WRITEBACK },
+
+	/* Rebuild the whole pooling directory */
+	{ "pool-full", 0, 0, OPT_POOL_FULL },
+
 	{ 0, 0, 0, 0 }
 };
 #endif
@@ -496,6 +549,7 @@ int main(int argc, char* argv[])
 	const char* command;
 	const char* import_timestamp;
 	const char* import_content;
+	const char* import_cache;
 	const char* log_file;
 	int lock;
 	const char* gen_conf;
@@ -525,6 +579,7 @@ int main(int argc, char* argv[])
 	olderthan = SCRUB_AUTO;
 	import_timestamp = 0;
 	import_content = 0;
+	import_cache = 0;
 	log_file = 0;
 	lock = 0;
 	gen_conf = 0;
@@ -582,6 +637,8 @@ int main(int argc, char* argv[])
 				plan = SCRUB_NEW;
 			} else if (strcmp(optarg, "full") == 0) {
 				plan = SCRUB_FULL;
+			} else if (strcmp(optarg, "rehash") == 0) {
+				plan = SCRUB_REHASH;
 			} else {
 				plan = strtoul(optarg, &e, 10);
 				if (!e || *e || plan > 100) {
@@ -646,6 +703,9 @@ int main(int argc, char* argv[])
 			}
 			import_content = optarg;
 			break;
+		case OPT_IMPORT_CACHE :
+			import_cache = optarg;
+			break;
 		case 'l' :
 			if (log_file) {
 				/* LCOV_EXCL_START */
@@ -818,6 +878,39 @@ int main(int argc, char* argv[])
 			thread_cond_signal_outside = 1;
 #endif
 			break;
+		case OPT_TEST_SKIP_SCAN_THREAD :
+			opt.skip_scan_thread = 1;
+			break;
+		case OPT_TEST_SKIP_MMAP :
+			opt.skip_mmap = 1;
+			break;
+		case OPT_TEST_RAID_THREAD :
+			opt.raid_thread = atoi(optarg);
+			if (opt.raid_thread == 0 || opt.raid_thread > GEN_THREAD_MAX) {
+				/* LCOV_EXCL_START */
+				log_fatal("The RAID threads should be between 1 and %u.\n", GEN_THREAD_MAX);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			break;
+		case OPT_IO_URING :
+			opt.io_uring = atoi(optarg);
+			if (opt.io_uring == 0 || opt.io_uring > IO_RING_MAX) {
+				/* LCOV_EXCL_START */
+				log_fatal("The io_uring threads should be between 1 and %u.\n", IO_RING_MAX);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			break;
+		case OPT_IO_DIRECT :
+			opt.io_direct = 1;
+			break;
+		case OPT_IO_WRITEBACK :
+			opt.io_writeback = 1;
+			break;
+		case OPT_POOL_FULL :
+			opt.pool_full = 1;
+			break;
 		default :
 			/* LCOV_EXCL_START */
 			log_fatal("Unknown option '%c'\n", (char)c);
@@ -952,6 +1045,18 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	switch (operation) {
+	case OPERATION_POOL :
+		break;
+	default :
+		if (opt.pool_full) {
+			/* LCOV_EXCL_START */
+			log_fatal("You cannot use --pool-full with the '%s' command\n", command);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
 	if (opt.force_full && opt.force_nocopy) {
 		/* LCOV_EXCL_START */
 		log_fatal("You cannot use the -F, --force-full and -N, --force-nocopy options at the same time\n");
@@ -1023,6 +1128,13 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	if (import_cache != 0 && import_content == 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("You can use --import-cache only when importing files by data\n");
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
 	switch (operation) {
 	case OPERATION_LIST :
 	case OPERATION_DUP :
@@ -1183,7 +1295,7 @@ int main(int argc, char* argv[])
 		/* refresh the size info before the content write */
 		state_refresh(&state);
 
-		memory();
+		memory(&state);
 
 		/* intercept signals while operating */
 		signal_init();
@@ -1232,7 +1344,7 @@ int main(int argc, char* argv[])
 		state_skip(&state);
 		state_filter(&state, &filterlist_file, &filterlist_disk, filter_missing, filter_error);
 
-		memory();
+		memory(&state);
 
 		/* intercept signals while operating */
 		signal_init();
@@ -1252,7 +1364,7 @@ int main(int argc, char* argv[])
 	} else if (operation == OPERATION_SCRUB) {
 		state_read(&state);
 
-		memory();
+		memory(&state);
 
 		/* intercept signals while operating */
 		signal_init();
@@ -1277,11 +1389,11 @@ int main(int argc, char* argv[])
 
 		state_write(&state);
 
-		memory();
+		memory(&state);
 	} else if (operation == OPERATION_READ) {
 		state_read(&state);
 
-		memory();
+		memory(&state);
 	} else if (operation == OPERATION_TOUCH) {
 		state_read(&state);
 
@@ -1292,7 +1404,7 @@ int main(int argc, char* argv[])
 
 		state_write(&state);
 
-		memory();
+		memory(&state);
 	} else if (operation == OPERATION_SPINUP) {
 		state_device(&state, DEVICE_UP, &filterlist_disk);
 	} else if (operation == OPERATION_SPINDOWN) {
@@ -1304,7 +1416,7 @@ int main(int argc, char* argv[])
 	} else if (operation == OPERATION_STATUS) {
 		state_read(&state);
 
-		memory();
+		memory(&state);
 
 		state_status(&state);
 	} else if (operation == OPERATION_DUP) {
@@ -1328,7 +1440,7 @@ int main(int argc, char* argv[])
 			if (import_timestamp != 0)
 				state_search(&state, import_timestamp);
 			if (import_content != 0)
-				state_import(&state, import_content);
+				state_import(&state, import_content, import_cache);
 
 			/* import from all the array */
 			if (!state.opt.force_nocopy)
@@ -1339,7 +1451,7 @@ int main(int argc, char* argv[])
 		state_skip(&state);
 		state_filter(&state, &filterlist_file, &filterlist_disk, filter_missing, filter_error);
 
-		memory();
+		memory(&state);
 
 		/* intercept signals while operating */
 		signal_init();
@@ -1376,6 +1488,7 @@ int main(int argc, char* argv[])
 	tommy_list_foreach(&filterlist_file, (tommy_foreach_func*)filter_free);
 	tommy_list_foreach(&filterlist_disk, (tommy_foreach_func*)filter_free);
 
+	huge_done();
 	os_done();
 	lock_done();
 
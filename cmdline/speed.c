@@ -24,6 +24,7 @@
 #include "raid/internal.h"
 #include "raid/memory.h"
 #include "state.h"
+#include "gen.h"
 
 /*
  * Size of the blocks to test.
@@ -35,6 +36,12 @@
  */
 #define TEST_COUNT (8)
 
+/*
+ * Number of stripes of data and double parity blocks to test the memory pages.
+ * It's large enough to exceed the reach of the TLB with normal pages.
+ */
+#define TEST_STRIPE (32)
+
 /**
  * Differential us of two timeval.
  */
@@ -82,6 +89,8 @@ void speed(int period)
 	int64_t ds;
 	int64_t dt;
 	int i, j;
+	unsigned t;
+	unsigned kind;
 	unsigned char digest[HASH_MAX];
 	unsigned char seed[HASH_MAX];
 	int id[RAID_PARITY_MAX];
@@ -130,11 +139,13 @@ void speed(int period)
 
 		raid_cpu_info(vendor, &family, &model);
 
-		printf("CPU %s, family %u, model %u, flags%s%s%s%s%s%s\n", vendor, family, model,
+		printf("CPU %s, family %u, model %u, flags%s%s%s%s%s%s%s%s\n", vendor, family, model,
 			raid_cpu_has_sse2() ? " sse2" : "",
 			raid_cpu_has_ssse3() ? " ssse3" : "",
 			raid_cpu_has_crc32() ? " crc32" : "",
 			raid_cpu_has_avx2() ? " avx2" : "",
+			raid_cpu_has_avx512bw() ? " avx512bw" : "",
+			raid_cpu_has_gfni() ? " gfni" : "",
 			raid_cpu_has_slowmult() ? " slowmult" : "",
 			raid_cpu_has_slowextendedreg() ? " slowext" : ""
 		);
@@ -268,6 +279,8 @@ void speed(int period)
 	printf("%8s", "avx2");
 #ifdef CONFIG_X86_64
 	printf("%8s", "avx2e");
+	printf("%8s", "avx512");
+	printf("%8s", "gfni");
 #endif
 #endif
 	printf("\n");
@@ -322,6 +335,21 @@ void speed(int period)
 		fflush(stdout);
 	}
 #endif
+
+#ifdef CONFIG_X86_64
+	printf("%8s", "");
+
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			raid_gen1_avx512bw(nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
+#endif
 #endif
 	printf("\n");
 
@@ -381,6 +409,21 @@ void speed(int period)
 		fflush(stdout);
 	}
 #endif
+
+#ifdef CONFIG_X86_64
+	printf("%8s", "");
+
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			raid_gen2_avx512bw(nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
+#endif
 #endif
 	printf("\n");
 
@@ -443,6 +486,28 @@ void speed(int period)
 		fflush(stdout);
 	}
 #endif
+
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			raid_genz_avx512bw(nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
+
+#ifdef CONFIG_GFNI
+	if (raid_cpu_has_gfni()) {
+		SPEED_START {
+			raid_genz_gfni(nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
 #endif
 #endif
 	printf("\n");
@@ -506,6 +571,28 @@ void speed(int period)
 		fflush(stdout);
 	}
 #endif
+
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			raid_gen3_avx512bw(nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
+
+#ifdef CONFIG_GFNI
+	if (raid_cpu_has_gfni()) {
+		SPEED_START {
+			raid_gen3_gfni(nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
 #endif
 #endif
 	printf("\n");
@@ -571,6 +658,28 @@ void speed(int period)
 		fflush(stdout);
 	}
 #endif
+
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			raid_gen4_avx512bw(nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
+
+#ifdef CONFIG_GFNI
+	if (raid_cpu_has_gfni()) {
+		SPEED_START {
+			raid_gen4_gfni(nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
 #endif
 #endif
 	printf("\n");
@@ -636,6 +745,28 @@ void speed(int period)
 		fflush(stdout);
 	}
 #endif
+
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			raid_gen5_avx512bw(nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
+
+#ifdef CONFIG_GFNI
+	if (raid_cpu_has_gfni()) {
+		SPEED_START {
+			raid_gen5_gfni(nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
 #endif
 #endif
 	printf("\n");
@@ -701,6 +832,28 @@ void speed(int period)
 		fflush(stdout);
 	}
 #endif
+
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			raid_gen6_avx512bw(nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
+
+#ifdef CONFIG_GFNI
+	if (raid_cpu_has_gfni()) {
+		SPEED_START {
+			raid_gen6_gfni(nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
 #endif
 #endif
 	printf("\n");
@@ -714,6 +867,10 @@ void speed(int period)
 #ifdef CONFIG_X86
 	printf("%8s", "ssse3");
 	printf("%8s", "avx2");
+#ifdef CONFIG_X86_64
+	printf("%8s", "avx512");
+	printf("%8s", "gfni");
+#endif
 #endif
 	printf("\n");
 
@@ -753,6 +910,30 @@ void speed(int period)
 		printf("%8" PRIu64, ds / dt);
 	}
 #endif
+#ifdef CONFIG_X86_64
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				/* +1 to avoid GEN1 optimized case */
+				raid_rec1_avx512bw(1, id, ip + 1, nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+	}
+#endif
+#ifdef CONFIG_GFNI
+	if (raid_cpu_has_gfni()) {
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				/* +1 to avoid GEN1 optimized case */
+				raid_rec1_gfni(1, id, ip + 1, nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+	}
+#endif
+#endif
 #endif
 	printf("\n");
 
@@ -792,6 +973,30 @@ void speed(int period)
 		printf("%8" PRIu64, ds / dt);
 	}
 #endif
+#ifdef CONFIG_X86_64
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				/* +1 to avoid GEN2 optimized case */
+				raid_rec2_avx512bw(2, id, ip + 1, nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+	}
+#endif
+#ifdef CONFIG_GFNI
+	if (raid_cpu_has_gfni()) {
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				/* +1 to avoid GEN2 optimized case */
+				raid_rec2_gfni(2, id, ip + 1, nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+	}
+#endif
+#endif
 #endif
 	printf("\n");
 
@@ -828,6 +1033,28 @@ void speed(int period)
 		printf("%8" PRIu64, ds / dt);
 	}
 #endif
+#ifdef CONFIG_X86_64
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				raid_recX_avx512bw(3, id, ip, nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+	}
+#endif
+#ifdef CONFIG_GFNI
+	if (raid_cpu_has_gfni()) {
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				raid_recX_gfni(3, id, ip, nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+	}
+#endif
+#endif
 #endif
 	printf("\n");
 
@@ -864,6 +1091,28 @@ void speed(int period)
 		printf("%8" PRIu64, ds / dt);
 	}
 #endif
+#ifdef CONFIG_X86_64
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				raid_recX_avx512bw(4, id, ip, nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+	}
+#endif
+#ifdef CONFIG_GFNI
+	if (raid_cpu_has_gfni()) {
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				raid_recX_gfni(4, id, ip, nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+	}
+#endif
+#endif
 #endif
 	printf("\n");
 
@@ -900,6 +1149,28 @@ void speed(int period)
 		printf("%8" PRIu64, ds / dt);
 	}
 #endif
+#ifdef CONFIG_X86_64
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				raid_recX_avx512bw(5, id, ip, nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+	}
+#endif
+#ifdef CONFIG_GFNI
+	if (raid_cpu_has_gfni()) {
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				raid_recX_gfni(5, id, ip, nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+	}
+#endif
+#endif
 #endif
 	printf("\n");
 
@@ -936,8 +1207,184 @@ void speed(int period)
 		printf("%8" PRIu64, ds / dt);
 	}
 #endif
+#ifdef CONFIG_X86_64
+#ifdef CONFIG_AVX512BW
+	if (raid_cpu_has_avx512bw()) {
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				raid_recX_avx512bw(6, id, ip, nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+	}
 #endif
+#ifdef CONFIG_GFNI
+	if (raid_cpu_has_gfni()) {
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				raid_recX_gfni(6, id, ip, nd, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+	}
+#endif
+#endif
+#endif
+	printf("\n");
+	printf("\n");
+
+	/* parallel parity table */
+	printf("RAID threads used for computing the parity with 'sync':\n");
+	printf("%8s", "");
+	printf("%8s", "best");
+	for (t = 1; t <= GEN_THREAD_MAX; t *= 2)
+		printf("%8u", t);
+	printf("\n");
+
+	for (j = 1; j <= RAID_PARITY_MAX; ++j) {
+		printf("%7s%d", "gen", j);
+		printf("%8u", gen_calibrate(nd, j, size));
+		fflush(stdout);
+
+		for (t = 1; t <= GEN_THREAD_MAX; t *= 2) {
+			struct snapraid_gen gen;
+
+			gen_init(&gen, nd, j, size, t);
+
+			SPEED_START {
+				gen_parity(&gen, size, v);
+			} SPEED_STOP
+
+			gen_done(&gen);
+
+			printf("%8" PRIu64, ds / dt);
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+	printf("\n");
+
+	/* fused hash and parity table */
+	printf("Hash and double parity computed in the same pass with 'scrub':\n");
+	printf("%8s", "");
+	printf("%8s", "split");
+	printf("%8s", "fused");
+	printf("\n");
+
+	for (kind = HASH_MURMUR3; kind <= HASH_SPOOKY2; ++kind) {
+		struct snapraid_gen gen;
+		struct snapraid_gen_hash* hash;
+
+		hash = malloc_nofail(nd * sizeof(struct snapraid_gen_hash));
+		for (j = 0; j < nd; ++j) {
+			hash[j].index = j;
+			hash[j].size = size;
+		}
+
+		gen_init(&gen, nd, 2, size, 1);
+
+		printf("%8s", hash_config_name(kind));
+		fflush(stdout);
+
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				memhash(kind, seed, digest, v[j], size);
+			gen_parity(&gen, size, v);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				memhash_init(&hash[j].ctx, kind, seed);
+			gen_parity_hash(&gen, size, v, 0, hash, nd);
+			for (j = 0; j < nd; ++j)
+				memhash_final(&hash[j].ctx, digest);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		printf("\n");
+
+		gen_done(&gen);
+		free(hash);
+	}
 	printf("\n");
+
+	/* memory pages table */
+	{
+		int stripe = nd + 2;
+		int n = TEST_STRIPE * stripe;
+		void* w_alloc;
+		void** w;
+		void* h_alloc;
+		void** h;
+		int s;
+
+		/* stripes as in the IO cache, with normal and huge pages */
+		w = malloc_nofail_vector_align(0, n, size, &w_alloc);
+		h = malloc_nofail_vector_huge(0, n, size, 0, &h_alloc);
+		for (j = 0; j < n; ++j) {
+			memset(w[j], j, size);
+			memset(h[j], j, size);
+		}
+
+		printf("Memory pages used for the IO cache, with %u MiB of buffers:\n", n * size / MEBI);
+		printf("%8s", "");
+		printf("%8s", "normal");
+		printf("%8s", huge_kind());
+		printf("\n");
+
+		printf("%8s", "hash");
+		fflush(stdout);
+
+		s = 0;
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				memhash(HASH_SPOOKY2, seed, digest, w[s * stripe + j], size);
+			s = (s + 1) % TEST_STRIPE;
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+
+		s = 0;
+		SPEED_START {
+			for (j = 0; j < nd; ++j)
+				memhash(HASH_SPOOKY2, seed, digest, h[s * stripe + j], size);
+			s = (s + 1) % TEST_STRIPE;
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		printf("\n");
+
+		printf("%8s", "gen2");
+		fflush(stdout);
+
+		s = 0;
+		SPEED_START {
+			raid_gen(nd, 2, size, w + s * stripe);
+			s = (s + 1) % TEST_STRIPE;
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+
+		s = 0;
+		SPEED_START {
+			raid_gen(nd, 2, size, h + s * stripe);
+			s = (s + 1) % TEST_STRIPE;
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		printf("\n");
+
+		free(w_alloc);
+		free(w);
+		free_huge(h_alloc);
+		free(h);
+		huge_done();
+	}
 	printf("\n");
 
 	printf("If the 'best' expectations are wrong, please report it in the SnapRAID forum\n\n");
@@ -108,36 +108,21 @@
 //
 #define sc_const 0xdeadbeefdeadbeefLL
 
-void SpookyHash128(const void* data, size_t size, const uint8_t* seed, uint8_t* digest)
+/**
+ * Process whole blocks of sc_blockSize bytes.
+ */
+static void SpookyHash128_blocks(uint64_t* h, const uint64_t* blocks, size_t nblocks)
 {
-	uint64_t h0, h1, h2, h3, h4, h5, h6, h7, h8, h9, h10, h11;
-	uint64_t buf[sc_numVars];
-	size_t nblocks;
-	const uint64_t* blocks;
-	const uint64_t* end;
-	size_t size_remainder;
+	const uint64_t* end = blocks + nblocks * sc_numVars;
+	uint64_t h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3];
+	uint64_t h4 = h[4], h5 = h[5], h6 = h[6], h7 = h[7];
+	uint64_t h8 = h[8], h9 = h[9], h10 = h[10], h11 = h[11];
 
 #if WORDS_BIGENDIAN
+	uint64_t buf[sc_numVars];
 	unsigned i;
 #endif
 
-	h9 = ((const uint64_t*)seed)[0];
-	h10 = ((const uint64_t*)seed)[1];
-
-#if WORDS_BIGENDIAN
-	h9 = util_swap64(h9);
-	h10 = util_swap64(h10);
-#endif
-
-	h0 = h3 = h6 = h9;
-	h1 = h4 = h7 = h10;
-	h2 = h5 = h8 = h11 = sc_const;
-
-	nblocks = size / sc_blockSize;
-	blocks = data;
-	end = blocks + nblocks * sc_numVars;
-
-	/* body */
 	while (blocks < end) {
 #if WORDS_BIGENDIAN
 		for (i = 0; i < sc_numVars; ++i)
@@ -149,9 +134,73 @@ void SpookyHash128(const void* data, size_t size, const uint8_t* seed, uint8_t*
 		blocks += sc_numVars;
 	}
 
+	h[0] = h0; h[1] = h1; h[2] = h2; h[3] = h3;
+	h[4] = h4; h[5] = h5; h[6] = h6; h[7] = h7;
+	h[8] = h8; h[9] = h9; h[10] = h10; h[11] = h11;
+}
+
+void SpookyHash128_init(struct spooky2_ctx* ctx, const uint8_t* seed)
+{
+	uint64_t s0 = ((const uint64_t*)seed)[0];
+	uint64_t s1 = ((const uint64_t*)seed)[1];
+
+#if WORDS_BIGENDIAN
+	s0 = util_swap64(s0);
+	s1 = util_swap64(s1);
+#endif
+
+	ctx->h[0] = ctx->h[3] = ctx->h[6] = ctx->h[9] = s0;
+	ctx->h[1] = ctx->h[4] = ctx->h[7] = ctx->h[10] = s1;
+	ctx->h[2] = ctx->h[5] = ctx->h[8] = ctx->h[11] = sc_const;
+
+	ctx->size = 0;
+}
+
+void SpookyHash128_update(struct spooky2_ctx* ctx, const void* data, size_t size)
+{
+	const uint8_t* ptr = data;
+	size_t used = ctx->size % sc_blockSize;
+
+	ctx->size += size;
+
+	/* complete the block left pending by the previous call */
+	if (used != 0) {
+		size_t fill = sc_blockSize - used;
+		if (fill > size)
+			fill = size;
+
+		memcpy((uint8_t*)ctx->buf + used, ptr, fill);
+		ptr += fill;
+		size -= fill;
+
+		/* if still not complete, wait for more data */
+		if (used + fill < sc_blockSize)
+			return;
+
+		SpookyHash128_blocks(ctx->h, ctx->buf, 1);
+	}
+
+	/* body */
+	SpookyHash128_blocks(ctx->h, (const uint64_t*)ptr, size / sc_blockSize);
+
+	/* keep the tail for the next call */
+	memcpy(ctx->buf, ptr + size - size % sc_blockSize, size % sc_blockSize);
+}
+
+void SpookyHash128_final(struct spooky2_ctx* ctx, uint8_t* digest)
+{
+	uint64_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2], h3 = ctx->h[3];
+	uint64_t h4 = ctx->h[4], h5 = ctx->h[5], h6 = ctx->h[6], h7 = ctx->h[7];
+	uint64_t h8 = ctx->h[8], h9 = ctx->h[9], h10 = ctx->h[10], h11 = ctx->h[11];
+	uint64_t* buf = ctx->buf;
+	size_t size_remainder;
+
+#if WORDS_BIGENDIAN
+	unsigned i;
+#endif
+
 	/* tail */
-	size_remainder = (size - ((const uint8_t*)end - (const uint8_t*)data));
-	memcpy(buf, end, size_remainder);
+	size_remainder = ctx->size % sc_blockSize;
 	memset(((uint8_t*)buf) + size_remainder, 0, sc_blockSize - size_remainder);
 	((uint8_t*)buf)[sc_blockSize - 1] = size_remainder;
 
@@ -172,3 +221,12 @@ void SpookyHash128(const void* data, size_t size, const uint8_t* seed, uint8_t*
 	((uint64_t*)digest)[1] = h1;
 }
 
+void SpookyHash128(const void* data, size_t size, const uint8_t* seed, uint8_t* digest)
+{
+	struct spooky2_ctx ctx;
+
+	SpookyHash128_init(&ctx, seed);
+	SpookyHash128_update(&ctx, data, size);
+	SpookyHash128_final(&ctx, digest);
+}
+
@@ -182,6 +182,7 @@ void state_init(struct snapraid_state* state)
 	tommy_hashdyn_init(&state->importset);
 	tommy_hashdyn_init(&state->previmportset);
 	tommy_hashdyn_init(&state->searchset);
+	tommy_list_init(&state->searchopen);
 	tommy_arrayblkof_init(&state->infoarr, sizeof(snapraid_info));
 }
 
@@ -527,6 +528,10 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 	/* adjust file mode */
 	if (state->opt.skip_sequential)
 		state->file_mode &= ~MODE_SEQUENTIAL;
+	if (state->opt.io_direct)
+		state->file_mode |= MODE_DIRECT;
+	if (state->opt.io_writeback)
+		state->file_mode |= MODE_WRITEBACK;
 
 	/* store current command */
 	state->command = command;
@@ -1193,6 +1198,13 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 
 	/* intentionally not set the prevhashseed, if used valgrind will warn about it */
 
+	/* direct I/O requires the blocks aligned in the files */
+	if ((state->file_mode & MODE_DIRECT) != 0 && state->block_size % DIRECT_ALIGN != 0) {
+		log_tag("io:direct:disabled:blocksize:%u\n", state->block_size);
+		msg_info("Direct I/O disabled because the 'blocksize' is not a multiple of %u KiB.\n", DIRECT_ALIGN / KIBI);
+		state->file_mode &= ~MODE_DIRECT;
+	}
+
 	log_tag("blocksize:%u\n", state->block_size);
 	for (i = state->disklist; i != 0; i = i->next) {
 		struct snapraid_disk* disk = i->data;
@@ -1662,6 +1674,14 @@ static void decoding_error(const char* path, STREAM* f)
 	uint32_t crc_stored;
 	uint32_t crc_computed;
 
+	/* a disk section is decoded from memory only after checking its CRC */
+	if (shandle(f) == -1) {
+		/* LCOV_EXCL_START */
+		log_fatal("Decoding error in a disk section of '%s' at section offset %" PRIi64 "\n", path, stell(f));
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
 	if (seof(f)) {
 		/* LCOV_EXCL_START */
 		log_fatal("Unexpected end of content file '%s' at offset %" PRIi64 "\n", path, stell(f));
@@ -1704,513 +1724,748 @@ static void decoding_error(const char* path, STREAM* f)
 	}
 }
 
-static void state_read_content(struct snapraid_state* state, const char* path, STREAM* f)
-{
-	block_off_t blockmax;
+/**
+ * Max size processed in a single call by the CRC and stream functions.
+ */
+#define STATE_SECTION_RUN (1U << 30)
+
+/**
+ * Records of a disk in the content file.
+ *
+ * From the SNAPCNT4 format, all the records of a disk are stored in a
+ * 'D' section prefixed by its size and CRC. The section is loaded in memory
+ * and decoded in a separated thread, while the main thread continues
+ * to read the next sections of the other disks.
+ *
+ * It's also used to read the records of the previous formats,
+ * directly from the content file.
+ */
+struct state_read_section {
+	struct snapraid_state* state;
+	const char* path; /**< Path of the content file. */
+	struct snapraid_disk* disk; /**< Disk of the records. */
+	block_off_t blockmax; /**< Number of blocks of the parity. */
+	unsigned char* data; /**< Data of the section. */
+	int is_mapped; /**< If the data is in the memory mapping of the content file, and not allocated. */
+	size_t size; /**< Size of the section. */
+	uint32_t crc; /**< CRC of the section. */
+	int64_t offset; /**< Offset of the section in the content file. */
+#if HAVE_PTHREAD
+	pthread_t thread;
+#endif
 	unsigned count_file;
 	unsigned count_hardlink;
 	unsigned count_symlink;
 	unsigned count_dir;
-	int crc_checked;
-	char buffer[PATH_MAX];
+	tommy_node node;
+};
+
+/**
+ * Read the mapping index of a record, and return the related disk.
+ */
+static struct snapraid_disk* state_read_mapping(const char* path, STREAM* f, tommy_array* disk_mapping, uint32_t mapping_max)
+{
+	uint32_t mapping;
 	int ret;
-	tommy_array disk_mapping;
-	uint32_t mapping_max;
 
-	blockmax = 0;
-	count_file = 0;
-	count_hardlink = 0;
-	count_symlink = 0;
-	count_dir = 0;
-	crc_checked = 0;
-	mapping_max = 0;
-	tommy_array_init(&disk_mapping);
+	ret = sgetb32(f, &mapping);
+	if (ret < 0 || mapping >= mapping_max) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		log_fatal("Internal inconsistency in mapping index!\n");
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
 
-	ret = sread(f, buffer, 12);
+	return tommy_array_get(disk_mapping, mapping);
+}
+
+/**
+ * Read the file record of a disk.
+ */
+static void state_read_file(struct state_read_section* section, STREAM* f)
+{
+	struct snapraid_state* state = section->state;
+	const char* path = section->path;
+	struct snapraid_disk* disk = section->disk;
+	block_off_t blockmax = section->blockmax;
+	char sub[PATH_MAX];
+	uint64_t v_size;
+	uint64_t v_mtime_sec;
+	uint32_t v_mtime_nsec;
+	uint64_t v_inode;
+	uint32_t v_idx;
+	struct snapraid_file* file;
+	int c;
+	int ret;
+
+	ret = sgetb64(f, &v_size);
 	if (ret < 0) {
 		/* LCOV_EXCL_START */
 		decoding_error(path, f);
-		log_fatal("Invalid header!\n");
 		os_abort();
 		/* LCOV_EXCL_STOP */
 	}
 
-	/*
-	 * File format versions:
-	 *  - SNAPCNT1/SnapRAID 4.0 First version.
-	 *  - SNAPCNT2/SnapRAID 7.0 Adds entries 'M' and 'P', to add free_blocks support.
-	 *    The previous 'm' entry is now deprecated, but supported for importing.
-	 *    Similarly for text file, we add 'mapping' and 'parity' deprecating 'map'.
-	 *  - SNAPCNT3/SnapRAID 11.0 Adds entry 'y' for hash size.
-	 */
-	if (memcmp(buffer, "SNAPCNT1\n\3\0\0", 12) != 0
-		&& memcmp(buffer, "SNAPCNT2\n\3\0\0", 12) != 0
-		&& memcmp(buffer, "SNAPCNT3\n\3\0\0", 12) != 0
-	) {
+	if (state->block_size == 0) {
 		/* LCOV_EXCL_START */
-		if (memcmp(buffer, "SNAPCNT", 7) != 0) {
-			decoding_error(path, f);
-			log_fatal("Invalid header!\n");
-			os_abort();
-		} else {
-			log_fatal("The content file '%s' was generated with a newer version of SnapRAID!\n", path);
-			exit(EXIT_FAILURE);
-		}
+		decoding_error(path, f);
+		log_fatal("Internal incosistency due zero blocksize!\n");
+		exit(EXIT_FAILURE);
 		/* LCOV_EXCL_STOP */
 	}
 
-	while (1) {
-		int c;
+	/* check for impossible file size to avoid to crash for a too big allocation */
+	if (v_size / state->block_size > blockmax) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		log_fatal("Internal inconsistency in file size too big!\n");
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
 
-		/* read the command */
+	ret = sgetb64(f, &v_mtime_sec);
+	if (ret < 0) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
+
+	ret = sgetb32(f, &v_mtime_nsec);
+	if (ret < 0) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* STAT_NSEC_INVALID is encoded as 0 */
+	if (v_mtime_nsec == 0)
+		v_mtime_nsec = STAT_NSEC_INVALID;
+	else
+		--v_mtime_nsec;
+
+	ret = sgetb64(f, &v_inode);
+	if (ret < 0) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
+
+	ret = sgetbs(f, sub, sizeof(sub));
+	if (ret < 0) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
+	if (!*sub) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		log_fatal("Internal inconsistency for null file!\n");
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* allocate the file */
+	file = file_alloc(disk, state->block_size, sub, v_size, v_mtime_sec, v_mtime_nsec, v_inode, 0);
+
+	/* insert the file in the file containers */
+	tommy_hashdyn_insert(&disk->inodeset, &file->nodeset, file, file_inode_hash(file->inode));
+	tommy_hashdyn_insert(&disk->pathset, &file->pathset, file, file_path_hash(sub));
+	tommy_hashdyn_insert(&disk->stampset, &file->stampset, file, file_stamp_hash(file->size, file->mtime_sec, file->mtime_nsec));
+	tommy_list_insert_tail(&disk->filelist, &file->nodelist, file);
+
+	/* read all the blocks */
+	v_idx = 0;
+	while (v_idx < file->blockmax) {
+		block_off_t v_pos;
+		uint32_t v_count;
+
+		/* get the "subcommand */
 		c = sgetc(f);
-		if (c == EOF) {
-			break;
+
+		ret = sgetb32(f, &v_pos);
+		if (ret < 0) {
+			/* LCOV_EXCL_START */
+			decoding_error(path, f);
+			os_abort();
+			/* LCOV_EXCL_STOP */
 		}
 
-		if (c == 'f') {
-			/* file */
-			char sub[PATH_MAX];
-			uint64_t v_size;
-			uint64_t v_mtime_sec;
-			uint32_t v_mtime_nsec;
-			uint64_t v_inode;
-			uint32_t v_idx;
-			struct snapraid_file* file;
-			struct snapraid_disk* disk;
-			uint32_t mapping;
+		ret = sgetb32(f, &v_count);
+		if (ret < 0) {
+			/* LCOV_EXCL_START */
+			decoding_error(path, f);
+			os_abort();
+			/* LCOV_EXCL_STOP */
+		}
 
-			ret = sgetb32(f, &mapping);
-			if (ret < 0 || mapping >= mapping_max) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				log_fatal("Internal inconsistency in mapping index!\n");
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
-			disk = tommy_array_get(&disk_mapping, mapping);
+		if (v_idx + v_count > file->blockmax) {
+			/* LCOV_EXCL_START */
+			decoding_error(path, f);
+			log_fatal("Internal inconsistency in block number!\n");
+			os_abort();
+			/* LCOV_EXCL_STOP */
+		}
 
-			ret = sgetb64(f, &v_size);
-			if (ret < 0) {
+		if (v_pos + v_count > blockmax) {
+			/* LCOV_EXCL_START */
+			decoding_error(path, f);
+			log_fatal("Internal inconsistency in block size %u/%u!\n", blockmax, v_pos + v_count);
+			os_abort();
+			/* LCOV_EXCL_START */
+		}
+
+		/* fill the blocks in the run */
+		while (v_count) {
+			struct snapraid_block* block = fs_file2block_get(file, v_idx);
+
+			switch (c) {
+			case 'b' :
+				block_state_set(block, BLOCK_STATE_BLK);
+				break;
+			case 'n' :
+				/* deprecated NEW blocks are converted to CHG ones */
+				block_state_set(block, BLOCK_STATE_CHG);
+				break;
+			case 'g' :
+				block_state_set(block, BLOCK_STATE_CHG);
+				break;
+			case 'p' :
+				block_state_set(block, BLOCK_STATE_REP);
+				break;
+			default :
 				/* LCOV_EXCL_START */
 				decoding_error(path, f);
+				log_fatal("Invalid block type!\n");
 				os_abort();
 				/* LCOV_EXCL_STOP */
 			}
 
-			if (state->block_size == 0) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				log_fatal("Internal incosistency due zero blocksize!\n");
-				exit(EXIT_FAILURE);
-				/* LCOV_EXCL_STOP */
+			/* read the hash only for 'blk/chg/rep', and not for 'new' */
+			if (c != 'n') {
+				ret = sread(f, block->hash, BLOCK_HASH_SIZE);
+				if (ret < 0) {
+					/* LCOV_EXCL_START */
+					decoding_error(path, f);
+					os_abort();
+					/* LCOV_EXCL_STOP */
+				}
+			} else {
+				/* set the ZERO hash for deprecated NEW blocks */
+				hash_zero_set(block->hash);
 			}
 
-			/* check for impossible file size to avoid to crash for a too big allocation */
-			if (v_size / state->block_size > blockmax) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				log_fatal("Internal inconsistency in file size too big!\n");
-				os_abort();
-				/* LCOV_EXCL_STOP */
+			/* if the block contains a hash of past data */
+			/* and we are clearing such undeterminated hashes */
+			if (state->clear_past_hash
+				&& block_has_past_hash(block)
+			) {
+				/* set the hash value to INVALID */
+				hash_invalid_set(block->hash);
+			}
+
+			/* if we are disabling the copy optimization */
+			/* we want also to clear any already previously stored information */
+			/* in other sync commands */
+			/* note that this is required only in sync, and we detect */
+			/* this using the clear_past_hash flag */
+			if (state->clear_past_hash
+				&& state->opt.force_nocopy
+				&& block_state_get(block) == BLOCK_STATE_REP
+			) {
+				/* set the hash value to INVALID */
+				hash_invalid_set(block->hash);
+				/* convert from REP to CHG block */
+				block_state_set(block, BLOCK_STATE_CHG);
 			}
 
-			ret = sgetb64(f, &v_mtime_sec);
-			if (ret < 0) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				os_abort();
-				/* LCOV_EXCL_STOP */
+			/* if we want a full sync, marks block as invalid parity */
+			/* note that we do this after the force_nocopy option */
+			/* to avoid to mixup the two things */
+			if (state->opt.force_full
+				&& block_state_get(block) == BLOCK_STATE_BLK) {
+				/* convert from BLK to REP */
+				block_state_set(block, BLOCK_STATE_REP);
 			}
 
-			ret = sgetb32(f, &v_mtime_nsec);
-			if (ret < 0) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
+			/* set the parity association */
+			fs_allocate(disk, v_pos, file, v_idx);
 
-			/* STAT_NSEC_INVALID is encoded as 0 */
-			if (v_mtime_nsec == 0)
-				v_mtime_nsec = STAT_NSEC_INVALID;
-			else
-				--v_mtime_nsec;
+			/* go to the next block */
+			++v_idx;
+			++v_pos;
+			--v_count;
+		}
+	}
 
-			ret = sgetb64(f, &v_inode);
-			if (ret < 0) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
+	/* stat */
+	++section->count_file;
+}
 
-			ret = sgetbs(f, sub, sizeof(sub));
-			if (ret < 0) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
-			if (!*sub) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				log_fatal("Internal inconsistency for null file!\n");
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
+/**
+ * Read the holes and deleted blocks record of a disk.
+ */
+static void state_read_hole(struct state_read_section* section, STREAM* f)
+{
+	struct snapraid_state* state = section->state;
+	const char* path = section->path;
+	struct snapraid_disk* disk = section->disk;
+	block_off_t blockmax = section->blockmax;
+	uint32_t v_pos;
+	int c;
+	int ret;
 
-			/* allocate the file */
-			file = file_alloc(state->block_size, sub, v_size, v_mtime_sec, v_mtime_nsec, v_inode, 0);
+	v_pos = 0;
+	while (v_pos < blockmax) {
+		uint32_t v_idx;
+		uint32_t v_count;
+		struct snapraid_file* deleted;
 
-			/* insert the file in the file containers */
-			tommy_hashdyn_insert(&disk->inodeset, &file->nodeset, file, file_inode_hash(file->inode));
-			tommy_hashdyn_insert(&disk->pathset, &file->pathset, file, file_path_hash(file->sub));
-			tommy_hashdyn_insert(&disk->stampset, &file->stampset, file, file_stamp_hash(file->size, file->mtime_sec, file->mtime_nsec));
-			tommy_list_insert_tail(&disk->filelist, &file->nodelist, file);
+		ret = sgetb32(f, &v_count);
+		if (ret < 0) {
+			/* LCOV_EXCL_START */
+			decoding_error(path, f);
+			os_abort();
+			/* LCOV_EXCL_STOP */
+		}
 
-			/* read all the blocks */
-			v_idx = 0;
-			while (v_idx < file->blockmax) {
-				block_off_t v_pos;
-				uint32_t v_count;
+		if (v_pos + v_count > blockmax) {
+			/* LCOV_EXCL_START */
+			decoding_error(path, f);
+			log_fatal("Internal inconsistency in hole size %u/%u!\n", blockmax, v_pos + v_count);
+			os_abort();
+			/* LCOV_EXCL_STOP */
+		}
 
-				/* get the "subcommand */
-				c = sgetc(f);
+		/* get the sub-command */
+		c = sgetc(f);
 
-				ret = sgetb32(f, &v_pos);
-				if (ret < 0) {
-					/* LCOV_EXCL_START */
-					decoding_error(path, f);
-					os_abort();
-					/* LCOV_EXCL_STOP */
-				}
+		switch (c) {
+		case 'o' :
+			/* if it's a run of deleted blocks */
 
-				ret = sgetb32(f, &v_count);
-				if (ret < 0) {
-					/* LCOV_EXCL_START */
-					decoding_error(path, f);
-					os_abort();
-					/* LCOV_EXCL_STOP */
-				}
+			/* allocate a fake deleted file */
+			deleted = file_alloc(disk, state->block_size, "<deleted>", v_count * (data_off_t)state->block_size, 0, 0, 0, 0);
+
+			/* mark the file as deleted */
+			file_flag_set(deleted, FILE_IS_DELETED);
+
+			/* insert it in the list of deleted files */
+			tommy_list_insert_tail(&disk->deletedlist, &deleted->nodelist, deleted);
+
+			/* process all blocks */
+			v_idx = 0;
+			while (v_count) {
+				struct snapraid_block* block = fs_file2block_get(deleted, v_idx);
 
-				if (v_idx + v_count > file->blockmax) {
+				/* set the block as deleted */
+				block_state_set(block, BLOCK_STATE_DELETED);
+
+				/* read the hash */
+				ret = sread(f, block->hash, BLOCK_HASH_SIZE);
+				if (ret < 0) {
 					/* LCOV_EXCL_START */
 					decoding_error(path, f);
-					log_fatal("Internal inconsistency in block number!\n");
 					os_abort();
 					/* LCOV_EXCL_STOP */
 				}
 
-				if (v_pos + v_count > blockmax) {
-					/* LCOV_EXCL_START */
-					decoding_error(path, f);
-					log_fatal("Internal inconsistency in block size %u/%u!\n", blockmax, v_pos + v_count);
-					os_abort();
-					/* LCOV_EXCL_START */
+				/* if we are clearing indeterminate hashes */
+				if (state->clear_past_hash) {
+					/* set the hash value to INVALID */
+					hash_invalid_set(block->hash);
 				}
 
-				/* fill the blocks in the run */
-				while (v_count) {
-					struct snapraid_block* block = fs_file2block_get(file, v_idx);
+				/* insert the block in the block array */
+				fs_allocate(disk, v_pos, deleted, v_idx);
 
-					switch (c) {
-					case 'b' :
-						block_state_set(block, BLOCK_STATE_BLK);
-						break;
-					case 'n' :
-						/* deprecated NEW blocks are converted to CHG ones */
-						block_state_set(block, BLOCK_STATE_CHG);
-						break;
-					case 'g' :
-						block_state_set(block, BLOCK_STATE_CHG);
-						break;
-					case 'p' :
-						block_state_set(block, BLOCK_STATE_REP);
-						break;
-					default :
-						/* LCOV_EXCL_START */
-						decoding_error(path, f);
-						log_fatal("Invalid block type!\n");
-						os_abort();
-						/* LCOV_EXCL_STOP */
-					}
+				/* go to next block */
+				++v_pos;
+				++v_idx;
+				--v_count;
+			}
+			break;
+		case 'O' :
+			/* go to the next run */
+			v_pos += v_count;
+			break;
+		default :
+			/* LCOV_EXCL_START */
+			decoding_error(path, f);
+			log_fatal("Invalid hole type!\n");
+			os_abort();
+			/* LCOV_EXCL_STOP */
+		}
+	}
+}
 
-					/* read the hash only for 'blk/chg/rep', and not for 'new' */
-					if (c != 'n') {
-						ret = sread(f, block->hash, BLOCK_HASH_SIZE);
-						if (ret < 0) {
-							/* LCOV_EXCL_START */
-							decoding_error(path, f);
-							os_abort();
-							/* LCOV_EXCL_STOP */
-						}
-					} else {
-						/* set the ZERO hash for deprecated NEW blocks */
-						hash_zero_set(block->hash);
-					}
+/**
+ * Read the symbolic link record of a disk.
+ */
+static void state_read_symlink(struct state_read_section* section, STREAM* f)
+{
+	const char* path = section->path;
+	struct snapraid_disk* disk = section->disk;
+	char sub[PATH_MAX];
+	char linkto[PATH_MAX];
+	struct snapraid_link* slink;
+	int ret;
 
-					/* if the block contains a hash of past data */
-					/* and we are clearing such undeterminated hashes */
-					if (state->clear_past_hash
-						&& block_has_past_hash(block)
-					) {
-						/* set the hash value to INVALID */
-						hash_invalid_set(block->hash);
-					}
+	ret = sgetbs(f, sub, sizeof(sub));
+	if (ret < 0) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
 
-					/* if we are disabling the copy optimization */
-					/* we want also to clear any already previously stored information */
-					/* in other sync commands */
-					/* note that this is required only in sync, and we detect */
-					/* this using the clear_past_hash flag */
-					if (state->clear_past_hash
-						&& state->opt.force_nocopy
-						&& block_state_get(block) == BLOCK_STATE_REP
-					) {
-						/* set the hash value to INVALID */
-						hash_invalid_set(block->hash);
-						/* convert from REP to CHG block */
-						block_state_set(block, BLOCK_STATE_CHG);
-					}
+	if (!*sub) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		log_fatal("Internal inconsistency for null symlink!\n");
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
 
-					/* if we want a full sync, marks block as invalid parity */
-					/* note that we do this after the force_nocopy option */
-					/* to avoid to mixup the two things */
-					if (state->opt.force_full
-						&& block_state_get(block) == BLOCK_STATE_BLK) {
-						/* convert from BLK to REP */
-						block_state_set(block, BLOCK_STATE_REP);
-					}
+	ret = sgetbs(f, linkto, sizeof(linkto));
+	if (ret < 0) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
 
-					/* set the parity association */
-					fs_allocate(disk, v_pos, file, v_idx);
+	/* allocate the link as symbolic link */
+	slink = link_alloc(disk, sub, linkto, FILE_IS_SYMLINK);
 
-					/* go to the next block */
-					++v_idx;
-					++v_pos;
-					--v_count;
-				}
-			}
+	/* insert the link in the link containers */
+	tommy_hashdyn_insert(&disk->linkset, &slink->nodeset, slink, link_name_hash(slink->sub));
+	tommy_list_insert_tail(&disk->linklist, &slink->nodelist, slink);
 
-			/* stat */
-			++count_file;
-		} else if (c == 'i') {
-			/* "inf" command */
-			snapraid_info info;
-			uint32_t v_pos;
-			uint32_t v_oldest;
+	/* stat */
+	++section->count_symlink;
+}
 
-			ret = sgetb32(f, &v_oldest);
-			if (ret < 0) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
+/**
+ * Read the hard link record of a disk.
+ */
+static void state_read_hardlink(struct state_read_section* section, STREAM* f)
+{
+	const char* path = section->path;
+	struct snapraid_disk* disk = section->disk;
+	char sub[PATH_MAX];
+	char linkto[PATH_MAX];
+	struct snapraid_link* slink;
+	int ret;
 
-			v_pos = 0;
-			while (v_pos < blockmax) {
-				int bad;
-				int rehash;
-				int justsynced;
-				uint32_t t;
-				uint32_t flag;
-				uint32_t v_count;
+	ret = sgetbs(f, sub, sizeof(sub));
+	if (ret < 0) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
 
-				ret = sgetb32(f, &v_count);
-				if (ret < 0) {
-					/* LCOV_EXCL_START */
-					decoding_error(path, f);
-					os_abort();
-					/* LCOV_EXCL_STOP */
-				}
+	if (!*sub) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		log_fatal("Internal inconsistency for null hardlink!\n");
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
 
-				if (v_pos + v_count > blockmax) {
-					/* LCOV_EXCL_START */
-					decoding_error(path, f);
-					log_fatal("Internal inconsistency in info size %u/%u!\n", blockmax, v_pos + v_count);
-					os_abort();
-					/* LCOV_EXCL_STOP */
-				}
+	ret = sgetbs(f, linkto, sizeof(linkto));
+	if (ret < 0) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
 
-				ret = sgetb32(f, &flag);
-				if (ret < 0) {
-					/* LCOV_EXCL_START */
-					decoding_error(path, f);
-					os_abort();
-					/* LCOV_EXCL_STOP */
-				}
+	if (!*linkto) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		log_fatal("Internal inconsistency for empty hardlink '%s'!\n", sub);
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
 
-				/* if there is an info */
-				if ((flag & 1) != 0) {
-					/* read the time */
-					ret = sgetb32(f, &t);
-					if (ret < 0) {
-						/* LCOV_EXCL_START */
-						decoding_error(path, f);
-						os_abort();
-						/* LCOV_EXCL_STOP */
-					}
+	/* allocate the link as hard link */
+	slink = link_alloc(disk, sub, linkto, FILE_IS_HARDLINK);
 
-					/* analyze the flags */
-					bad = (flag & 2) != 0;
-					rehash = (flag & 4) != 0;
-					justsynced = (flag & 8) != 0;
+	/* insert the link in the link containers */
+	tommy_hashdyn_insert(&disk->linkset, &slink->nodeset, slink, link_name_hash(slink->sub));
+	tommy_list_insert_tail(&disk->linklist, &slink->nodelist, slink);
 
-					if (rehash && state->prevhash == HASH_UNDEFINED) {
-						/* LCOV_EXCL_START */
-						decoding_error(path, f);
-						log_fatal("Internal inconsistency for missing previous checksum!\n");
-						os_abort();
-						/* LCOV_EXCL_STOP */
-					}
+	/* stat */
+	++section->count_hardlink;
+}
 
-					info = info_make(t + v_oldest, bad, rehash, justsynced);
-				} else {
-					info = 0;
-				}
+/**
+ * Read the empty directory record of a disk.
+ */
+static void state_read_dir(struct state_read_section* section, STREAM* f)
+{
+	const char* path = section->path;
+	struct snapraid_disk* disk = section->disk;
+	char sub[PATH_MAX];
+	struct snapraid_dir* dir;
+	int ret;
 
-				while (v_count) {
-					/* insert the info in the array */
-					info_set(&state->infoarr, v_pos, info);
+	ret = sgetbs(f, sub, sizeof(sub));
+	if (ret < 0) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
 
-					/* ensure that an info is present only for used positions */
-					if (fs_info_is_required(state, v_pos)) {
-						if (!info) {
-							/* LCOV_EXCL_START */
-							decoding_error(path, f);
-							log_fatal("Internal inconsistency for missing info!\n");
-							os_abort();
-							/* LCOV_EXCL_STOP */
-						}
-					} else {
-						/* extra info are accepted for backward compatibility */
-						/* they are discarded at the first write */
-					}
+	if (!*sub) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		log_fatal("Internal inconsistency for null dir!\n");
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
 
-					/* go to next block */
-					++v_pos;
-					--v_count;
-				}
-			}
-		} else if (c == 'h') {
-			/* hole */
-			uint32_t v_pos;
-			struct snapraid_disk* disk;
-			uint32_t mapping;
+	/* allocate the dir */
+	dir = dir_alloc(disk, sub);
 
-			ret = sgetb32(f, &mapping);
-			if (ret < 0 || mapping >= mapping_max) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				log_fatal("Internal inconsistency in mapping index!\n");
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
-			disk = tommy_array_get(&disk_mapping, mapping);
+	/* insert the dir in the dir containers */
+	tommy_hashdyn_insert(&disk->dirset, &dir->nodeset, dir, dir_name_hash(dir->sub));
+	tommy_list_insert_tail(&disk->dirlist, &dir->nodelist, dir);
 
-			v_pos = 0;
-			while (v_pos < blockmax) {
-				uint32_t v_idx;
-				uint32_t v_count;
-				struct snapraid_file* deleted;
+	/* stat */
+	++section->count_dir;
+}
 
-				ret = sgetb32(f, &v_count);
-				if (ret < 0) {
-					/* LCOV_EXCL_START */
-					decoding_error(path, f);
-					os_abort();
-					/* LCOV_EXCL_STOP */
-				}
+/**
+ * Decode all the records of a disk section.
+ */
+static void* state_read_section_thread(void* arg)
+{
+	struct state_read_section* section = arg;
+	STREAM* f;
+	uint32_t crc;
+	size_t pos;
 
-				if (v_pos + v_count > blockmax) {
-					/* LCOV_EXCL_START */
-					decoding_error(path, f);
-					log_fatal("Internal inconsistency in hole size %u/%u!\n", blockmax, v_pos + v_count);
-					os_abort();
-					/* LCOV_EXCL_STOP */
-				}
+	/* check the CRC before decoding, to distinguish a damaged content file */
+	/* from an internal inconsistency in a decoding error */
+	crc = 0;
+	pos = 0;
+	while (pos < section->size) {
+		size_t run = section->size - pos;
+		if (run > STATE_SECTION_RUN)
+			run = STATE_SECTION_RUN;
+		crc = crc32c(crc, section->data + pos, run);
+		pos += run;
+	}
 
-				/* get the sub-command */
-				c = sgetc(f);
+	if (crc != section->crc) {
+		/* LCOV_EXCL_START */
+		log_fatal("Mismatching CRC in '%s' for the section of disk '%s' at offset %" PRIi64 "\n", section->path, section->disk->name, section->offset);
+		log_fatal("This content file is damaged! Use an alternate copy.\n");
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
 
-				switch (c) {
-				case 'o' :
-					/* if it's a run of deleted blocks */
+	if (section->is_mapped) {
+		f = sopen_mem_view(section->data, section->size);
+	} else {
+		/* the stream takes the ownership of the data */
+		f = sopen_mem_read(section->data, section->size);
+	}
+	section->data = 0;
 
-					/* allocate a fake deleted file */
-					deleted = file_alloc(state->block_size, "<deleted>", v_count * (data_off_t)state->block_size, 0, 0, 0, 0);
+	while (1) {
+		int c;
 
-					/* mark the file as deleted */
-					file_flag_set(deleted, FILE_IS_DELETED);
+		/* read the command */
+		c = sgetc(f);
+		if (c == EOF) {
+			break;
+		}
 
-					/* insert it in the list of deleted files */
-					tommy_list_insert_tail(&disk->deletedlist, &deleted->nodelist, deleted);
+		switch (c) {
+		case 'f' :
+			state_read_file(section, f);
+			break;
+		case 'h' :
+			state_read_hole(section, f);
+			break;
+		case 's' :
+			state_read_symlink(section, f);
+			break;
+		case 'a' :
+			state_read_hardlink(section, f);
+			break;
+		case 'r' :
+			state_read_dir(section, f);
+			break;
+		default :
+			/* LCOV_EXCL_START */
+			decoding_error(section->path, f);
+			log_fatal("Invalid command '%c' in the section of disk '%s'!\n", (char)c, section->disk->name);
+			os_abort();
+			/* LCOV_EXCL_STOP */
+		}
+	}
 
-					/* process all blocks */
-					v_idx = 0;
-					while (v_count) {
-						struct snapraid_block* block = fs_file2block_get(deleted, v_idx);
+	sclose(f);
 
-						/* set the block as deleted */
-						block_state_set(block, BLOCK_STATE_DELETED);
+	return 0;
+}
 
-						/* read the hash */
-						ret = sread(f, block->hash, BLOCK_HASH_SIZE);
-						if (ret < 0) {
-							/* LCOV_EXCL_START */
-							decoding_error(path, f);
-							os_abort();
-							/* LCOV_EXCL_STOP */
-						}
+/**
+ * Wait for the decoding of all the disk sections, and collect their stats.
+ */
+static void state_read_section_join(tommy_list* section_list, struct state_read_section* total)
+{
+	tommy_node* i;
 
-						/* if we are clearing indeterminate hashes */
-						if (state->clear_past_hash) {
-							/* set the hash value to INVALID */
-							hash_invalid_set(block->hash);
-						}
+	i = tommy_list_head(section_list);
+	while (i) {
+		struct state_read_section* section = i->data;
 
-						/* insert the block in the block array */
-						fs_allocate(disk, v_pos, deleted, v_idx);
+		i = i->next;
 
-						/* go to next block */
-						++v_pos;
-						++v_idx;
-						--v_count;
-					}
-					break;
-				case 'O' :
-					/* go to the next run */
-					v_pos += v_count;
-					break;
-				default :
+#if HAVE_PTHREAD
+		thread_join(section->thread, 0);
+#endif
+
+		total->count_file += section->count_file;
+		total->count_hardlink += section->count_hardlink;
+		total->count_symlink += section->count_symlink;
+		total->count_dir += section->count_dir;
+
+		free(section);
+	}
+
+	tommy_list_init(section_list);
+}
+
+static void state_read_content(struct snapraid_state* state, const char* path, STREAM* f)
+{
+	block_off_t blockmax;
+	int crc_checked;
+	char buffer[PATH_MAX];
+	int ret;
+	tommy_array disk_mapping;
+	uint32_t mapping_max;
+	struct state_read_section section;
+	tommy_list section_list;
+	struct stat st;
+
+	blockmax = 0;
+	crc_checked = 0;
+	mapping_max = 0;
+	tommy_array_init(&disk_mapping);
+	tommy_list_init(&section_list);
+
+	/* records read directly from the content file */
+	section.state = state;
+	section.path = path;
+	section.disk = 0;
+	section.blockmax = 0;
+	section.count_file = 0;
+	section.count_hardlink = 0;
+	section.count_symlink = 0;
+	section.count_dir = 0;
+
+	/* the size of the file limits the size of the sections */
+	if (fstat(shandle(f), &st) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error accessing the content file '%s'. %s.\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	ret = sread(f, buffer, 12);
+	if (ret < 0) {
+		/* LCOV_EXCL_START */
+		decoding_error(path, f);
+		log_fatal("Invalid header!\n");
+		os_abort();
+		/* LCOV_EXCL_STOP */
+	}
+
+	/*
+	 * File format versions:
+	 *  - SNAPCNT1/SnapRAID 4.0 First version.
+	 *  - SNAPCNT2/SnapRAID 7.0 Adds entries 'M' and 'P', to add free_blocks support.
+	 *    The previous 'm' entry is now deprecated, but supported for importing.
+	 *    Similarly for text file, we add 'mapping' and 'parity' deprecating 'map'.
+	 *  - SNAPCNT3/SnapRAID 11.0 Adds entry 'y' for hash size.
+	 *  - SNAPCNT4/SnapRAID 12.0 Adds entry 'D' for disk sections.
+	 *    The records of each disk are stored in a section without the
+	 *    mapping index, and prefixed by the section size and CRC.
+	 */
+	if (memcmp(buffer, "SNAPCNT1\n\3\0\0", 12) != 0
+		&& memcmp(buffer, "SNAPCNT2\n\3\0\0", 12) != 0
+		&& memcmp(buffer, "SNAPCNT3\n\3\0\0", 12) != 0
+		&& memcmp(buffer, "SNAPCNT4\n\3\0\0", 12) != 0
+	) {
+		/* LCOV_EXCL_START */
+		if (memcmp(buffer, "SNAPCNT", 7) != 0) {
+			decoding_error(path, f);
+			log_fatal("Invalid header!\n");
+			os_abort();
+		} else {
+			log_fatal("The content file '%s' was generated with a newer version of SnapRAID!\n", path);
+			exit(EXIT_FAILURE);
+		}
+		/* LCOV_EXCL_STOP */
+	}
+
+	while (1) {
+		int c;
+
+		/* read the command */
+		c = sgetc(f);
+
+		/* any other command may need the disks already decoded, */
+		/* like the 'i' one, so wait for all the pending sections */
+		if (c != 'D')
+			state_read_section_join(&section_list, &section);
+
+		if (c == EOF) {
+			break;
+		}
+
+		if (c == 'D') {
+			/* disk section */
+			struct state_read_section* disk_section;
+			uint64_t v_size;
+			size_t pos;
+			tommy_node* j;
+
+			disk_section = malloc_nofail(sizeof(struct state_read_section));
+			disk_section->state = state;
+			disk_section->path = path;
+			disk_section->disk = state_read_mapping(path, f, &disk_mapping, mapping_max);
+			disk_section->blockmax = blockmax;
+			disk_section->count_file = 0;
+			disk_section->count_hardlink = 0;
+			disk_section->count_symlink = 0;
+			disk_section->count_dir = 0;
+
+			/* two sections of the same disk cannot be decoded concurrently */
+			for (j = tommy_list_head(&section_list); j != 0; j = j->next) {
+				struct snapraid_disk* other = ((struct state_read_section*)j->data)->disk;
+				if (other == disk_section->disk) {
 					/* LCOV_EXCL_START */
 					decoding_error(path, f);
-					log_fatal("Invalid hole type!\n");
+					log_fatal("Internal inconsistency for duplicate section of disk '%s'!\n", other->name);
 					os_abort();
 					/* LCOV_EXCL_STOP */
 				}
 			}
-		} else if (c == 's') {
-			/* symlink */
-			char sub[PATH_MAX];
-			char linkto[PATH_MAX];
-			struct snapraid_link* slink;
-			struct snapraid_disk* disk;
-			uint32_t mapping;
-
-			ret = sgetb32(f, &mapping);
-			if (ret < 0 || mapping >= mapping_max) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				log_fatal("Internal inconsistency in mapping index!\n");
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
-			disk = tommy_array_get(&disk_mapping, mapping);
 
-			ret = sgetbs(f, sub, sizeof(sub));
+			ret = sgetb64(f, &v_size);
 			if (ret < 0) {
 				/* LCOV_EXCL_START */
 				decoding_error(path, f);
@@ -2218,15 +2473,16 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 				/* LCOV_EXCL_STOP */
 			}
 
-			if (!*sub) {
+			/* check for impossible section size to avoid to crash for a too big allocation */
+			if (v_size == 0 || v_size > (uint64_t)st.st_size || (size_t)v_size != v_size) {
 				/* LCOV_EXCL_START */
 				decoding_error(path, f);
-				log_fatal("Internal inconsistency for null symlink!\n");
+				log_fatal("Internal inconsistency in section size!\n");
 				os_abort();
 				/* LCOV_EXCL_STOP */
 			}
 
-			ret = sgetbs(f, linkto, sizeof(linkto));
+			ret = sgetble32(f, &disk_section->crc);
 			if (ret < 0) {
 				/* LCOV_EXCL_START */
 				decoding_error(path, f);
@@ -2234,50 +2490,51 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 				/* LCOV_EXCL_STOP */
 			}
 
-			/* allocate the link as symbolic link */
-			slink = link_alloc(sub, linkto, FILE_IS_SYMLINK);
-
-			/* insert the link in the link containers */
-			tommy_hashdyn_insert(&disk->linkset, &slink->nodeset, slink, link_name_hash(slink->sub));
-			tommy_list_insert_tail(&disk->linklist, &slink->nodelist, slink);
+			disk_section->offset = stell(f);
+			disk_section->size = v_size;
 
-			/* stat */
-			++count_symlink;
-		} else if (c == 'a') {
-			/* hardlink */
-			char sub[PATH_MAX];
-			char linkto[PATH_MAX];
-			struct snapraid_link* slink;
-			struct snapraid_disk* disk;
-			uint32_t mapping;
+			/* if the content file is mapped, use the data in place, */
+			/* leaving the CRC check of the section to the decoding thread */
+			disk_section->data = smapskip(f, disk_section->size, disk_section->crc);
+			disk_section->is_mapped = disk_section->data != 0;
+			if (!disk_section->is_mapped) {
+				disk_section->data = malloc_nofail(disk_section->size);
 
-			ret = sgetb32(f, &mapping);
-			if (ret < 0 || mapping >= mapping_max) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				log_fatal("Internal inconsistency in mapping index!\n");
-				os_abort();
-				/* LCOV_EXCL_STOP */
+				pos = 0;
+				while (pos < disk_section->size) {
+					size_t run = disk_section->size - pos;
+					if (run > STATE_SECTION_RUN)
+						run = STATE_SECTION_RUN;
+					ret = sread(f, disk_section->data + pos, run);
+					if (ret < 0) {
+						/* LCOV_EXCL_START */
+						decoding_error(path, f);
+						os_abort();
+						/* LCOV_EXCL_STOP */
+					}
+					pos += run;
+				}
 			}
-			disk = tommy_array_get(&disk_mapping, mapping);
 
-			ret = sgetbs(f, sub, sizeof(sub));
-			if (ret < 0) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
+			tommy_list_insert_tail(&section_list, &disk_section->node, disk_section);
 
-			if (!*sub) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				log_fatal("Internal inconsistency for null hardlink!\n");
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
+			/* decode the section while reading the next one */
+#if HAVE_PTHREAD
+			thread_create(&disk_section->thread, 0, state_read_section_thread, disk_section);
+#else
+			state_read_section_thread(disk_section);
+#endif
+		} else if (c == 'f') {
+			/* file */
+			section.disk = state_read_mapping(path, f, &disk_mapping, mapping_max);
+			state_read_file(&section, f);
+		} else if (c == 'i') {
+			/* "inf" command */
+			snapraid_info info;
+			uint32_t v_pos;
+			uint32_t v_oldest;
 
-			ret = sgetbs(f, linkto, sizeof(linkto));
+			ret = sgetb32(f, &v_oldest);
 			if (ret < 0) {
 				/* LCOV_EXCL_START */
 				decoding_error(path, f);
@@ -2285,65 +2542,107 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 				/* LCOV_EXCL_STOP */
 			}
 
-			if (!*linkto) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				log_fatal("Internal inconsistency for empty hardlink '%s'!\n", sub);
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
+			v_pos = 0;
+			while (v_pos < blockmax) {
+				int bad;
+				int rehash;
+				int justsynced;
+				uint32_t t;
+				uint32_t flag;
+				uint32_t v_count;
 
-			/* allocate the link as hard link */
-			slink = link_alloc(sub, linkto, FILE_IS_HARDLINK);
+				ret = sgetb32(f, &v_count);
+				if (ret < 0) {
+					/* LCOV_EXCL_START */
+					decoding_error(path, f);
+					os_abort();
+					/* LCOV_EXCL_STOP */
+				}
 
-			/* insert the link in the link containers */
-			tommy_hashdyn_insert(&disk->linkset, &slink->nodeset, slink, link_name_hash(slink->sub));
-			tommy_list_insert_tail(&disk->linklist, &slink->nodelist, slink);
+				if (v_pos + v_count > blockmax) {
+					/* LCOV_EXCL_START */
+					decoding_error(path, f);
+					log_fatal("Internal inconsistency in info size %u/%u!\n", blockmax, v_pos + v_count);
+					os_abort();
+					/* LCOV_EXCL_STOP */
+				}
 
-			/* stat */
-			++count_hardlink;
-		} else if (c == 'r') {
-			/* dir */
-			char sub[PATH_MAX];
-			struct snapraid_dir* dir;
-			struct snapraid_disk* disk;
-			uint32_t mapping;
+				ret = sgetb32(f, &flag);
+				if (ret < 0) {
+					/* LCOV_EXCL_START */
+					decoding_error(path, f);
+					os_abort();
+					/* LCOV_EXCL_STOP */
+				}
 
-			ret = sgetb32(f, &mapping);
-			if (ret < 0 || mapping >= mapping_max) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				log_fatal("Internal inconsistency in mapping index!\n");
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
-			disk = tommy_array_get(&disk_mapping, mapping);
+				/* if there is an info */
+				if ((flag & 1) != 0) {
+					/* read the time */
+					ret = sgetb32(f, &t);
+					if (ret < 0) {
+						/* LCOV_EXCL_START */
+						decoding_error(path, f);
+						os_abort();
+						/* LCOV_EXCL_STOP */
+					}
 
-			ret = sgetbs(f, sub, sizeof(sub));
-			if (ret < 0) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
+					/* analyze the flags */
+					bad = (flag & 2) != 0;
+					rehash = (flag & 4) != 0;
+					justsynced = (flag & 8) != 0;
 
-			if (!*sub) {
-				/* LCOV_EXCL_START */
-				decoding_error(path, f);
-				log_fatal("Internal inconsistency for null dir!\n");
-				os_abort();
-				/* LCOV_EXCL_STOP */
-			}
+					if (rehash && state->prevhash == HASH_UNDEFINED) {
+						/* LCOV_EXCL_START */
+						decoding_error(path, f);
+						log_fatal("Internal inconsistency for missing previous checksum!\n");
+						os_abort();
+						/* LCOV_EXCL_STOP */
+					}
+
+					info = info_make(t + v_oldest, bad, rehash, justsynced);
+				} else {
+					info = 0;
+				}
 
-			/* allocate the dir */
-			dir = dir_alloc(sub);
+				while (v_count) {
+					/* insert the info in the array */
+					info_set(&state->infoarr, v_pos, info);
 
-			/* insert the dir in the dir containers */
-			tommy_hashdyn_insert(&disk->dirset, &dir->nodeset, dir, dir_name_hash(dir->sub));
-			tommy_list_insert_tail(&disk->dirlist, &dir->nodelist, dir);
+					/* ensure that an info is present only for used positions */
+					if (fs_info_is_required(state, v_pos)) {
+						if (!info) {
+							/* LCOV_EXCL_START */
+							decoding_error(path, f);
+							log_fatal("Internal inconsistency for missing info!\n");
+							os_abort();
+							/* LCOV_EXCL_STOP */
+						}
+					} else {
+						/* extra info are accepted for backward compatibility */
+						/* they are discarded at the first write */
+					}
 
-			/* stat */
-			++count_dir;
+					/* go to next block */
+					++v_pos;
+					--v_count;
+				}
+			}
+		} else if (c == 'h') {
+			/* hole */
+			section.disk = state_read_mapping(path, f, &disk_mapping, mapping_max);
+			state_read_hole(&section, f);
+		} else if (c == 's') {
+			/* symlink */
+			section.disk = state_read_mapping(path, f, &disk_mapping, mapping_max);
+			state_read_symlink(&section, f);
+		} else if (c == 'a') {
+			/* hardlink */
+			section.disk = state_read_mapping(path, f, &disk_mapping, mapping_max);
+			state_read_hardlink(&section, f);
+		} else if (c == 'r') {
+			/* dir */
+			section.disk = state_read_mapping(path, f, &disk_mapping, mapping_max);
+			state_read_dir(&section, f);
 		} else if (c == 'c') {
 			/* get the subcommand */
 			c = sgetc(f);
@@ -2470,6 +2769,8 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 				os_abort();
 				/* LCOV_EXCL_STOP */
 			}
+
+			section.blockmax = blockmax;
 		} else if (c == 'm' || c == 'M') {
 			struct snapraid_map* map;
 			char uuid[UUID_MAX];
@@ -2676,10 +2977,10 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 		/* LCOV_EXCL_STOP */
 	}
 
-	msg_verbose("%8u files\n", count_file);
-	msg_verbose("%8u hardlinks\n", count_hardlink);
-	msg_verbose("%8u symlinks\n", count_symlink);
-	msg_verbose("%8u empty dirs\n", count_dir);
+	msg_verbose("%8u files\n", section.count_file);
+	msg_verbose("%8u hardlinks\n", section.count_hardlink);
+	msg_verbose("%8u symlinks\n", section.count_symlink);
+	msg_verbose("%8u empty dirs\n", section.count_dir);
 }
 
 struct state_write_thread_context {
@@ -2700,6 +3001,199 @@ struct state_write_thread_context {
 	unsigned count_dir;
 };
 
+/**
+ * Size of the space reserved for the size and CRC of a disk section.
+ *
+ * The size is stored with the same encoding of sputb64(), but padded
+ * to the max length, to write it after the section without moving it.
+ */
+#define STATE_SECTION_HEADER (10 + 4)
+
+/**
+ * Encode the size and CRC of a disk section.
+ */
+static void state_write_section_header(unsigned char* header, uint64_t size, uint32_t crc)
+{
+	unsigned i;
+
+	/* the last byte has the 0x80 terminator, the previous ones may be 0 */
+	for (i = 0; i < 9; ++i) {
+		header[i] = size & 0x7f;
+		size >>= 7;
+	}
+	header[9] = (size & 0x7f) | 0x80;
+
+	header[10] = crc & 0xFF;
+	header[11] = (crc >> 8) & 0xFF;
+	header[12] = (crc >> 16) & 0xFF;
+	header[13] = (crc >> 24) & 0xFF;
+}
+
+/**
+ * Write all the records of a disk, without the mapping index.
+ * Return 0 on success or -1 on error.
+ */
+static int state_write_section(struct state_write_thread_context* context, struct snapraid_disk* disk, STREAM* f)
+{
+	block_off_t blockmax = context->blockmax;
+	tommy_node* j;
+	block_off_t idx;
+	block_off_t begin;
+	char sub_buffer[PATH_MAX];
+
+	/* for each file */
+	for (j = disk->filelist; j != 0; j = j->next) {
+		struct snapraid_file* file = j->data;
+		uint64_t size;
+		uint64_t mtime_sec;
+		int32_t mtime_nsec;
+		uint64_t inode;
+
+		size = file->size;
+		mtime_sec = file->mtime_sec;
+		mtime_nsec = file->mtime_nsec;
+		inode = file->inode;
+
+		sputc('f', f);
+		sputb64(size, f);
+		sputb64(mtime_sec, f);
+		/* encode STAT_NSEC_INVALID as 0 */
+		if (mtime_nsec == STAT_NSEC_INVALID)
+			sputb32(0, f);
+		else
+			sputb32(mtime_nsec + 1, f);
+		sputb64(inode, f);
+		sputbs(file_sub(file, sub_buffer), f);
+
+		/* for all the blocks of the file */
+		begin = 0;
+		while (begin < file->blockmax) {
+			unsigned v_state = block_state_get(fs_file2block_get(file, begin));
+			block_off_t v_pos = fs_file2par_get(disk, file, begin);
+			uint32_t v_count;
+
+			block_off_t end;
+
+			/* find the end of run of blocks */
+			end = begin + 1;
+			while (end < file->blockmax) {
+				if (v_state != block_state_get(fs_file2block_get(file, end)))
+					break;
+				if (v_pos + (end - begin) != fs_file2par_get(disk, file, end))
+					break;
+				++end;
+			}
+
+			switch (v_state) {
+			case BLOCK_STATE_BLK :
+				sputc('b', f);
+				break;
+			case BLOCK_STATE_CHG :
+				sputc('g', f);
+				break;
+			case BLOCK_STATE_REP :
+				sputc('p', f);
+				break;
+			default :
+				/* LCOV_EXCL_START */
+				log_fatal("Internal inconsistency in state for block %u state %u\n", v_pos, v_state);
+				return -1;
+				/* LCOV_EXCL_STOP */
+			}
+
+			sputb32(v_pos, f);
+
+			v_count = end - begin;
+			sputb32(v_count, f);
+
+			/* write hashes */
+			for (idx = begin; idx < end; ++idx) {
+				struct snapraid_block* block = fs_file2block_get(file, idx);
+
+				swrite(block->hash, BLOCK_HASH_SIZE, f);
+			}
+
+
+			/* next begin position */
+			begin = end;
+		}
+
+		++context->count_file;
+	}
+
+	/* for each link */
+	for (j = disk->linklist; j != 0; j = j->next) {
+		struct snapraid_link* slink = j->data;
+
+		switch (link_flag_get(slink, FILE_IS_LINK_MASK)) {
+		case FILE_IS_HARDLINK :
+			sputc('a', f);
+			++context->count_hardlink;
+			break;
+		case FILE_IS_SYMLINK :
+			sputc('s', f);
+			++context->count_symlink;
+			break;
+		}
+
+		sputbs(slink->sub, f);
+		sputbs(slink->linkto, f);
+	}
+
+	/* for each dir */
+	for (j = disk->dirlist; j != 0; j = j->next) {
+		struct snapraid_dir* dir = j->data;
+
+		sputc('r', f);
+		sputbs(dir->sub, f);
+
+		++context->count_dir;
+	}
+
+	/* deleted blocks of the disk */
+	sputc('h', f);
+	begin = 0;
+	while (begin < blockmax) {
+		int is_deleted;
+		block_off_t end;
+
+		is_deleted = fs_is_block_deleted(disk, begin);
+
+		/* find the end of run of blocks */
+		end = begin + 1;
+		while (end < blockmax
+			&& is_deleted == fs_is_block_deleted(disk, end)
+		) {
+			++end;
+		}
+
+		sputb32(end - begin, f);
+
+		if (is_deleted) {
+			/* write the run of deleted blocks with hash */
+			sputc('o', f);
+
+			/* write all the hash */
+			while (begin < end) {
+				struct snapraid_block* block = fs_par2block_get(disk, begin);
+
+				swrite(block->hash, BLOCK_HASH_SIZE, f);
+
+				++begin;
+			}
+		} else {
+			/* write the run of blocks without hash */
+			/* they can be either used or empty blocks */
+			sputc('O', f);
+
+			/* next begin position */
+			begin = end;
+		}
+	}
+
+	return 0;
+}
+
 static void* state_write_thread(void* arg)
 {
 	struct state_write_thread_context* context = arg;
@@ -2709,27 +3203,17 @@ static void* state_write_thread(void* arg)
 	int info_has_rehash = context->info_has_rehash;
 	STREAM* f = context->f;
 	uint32_t crc;
-	unsigned count_file;
-	unsigned count_hardlink;
-	unsigned count_symlink;
-	unsigned count_dir;
 	tommy_node* i;
-	block_off_t idx;
 	block_off_t begin;
 	unsigned l;
 
-	count_file = 0;
-	count_hardlink = 0;
-	count_symlink = 0;
-	count_dir = 0;
+	context->count_file = 0;
+	context->count_hardlink = 0;
+	context->count_symlink = 0;
+	context->count_dir = 0;
 
 	/* write header */
-	if (BLOCK_HASH_SIZE == HASH_MAX) {
-		swrite("SNAPCNT2\n\3\0\0", 12, f);
-	} else {
-		/* use version 3 only if the hash size is not standard */
-		swrite("SNAPCNT3\n\3\0\0", 12, f);
-	}
+	swrite("SNAPCNT4\n\3\0\0", 12, f);
 
 	/* write block size and block max */
 	sputc('z', f);
@@ -2842,202 +3326,43 @@ static void* state_write_thread(void* arg)
 
 	/* for each disk */
 	for (i = state->disklist; i != 0; i = i->next) {
-		tommy_node* j;
 		struct snapraid_disk* disk = i->data;
+		unsigned char header[STATE_SECTION_HEADER];
+		int64_t header_offset;
+		int64_t section_offset;
+		uint64_t size;
+		uint32_t section_crc;
 
 		/* if the disk is not mapped, skip it */
 		if (disk->mapping_idx < 0)
 			continue;
 
-		/* for each file */
-		for (j = disk->filelist; j != 0; j = j->next) {
-			struct snapraid_file* file = j->data;
-			uint64_t size;
-			uint64_t mtime_sec;
-			int32_t mtime_nsec;
-			uint64_t inode;
-
-			size = file->size;
-			mtime_sec = file->mtime_sec;
-			mtime_nsec = file->mtime_nsec;
-			inode = file->inode;
-
-			sputc('f', f);
-			sputb32(disk->mapping_idx, f);
-			sputb64(size, f);
-			sputb64(mtime_sec, f);
-			/* encode STAT_NSEC_INVALID as 0 */
-			if (mtime_nsec == STAT_NSEC_INVALID)
-				sputb32(0, f);
-			else
-				sputb32(mtime_nsec + 1, f);
-			sputb64(inode, f);
-			sputbs(file->sub, f);
-			if (serror(f)) {
-				/* LCOV_EXCL_START */
-				log_fatal("Error writing the content file '%s'. %s.\n", serrorfile(f), strerror(errno));
-				return context;
-				/* LCOV_EXCL_STOP */
-			}
-
-			/* for all the blocks of the file */
-			begin = 0;
-			while (begin < file->blockmax) {
-				unsigned v_state = block_state_get(fs_file2block_get(file, begin));
-				block_off_t v_pos = fs_file2par_get(disk, file, begin);
-				uint32_t v_count;
-
-				block_off_t end;
-
-				/* find the end of run of blocks */
-				end = begin + 1;
-				while (end < file->blockmax) {
-					if (v_state != block_state_get(fs_file2block_get(file, end)))
-						break;
-					if (v_pos + (end - begin) != fs_file2par_get(disk, file, end))
-						break;
-					++end;
-				}
-
-				switch (v_state) {
-				case BLOCK_STATE_BLK :
-					sputc('b', f);
-					break;
-				case BLOCK_STATE_CHG :
-					sputc('g', f);
-					break;
-				case BLOCK_STATE_REP :
-					sputc('p', f);
-					break;
-				default :
-					/* LCOV_EXCL_START */
-					log_fatal("Internal inconsistency in state for block %u state %u\n", v_pos, v_state);
-					return context;
-					/* LCOV_EXCL_STOP */
-				}
-
-				sputb32(v_pos, f);
-
-				v_count = end - begin;
-				sputb32(v_count, f);
-
-				/* write hashes */
-				for (idx = begin; idx < end; ++idx) {
-					struct snapraid_block* block = fs_file2block_get(file, idx);
-
-					swrite(block->hash, BLOCK_HASH_SIZE, f);
-				}
-
-				if (serror(f)) {
-					/* LCOV_EXCL_START */
-					log_fatal("Error writing the content file '%s'. %s.\n", serrorfile(f), strerror(errno));
-					return context;
-					/* LCOV_EXCL_STOP */
-				}
-
-				/* next begin position */
-				begin = end;
-			}
-
-			++count_file;
-		}
-
-		/* for each link */
-		for (j = disk->linklist; j != 0; j = j->next) {
-			struct snapraid_link* slink = j->data;
-
-			switch (link_flag_get(slink, FILE_IS_LINK_MASK)) {
-			case FILE_IS_HARDLINK :
-				sputc('a', f);
-				++count_hardlink;
-				break;
-			case FILE_IS_SYMLINK :
-				sputc('s', f);
-				++count_symlink;
-				break;
-			}
-
-			sputb32(disk->mapping_idx, f);
-			sputbs(slink->sub, f);
-			sputbs(slink->linkto, f);
-			if (serror(f)) {
-				/* LCOV_EXCL_START */
-				log_fatal("Error writing the content file '%s'. %s.\n", serrorfile(f), strerror(errno));
-				return context;
-				/* LCOV_EXCL_STOP */
-			}
-		}
-
-		/* for each dir */
-		for (j = disk->dirlist; j != 0; j = j->next) {
-			struct snapraid_dir* dir = j->data;
-
-			sputc('r', f);
-			sputb32(disk->mapping_idx, f);
-			sputbs(dir->sub, f);
-			if (serror(f)) {
-				/* LCOV_EXCL_START */
-				log_fatal("Error writing the content file '%s'. %s.\n", serrorfile(f), strerror(errno));
-				return context;
-				/* LCOV_EXCL_STOP */
-			}
-
-			++count_dir;
-		}
-
-		/* deleted blocks of the disk */
-		sputc('h', f);
+		/* reserve the space for the size and crc, known only at the end */
+		sputc('D', f);
 		sputb32(disk->mapping_idx, f);
-		if (serror(f)) {
+		header_offset = sreserve(f, STATE_SECTION_HEADER);
+
+		/* write all the records of the disk directly in the stream */
+		crc = scrc(f);
+		section_offset = stell(f);
+		if (header_offset < 0 || state_write_section(context, disk, f) != 0 || serror(f)) {
 			/* LCOV_EXCL_START */
 			log_fatal("Error writing the content file '%s'. %s.\n", serrorfile(f), strerror(errno));
 			return context;
 			/* LCOV_EXCL_STOP */
 		}
-		begin = 0;
-		while (begin < blockmax) {
-			int is_deleted;
-			block_off_t end;
-
-			is_deleted = fs_is_block_deleted(disk, begin);
 
-			/* find the end of run of blocks */
-			end = begin + 1;
-			while (end < blockmax
-				&& is_deleted == fs_is_block_deleted(disk, end)
-			) {
-				++end;
-			}
-
-			sputb32(end - begin, f);
-
-			if (is_deleted) {
-				/* write the run of deleted blocks with hash */
-				sputc('o', f);
-
-				/* write all the hash */
-				while (begin < end) {
-					struct snapraid_block* block = fs_par2block_get(disk, begin);
+		/* get the crc of the section, removing the previous data from the file crc */
+		size = stell(f) - section_offset;
+		section_crc = scrc(f) ^ crc32c_combine(crc, 0, size);
 
-					swrite(block->hash, BLOCK_HASH_SIZE, f);
-
-					++begin;
-				}
-			} else {
-				/* write the run of blocks without hash */
-				/* they can be either used or empty blocks */
-				sputc('O', f);
-
-				/* next begin position */
-				begin = end;
-			}
-
-			if (serror(f)) {
-				/* LCOV_EXCL_START */
-				log_fatal("Error writing the content file '%s'. %s.\n", serrorfile(f), strerror(errno));
-				return context;
-				/* LCOV_EXCL_STOP */
-			}
+		/* write the size and crc of the section in the reserved space */
+		state_write_section_header(header, size, section_crc);
+		if (spatch(f, header_offset, header, STATE_SECTION_HEADER) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error writing the content file '%s'. %s.\n", serrorfile(f), strerror(errno));
+			return context;
+			/* LCOV_EXCL_STOP */
 		}
 	}
 
@@ -3127,10 +3452,6 @@ static void* state_write_thread(void* arg)
 
 	/* set output variables */
 	context->crc = crc;
-	context->count_file = count_file;
-	context->count_hardlink = count_hardlink;
-	context->count_symlink = count_symlink;
-	context->count_dir = count_dir;
 
 	return 0;
 }
@@ -3452,7 +3773,10 @@ void state_read(struct snapraid_state* state)
 		}
 		msg_progress("Loading state from %s...\n", path);
 
-		f = sopen_read(path);
+		if (state->opt.skip_mmap)
+			f = sopen_read(path);
+		else
+			f = sopen_map_read(path);
 		if (f != 0) {
 			/* if opened stop the search */
 			break;
@@ -3649,7 +3973,10 @@ static void state_verify_content(struct snapraid_state* state, uint32_t crc)
 
 		pathprint(tmp, sizeof(tmp), "%s.tmp", content->content);
 
-		f = sopen_read(tmp);
+		if (state->opt.skip_mmap)
+			f = sopen_read(tmp);
+		else
+			f = sopen_map_read(tmp);
 		if (f == 0) {
 			/* LCOV_EXCL_START */
 			log_fatal("Error reopening the content file '%s'. %s.\n", tmp, strerror(errno));
@@ -3792,6 +4119,7 @@ void state_filter(struct snapraid_state* state, tommy_list* filterlist_file, tom
 {
 	tommy_node* i;
 	unsigned l;
+	char sub_buffer[PATH_MAX];
 
 	/* if no filter, include all */
 	if (!filter_missing && !filter_error && tommy_list_empty(filterlist_file) && tommy_list_empty(filterlist_disk))
@@ -3824,10 +4152,11 @@ void state_filter(struct snapraid_state* state, tommy_list* filterlist_file, tom
 		/* for each file */
 		for (j = tommy_list_head(&disk->filelist); j != 0; j = j->next) {
 			struct snapraid_file* file = j->data;
+			const char* sub = file_sub(file, sub_buffer);
 
-			if (filter_path(filterlist_disk, 0, disk->name, file->sub) != 0
-				|| filter_path(filterlist_file, 0, disk->name, file->sub) != 0
-				|| filter_existence(filter_missing, disk->dir, file->sub) != 0
+			if (filter_path(filterlist_disk, 0, disk->name, sub) != 0
+				|| filter_path(filterlist_file, 0, disk->name, sub) != 0
+				|| filter_existence(filter_missing, disk->dir, sub) != 0
 				|| filter_correctness(filter_error, &state->infoarr, disk, file) != 0
 			) {
 				file_flag_set(file, FILE_IS_EXCLUDED);
@@ -3892,6 +4221,8 @@ int state_progress_begin(struct snapraid_state* state, block_off_t blockstart, b
 	now = time(0);
 
 	state->progress_whole_start = now;
+	state->progress_whole_ms = tick_ms();
+	state->progress_whole_cpu_ms = tick_cpu_ms();
 
 	state->progress_tick = 0;
 	state->progress_ptr = 0;
@@ -3922,6 +4253,8 @@ void state_progress_end(struct snapraid_state* state, block_off_t countpos, bloc
 	} else {
 		time_t now;
 		time_t elapsed;
+		uint64_t elapsed_ms;
+		uint64_t cpu_ms;
 
 		unsigned countsize_MB = (countsize + MEGA - 1) / MEGA;
 
@@ -3933,6 +4266,19 @@ void state_progress_end(struct snapraid_state* state, block_off_t countpos, bloc
 		if (elapsed >= 60)
 			msg_bar(" in %u:%02u", (unsigned)(elapsed / 3600), (unsigned)((elapsed % 3600) / 60));
 		msg_bar("\n");
+
+		/* average speed and CPU time of the whole process */
+		/* useful to compare the IO modes, like with and without direct IO */
+		elapsed_ms = tick_ms() - state->progress_whole_ms;
+		cpu_ms = tick_cpu_ms() - state->progress_whole_cpu_ms;
+		if (elapsed_ms > state->progress_wasted * 1000ULL)
+			elapsed_ms -= state->progress_wasted * 1000ULL;
+		if (elapsed_ms != 0) {
+			msg_progress("Average speed %u MB/s, CPU time %u.%03u s (%u%% of a core)\n",
+				(unsigned)(countsize * 1000 / MEGA / elapsed_ms),
+				(unsigned)(cpu_ms / 1000), (unsigned)(cpu_ms % 1000),
+				(unsigned)(cpu_ms * 100 / elapsed_ms));
+		}
 		msg_flush();
 	}
 }
@@ -4336,6 +4682,12 @@ void state_usage_hash(struct snapraid_state* state)
 	state->tick_last = now;
 }
 
+void state_usage_hash_worker(struct snapraid_state* state, uint64_t delta)
+{
+	/* the time is spent in parallel, and it's not removed from the others */
+	state->tick_hash += delta;
+}
+
 void state_usage_disk(struct snapraid_state* state, struct snapraid_handle* handle_map, unsigned* waiting_map, unsigned waiting_mac)
 {
 	uint64_t now = tick();
@@ -4405,6 +4757,7 @@ void generate_configuration(const char* path)
 	struct snapraid_content* content;
 	unsigned i;
 	tommy_node* j;
+	char sub_buffer[PATH_MAX];
 
 	state_init(&state);
 
@@ -4449,7 +4802,7 @@ void generate_configuration(const char* path)
 		if (disk && disk->filelist) {
 			struct snapraid_file* file = disk->filelist->data;
 			if (file) {
-				printf("# and containing: %s\n", file->sub);
+				printf("# and containing: %s\n", file_sub(file, sub_buffer));
 			}
 		}
 		printf("data %s ENTER_HERE_THE_DIR\n", map->name);
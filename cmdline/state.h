@@ -60,6 +60,8 @@ const char* lev_config_name(unsigned level);
  * File modes.
  */
 #define MODE_SEQUENTIAL 1 /**< Open the file in sequential mode. */
+#define MODE_DIRECT 2 /**< Open the file in direct mode, bypassing the OS cache. */
+#define MODE_WRITEBACK 4 /**< Start the writeback of the data as soon as it's written. */
 
 /**
  * Global variable to identify if Ctrl+C is pressed.
@@ -119,6 +121,13 @@ struct snapraid_option {
 	unsigned io_cache; /**< Number of IO buffers to use. 0 for default. */
 	int auto_conf; /**< Allow to run without configuration file. */
 	int force_stats; /**< Force stats print during process. */
+	int skip_scan_thread; /**< Skip the use of a thread for each disk when scanning. */
+	int skip_mmap; /**< Skip the memory mapping of the content file. */
+	unsigned raid_thread; /**< Number of threads used to compute the parity. 0 for automatic selection. */
+	unsigned io_uring; /**< Number of io_uring threads. 0 to use a thread for each disk. */
+	int io_direct; /**< Read and write data and parity bypassing the OS cache. */
+	int io_writeback; /**< Start the writeback of the parity as soon as it's written. */
+	int pool_full; /**< Force a full rebuild of the pooling directory. */
 };
 
 struct snapraid_state {
@@ -150,6 +159,7 @@ struct snapraid_state {
 	tommy_hashdyn importset; /**< Hashtable by hash of all the import blocks. */
 	tommy_hashdyn previmportset; /**< Hashtable by prevhash of all the import blocks. Valid only if we are in a rehash state. */
 	tommy_hashdyn searchset; /**< Hashtable by timestamp of all the search files. */
+	tommy_list searchopen; /**< List of the search files kept open, from the most recently used. */
 	tommy_arrayblkof infoarr; /**< Block information array. */
 
 	/**
@@ -175,6 +185,8 @@ struct snapraid_state {
 	time_t progress_whole_start; /**< Initial start of the whole process. */
 	time_t progress_interruption; /**< Time of the start of the progress interruption. */
 	time_t progress_wasted; /**< Time wasted in interruptions. */
+	uint64_t progress_whole_ms; /**< Initial start of the whole process in millisecond. */
+	uint64_t progress_whole_cpu_ms; /**< CPU time used at the start of the whole process in millisecond. */
 
 	time_t progress_time[PROGRESS_MAX]; /**< Last times of progress. */
 	block_off_t progress_pos[PROGRESS_MAX]; /**< Last positions of progress. */
@@ -265,6 +277,7 @@ void state_rehash(struct snapraid_state* state);
 #define SCRUB_NEW -3 /**< Scub the new blocks. */
 #define SCRUB_FULL -4 /**< Scrub everything. */
 #define SCRUB_EVEN -5 /**< Even blocks. */
+#define SCRUB_REHASH -6 /**< Scrub the blocks still to rehash. */
 
 /**
  * Scrub the files.
@@ -348,6 +361,11 @@ void state_usage_sched(struct snapraid_state* state);
 void state_usage_raid(struct snapraid_state* state);
 void state_usage_hash(struct snapraid_state* state);
 
+/**
+ * Add the time spent by the worker threads to compute the hashes.
+ */
+void state_usage_hash_worker(struct snapraid_state* state, uint64_t delta);
+
 /**
  * Set the usage time for a set of data disks.
  */
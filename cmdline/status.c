@@ -79,7 +79,10 @@ int state_status(struct snapraid_state* state)
 	unsigned unsynced_blocks;
 	unsigned unscrubbed_blocks;
 	uint64_t all_wasted;
+	uint64_t memory_used;
+	uint64_t memory_block;
 	int free_not_zero;
+	char sub_buffer[PATH_MAX];
 
 	/* get the present time */
 	now = time(0);
@@ -148,9 +151,9 @@ int state_status(struct snapraid_state* state)
 				++file_zerosubsecond;
 				++disk_file_zerosubsecond;
 				if (disk_file_zerosubsecond < 50)
-					log_tag("zerosubsecond:%s:%s: \n", disk->name, file->sub);
+					log_tag("zerosubsecond:%s:%s: \n", disk->name, file_sub(file, sub_buffer));
 				if (disk_file_zerosubsecond == 50)
-					log_tag("zerosubsecond:%s:%s: (more follow)\n", disk->name, file->sub);
+					log_tag("zerosubsecond:%s:%s: (more follow)\n", disk->name, file_sub(file, sub_buffer));
 			}
 
 			/* check fragmentation */
@@ -269,6 +272,16 @@ int state_status(struct snapraid_state* state)
 	if (!free_not_zero)
 		printf("\nWARNING! Free space info will be valid after the first sync.\n");
 
+	/* memory used by the blocks, and overall for each block */
+	memory_used = malloc_counter_get();
+	memory_block = file_block_count * block_sizeof();
+	printf("\n");
+	printf("The block table uses %" PRIu64 " MiB of memory, %u bytes for each block.\n", memory_block / MEBI, (unsigned)block_sizeof());
+	if (file_block_count != 0)
+		printf("The total memory used is %" PRIu64 " MiB, %" PRIu64 " bytes for each block.\n", memory_used / MEBI, memory_used / file_block_count);
+	else
+		printf("The total memory used is %" PRIu64 " MiB.\n", memory_used / MEBI);
+
 	log_tag("summary:file_count:%u\n", file_count);
 	log_tag("summary:file_block_count:%" PRIu64 "\n", file_block_count);
 	log_tag("summary:fragmented_file_count:%u\n", file_fragmented);
@@ -280,6 +293,9 @@ int state_status(struct snapraid_state* state)
 	log_tag("summary:hash:%s\n", hash_config_name(state->hash));
 	log_tag("summary:prev_hash:%s\n", hash_config_name(state->prevhash));
 	log_tag("summary:best_hash:%s\n", hash_config_name(state->besthash));
+	log_tag("summary:memory_block_size:%u\n", (unsigned)block_sizeof());
+	log_tag("summary:memory_block_table:%" PRIu64 "\n", memory_block);
+	log_tag("summary:memory_used:%" PRIu64 "\n", memory_used);
 	log_flush();
 
 	/* copy the info a temp vector, and count bad/rehash/unsynced blocks */
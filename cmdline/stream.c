@@ -58,6 +58,9 @@ STREAM* sopen_read(const char* file)
 #endif
 
 	s->buffer = malloc_nofail_test(STREAM_SIZE);
+	s->map = 0;
+	s->map_size = 0;
+	s->own = 1;
 	s->pos = s->buffer;
 	s->end = s->buffer;
 	s->state = STREAM_STATE_READ;
@@ -71,6 +74,68 @@ STREAM* sopen_read(const char* file)
 	return s;
 }
 
+STREAM* sopen_map_read(const char* file)
+{
+#if HAVE_MMAP
+	STREAM* s;
+	struct stat st;
+	void* map;
+	int f;
+
+	f = open(file, O_RDONLY | O_BINARY | O_SEQUENTIAL);
+	if (f == -1)
+		return 0;
+
+	/* an empty file cannot be mapped */
+	if (fstat(f, &st) != 0
+		|| st.st_size == 0
+		|| (uint64_t)(size_t)st.st_size != (uint64_t)st.st_size
+	) {
+		close(f);
+		return sopen_read(file);
+	}
+
+	map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+	if (map == MAP_FAILED) {
+		/* LCOV_EXCL_START */
+		close(f);
+		return sopen_read(file);
+		/* LCOV_EXCL_STOP */
+	}
+
+#if HAVE_MADVISE
+	/* advise sequential access, to read ahead and to release the pages already read */
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif
+
+	s = malloc_nofail(sizeof(STREAM));
+
+	s->handle_size = 1;
+	s->handle = malloc_nofail(sizeof(struct stream_handle));
+
+	pathcpy(s->handle[0].path, sizeof(s->handle[0].path), file);
+	s->handle[0].f = f;
+
+	s->buffer = map;
+	s->map = map;
+	s->map_size = st.st_size;
+	s->own = 0;
+	s->pos = s->buffer;
+	s->end = s->buffer + s->map_size;
+	s->state = STREAM_STATE_READ;
+	s->state_index = 0;
+	s->offset = s->map_size;
+	s->offset_uncached = 0;
+	s->crc = 0;
+	s->crc_uncached = 0;
+	s->crc_stream = CRC_IV;
+
+	return s;
+#else
+	return sopen_read(file);
+#endif
+}
+
 STREAM* sopen_multi_write(unsigned count)
 {
 	unsigned i;
@@ -84,6 +149,9 @@ STREAM* sopen_multi_write(unsigned count)
 		s->handle[i].f = -1;
 
 	s->buffer = malloc_nofail_test(STREAM_SIZE);
+	s->map = 0;
+	s->map_size = 0;
+	s->own = 1;
 	s->pos = s->buffer;
 	s->end = s->buffer + STREAM_SIZE;
 	s->state = STREAM_STATE_WRITE;
@@ -141,6 +209,40 @@ STREAM* sopen_write(const char* file)
 	return s;
 }
 
+STREAM* sopen_mem_read(unsigned char* data, size_t size)
+{
+	STREAM* s = malloc_nofail(sizeof(STREAM));
+
+	s->handle_size = 0;
+	s->handle = 0;
+
+	s->buffer = data;
+	s->map = 0;
+	s->map_size = 0;
+	s->own = 1;
+	s->pos = s->buffer;
+	s->end = s->buffer + size;
+	s->state = STREAM_STATE_READ;
+	s->state_index = 0;
+	s->offset = size;
+	s->offset_uncached = 0;
+	s->crc = 0;
+	s->crc_uncached = 0;
+	s->crc_stream = CRC_IV;
+
+	return s;
+}
+
+STREAM* sopen_mem_view(unsigned char* data, size_t size)
+{
+	STREAM* s = sopen_mem_read(data, size);
+
+	/* the data is not owned */
+	s->own = 0;
+
+	return s;
+}
+
 int sclose(STREAM* s)
 {
 	int fail = 0;
@@ -162,8 +264,14 @@ int sclose(STREAM* s)
 		}
 	}
 
+#if HAVE_MMAP
+	if (s->map)
+		munmap(s->map, s->map_size);
+#endif
+
 	free(s->handle);
-	free(s->buffer);
+	if (s->own)
+		free(s->buffer);
 	free(s);
 
 	if (fail) {
@@ -200,6 +308,12 @@ static int sfill(STREAM* s)
 		/* LCOV_EXCL_STOP */
 	}
 
+	/* a memory or mapped stream has all the data already in the buffer */
+	if (s->handle_size == 0 || s->map) {
+		s->state = STREAM_STATE_EOF;
+		return EOF;
+	}
+
 	ret = read(s->handle[0].f, s->buffer, STREAM_SIZE);
 
 	if (ret < 0) {
@@ -312,14 +426,107 @@ int sflush(STREAM* s)
 	return 0;
 }
 
+int64_t sreserve(STREAM* s, unsigned size)
+{
+	int64_t offset = stell(s);
+
+	while (size--) {
+		if (sputc(0, s) != 0) {
+			/* LCOV_EXCL_START */
+			return -1;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	return offset;
+}
+
+int spatch(STREAM* s, int64_t offset, const void* data, unsigned size)
+{
+	unsigned char zero[16];
+	uint32_t delta;
+	uint64_t after;
+	unsigned i;
+
+	if (size > sizeof(zero) || offset < 0 || offset + size > stell(s)) {
+		/* LCOV_EXCL_START */
+		return EOF;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* all the CRCs are affine, so the change of the CRC */
+	/* depends only on the change of the data and on its position */
+	memset(zero, 0, size);
+	delta = crc32c(0, data, size) ^ crc32c(0, zero, size);
+	after = stell(s) - (offset + size);
+	delta = crc32c_combine(delta, 0, after);
+
+	/* move all the data to the files, to patch only them */
+	if (sflush(s) != 0) {
+		/* LCOV_EXCL_START */
+		return EOF;
+		/* LCOV_EXCL_STOP */
+	}
+
+	for (i = 0; i < s->handle_size; ++i) {
+		ssize_t ret = pwrite(s->handle[i].f, data, size, offset);
+
+		if (ret != (ssize_t)size) {
+			/* LCOV_EXCL_START */
+			s->state = STREAM_STATE_ERROR;
+			s->state_index = i;
+			return EOF;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	s->crc ^= delta;
+	s->crc_uncached = s->crc;
+	s->crc_stream ^= delta;
+
+	return 0;
+}
+
 int64_t stell(STREAM* s)
 {
 	return s->offset_uncached + (s->pos - s->buffer);
 }
 
+/**
+ * Max size processed in a single call by the CRC functions.
+ */
+#define STREAM_CRC_RUN (1U << 30)
+
 uint32_t scrc(STREAM*s)
 {
-	return crc32c(s->crc_uncached, s->buffer, s->pos - s->buffer);
+	uint32_t crc = s->crc_uncached;
+	unsigned char* ptr = s->buffer;
+
+	/* a mapped buffer may be too big for a single call */
+	while ((size_t)(s->pos - ptr) > STREAM_CRC_RUN) {
+		crc = crc32c(crc, ptr, STREAM_CRC_RUN);
+		ptr += STREAM_CRC_RUN;
+	}
+
+	return crc32c(crc, ptr, s->pos - ptr);
+}
+
+unsigned char* smapskip(STREAM* s, size_t size, uint32_t crc)
+{
+	unsigned char* ptr;
+
+	if (!s->map || (size_t)(s->end - s->pos) < size)
+		return 0;
+
+	ptr = s->pos;
+
+	/* move the start of the CRC computation after the skipped data */
+	s->crc_uncached = crc32c_combine(scrc(s), crc, size);
+	s->offset_uncached += (s->pos - s->buffer) + size;
+	s->buffer = s->pos + size;
+	s->pos = s->buffer;
+
+	return ptr;
 }
 
 uint32_t scrc_stream(STREAM*s)
@@ -387,16 +594,25 @@ int sread(STREAM* f, void* void_data, unsigned size)
 
 		sptrset(f, pos);
 	} else {
-		/* standard version using sgetc() */
-		while (size--) {
-			int c = sgetc(f);
-			if (c == EOF) {
+		/* copy the buffer content, and refill it until done */
+		while (size) {
+			unsigned run;
+
+			if (f->pos == f->end && sfill(f) != 0) {
 				/* LCOV_EXCL_START */
 				return -1;
 				/* LCOV_EXCL_STOP */
 			}
 
-			*data++ = c;
+			run = f->end - f->pos;
+			if (run > size)
+				run = size;
+
+			memcpy(data, f->pos, run);
+
+			f->pos += run;
+			data += run;
+			size -= run;
 		}
 	}
 
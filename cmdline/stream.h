@@ -42,6 +42,9 @@ struct stream_handle {
 
 struct stream {
 	unsigned char* buffer; /**< Buffer of the stream. */
+	unsigned char* map; /**< Memory mapping of the whole file. 0 if not mapped. */
+	size_t map_size; /**< Size of the memory mapping. */
+	int own; /**< If the buffer is allocated by the stream, and freed by sclose(). */
 	unsigned char* pos; /**< Current position in the buffer. */
 	unsigned char* end; /**< End position of the buffer. */
 	int state; /**< State of the stream. One of STREAM_STATE. */
@@ -102,6 +105,15 @@ typedef struct stream STREAM;
  */
 STREAM* sopen_read(const char* file);
 
+/**
+ * Open a stream for reading, mapping the whole file in memory.
+ *
+ * The data is read directly from the mapping without copying it
+ * in the stream buffer, and the CRC is computed only when requested.
+ * If the file cannot be mapped, it falls back to sopen_read().
+ */
+STREAM* sopen_map_read(const char* file);
+
 /**
  * Open a stream for writing. Like fopen("w").
  */
@@ -117,6 +129,32 @@ STREAM* sopen_multi_write(unsigned count);
  */
 int sopen_multi_file(STREAM* s, unsigned i, const char* file);
 
+/**
+ * Open a stream for reading data already in memory.
+ * The stream takes the ownership of the data, that must be allocated
+ * with malloc(), and it's freed by sclose().
+ * The stream has no file handle, and it reaches EOF at the end of the data.
+ */
+STREAM* sopen_mem_read(unsigned char* data, size_t size);
+
+/**
+ * Open a stream for reading data already in memory, without copying it.
+ * The data must remain valid until sclose().
+ */
+STREAM* sopen_mem_view(unsigned char* data, size_t size);
+
+/**
+ * Skip data of a memory mapped stream, without computing its CRC.
+ *
+ * The CRC of the stream is updated using the specified CRC of the skipped data,
+ * that must be verified by the caller before using the stream CRC.
+ * \param size Size of the data to skip.
+ * \param crc CRC of the data to skip.
+ * \return The pointer at the skipped data in the mapping, or 0 if the stream
+ * is not mapped or it doesn't contain enough data. In such case nothing is skipped.
+ */
+unsigned char* smapskip(STREAM* s, size_t size, uint32_t crc);
+
 /**
  * Close a stream. Like fclose().
  */
@@ -141,6 +179,24 @@ int sdeplete(STREAM* s, unsigned char* last);
  */
 int sflush(STREAM* s);
 
+/**
+ * Reserve space in a write stream, to be written later with spatch().
+ * The space is filled with zeros.
+ * \return The offset of the reserved space, or -1 on error.
+ */
+int64_t sreserve(STREAM* s, unsigned size);
+
+/**
+ * Overwrite the space reserved with sreserve() in a write stream.
+ *
+ * The data is written directly in the files at the specified offset,
+ * and the CRC of the file, and the CRC of the stream, are updated
+ * without reading back the data written after it.
+ * The reserved space must be still filled with zeros.
+ * \return 0 on success, or EOF on error.
+ */
+int spatch(STREAM* s, int64_t offset, const void* data, unsigned size);
+
 /**
  * Get the file pointer.
  */
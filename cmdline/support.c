@@ -1035,6 +1035,254 @@ char* strdup_nofail(const char* str)
 	return ptr;
 }
 
+/**
+ * Size of the blocks allocated by the arena.
+ */
+#define ARENA_BLOCK_SIZE (1024 * 1024)
+
+/**
+ * Alignment of the objects allocated in the arena.
+ */
+#define ARENA_ALIGN 8
+
+/**
+ * Space reserved at the start of each block for the link to the previous one.
+ */
+#define ARENA_HEADER ((sizeof(void*) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/**
+ * Space reserved at the start of each large object for the links to the previous and next ones.
+ */
+#define ARENA_LARGE_HEADER ((2 * sizeof(void*) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/**
+ * Objects larger than this get a dedicated block.
+ */
+#define ARENA_LARGE (ARENA_BLOCK_SIZE / 8)
+
+/**
+ * Objects up to this size have a size class for each multiple of the alignment.
+ * Bigger objects have a size class for each power of 2.
+ */
+#define ARENA_SMALL 256
+
+void arena_init(struct arena* arena)
+{
+	unsigned i;
+
+	arena->block = 0;
+	arena->large = 0;
+	arena->ptr = 0;
+	arena->avail = 0;
+	arena->alloc_count = 0;
+	arena->block_count = 0;
+	arena->reuse_count = 0;
+	for (i = 0; i < ARENA_FREE_MAX; ++i)
+		arena->free[i] = 0;
+}
+
+void arena_done(struct arena* arena)
+{
+	void* block = arena->block;
+
+	while (block) {
+		void* prev = *(void**)block;
+		free(block);
+		block = prev;
+	}
+
+	block = arena->large;
+	while (block) {
+		void* next = ((void**)block)[1];
+		free(block);
+		block = next;
+	}
+
+	arena_init(arena);
+}
+
+/**
+ * Return the size class of the objects of at least the specified size.
+ * All the objects in the returned class are big enough.
+ */
+static unsigned arena_class_up(size_t size)
+{
+	unsigned c;
+	size_t bound;
+
+	if (size <= ARENA_SMALL)
+		return (size + ARENA_ALIGN - 1) / ARENA_ALIGN;
+
+	c = ARENA_SMALL / ARENA_ALIGN + 1;
+	bound = ARENA_SMALL * 2;
+	while (bound < size) {
+		++c;
+		bound *= 2;
+	}
+
+	return c;
+}
+
+/**
+ * Return the size class where to store an object of the specified size.
+ * The object is big enough for all the allocations of its class.
+ */
+static unsigned arena_class_down(size_t size)
+{
+	unsigned c;
+	size_t bound;
+
+	if (size <= ARENA_SMALL)
+		return size / ARENA_ALIGN;
+
+	c = ARENA_SMALL / ARENA_ALIGN;
+	bound = ARENA_SMALL * 2;
+	while (bound <= size) {
+		++c;
+		bound *= 2;
+	}
+
+	return c;
+}
+
+/**
+ * Allocate a large object in its own block.
+ */
+static unsigned char* arena_large(struct arena* arena, size_t size)
+{
+	void** block;
+
+	block = malloc_nofail(ARENA_LARGE_HEADER + size);
+
+	block[0] = 0;
+	block[1] = arena->large;
+	if (arena->large)
+		((void**)arena->large)[0] = block;
+	arena->large = block;
+
+	++arena->block_count;
+
+	return (unsigned char*)block + ARENA_LARGE_HEADER;
+}
+
+/**
+ * Allocate memory in the arena with the specified alignment.
+ */
+static void* arena_raw(struct arena* arena, size_t size, size_t align)
+{
+	unsigned char* ptr;
+	size_t skip;
+	unsigned c;
+
+	++arena->alloc_count;
+
+	/* large objects get their own block */
+	if (size > ARENA_LARGE)
+		return arena_large(arena, size);
+
+	/* reuse a freed object, they are all aligned */
+	c = arena_class_up(size);
+	if (arena->free[c]) {
+		ptr = arena->free[c];
+		arena->free[c] = *(void**)ptr;
+		++arena->reuse_count;
+		return ptr;
+	}
+
+	skip = (align - ((uintptr_t)arena->ptr & (align - 1))) & (align - 1);
+
+	if (arena->ptr == 0 || skip + size > arena->avail) {
+		/* start a new current block */
+		void* block = malloc_nofail(ARENA_HEADER + ARENA_BLOCK_SIZE);
+		*(void**)block = arena->block;
+		arena->block = block;
+		++arena->block_count;
+		arena->ptr = (unsigned char*)block + ARENA_HEADER;
+		arena->avail = ARENA_BLOCK_SIZE;
+		skip = 0;
+	}
+
+	ptr = arena->ptr + skip;
+	arena->ptr = ptr + size;
+	arena->avail -= skip + size;
+
+	return ptr;
+}
+
+void* arena_alloc(struct arena* arena, size_t size)
+{
+	return arena_raw(arena, size, ARENA_ALIGN);
+}
+
+char* arena_strdup(struct arena* arena, const char* str)
+{
+	size_t size;
+	char* ptr;
+
+	size = strlen(str) + 1;
+
+	/* strings don't need alignment */
+	ptr = arena_raw(arena, size, 1);
+
+	memcpy(ptr, str, size);
+
+	return ptr;
+}
+
+char* arena_strndup(struct arena* arena, const char* str, size_t len)
+{
+	char* ptr;
+
+	/* strings don't need alignment */
+	ptr = arena_raw(arena, len + 1, 1);
+
+	memcpy(ptr, str, len);
+	ptr[len] = 0;
+
+	return ptr;
+}
+
+void arena_free(struct arena* arena, void* void_ptr, size_t size)
+{
+	unsigned char* ptr = void_ptr;
+	size_t skip;
+	unsigned c;
+
+	/* large objects are returned to the system */
+	if (size > ARENA_LARGE) {
+		void** block = (void**)(ptr - ARENA_LARGE_HEADER);
+
+		if (block[0])
+			((void**)block[0])[1] = block[1];
+		else
+			arena->large = block[1];
+		if (block[1])
+			((void**)block[1])[0] = block[0];
+
+		free(block);
+		--arena->block_count;
+		return;
+	}
+
+	/* strings are not aligned, so align the start of the free space */
+	skip = (ARENA_ALIGN - ((uintptr_t)ptr & (ARENA_ALIGN - 1))) & (ARENA_ALIGN - 1);
+	if (skip + sizeof(void*) > size)
+		return; /* too small to be reused */
+
+	ptr += skip;
+	size -= skip;
+
+	c = arena_class_down(size);
+
+	*(void**)ptr = arena->free[c];
+	arena->free[c] = ptr;
+}
+
+void arena_strfree(struct arena* arena, char* str)
+{
+	arena_free(arena, str, strlen(str) + 1);
+}
+
 /****************************************************************************/
 /* smartctl */
 
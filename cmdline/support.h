@@ -353,6 +353,83 @@ char* strdup_nofail(const char* str);
  */
 void malloc_fail(size_t size);
 
+/**
+ * Number of size classes of the free lists of the arena.
+ */
+#define ARENA_FREE_MAX 42
+
+/**
+ * Arena allocator.
+ *
+ * Allocates many small objects inside big blocks of memory,
+ * releasing all of them at once with arena_done().
+ * Objects freed one by one with arena_free() are kept in a free list
+ * for each size class, and reused by the next allocations.
+ * Large objects have their own block, and they are returned to the system.
+ *
+ * It's not thread-safe. Each thread must use its own arena.
+ */
+struct arena {
+	void* block; /**< Last allocated block. Each block starts with the pointer at the previous one. */
+	void* large; /**< First large object block. Each block starts with the pointers at the previous and next ones. */
+	unsigned char* ptr; /**< First free byte in the current block. */
+	size_t avail; /**< Free bytes in the current block. */
+	size_t alloc_count; /**< Number of objects allocated. */
+	size_t block_count; /**< Number of blocks allocated with malloc(). */
+	size_t reuse_count; /**< Number of objects allocated reusing freed ones. */
+	void* free[ARENA_FREE_MAX]; /**< Free lists of the freed objects, for each size class. */
+};
+
+/**
+ * Initialize an empty arena.
+ */
+void arena_init(struct arena* arena);
+
+/**
+ * Release all the objects allocated in the arena.
+ */
+void arena_done(struct arena* arena);
+
+/**
+ * Allocate an object in the arena.
+ * The memory is aligned for any basic type.
+ * If no memory is available, it aborts.
+ */
+void* arena_alloc(struct arena* arena, size_t size);
+
+/**
+ * Duplicate a string in the arena.
+ * If no memory is available, it aborts.
+ */
+char* arena_strdup(struct arena* arena, const char* str);
+
+/**
+ * Duplicate the first chars of a string in the arena.
+ * If no memory is available, it aborts.
+ */
+char* arena_strndup(struct arena* arena, const char* str, size_t len);
+
+/**
+ * Free an object allocated in the arena.
+ * \param size The same size used to allocate it.
+ */
+void arena_free(struct arena* arena, void* ptr, size_t size);
+
+/**
+ * Free a string allocated in the arena with arena_strdup().
+ */
+void arena_strfree(struct arena* arena, char* str);
+
+/**
+ * Return the number of malloc() calls saved by the arena.
+ */
+static inline size_t arena_saved(struct arena* arena)
+{
+	if (arena->alloc_count < arena->block_count)
+		return 0;
+	return arena->alloc_count - arena->block_count;
+}
+
 /****************************************************************************/
 /* smartctl */
 
@@ -23,18 +23,241 @@
 #include "parity.h"
 #include "handle.h"
 #include "io.h"
+#include "gen.h"
 #include "raid/raid.h"
 
 /****************************************************************************/
 /* hash */
 
+/**
+ * Hash plan to use.
+ */
+struct snapraid_hash_plan {
+	unsigned handle_max;
+	struct snapraid_handle* handle_map;
+};
+
+/**
+ * Check if the block has to be hashed.
+ */
+static int block_is_hashable(struct snapraid_block* block)
+{
+	unsigned block_state = block_state_get(block);
+
+	/* process REP and CHG blocks */
+	return block_state == BLOCK_STATE_REP || block_state == BLOCK_STATE_CHG;
+}
+
+/**
+ * Check if we have to hash the specified block index ::i.
+ */
+static int hash_block_is_enabled(void* void_plan, block_off_t i)
+{
+	struct snapraid_hash_plan* plan = void_plan;
+	unsigned j;
+
+	for (j = 0; j < plan->handle_max; ++j) {
+		struct snapraid_disk* disk = plan->handle_map[j].disk;
+
+		/* if no disk, nothing to check */
+		if (!disk)
+			continue;
+
+		if (block_is_hashable(fs_par2block_find(disk, i)))
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Continuation of hash_data_reader() after the read of the block.
+ */
+static void hash_data_reader_done(struct snapraid_worker* worker, struct snapraid_task* task, int ret)
+{
+	struct snapraid_io* io = worker->io;
+	struct snapraid_state* state = io->state;
+	struct snapraid_handle* handle = worker->handle;
+	struct snapraid_disk* disk = handle->disk;
+	block_off_t blockcur = task->position;
+	unsigned char* buffer = task->buffer;
+	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
+	char quote_buffer[QUOTE_MAX];
+
+	task->read_size = ret;
+	if (task->read_size == -1) {
+		/* LCOV_EXCL_START */
+		if (errno == EIO) {
+			log_tag("error:%u:%s:%s: Read EIO error at position %u. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), task->file_pos, strerror(errno));
+			log_fatal("DANGER! Unexpected input/output read error in a data disk, it isn't possible to sync.\n");
+			log_fatal("Ensure that disk '%s' is sane and that file '%s' can be read.\n", disk->dir, handle->path);
+			log_fatal("Stopping at block %u\n", blockcur);
+			task->state = TASK_STATE_IOERROR;
+			return;
+		}
+
+		log_tag("error:%u:%s:%s: Read error at position %u. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), task->file_pos, strerror(errno));
+		log_fatal("WARNING! Unexpected read error in a data disk, it isn't possible to sync.\n");
+		log_fatal("Ensure that file '%s' can be read.\n", handle->path);
+		log_fatal("Stopping to allow recovery. Try with 'snapraid check -f %s'\n", quote('/', file_sub(task->file, sub_buffer), quote_buffer));
+		task->state = TASK_STATE_ERROR;
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* compute the hash in the worker thread, to hash all the disks concurrently */
+	if (info_get_rehash(info_get(&state->infoarr, blockcur))) {
+		memhash(state->prevhash, state->prevhashseed, task->hash, buffer, task->read_size);
+	} else {
+		memhash(state->hash, state->hashseed, task->hash, buffer, task->read_size);
+	}
+
+	/* store the path of the opened file */
+	pathcpy(task->path, sizeof(task->path), handle->path);
+
+	task->state = TASK_STATE_DONE;
+}
+
+static void hash_data_reader(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	struct snapraid_io* io = worker->io;
+	struct snapraid_state* state = io->state;
+	struct snapraid_handle* handle = worker->handle;
+	struct snapraid_disk* disk = handle->disk;
+	block_off_t blockcur = task->position;
+	int ret;
+	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
+	char quote_buffer[QUOTE_MAX];
+
+	/* if the disk position is not used */
+	if (!disk) {
+		/* report an empty block, without clearing the buffer */
+		task->state = TASK_STATE_EMPTY;
+		return;
+	}
+
+	/* get the block */
+	task->block = fs_par2block_find(disk, blockcur);
+
+	/* if the block is not REP or CHG, there is nothing to hash */
+	if (!block_is_hashable(task->block)) {
+		/* report an empty block, without clearing the buffer */
+		task->state = TASK_STATE_EMPTY;
+		return;
+	}
+
+	/* get the file of this block */
+	task->file = fs_par2file_get(disk, blockcur, &task->file_pos);
+
+	/* if the file is different than the current one, close it */
+	if (handle->file != 0 && handle->file != task->file) {
+		/* keep a pointer at the file we are going to close for error reporting */
+		struct snapraid_file* report = handle->file;
+		ret = handle_close(handle);
+		if (ret == -1) {
+			/* LCOV_EXCL_START */
+			/* This one is really an unexpected error, because we are only reading */
+			/* and closing a descriptor should never fail */
+			if (errno == EIO) {
+				log_tag("error:%u:%s:%s: Close EIO error. %s\n", blockcur, disk->name, esc(file_sub(report, sub_buffer), esc_buffer), strerror(errno));
+				log_fatal("DANGER! Unexpected input/output close error in a data disk, it isn't possible to sync.\n");
+				log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
+				log_fatal("Stopping at block %u\n", blockcur);
+				task->state = TASK_STATE_IOERROR;
+				return;
+			}
+
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(file_sub(report, sub_buffer), esc_buffer), strerror(errno));
+			log_fatal("WARNING! Unexpected close error in a data disk, it isn't possible to sync.\n");
+			log_fatal("Ensure that file '%s' can be accessed.\n", handle->path);
+			log_fatal("Stopping at block %u\n", blockcur);
+			task->state = TASK_STATE_ERROR;
+			return;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	ret = handle_open(handle, task->file, state->file_mode, log_error, 0);
+	if (ret == -1) {
+		if (errno == EIO) {
+			/* LCOV_EXCL_START */
+			log_tag("error:%u:%s:%s: Open EIO error. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), strerror(errno));
+			log_fatal("DANGER! Unexpected input/output open error in a data disk, it isn't possible to sync.\n");
+			log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
+			log_fatal("Stopping at block %u\n", blockcur);
+			task->state = TASK_STATE_IOERROR;
+			return;
+			/* LCOV_EXCL_STOP */
+		}
+
+		if (errno == ENOENT) {
+			log_tag("error:%u:%s:%s: Open ENOENT error. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), strerror(errno));
+			log_error("Missing file '%s'.\n", handle->path);
+			log_error("WARNING! You cannot modify data disk during a sync.\n");
+			log_error("Rerun the sync command when finished.\n");
+			/* if the file is missing, it means that it was removed during sync */
+			/* this isn't a serious error, so we skip this block, and continue with others */
+			task->state = TASK_STATE_ERROR_CONTINUE;
+			return;
+		}
+
+		if (errno == EACCES) {
+			log_tag("error:%u:%s:%s: Open EACCES error. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), strerror(errno));
+			log_error("No access at file '%s'.\n", handle->path);
+			log_error("WARNING! Please fix the access permission in the data disk.\n");
+			log_error("Rerun the sync command when finished.\n");
+			/* this isn't a serious error, so we skip this block, and continue with others */
+			task->state = TASK_STATE_ERROR_CONTINUE;
+			return;
+		}
+
+		/* LCOV_EXCL_START */
+		log_tag("error:%u:%s:%s: Open error. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), strerror(errno));
+		log_fatal("WARNING! Unexpected open error in a data disk, it isn't possible to sync.\n");
+		log_fatal("Ensure that file '%s' can be accessed.\n", handle->path);
+		log_fatal("Stopping to allow recovery. Try with 'snapraid check -f %s'\n", quote('/', file_sub(task->file, sub_buffer), quote_buffer));
+		task->state = TASK_STATE_ERROR;
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* check if the file is changed */
+	if (handle->st.st_size != task->file->size
+		|| handle->st.st_mtime != task->file->mtime_sec
+		|| STAT_NSEC(&handle->st) != task->file->mtime_nsec
+		|| handle->st.st_ino != task->file->inode
+	) {
+		log_tag("error:%u:%s:%s: Unexpected attribute change\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer));
+		if (handle->st.st_size != task->file->size) {
+			log_error("Unexpected size change at file '%s' from %" PRIu64 " to %" PRIu64 ".\n", handle->path, task->file->size, handle->st.st_size);
+		} else if (handle->st.st_mtime != task->file->mtime_sec
+			|| STAT_NSEC(&handle->st) != task->file->mtime_nsec) {
+			log_error("Unexpected time change at file '%s' from %" PRIu64 ".%d to %" PRIu64 ".%d.\n", handle->path, task->file->mtime_sec, task->file->mtime_nsec, (uint64_t)handle->st.st_mtime, (uint32_t)STAT_NSEC(&handle->st));
+		} else {
+			log_error("Unexpected inode change from %" PRIu64 " to %" PRIu64 " at file '%s'.\n", task->file->inode, (uint64_t)handle->st.st_ino, handle->path);
+		}
+		log_error("WARNING! You cannot modify files during a sync.\n");
+		log_error("Rerun the sync command when finished.\n");
+		/* if the file is changed, it means that it was modified during sync */
+		/* this isn't a serious error, so we skip this block, and continue with others */
+		task->state = TASK_STATE_ERROR_CONTINUE;
+		return;
+	}
+
+	/* read the block, the hash is computed at completion */
+	io_task_handle_read(worker, task, log_fatal, 0, hash_data_reader_done);
+}
+
 static int state_hash_process(struct snapraid_state* state, block_off_t blockstart, block_off_t blockmax, int* skip_sync)
 {
+	struct snapraid_io io;
+	struct snapraid_hash_plan plan;
 	struct snapraid_handle* handle;
 	unsigned diskmax;
-	block_off_t i;
+	block_off_t blockcur;
 	unsigned j;
-	void* buffer;
 	data_off_t countsize;
 	block_off_t countpos;
 	block_off_t countmax;
@@ -42,16 +265,23 @@ static int state_hash_process(struct snapraid_state* state, block_off_t blocksta
 	unsigned error;
 	unsigned silent_error;
 	unsigned io_error;
+	unsigned* waiting_map;
+	unsigned waiting_mac;
 	char esc_buffer[ESC_MAX];
-	char quote_buffer[QUOTE_MAX];
+	char sub_buffer[PATH_MAX];
 
 	/* maps the disks to handles */
 	handle = handle_mapping(state, &diskmax);
 
-	/* buffer for reading */
-	buffer = malloc_nofail(state->block_size);
-	if (!state->opt.skip_self)
-		mtest_vector(1, state->block_size, &buffer);
+	/* initialize the io threads, reading and hashing all the disks concurrently */
+	io_init(&io, state, state->opt.io_cache, diskmax, hash_data_reader, handle, diskmax, 0, 0, 0, 0);
+
+	/* possibly waiting disks */
+	waiting_mac = diskmax;
+	waiting_map = malloc_nofail(waiting_mac * sizeof(unsigned));
+
+	plan.handle_max = diskmax;
+	plan.handle_map = handle;
 
 	error = 0;
 	silent_error = 0;
@@ -66,17 +296,8 @@ static int state_hash_process(struct snapraid_state* state, block_off_t blocksta
 		if (!disk)
 			continue;
 
-		for (i = blockstart; i < blockmax; ++i) {
-			struct snapraid_block* block;
-			unsigned block_state;
-
-			block = fs_par2block_find(disk, i);
-
-			/* get the state of the block */
-			block_state = block_state_get(block);
-
-			/* process REP and CHG blocks */
-			if (block_state != BLOCK_STATE_REP && block_state != BLOCK_STATE_CHG)
+		for (blockcur = blockstart; blockcur < blockmax; ++blockcur) {
+			if (!block_is_hashable(fs_par2block_find(disk, blockcur)))
 				continue;
 
 			++countmax;
@@ -88,183 +309,85 @@ static int state_hash_process(struct snapraid_state* state, block_off_t blocksta
 
 	countsize = 0;
 	countpos = 0;
+	blockcur = blockstart;
+
+	/* start all the worker threads */
+	io_start(&io, blockstart, blockmax, &hash_block_is_enabled, &plan);
+
 	if (!state_progress_begin(state, blockstart, blockmax, countmax))
 		goto end;
 
-	for (j = 0; j < diskmax; ++j) {
-		struct snapraid_disk* disk = handle[j].disk;
+	while (1) {
+		void** buffer;
 
-		/* if no disk, nothing to check */
-		if (!disk)
-			continue;
+		/* go to the next block */
+		blockcur = io_read_next(&io, &buffer);
+		if (blockcur >= blockmax)
+			break;
 
-		for (i = blockstart; i < blockmax; ++i) {
-			snapraid_info info;
-			int rehash;
+		/* until now is scheduling */
+		state_usage_sched(state);
+
+		/* for each disk, process the block */
+		for (j = 0; j < diskmax; ++j) {
+			struct snapraid_task* task;
 			struct snapraid_block* block;
-			int read_size;
-			unsigned char hash[HASH_MAX];
-			unsigned block_state;
+			struct snapraid_disk* disk;
 			struct snapraid_file* file;
 			block_off_t file_pos;
-
-			block = fs_par2block_find(disk, i);
-
-			/* get the state of the block */
-			block_state = block_state_get(block);
-
-			/* process REP and CHG blocks */
-			if (block_state != BLOCK_STATE_REP && block_state != BLOCK_STATE_CHG)
-				continue;
-
-			/* get the file of this block */
-			file = fs_par2file_get(disk, i, &file_pos);
-
-			/* get block specific info */
-			info = info_get(&state->infoarr, i);
-
-			/* if we have to use the old hash */
-			rehash = info_get_rehash(info);
+			unsigned block_state;
+			unsigned diskcur;
 
 			/* until now is misc */
 			state_usage_misc(state);
 
-			/* if the file is different than the current one, close it */
-			if (handle[j].file != 0 && handle[j].file != file) {
-				/* keep a pointer at the file we are going to close for error reporting */
-				struct snapraid_file* report = handle[j].file;
-				ret = handle_close(&handle[j]);
-				if (ret == -1) {
-					/* LCOV_EXCL_START */
-					/* This one is really an unexpected error, because we are only reading */
-					/* and closing a descriptor should never fail */
-					if (errno == EIO) {
-						log_tag("error:%u:%s:%s: Close EIO error. %s\n", i, disk->name, esc(report->sub, esc_buffer), strerror(errno));
-						log_fatal("DANGER! Unexpected input/output close error in a data disk, it isn't possible to sync.\n");
-						log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle[j].path);
-						log_fatal("Stopping at block %u\n", i);
-						++io_error;
-						goto bail;
-					}
-
-					log_tag("error:%u:%s:%s: Close error. %s\n", i, disk->name, esc(report->sub, esc_buffer), strerror(errno));
-					log_fatal("WARNING! Unexpected close error in a data disk, it isn't possible to sync.\n");
-					log_fatal("Ensure that file '%s' can be accessed.\n", handle[j].path);
-					log_fatal("Stopping at block %u\n", i);
-					++error;
-					goto bail;
-					/* LCOV_EXCL_STOP */
-				}
-			}
+			task = io_data_read(&io, &diskcur, waiting_map, &waiting_mac);
 
-			ret = handle_open(&handle[j], file, state->file_mode, log_error, 0);
-			if (ret == -1) {
-				if (errno == EIO) {
-					/* LCOV_EXCL_START */
-					log_tag("error:%u:%s:%s: Open EIO error. %s\n", i, disk->name, esc(file->sub, esc_buffer), strerror(errno));
-					log_fatal("DANGER! Unexpected input/output open error in a data disk, it isn't possible to sync.\n");
-					log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle[j].path);
-					log_fatal("Stopping at block %u\n", i);
-					++io_error;
-					goto bail;
-					/* LCOV_EXCL_STOP */
-				}
+			/* until now is disk */
+			state_usage_disk(state, handle, waiting_map, waiting_mac);
 
-				if (errno == ENOENT) {
-					log_tag("error:%u:%s:%s: Open ENOENT error. %s\n", i, disk->name, esc(file->sub, esc_buffer), strerror(errno));
-					log_error("Missing file '%s'.\n", handle[j].path);
-					log_error("WARNING! You cannot modify data disk during a sync.\n");
-					log_error("Rerun the sync command when finished.\n");
-					++error;
-					/* if the file is missing, it means that it was removed during sync */
-					/* this isn't a serious error, so we skip this block, and continue with others */
-					continue;
-				}
+			/* nothing to hash */
+			if (task->state == TASK_STATE_EMPTY)
+				continue;
 
-				if (errno == EACCES) {
-					log_tag("error:%u:%s:%s: Open EACCES error. %s\n", i, disk->name, esc(file->sub, esc_buffer), strerror(errno));
-					log_error("No access at file '%s'.\n", handle[j].path);
-					log_error("WARNING! Please fix the access permission in the data disk.\n");
-					log_error("Rerun the sync command when finished.\n");
-					++error;
-					/* this isn't a serious error, so we skip this block, and continue with others */
-					continue;
-				}
+			/* get the results */
+			disk = task->disk;
+			block = task->block;
+			file = task->file;
+			file_pos = task->file_pos;
 
-				/* LCOV_EXCL_START */
-				log_tag("error:%u:%s:%s: Open error. %s\n", i, disk->name, esc(file->sub, esc_buffer), strerror(errno));
-				log_fatal("WARNING! Unexpected open error in a data disk, it isn't possible to sync.\n");
-				log_fatal("Ensure that file '%s' can be accessed.\n", handle[j].path);
-				log_fatal("Stopping to allow recovery. Try with 'snapraid check -f %s'\n", quote('/', file->sub, quote_buffer));
+			/* handle error conditions */
+			if (task->state == TASK_STATE_IOERROR) {
+				++io_error;
+				goto bail;
+			}
+			if (task->state == TASK_STATE_ERROR) {
 				++error;
 				goto bail;
-				/* LCOV_EXCL_STOP */
 			}
-
-			/* check if the file is changed */
-			if (handle[j].st.st_size != file->size
-				|| handle[j].st.st_mtime != file->mtime_sec
-				|| STAT_NSEC(&handle[j].st) != file->mtime_nsec
-				|| handle[j].st.st_ino != file->inode
-			) {
-				log_tag("error:%u:%s:%s: Unexpected attribute change\n", i, disk->name, esc(file->sub, esc_buffer));
-				if (handle[j].st.st_size != file->size) {
-					log_error("Unexpected size change at file '%s' from %" PRIu64 " to %" PRIu64 ".\n", handle[j].path, file->size, handle[j].st.st_size);
-				} else if (handle[j].st.st_mtime != file->mtime_sec
-					|| STAT_NSEC(&handle[j].st) != file->mtime_nsec) {
-					log_error("Unexpected time change at file '%s' from %" PRIu64 ".%d to %" PRIu64 ".%d.\n", handle[j].path, file->mtime_sec, file->mtime_nsec, (uint64_t)handle[j].st.st_mtime, (uint32_t)STAT_NSEC(&handle[j].st));
-				} else {
-					log_error("Unexpected inode change from %" PRIu64 " to %" PRIu64 " at file '%s'.\n", file->inode, (uint64_t)handle[j].st.st_ino, handle[j].path);
-				}
-				log_error("WARNING! You cannot modify files during a sync.\n");
-				log_error("Rerun the sync command when finished.\n");
+			if (task->state == TASK_STATE_ERROR_CONTINUE) {
 				++error;
-				/* if the file is changed, it means that it was modified during sync */
-				/* this isn't a serious error, so we skip this block, and continue with others */
 				continue;
 			}
-
-			read_size = handle_read(&handle[j], file_pos, buffer, state->block_size, log_fatal, 0);
-			if (read_size == -1) {
+			if (task->state != TASK_STATE_DONE) {
 				/* LCOV_EXCL_START */
-				if (errno == EIO) {
-					log_tag("error:%u:%s:%s: Read EIO error at position %u. %s\n", i, disk->name, esc(file->sub, esc_buffer), file_pos, strerror(errno));
-					log_fatal("DANGER! Unexpected input/output read error in a data disk, it isn't possible to sync.\n");
-					log_fatal("Ensure that disk '%s' is sane and that file '%s' can be read.\n", disk->dir, handle[j].path);
-					log_fatal("Stopping at block %u\n", i);
-					++io_error;
-					goto bail;
-				}
-
-				log_tag("error:%u:%s:%s: Read error at position %u. %s\n", i, disk->name, esc(file->sub, esc_buffer), file_pos, strerror(errno));
-				log_fatal("WARNING! Unexpected read error in a data disk, it isn't possible to sync.\n");
-				log_fatal("Ensure that file '%s' can be read.\n", handle[j].path);
-				log_fatal("Stopping to allow recovery. Try with 'snapraid check -f %s'\n", quote('/', file->sub, quote_buffer));
-				++error;
-				goto bail;
+				log_fatal("Internal inconsistency in task state\n");
+				os_abort();
 				/* LCOV_EXCL_STOP */
 			}
 
-			/* until now is disk */
-			state_usage_disk(state, handle, &j, 1);
+			countsize += task->read_size;
 
-			countsize += read_size;
+			/* the hash is already computed by the worker thread */
 
-			/* now compute the hash */
-			if (rehash) {
-				memhash(state->prevhash, state->prevhashseed, hash, buffer, read_size);
-			} else {
-				memhash(state->hash, state->hashseed, hash, buffer, read_size);
-			}
-
-			/* until now is hash */
-			state_usage_hash(state);
+			/* get the state of the block */
+			block_state = block_state_get(block);
 
 			if (block_state == BLOCK_STATE_REP) {
 				/* compare the hash */
-				if (memcmp(hash, block->hash, BLOCK_HASH_SIZE) != 0) {
-					log_tag("error:%u:%s:%s: Unexpected data change\n", i, disk->name, esc(file->sub, esc_buffer));
-					log_error("Data change at file '%s' at position '%u'\n", handle[j].path, file_pos);
+				if (memcmp(task->hash, block->hash, BLOCK_HASH_SIZE) != 0) {
+					log_tag("error:%u:%s:%s: Unexpected data change\n", blockcur, disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
+					log_error("Data change at file '%s' at position '%u'\n", task->path, file_pos);
 					log_error("WARNING! Unexpected data modification of a file without parity!\n");
 
 					if (file_flag_has(file, FILE_IS_COPY)) {
@@ -288,7 +411,7 @@ static int state_hash_process(struct snapraid_state* state, block_off_t blocksta
 				assert(block_state == BLOCK_STATE_CHG);
 
 				/* copy the hash in the block */
-				memcpy(block->hash, hash, BLOCK_HASH_SIZE);
+				memcpy(block->hash, task->hash, BLOCK_HASH_SIZE);
 
 				/* and mark the block as hashed */
 				block_state_set(block, BLOCK_STATE_REP);
@@ -299,51 +422,56 @@ static int state_hash_process(struct snapraid_state* state, block_off_t blocksta
 
 			/* count the number of processed block */
 			++countpos;
-
-			/* progress */
-			if (state_progress(state, 0, i, countpos, countmax, countsize)) {
-				/* LCOV_EXCL_START */
-				*skip_sync = 1; /* avoid to run the next sync */
-				break;
-				/* LCOV_EXCL_STOP */
-			}
 		}
 
-		/* close the last file in the disk */
-		if (handle[j].file != 0) {
-			/* keep a pointer at the file we are going to close for error reporting */
-			struct snapraid_file* report = handle[j].file;
-			ret = handle_close(&handle[j]);
-			if (ret == -1) {
-				/* LCOV_EXCL_START */
-				/* This one is really an unexpected error, because we are only reading */
-				/* and closing a descriptor should never fail */
-				if (errno == EIO) {
-					log_tag("error:%u:%s:%s: Close EIO error. %s\n", blockmax, disk->name, esc(report->sub, esc_buffer), strerror(errno));
-					log_fatal("DANGER! Unexpected input/output close error in a data disk, it isn't possible to sync.\n");
-					log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle[j].path);
-					log_fatal("Stopping at block %u\n", blockmax);
-					++io_error;
-					goto bail;
-				}
-
-				log_tag("error:%u:%s:%s: Close error. %s\n", blockmax, disk->name, esc(report->sub, esc_buffer), strerror(errno));
-				log_fatal("WARNING! Unexpected close error in a data disk, it isn't possible to sync.\n");
-				log_fatal("Ensure that file '%s' can be accessed.\n", handle[j].path);
-				log_fatal("Stopping at block %u\n", blockmax);
-				++error;
-				goto bail;
-				/* LCOV_EXCL_STOP */
-			}
+		/* progress */
+		if (state_progress(state, &io, blockcur, countpos, countmax, countsize)) {
+			/* LCOV_EXCL_START */
+			*skip_sync = 1; /* avoid to run the next sync */
+			break;
+			/* LCOV_EXCL_STOP */
 		}
 	}
 
 end:
 	state_progress_end(state, countpos, countmax, countsize);
 
-	/* note that at this point no io_error is possible */
-	/* becasue at the first one we bail out */
-	assert(io_error == 0);
+	/* stop all the worker threads */
+	io_stop(&io);
+
+	/* close the last file in each disk */
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_file* report = handle[j].file;
+		struct snapraid_disk* disk = handle[j].disk;
+
+		if (report == 0)
+			continue;
+
+		ret = handle_close(&handle[j]);
+		if (ret == -1) {
+			/* LCOV_EXCL_START */
+			/* This one is really an unexpected error, because we are only reading */
+			/* and closing a descriptor should never fail */
+			if (errno == EIO) {
+				log_tag("error:%u:%s:%s: Close EIO error. %s\n", blockmax, disk->name, esc(file_sub(report, sub_buffer), esc_buffer), strerror(errno));
+				log_fatal("DANGER! Unexpected input/output close error in a data disk, it isn't possible to sync.\n");
+				log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle[j].path);
+				log_fatal("Stopping at block %u\n", blockmax);
+				++io_error;
+				*skip_sync = 1; /* avoid to run the next sync */
+				continue;
+			}
+
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockmax, disk->name, esc(file_sub(report, sub_buffer), esc_buffer), strerror(errno));
+			log_fatal("WARNING! Unexpected close error in a data disk, it isn't possible to sync.\n");
+			log_fatal("Ensure that file '%s' can be accessed.\n", handle[j].path);
+			log_fatal("Stopping at block %u\n", blockmax);
+			++error;
+			*skip_sync = 1; /* avoid to run the next sync */
+			continue;
+			/* LCOV_EXCL_STOP */
+		}
+	}
 
 	if (error || io_error || silent_error) {
 		msg_status("\n");
@@ -368,13 +496,16 @@ bail:
 	/* on bail, don't run the next sync */
 	*skip_sync = 1;
 
+	/* stop all the worker threads */
+	io_stop(&io);
+
 	/* close files left open */
 	for (j = 0; j < diskmax; ++j) {
 		struct snapraid_file* file = handle[j].file;
 		struct snapraid_disk* disk = handle[j].disk;
 		ret = handle_close(&handle[j]);
 		if (ret == -1) {
-			log_tag("error:%u:%s:%s: Close error. %s\n", i, disk->name, esc(file->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(file_sub(file, sub_buffer), esc_buffer), strerror(errno));
 			log_fatal("DANGER! Unexpected close error in a data disk.\n");
 			++error;
 			/* continue, as we are already exiting */
@@ -383,7 +514,8 @@ bail:
 
 finish:
 	free(handle);
-	free(buffer);
+	free(waiting_map);
+	io_done(&io);
 
 	if (error + io_error + silent_error != 0)
 		return -1;
@@ -471,7 +603,10 @@ static int block_is_enabled(void* void_plan, block_off_t i)
 	return 1;
 }
 
-static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_task* task)
+/**
+ * Continuation of sync_data_reader() after the read of the block.
+ */
+static void sync_data_reader_done(struct snapraid_worker* worker, struct snapraid_task* task, int ret)
 {
 	struct snapraid_io* io = worker->io;
 	struct snapraid_state* state = io->state;
@@ -479,15 +614,64 @@ static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_tas
 	struct snapraid_disk* disk = handle->disk;
 	block_off_t blockcur = task->position;
 	unsigned char* buffer = task->buffer;
+	uint64_t tick_hash;
+	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
+	char quote_buffer[QUOTE_MAX];
+
+	task->read_size = ret;
+	if (task->read_size == -1) {
+		/* LCOV_EXCL_START */
+		if (errno == EIO) {
+			log_tag("error:%u:%s:%s: Read EIO error at position %u. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), task->file_pos, strerror(errno));
+			log_error("Input/Output error in file '%s' at position '%u'\n", handle->path, task->file_pos);
+			task->state = TASK_STATE_IOERROR_CONTINUE;
+			return;
+		}
+
+		log_tag("error:%u:%s:%s: Read error at position %u. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), task->file_pos, strerror(errno));
+		log_fatal("WARNING! Unexpected read error in a data disk, it isn't possible to sync.\n");
+		log_fatal("Ensure that file '%s' can be read.\n", handle->path);
+		log_fatal("Stopping to allow recovery. Try with 'snapraid check -f %s'\n", quote('/', file_sub(task->file, sub_buffer), quote_buffer));
+		task->state = TASK_STATE_ERROR;
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* compute the hash in the worker thread, to scale with the number of disks */
+	tick_hash = tick();
+	if (info_get_rehash(info_get(&state->infoarr, blockcur))) {
+		memhash(state->prevhash, state->prevhashseed, task->hash, buffer, task->read_size);
+
+		/* compute also the new hash */
+		memhash(state->hash, state->hashseed, task->rehash, buffer, task->read_size);
+	} else {
+		memhash(state->hash, state->hashseed, task->hash, buffer, task->read_size);
+	}
+	task->tick_hash = tick() - tick_hash;
+
+	/* store the path of the opened file */
+	pathcpy(task->path, sizeof(task->path), handle->path);
+
+	task->state = TASK_STATE_DONE;
+}
+
+static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	struct snapraid_io* io = worker->io;
+	struct snapraid_state* state = io->state;
+	struct snapraid_handle* handle = worker->handle;
+	struct snapraid_disk* disk = handle->disk;
+	block_off_t blockcur = task->position;
 	int ret;
 	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
 	char quote_buffer[QUOTE_MAX];
 
 	/* if the disk position is not used */
 	if (!disk) {
-		/* use an empty block */
-		memset(buffer, 0, state->block_size);
-		task->state = TASK_STATE_DONE;
+		/* report an empty block, without clearing the buffer */
+		task->state = TASK_STATE_EMPTY;
 		return;
 	}
 
@@ -497,9 +681,8 @@ static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_tas
 	/* if the block has no file, meanining that it's EMPTY or DELETED, */
 	/* it doesn't partecipate in the new parity computation */
 	if (!block_has_file(task->block)) {
-		/* use an empty block */
-		memset(buffer, 0, state->block_size);
-		task->state = TASK_STATE_DONE;
+		/* report an empty block, without clearing the buffer */
+		task->state = TASK_STATE_EMPTY;
 		return;
 	}
 
@@ -516,7 +699,7 @@ static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_tas
 			/* This one is really an unexpected error, because we are only reading */
 			/* and closing a descriptor should never fail */
 			if (errno == EIO) {
-				log_tag("error:%u:%s:%s: Close EIO error. %s\n", blockcur, disk->name, esc(report->sub, esc_buffer), strerror(errno));
+				log_tag("error:%u:%s:%s: Close EIO error. %s\n", blockcur, disk->name, esc(file_sub(report, sub_buffer), esc_buffer), strerror(errno));
 				log_fatal("DANGER! Unexpected input/output close error in a data disk, it isn't possible to sync.\n");
 				log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
 				log_fatal("Stopping at block %u\n", blockcur);
@@ -524,7 +707,7 @@ static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_tas
 				return;
 			}
 
-			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(report->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(file_sub(report, sub_buffer), esc_buffer), strerror(errno));
 			log_fatal("WARNING! Unexpected close error in a data disk, it isn't possible to sync.\n");
 			log_fatal("Ensure that file '%s' can be accessed.\n", handle->path);
 			log_fatal("Stopping at block %u\n", blockcur);
@@ -538,7 +721,7 @@ static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_tas
 	if (ret == -1) {
 		if (errno == EIO) {
 			/* LCOV_EXCL_START */
-			log_tag("error:%u:%s:%s: Open EIO error. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Open EIO error. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), strerror(errno));
 			log_fatal("DANGER! Unexpected input/output open error in a data disk, it isn't possible to sync.\n");
 			log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
 			log_fatal("Stopping at block %u\n", blockcur);
@@ -548,7 +731,7 @@ static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_tas
 		}
 
 		if (errno == ENOENT) {
-			log_tag("error:%u:%s:%s: Open ENOENT error. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Open ENOENT error. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), strerror(errno));
 			log_error("Missing file '%s'.\n", handle->path);
 			log_error("WARNING! You cannot modify data disk during a sync.\n");
 			log_error("Rerun the sync command when finished.\n");
@@ -559,7 +742,7 @@ static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_tas
 		}
 
 		if (errno == EACCES) {
-			log_tag("error:%u:%s:%s: Open EACCES error. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Open EACCES error. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), strerror(errno));
 			log_error("No access at file '%s'.\n", handle->path);
 			log_error("WARNING! Please fix the access permission in the data disk.\n");
 			log_error("Rerun the sync command when finished.\n");
@@ -569,10 +752,10 @@ static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_tas
 		}
 
 		/* LCOV_EXCL_START */
-		log_tag("error:%u:%s:%s: Open error. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), strerror(errno));
+		log_tag("error:%u:%s:%s: Open error. %s\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer), strerror(errno));
 		log_fatal("WARNING! Unexpected open error in a data disk, it isn't possible to sync.\n");
 		log_fatal("Ensure that file '%s' can be accessed.\n", handle->path);
-		log_fatal("Stopping to allow recovery. Try with 'snapraid check -f %s'\n", quote('/', task->file->sub, quote_buffer));
+		log_fatal("Stopping to allow recovery. Try with 'snapraid check -f %s'\n", quote('/', file_sub(task->file, sub_buffer), quote_buffer));
 		task->state = TASK_STATE_ERROR;
 		return;
 		/* LCOV_EXCL_STOP */
@@ -584,7 +767,7 @@ static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_tas
 		|| STAT_NSEC(&handle->st) != task->file->mtime_nsec
 		|| handle->st.st_ino != task->file->inode
 	) {
-		log_tag("error:%u:%s:%s: Unexpected attribute change\n", blockcur, disk->name, esc(task->file->sub, esc_buffer));
+		log_tag("error:%u:%s:%s: Unexpected attribute change\n", blockcur, disk->name, esc(file_sub(task->file, sub_buffer), esc_buffer));
 		if (handle->st.st_size != task->file->size) {
 			log_error("Unexpected size change at file '%s' from %" PRIu64 " to %" PRIu64 ".\n", handle->path, task->file->size, handle->st.st_size);
 		} else if (handle->st.st_mtime != task->file->mtime_sec
@@ -601,43 +784,19 @@ static void sync_data_reader(struct snapraid_worker* worker, struct snapraid_tas
 		return;
 	}
 
-	task->read_size = handle_read(handle, task->file_pos, buffer, state->block_size, log_error, 0);
-	if (task->read_size == -1) {
-		/* LCOV_EXCL_START */
-		if (errno == EIO) {
-			log_tag("error:%u:%s:%s: Read EIO error at position %u. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), task->file_pos, strerror(errno));
-			log_error("Input/Output error in file '%s' at position '%u'\n", handle->path, task->file_pos);
-			task->state = TASK_STATE_IOERROR_CONTINUE;
-			return;
-		}
-
-		log_tag("error:%u:%s:%s: Read error at position %u. %s\n", blockcur, disk->name, esc(task->file->sub, esc_buffer), task->file_pos, strerror(errno));
-		log_fatal("WARNING! Unexpected read error in a data disk, it isn't possible to sync.\n");
-		log_fatal("Ensure that file '%s' can be read.\n", handle->path);
-		log_fatal("Stopping to allow recovery. Try with 'snapraid check -f %s'\n", quote('/', task->file->sub, quote_buffer));
-		task->state = TASK_STATE_ERROR;
-		return;
-		/* LCOV_EXCL_STOP */
-	}
-
-	/* store the path of the opened file */
-	pathcpy(task->path, sizeof(task->path), handle->path);
-
-	task->state = TASK_STATE_DONE;
+	/* read the block, the hash is computed at completion */
+	io_task_handle_read(worker, task, log_error, 0, sync_data_reader_done);
 }
 
-static void sync_parity_writer(struct snapraid_worker* worker, struct snapraid_task* task)
+/**
+ * Continuation of sync_parity_writer() after the write of the block.
+ */
+static void sync_parity_writer_done(struct snapraid_worker* worker, struct snapraid_task* task, int ret)
 {
-	struct snapraid_io* io = worker->io;
-	struct snapraid_state* state = io->state;
 	struct snapraid_parity_handle* parity_handle = worker->parity_handle;
 	unsigned level = parity_handle->level;
 	block_off_t blockcur = task->position;
-	unsigned char* buffer = task->buffer;
-	int ret;
 
-	/* write parity */
-	ret = parity_write(parity_handle, blockcur, buffer, state->block_size);
 	if (ret == -1) {
 		/* LCOV_EXCL_START */
 		if (errno == EIO) {
@@ -659,9 +818,16 @@ static void sync_parity_writer(struct snapraid_worker* worker, struct snapraid_t
 	task->state = TASK_STATE_DONE;
 }
 
+static void sync_parity_writer(struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	/* write parity */
+	io_task_parity_write(worker, task, sync_parity_writer_done);
+}
+
 static int state_sync_process(struct snapraid_state* state, struct snapraid_parity_handle* parity_handle, block_off_t blockstart, block_off_t blockmax)
 {
 	struct snapraid_io io;
+	struct snapraid_gen gen;
 	struct snapraid_plan plan;
 	struct snapraid_handle* handle;
 	void* rehandle_alloc;
@@ -687,10 +853,12 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 	time_t now;
 	struct failed_struct* failed;
 	int* failed_map;
+	unsigned char* present;
 	unsigned l;
 	unsigned* waiting_map;
 	unsigned waiting_mac;
 	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
 
 	/* the sync process assumes that all the hashes are correct */
 	/* including the ones from CHG and DELETED blocks */
@@ -711,6 +879,17 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 	/* initialize the io threads */
 	io_init(&io, state, state->opt.io_cache, buffermax, sync_data_reader, handle, diskmax, 0, sync_parity_writer, parity_handle, state->level);
 
+	/* initialize the parity threads */
+	gen_init(&gen, diskmax, state->level, state->block_size, state->opt.raid_thread);
+	log_tag("raid:thread:%u\n", gen.thread_max);
+
+	/* the disks with deleted blocks are changed with fs_deallocate() */
+	/* while the worker threads are running, so they cannot use the chunk index */
+	for (j = 0; j < diskmax; ++j) {
+		if (handle[j].disk && !tommy_list_empty(&handle[j].disk->deletedlist))
+			fs_index_drop(handle[j].disk);
+	}
+
 	/* allocate the copy buffer */
 	copy = malloc_nofail_vector_align(diskmax, diskmax, state->block_size, &copy_alloc);
 
@@ -722,6 +901,9 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 	failed = malloc_nofail(diskmax * sizeof(struct failed_struct));
 	failed_map = malloc_nofail(diskmax * sizeof(unsigned));
 
+	/* data blocks present in the stripe */
+	present = malloc_nofail(diskmax);
+
 	/* possibly waiting disks */
 	waiting_mac = diskmax > RAID_PARITY_MAX ? diskmax : RAID_PARITY_MAX;
 	waiting_map = malloc_nofail(waiting_mac * sizeof(unsigned));
@@ -753,6 +935,10 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 	countsize = 0;
 	countpos = 0;
 
+	/* preallocate the info array, as it's read by the worker threads */
+	/* and it must not be reallocated by info_set() while they run */
+	tommy_arrayblkof_grow(&state->infoarr, blockmax);
+
 	/* start all the worker threads */
 	io_start(&io, blockstart, blockmax, &block_is_enabled, &plan);
 
@@ -820,7 +1006,7 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 		for (j = 0; j < diskmax; ++j) {
 			struct snapraid_task* task;
 			int read_size;
-			unsigned char hash[HASH_MAX];
+			unsigned char* hash;
 			struct snapraid_block* block;
 			unsigned block_state;
 			struct snapraid_disk* disk;
@@ -846,6 +1032,9 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 			/* by default no rehash in case of "continue" */
 			rehandle[diskcur].block = 0;
 
+			/* the empty blocks are not read, and their buffer is not cleared */
+			present[diskcur] = task->state != TASK_STATE_EMPTY;
+
 			/* if the disk position is not used */
 			if (!disk)
 				continue;
@@ -917,26 +1106,22 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 
 			countsize += read_size;
 
-			/* now compute the hash */
-			if (rehash) {
-				memhash(state->prevhash, state->prevhashseed, hash, buffer[diskcur], read_size);
+			/* the hash is already computed by the worker thread */
+			hash = task->hash;
+			state_usage_hash_worker(state, task->tick_hash);
 
-				/* compute the new hash, and store it */
+			/* store the new hash */
+			if (rehash) {
 				rehandle[diskcur].block = block;
-				memhash(state->hash, state->hashseed, rehandle[diskcur].hash, buffer[diskcur], read_size);
-			} else {
-				memhash(state->hash, state->hashseed, hash, buffer[diskcur], read_size);
+				memcpy(rehandle[diskcur].hash, task->rehash, BLOCK_HASH_SIZE);
 			}
 
-			/* until now is hash */
-			state_usage_hash(state);
-
 			if (block_has_updated_hash(block)) {
 				/* compare the hash */
 				if (memcmp(hash, block->hash, BLOCK_HASH_SIZE) != 0) {
 					/* if the file has invalid parity, it's a REP changed during the sync */
 					if (block_has_invalid_parity(block)) {
-						log_tag("error:%u:%s:%s: Unexpected data change\n", blockcur, disk->name, esc(file->sub, esc_buffer));
+						log_tag("error:%u:%s:%s: Unexpected data change\n", blockcur, disk->name, esc(file_sub(file, sub_buffer), esc_buffer));
 						log_error("Data change at file '%s' at position '%u'\n", task->path, file_pos);
 						log_error("WARNING! Unexpected data modification of a file without parity!\n");
 
@@ -957,7 +1142,7 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 						continue;
 					} else { /* otherwise it's a BLK with silent error */
 						unsigned diff = memdiff(hash, block->hash, BLOCK_HASH_SIZE);
-						log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u\n", blockcur, disk->name, esc(file->sub, esc_buffer), file_pos, diff);
+						log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u\n", blockcur, disk->name, esc(file_sub(file, sub_buffer), esc_buffer), file_pos, diff);
 						log_error("Data error in file '%s' at position '%u', diff bits %u\n", task->path, file_pos, diff);
 
 						/* save the failed block for the fix */
@@ -1011,6 +1196,14 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 			unsigned failed_mac;
 			int something_to_recover = 0;
 
+			/* the recovering uses all the blocks, so clear the empty ones */
+			for (j = 0; j < diskmax; ++j) {
+				if (!present[j]) {
+					memset(buffer[j], 0, state->block_size);
+					present[j] = 1;
+				}
+			}
+
 			/* sort the failed vector */
 			/* because with threads it may be in any order */
 			/* but RAID requires the indexes to be sorted */
@@ -1150,7 +1343,7 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 			/* update the parity only if really needed */
 			if (parity_needs_to_be_updated) {
 				/* compute the parity */
-				raid_gen(diskmax, state->level, state->block_size, buffer);
+				gen_parity_sparse(&gen, state->block_size, buffer, present);
 
 				/* until now is raid */
 				state_usage_raid(state);
@@ -1379,7 +1572,7 @@ bail:
 		ret = handle_close(&handle[j]);
 		if (ret == -1) {
 			/* LCOV_EXCL_START */
-			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(file->sub, esc_buffer), strerror(errno));
+			log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc(file_sub(file, sub_buffer), esc_buffer), strerror(errno));
 			log_fatal("DANGER! Unexpected close error in a data disk.\n");
 			++error;
 			/* continue, as we are already exiting */
@@ -1394,7 +1587,9 @@ bail:
 	free(rehandle_alloc);
 	free(failed);
 	free(failed_map);
+	free(present);
 	free(waiting_map);
+	gen_done(&gen);
 	io_done(&io);
 
 	if (state->opt.expect_recoverable) {
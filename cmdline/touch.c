@@ -26,6 +26,7 @@ void state_touch(struct snapraid_state* state)
 {
 	tommy_node* i;
 	char esc_buffer[ESC_MAX];
+	char sub_buffer[PATH_MAX];
 
 	msg_progress("Setting sub-second timestamps...\n");
 
@@ -49,7 +50,7 @@ void state_touch(struct snapraid_state* state)
 				int nsec;
 				int flags;
 
-				pathprint(path, sizeof(path), "%s%s", disk->dir, file->sub);
+				pathprint(path, sizeof(path), "%s%s", disk->dir, file_sub(file, sub_buffer));
 
 				/* set a new nanosecond timestamp different than 0 */
 				do {
@@ -137,8 +138,8 @@ void state_touch(struct snapraid_state* state)
 				/* state changed, we need to update it */
 				state->need_write = 1;
 
-				log_tag("touch:%s:%s: %" PRIu64 ".%d\n", disk->name, esc(file->sub, esc_buffer), (uint64_t)st.st_mtime, (int)STAT_NSEC(&st));
-				msg_info("touch %s%s\n", disk->dir, file->sub);
+				log_tag("touch:%s:%s: %" PRIu64 ".%d\n", disk->name, esc(file_sub(file, sub_buffer), esc_buffer), (uint64_t)st.st_mtime, (int)STAT_NSEC(&st));
+				msg_info("touch %s%s\n", disk->dir, file_sub(file, sub_buffer));
 			}
 		}
 	}
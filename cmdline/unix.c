@@ -642,6 +642,20 @@ uint64_t tick_ms(void)
 	return tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
 }
 
+uint64_t tick_cpu_ms(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_PROCESS_CPUTIME_ID)
+	struct timespec tv;
+
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tv) != 0)
+		return 0;
+
+	return tv.tv_sec * 1000ULL + tv.tv_nsec / 1000000;
+#else
+	return clock() * 1000ULL / CLOCKS_PER_SEC;
+#endif
+}
+
 int randomize(void* ptr, size_t size)
 {
 	int f;
@@ -57,6 +57,195 @@ void** malloc_nofail_vector_align(int nd, int n, size_t size, void** freeptr)
 	return ptr;
 }
 
+void* malloc_nofail_direct(size_t size, void** freeptr)
+{
+	unsigned char* ptr;
+	uintptr_t offset;
+
+	ptr = malloc_nofail(direct_size(size) + DIRECT_ALIGN);
+
+	*freeptr = ptr;
+
+	offset = ((uintptr_t)ptr) % DIRECT_ALIGN;
+
+	if (offset != 0)
+		ptr += DIRECT_ALIGN - offset;
+
+	return ptr;
+}
+
+/**
+ * Memory allocated for huge pages.
+ */
+struct huge_alloc {
+	void* map; /**< Memory mapped, or allocated with malloc(). */
+	size_t map_size; /**< Size of the memory mapped. 0 if allocated with malloc(). */
+	unsigned char* ptr; /**< Memory to use, aligned at HUGE_ALIGN. */
+	size_t size; /**< Size of the memory to use. */
+	const char* kind; /**< Kind of pages used. */
+};
+
+/**
+ * Memory released, and kept for the next allocation.
+ */
+static struct huge_alloc* huge_cache;
+
+/**
+ * Kind of pages of the latest allocation.
+ */
+static const char* huge_last = "normal";
+
+static void huge_release(struct huge_alloc* alloc)
+{
+#if HAVE_MMAP
+	if (alloc->map_size != 0)
+		munmap(alloc->map, alloc->map_size);
+	else
+		free(alloc->map);
+#else
+	free(alloc->map);
+#endif
+	free(alloc);
+}
+
+static struct huge_alloc* huge_map(size_t size)
+{
+	struct huge_alloc* alloc;
+	uintptr_t offset;
+
+	/* round up to the huge page size */
+	size = (size + HUGE_ALIGN - 1) & ~(size_t)(HUGE_ALIGN - 1);
+
+	/* reuse the memory of the previous allocation, if large enough */
+	if (huge_cache && huge_cache->size >= size) {
+		alloc = huge_cache;
+		huge_cache = 0;
+		return alloc;
+	}
+
+	/* otherwise free it, as it's not possible to reuse it */
+	if (huge_cache) {
+		huge_release(huge_cache);
+		huge_cache = 0;
+	}
+
+	alloc = malloc_nofail(sizeof(struct huge_alloc));
+	alloc->size = size;
+
+#if HAVE_MMAP && defined(MAP_ANONYMOUS)
+#ifdef MAP_HUGETLB
+	/* explicit huge pages are available only if reserved by the system */
+	alloc->map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (alloc->map != MAP_FAILED) {
+		alloc->map_size = size;
+		alloc->ptr = alloc->map;
+		alloc->kind = "huge";
+		return alloc;
+	}
+#endif
+
+	/* transparent huge pages require the memory aligned at the huge page size */
+	alloc->map = mmap(0, size + HUGE_ALIGN, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (alloc->map != MAP_FAILED) {
+		alloc->map_size = size + HUGE_ALIGN;
+		alloc->ptr = alloc->map;
+		offset = ((uintptr_t)alloc->ptr) % HUGE_ALIGN;
+		if (offset != 0)
+			alloc->ptr += HUGE_ALIGN - offset;
+		alloc->kind = "normal";
+#if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+		/* if not supported, the memory is still usable with normal pages */
+		if (madvise(alloc->ptr, size, MADV_HUGEPAGE) == 0)
+			alloc->kind = "thp";
+#endif
+		return alloc;
+	}
+#endif
+
+	/* fallback to normal memory */
+	alloc->map = malloc_nofail(size + HUGE_ALIGN);
+	alloc->map_size = 0;
+	alloc->ptr = alloc->map;
+	offset = ((uintptr_t)alloc->ptr) % HUGE_ALIGN;
+	if (offset != 0)
+		alloc->ptr += HUGE_ALIGN - offset;
+	alloc->kind = "normal";
+
+	return alloc;
+}
+
+void** malloc_nofail_vector_huge(int nd, int n, size_t size, int direct, void** freeptr)
+{
+	struct huge_alloc* alloc;
+	void** v;
+	unsigned char* va;
+	size_t step;
+	int i;
+
+	/* direct mode requires aligned blocks, that prevents the displacement */
+	if (direct)
+		step = direct_size(size);
+	else
+		step = size + RAID_MALLOC_DISPLACEMENT;
+
+	v = malloc_nofail(n * sizeof(void*));
+
+	alloc = huge_map(n * step);
+
+	huge_last = alloc->kind;
+
+	*freeptr = alloc;
+
+	va = alloc->ptr;
+	for (i = 0; i < n; ++i) {
+		v[i] = va;
+		va += step;
+	}
+
+	/* reverse order of the data blocks */
+	/* because they are usually accessed from the last one */
+	for (i = 0; i < nd / 2; ++i) {
+		void* ptr = v[i];
+
+		v[i] = v[nd - 1 - i];
+		v[nd - 1 - i] = ptr;
+	}
+
+	return v;
+}
+
+void free_huge(void* freeptr)
+{
+	struct huge_alloc* alloc = freeptr;
+
+	if (!alloc)
+		return;
+
+	/* keep the largest memory for the next allocation */
+	if (huge_cache && huge_cache->size > alloc->size) {
+		huge_release(alloc);
+		return;
+	}
+
+	if (huge_cache)
+		huge_release(huge_cache);
+
+	huge_cache = alloc;
+}
+
+void huge_done(void)
+{
+	if (huge_cache) {
+		huge_release(huge_cache);
+		huge_cache = 0;
+	}
+}
+
+const char* huge_kind(void)
+{
+	return huge_last;
+}
+
 void* malloc_nofail_test(size_t size)
 {
 	void* ptr;
@@ -421,6 +610,76 @@ void crc32c_init(void)
 #endif
 }
 
+/**
+ * Multiply a 32x32 GF(2) matrix with a vector.
+ */
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec)
+{
+	uint32_t sum = 0;
+
+	while (vec) {
+		if (vec & 1)
+			sum ^= *mat;
+		vec >>= 1;
+		++mat;
+	}
+
+	return sum;
+}
+
+/**
+ * Square a 32x32 GF(2) matrix.
+ */
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat)
+{
+	unsigned n;
+
+	for (n = 0; n < 32; ++n)
+		square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2)
+{
+	uint32_t even[32];
+	uint32_t odd[32];
+	uint32_t row;
+	unsigned n;
+
+	if (len2 == 0)
+		return crc1;
+
+	/* operator for one zero bit, using the reflected Castagnoli polynomial */
+	odd[0] = 0x82F63B78;
+	row = 1;
+	for (n = 1; n < 32; ++n) {
+		odd[n] = row;
+		row <<= 1;
+	}
+
+	/* operator for two zero bits */
+	gf2_matrix_square(even, odd);
+
+	/* operator for four zero bits */
+	gf2_matrix_square(odd, even);
+
+	/* apply len2 zeros to crc1, the first square gives the operator for one zero byte */
+	do {
+		gf2_matrix_square(even, odd);
+		if (len2 & 1)
+			crc1 = gf2_matrix_times(even, crc1);
+		len2 >>= 1;
+		if (len2 == 0)
+			break;
+
+		gf2_matrix_square(odd, even);
+		if (len2 & 1)
+			crc1 = gf2_matrix_times(odd, crc1);
+		len2 >>= 1;
+	} while (len2 != 0);
+
+	return crc1 ^ crc2;
+}
+
 /****************************************************************************/
 /* byte operations */
 
@@ -494,6 +753,50 @@ void memhash(unsigned kind, const unsigned char* seed, void* digest, const void*
 	}
 }
 
+void memhash_init(struct memhash_ctx* ctx, unsigned kind, const unsigned char* seed)
+{
+	ctx->kind = kind;
+
+	switch (kind) {
+	case HASH_MURMUR3 :
+		MurmurHash3_x86_128_init(&ctx->u.murmur3, seed);
+		break;
+	case HASH_SPOOKY2 :
+		SpookyHash128_init(&ctx->u.spooky2, seed);
+		break;
+	default :
+		/* LCOV_EXCL_START */
+		log_fatal("Internal inconsistency in hash function %u\n", kind);
+		exit(EXIT_FAILURE);
+		break;
+		/* LCOV_EXCL_STOP */
+	}
+}
+
+void memhash_update(struct memhash_ctx* ctx, const void* src, size_t size)
+{
+	switch (ctx->kind) {
+	case HASH_MURMUR3 :
+		MurmurHash3_x86_128_update(&ctx->u.murmur3, src, size);
+		break;
+	case HASH_SPOOKY2 :
+		SpookyHash128_update(&ctx->u.spooky2, src, size);
+		break;
+	}
+}
+
+void memhash_final(struct memhash_ctx* ctx, void* digest)
+{
+	switch (ctx->kind) {
+	case HASH_MURMUR3 :
+		MurmurHash3_x86_128_final(&ctx->u.murmur3, digest);
+		break;
+	case HASH_SPOOKY2 :
+		SpookyHash128_final(&ctx->u.spooky2, digest);
+		break;
+	}
+}
+
 const char* hash_config_name(unsigned kind)
 {
 	switch (kind) {
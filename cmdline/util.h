@@ -33,6 +33,63 @@ void* malloc_nofail_align(size_t size, void** freeptr);
  */
 void** malloc_nofail_vector_align(int nd, int n, size_t size, void** freeptr);
 
+/**
+ * Alignment of buffers and sizes for direct I/O.
+ * It's the page size, that is a multiple of the sector size of all the disks.
+ */
+#define DIRECT_ALIGN 4096
+
+/**
+ * Round up the size to a multiple of DIRECT_ALIGN.
+ */
+static inline size_t direct_size(size_t size)
+{
+	return (size + DIRECT_ALIGN - 1) & ~(size_t)(DIRECT_ALIGN - 1);
+}
+
+/**
+ * Safe aligned malloc for direct I/O.
+ * The memory is aligned at DIRECT_ALIGN, and its size rounded up to it.
+ * If no memory is available, it aborts.
+ */
+void* malloc_nofail_direct(size_t size, void** freeptr);
+
+/**
+ * Alignment of the memory allocated with huge pages.
+ * It's the size of the huge pages of x86/x64 and ARM64.
+ */
+#define HUGE_ALIGN (2 * 1024 * 1024)
+
+/**
+ * Safe vector allocation using huge pages, to reduce the TLB misses.
+ * It tries explicit huge pages, then transparent huge pages, and then
+ * normal memory.
+ * The memory released with free_huge() is kept, and reused by the next
+ * allocation if large enough, until huge_done() is called.
+ * With direct, each block is aligned at DIRECT_ALIGN, and its size rounded up to it,
+ * otherwise the blocks have the same displacement of malloc_nofail_vector_align().
+ * If no memory is available, it aborts.
+ * \param freeptr Where to store the pointer to pass to free_huge().
+ */
+void** malloc_nofail_vector_huge(int nd, int n, size_t size, int direct, void** freeptr);
+
+/**
+ * Free the memory allocated with malloc_nofail_vector_huge().
+ * Note that the vector of pointers has to be freed with free().
+ */
+void free_huge(void* freeptr);
+
+/**
+ * Release the memory kept for the next huge pages allocations.
+ */
+void huge_done(void);
+
+/**
+ * Return the kind of pages used by the latest huge pages allocation.
+ * One of "huge", "thp" or "normal".
+ */
+const char* huge_kind(void);
+
 /**
  * Safe allocation with memory test.
  */
@@ -158,6 +215,16 @@ uint32_t (*crc32c)(uint32_t crc, const unsigned char* ptr, unsigned size);
 uint32_t crc32c_gen(uint32_t crc, const unsigned char* ptr, unsigned size);
 uint32_t crc32c_x86(uint32_t crc, const unsigned char* ptr, unsigned size);
 
+/**
+ * Combine the CRC-32 (Castagnoli) of two consecutive blocks of data.
+ * Like zlib crc32_combine().
+ * \param crc1 CRC of the first block.
+ * \param crc2 CRC of the second block.
+ * \param len2 Size of the second block.
+ * \return The CRC of the two blocks together.
+ */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
 /**
  * Initialize the CRC-32 (Castagnoli) support.
  */
@@ -184,6 +251,52 @@ void crc32c_init(void);
  */
 void memhash(unsigned kind, const unsigned char* seed, void* digest, const void* src, size_t size);
 
+/**
+ * Murmur3 incremental state.
+ */
+struct murmur3_ctx {
+	uint32_t h[4]; /**< Hash state. */
+	uint32_t buf[4]; /**< Pending data not yet processed. */
+	size_t size; /**< Total size processed. */
+};
+
+/**
+ * Spooky2 incremental state.
+ */
+struct spooky2_ctx {
+	uint64_t h[12]; /**< Hash state. */
+	uint64_t buf[12]; /**< Pending data not yet processed. */
+	size_t size; /**< Total size processed. */
+};
+
+/**
+ * Incremental HASH context.
+ */
+struct memhash_ctx {
+	unsigned kind; /**< Hash kind. */
+	union {
+		struct murmur3_ctx murmur3;
+		struct spooky2_ctx spooky2;
+	} u;
+};
+
+/**
+ * Start the incremental HASH computation.
+ * The result is the same of memhash() called with all the data at once.
+ */
+void memhash_init(struct memhash_ctx* ctx, unsigned kind, const unsigned char* seed);
+
+/**
+ * Add more data to the incremental HASH computation.
+ * The data can be split in any way.
+ */
+void memhash_update(struct memhash_ctx* ctx, const void* src, size_t size);
+
+/**
+ * Complete the incremental HASH computation.
+ */
+void memhash_final(struct memhash_ctx* ctx, void* digest);
+
 /**
  * Return the hash name.
  */
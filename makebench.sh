@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# Benchmark the scan of the data disks with an increasing number of disks,
+# comparing the parallel scan with the scan of one disk after the other.
+#
+# Run it in the build directory after "make".
+#
+# Usage: makebench.sh [MAX_DISKS] [FILE_NUM]
+#
+
+MAX_DISKS=${1:-6}
+FILE_NUM=${2:-10000}
+FLAGS="--test-skip-device --test-skip-self --test-skip-lock --no-warnings -q"
+
+if [ ! -x ./snapraid ] || [ ! -x ./mktest ]; then
+	echo "Run it in the build directory after make"
+	exit 1
+fi
+
+# Return the current time in milliseconds
+now()
+{
+	echo $(($(date +%s%N) / 1000000))
+}
+
+echo "disks serial_ms parallel_ms"
+
+N=1
+while [ $N -le $MAX_DISKS ]; do
+	rm -rf bench
+	mkdir bench
+
+	echo "blocksize 1" > bench/bench.conf
+	echo "parity bench/parity" >> bench/bench.conf
+	echo "content bench/content" >> bench/bench.conf
+	D=1
+	while [ $D -le $N ]; do
+		mkdir bench/disk$D
+		echo "disk disk$D bench/disk$D/" >> bench/bench.conf
+		D=$(($D + 1))
+	done
+
+	# create the files and sync them, to benchmark the scan of an unchanged array
+	if ! ./mktest generate 1 $N $FILE_NUM 1 > /dev/null; then
+		exit 1
+	fi
+	if ! ./snapraid $FLAGS -c bench/bench.conf sync > /dev/null 2>&1; then
+		exit 1
+	fi
+
+	START=$(now)
+	./snapraid $FLAGS --test-skip-scan-thread -c bench/bench.conf diff > /dev/null 2>&1
+	SERIAL=$(($(now) - $START))
+
+	START=$(now)
+	./snapraid $FLAGS -c bench/bench.conf diff > /dev/null 2>&1
+	PARALLEL=$(($(now) - $START))
+
+	echo "$N $SERIAL $PARALLEL"
+
+	N=$(($N + 1))
+done
+
+rm -rf bench
@@ -212,6 +212,29 @@ static inline int raid_cpu_has_avx512bw(void)
 		(3 << 1) | (7 << 5)); /* OS saves XMM, YMM and ZMM registers */
 }
 
+static inline int raid_cpu_has_gfni(void)
+{
+	uint32_t reg[4];
+
+	/*
+	 * Intel Architecture Instruction Set Extensions Programming Reference
+	 * 319433-030 October 2017
+	 *
+	 * Galois Field New Instructions are supported
+	 * if CPUID.(EAX=07H, ECX=0H):ECX.GFNI[bit 8] = 1.
+	 * The EVEX encoded forms with ZMM registers also require AVX512F,
+	 * and we use them together with the AVX512BW instructions.
+	 */
+	if (!raid_cpu_has_avx512bw())
+		return 0;
+
+	raid_cpuid(7, 0, reg);
+	if ((reg[2] & (1 << 8)) == 0)
+		return 0;
+
+	return 1;
+}
+
 /**
  * Check if it's an Intel Atom CPU.
  */
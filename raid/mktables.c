@@ -40,6 +40,28 @@ static uint8_t gfmul(uint8_t a, uint8_t b)
 	return v;
 }
 
+/**
+ * GF2P8AFFINEQB matrix for the multiplication by a in GF(2^8).
+ *
+ * The byte 7 - i of the matrix is the row for the bit i of the result,
+ * and its bit j is the bit i of the product of a with 2^j.
+ */
+static uint64_t gfaffine(uint8_t a)
+{
+	uint64_t m;
+	int i, j;
+
+	m = 0;
+	for (i = 0; i < 8; ++i) {
+		for (j = 0; j < 8; ++j) {
+			if ((gfmul(a, 1 << j) >> i) & 1)
+				m |= (uint64_t)1 << (8 * (7 - i) + j);
+		}
+	}
+
+	return m;
+}
+
 /**
  * Inversion (1/a) in GF(2^8).
  */
@@ -423,6 +445,55 @@ int main(void)
 	printf("};\n");
 	printf("#endif\n\n");
 
+	printf("#ifdef CONFIG_X86\n");
+	printf("/**\n");
+	printf(" * GF2P8AFFINEQB matrices for the Cauchy matrix.\n");
+	printf(" *\n");
+	printf(" * Indexes are [DISK][PARITY - 1].\n");
+	printf(" * Where DISK is from 0 to %u, PARITY from 1 to %u.\n", DISK - 1, PARITY - 1);
+	printf(" */\n");
+	printf("const uint64_t __aligned(256) raid_gfcauchyaffine[%u][%u] =\n", DISK, np(PARITY - 1));
+	printf("{\n");
+	for (i = 0; i < DISK; ++i) {
+		printf("\t{\n");
+		for (p = 1; p < (int)np(PARITY - 1) + 1; ++p) {
+			uint64_t m = 0;
+			if (p < PARITY)
+				m = gfaffine(matrix[p * DISK + i]);
+			if ((p - 1) % 4 == 0)
+				printf("\t\t");
+			printf("0x%016llxULL,", (unsigned long long)m);
+			if ((p - 1) % 4 == 3)
+				printf("\n");
+			else
+				printf(" ");
+		}
+		printf("\t},\n");
+	}
+	printf("};\n");
+	printf("#endif\n\n");
+
+	printf("#ifdef CONFIG_X86\n");
+	printf("/**\n");
+	printf(" * GF2P8AFFINEQB matrices for generic multiplication.\n");
+	printf(" *\n");
+	printf(" * Indexes are [MULTIPLER].\n");
+	printf(" * Where MULTIPLER is from 0 to 255.\n");
+	printf(" */\n");
+	printf("const uint64_t __aligned(256) raid_gfmulaffine[256] =\n");
+	printf("{\n");
+	for (i = 0; i < 256; ++i) {
+		if (i % 4 == 0)
+			printf("\t");
+		printf("0x%016llxULL,", (unsigned long long)gfaffine(i));
+		if (i % 4 == 3)
+			printf("\n");
+		else
+			printf(" ");
+	}
+	printf("};\n");
+	printf("#endif\n\n");
+
 	return 0;
 }
 
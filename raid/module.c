@@ -110,6 +110,41 @@ void raid_init(void)
 		raid_rec_ptr[5] = raid_recX_avx2;
 	}
 #endif
+
+#if defined(CONFIG_X86_64) && defined(CONFIG_AVX512BW)
+	if (raid_cpu_has_avx512bw()) {
+		raid_gen_ptr[0] = raid_gen1_avx512bw;
+		raid_gen_ptr[1] = raid_gen2_avx512bw;
+		raid_gen3_ptr = raid_gen3_avx512bw;
+		raid_genz_ptr = raid_genz_avx512bw;
+		raid_gen_ptr[3] = raid_gen4_avx512bw;
+		raid_gen_ptr[4] = raid_gen5_avx512bw;
+		raid_gen_ptr[5] = raid_gen6_avx512bw;
+		raid_rec_ptr[0] = raid_rec1_avx512bw;
+		raid_rec_ptr[1] = raid_rec2_avx512bw;
+		raid_rec_ptr[2] = raid_recX_avx512bw;
+		raid_rec_ptr[3] = raid_recX_avx512bw;
+		raid_rec_ptr[4] = raid_recX_avx512bw;
+		raid_rec_ptr[5] = raid_recX_avx512bw;
+	}
+#endif
+
+#if defined(CONFIG_X86_64) && defined(CONFIG_GFNI)
+	if (raid_cpu_has_gfni()) {
+		/* gen1 and gen2 don't multiply, and stay with AVX512BW */
+		raid_gen3_ptr = raid_gen3_gfni;
+		raid_genz_ptr = raid_genz_gfni;
+		raid_gen_ptr[3] = raid_gen4_gfni;
+		raid_gen_ptr[4] = raid_gen5_gfni;
+		raid_gen_ptr[5] = raid_gen6_gfni;
+		raid_rec_ptr[0] = raid_rec1_gfni;
+		raid_rec_ptr[1] = raid_rec2_gfni;
+		raid_rec_ptr[2] = raid_recX_gfni;
+		raid_rec_ptr[3] = raid_recX_gfni;
+		raid_rec_ptr[4] = raid_recX_gfni;
+		raid_rec_ptr[5] = raid_recX_gfni;
+	}
+#endif
 #endif /* CONFIG_X86 */
 
 	/* set the default mode */
@@ -253,3 +253,106 @@ void raid_genz_avx2ext(int nd, size_t size, void **vv)
 }
 #endif
 
+
+#if defined(CONFIG_X86_64) && defined(CONFIG_AVX512BW)
+/*
+ * GENz (triple parity with powers of 2^-1) AVX512BW implementation
+ *
+ * The multiplications by two and by two^-1 extract the carried bits
+ * in mask registers, and xor the polynomial only in the masked bytes.
+ */
+void raid_genz_avx512bw(int nd, size_t size, void **vv)
+{
+	uint8_t **v = (uint8_t**)vv;
+	uint8_t *p;
+	uint8_t *q;
+	uint8_t *r;
+	int d, l;
+	size_t i;
+
+	l = nd - 1;
+	p = v[nd];
+	q = v[nd + 1];
+	r = v[nd + 2];
+
+	raid_avx512_begin();
+
+	asm volatile ("vbroadcasti32x4 %0,%%zmm7" : : "m" (gfzconst16.poly[0]));
+	asm volatile ("vbroadcasti32x4 %0,%%zmm3" : : "m" (gfzconst16.half[0]));
+	asm volatile ("vbroadcasti32x4 %0,%%zmm11" : : "m" (gfzconst16.low7[0]));
+
+	for (i = 0; i < size; i += 64) {
+		asm volatile ("vmovdqa64 %0,%%zmm0" : : "m" (v[l][i]));
+		asm volatile ("vmovdqa64 %zmm0,%zmm1");
+		asm volatile ("vmovdqa64 %zmm0,%zmm2");
+		for (d = l - 1; d >= 0; --d) {
+			asm volatile ("vpsllw $7,%zmm2,%zmm6");
+			asm volatile ("vpsrlw $1,%zmm2,%zmm2");
+			asm volatile ("vpmovb2m %zmm1,%k1");
+			asm volatile ("vpmovb2m %zmm6,%k2");
+			asm volatile ("vpaddb %zmm1,%zmm1,%zmm1");
+			asm volatile ("vmovdqu8 %zmm7,%zmm4{%k1}{z}");
+			asm volatile ("vmovdqu8 %zmm3,%zmm5{%k2}{z}");
+			asm volatile ("vpternlogq $0x6a,%zmm5,%zmm11,%zmm2");
+
+			asm volatile ("vmovdqa64 %0,%%zmm8" : : "m" (v[d][i]));
+			asm volatile ("vpxorq %zmm8,%zmm0,%zmm0");
+			asm volatile ("vpternlogq $0x96,%zmm8,%zmm4,%zmm1");
+			asm volatile ("vpxorq %zmm8,%zmm2,%zmm2");
+		}
+		asm volatile ("vmovntdq %%zmm0,%0" : "=m" (p[i]));
+		asm volatile ("vmovntdq %%zmm1,%0" : "=m" (q[i]));
+		asm volatile ("vmovntdq %%zmm2,%0" : "=m" (r[i]));
+	}
+
+	raid_avx512_end();
+}
+#endif
+
+#if defined(CONFIG_X86_64) && defined(CONFIG_GFNI)
+/*
+ * GENz (triple parity with powers of 2^-1) GFNI implementation
+ *
+ * The multiplications by two and by two^-1 are single gf2p8affineqb
+ * with the bit matrices of the two coefficients.
+ */
+void raid_genz_gfni(int nd, size_t size, void **vv)
+{
+	uint8_t **v = (uint8_t**)vv;
+	uint8_t *p;
+	uint8_t *q;
+	uint8_t *r;
+	int d, l;
+	size_t i;
+
+	l = nd - 1;
+	p = v[nd];
+	q = v[nd + 1];
+	r = v[nd + 2];
+
+	raid_avx512_begin();
+
+	asm volatile ("vpbroadcastq %0,%%zmm6" : : "m" (gfmulaffine[2]));
+	asm volatile ("vpbroadcastq %0,%%zmm7" : : "m" (gfmulaffine[0x8e]));
+
+	for (i = 0; i < size; i += 64) {
+		asm volatile ("vmovdqa64 %0,%%zmm0" : : "m" (v[l][i]));
+		asm volatile ("vmovdqa64 %zmm0,%zmm1");
+		asm volatile ("vmovdqa64 %zmm0,%zmm2");
+		for (d = l - 1; d >= 0; --d) {
+			asm volatile ("vgf2p8affineqb $0,%zmm6,%zmm1,%zmm1");
+			asm volatile ("vgf2p8affineqb $0,%zmm7,%zmm2,%zmm2");
+
+			asm volatile ("vmovdqa64 %0,%%zmm4" : : "m" (v[d][i]));
+			asm volatile ("vpxorq %zmm4,%zmm0,%zmm0");
+			asm volatile ("vpxorq %zmm4,%zmm1,%zmm1");
+			asm volatile ("vpxorq %zmm4,%zmm2,%zmm2");
+		}
+		asm volatile ("vmovntdq %%zmm0,%0" : "=m" (p[i]));
+		asm volatile ("vmovntdq %%zmm1,%0" : "=m" (q[i]));
+		asm volatile ("vmovntdq %%zmm2,%0" : "=m" (r[i]));
+	}
+
+	raid_avx512_end();
+}
+#endif